@@ -0,0 +1,69 @@
+#ifndef ATTRACTORPATHS_H_
+#define ATTRACTORPATHS_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file AttractorPaths.h
+/// @brief closed attractor paths loaded from a text file, the C++ twin of shaders/AttractorAnimate.glsl
+/// @class AttractorPaths
+/// @brief each path loops every period seconds of simulation time and is one of
+/// lissajous : centre + amplitude * sin(2pi * (frequency * cycle + phase)) per axis, integer frequencies
+/// keep it closed
+/// spline : a closed uniform Catmull-Rom spline through the keys, one segment per key per period
+/// Attractor i follows path i % numPaths(), the attractors sharing a path are spread evenly along it. The time
+/// is step * stepSeconds in float on both backends so a run only depends on the step count, never the frame rate.
+/// The file has one path per line, # starts a comment :
+///   lissajous period cx cy cz ax ay az fx fy fz px py pz
+///   spline period x0 y0 z0 x1 y1 z1 ...
+//----------------------------------------------------------------------------------------------------------------------
+class AttractorPaths
+{
+public:
+  enum class Type : uint32_t
+  {
+    Lissajous = 0,
+    Spline = 1
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief one path, the same std430 layout as the Path struct in AttractorAnimate.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Path
+  {
+    Type type;
+    uint32_t first; ///< first vec4 in keys(), Lissajous has centre, amplitude, frequency and phase
+    uint32_t count; ///< number of vec4s, the spline keys
+    float period;   ///< simulation seconds per loop
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief replace the paths with the ones in a file
+  /// @param [in] _path the file to read
+  /// @returns false and prints a message if the file can't be read or a line is malformed, the paths are then
+  /// left empty
+  //----------------------------------------------------------------------------------------------------------------------
+  bool load(const std::string &_path);
+  bool empty() const { return m_paths.empty(); }
+  size_t numPaths() const { return m_paths.size(); }
+  const std::vector<Path> &paths() const { return m_paths; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the path parameters as x,y,z,0 quadruples, uploaded as is for the shader
+  //----------------------------------------------------------------------------------------------------------------------
+  const std::vector<float> &keys() const { return m_keys; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the attractor positions at a step
+  /// @param [in] _step the simulation step, the time is _step * _stepSeconds
+  /// @param [in] _stepSeconds simulation seconds per step
+  /// @param [in] _count number of attractors
+  /// @param [out] o_xyz _count tightly packed x,y,z triples
+  //----------------------------------------------------------------------------------------------------------------------
+  void evaluate(uint32_t _step, float _stepSeconds, size_t _count, float *o_xyz) const;
+
+private:
+  std::vector<Path> m_paths;
+  std::vector<float> m_keys;
+};
+
+static_assert(sizeof(AttractorPaths::Path) == 16, "Path must match the std430 struct in AttractorAnimate.glsl");
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef CPUPARTICLESIMULATOR_H_
+#define CPUPARTICLESIMULATOR_H_
+#include "AttractorPaths.h"
+#include "Checkpoint.h"
+#include "MortonOrder.h"
+#include "ParticleSimulator.h"
+#include "ParticleSystems.h"
+#include "SimulationConfig.h"
+#include "SimdMath.h"
+#include "SpatialHash.h"
+#include "ThreadPool.h"
+#include <array>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file CPUParticleSimulator.h
+/// @brief CPU implementation of shaders/ParticlesCompute.glsl
+/// @class CPUParticleSimulator
+/// @brief particles are stored as a structure of arrays (one aligned stream per component) so the inner loop
+/// can load c_width particles at once with AVX2 / SSE. The particle range is split into chunks that are
+/// processed by a ThreadPool, chunk sizes are multiples of c_chunkAlign so no two threads write to the same
+/// cache line. In ForceMode::Tiled the particles are further split into small blocks and the attractors
+/// into tiles so each tile is reused by a whole block while it is in L1, the CPU version of the shared memory
+/// tiles in the shader. ForceMode::Grid bakes the same per attractor field into a 3D grid whenever the
+/// attractors change and each particle just does a trilinear lookup. With a neighbour radius set the particles
+/// are binned into a SpatialHash each step and push each other apart on top of the attractor force. With attractor
+/// paths loaded the attractors are moved along them at the start of every step, exactly like the GPU backend.
+/// With emitters the live particles are kept packed at the front of the streams : after each step the expired
+/// ones are swapped out with the last live particle and the new ones are appended, so a step only touches the
+/// live range and a sparse pool costs proportionally less. With a reorder interval the live particles are sorted
+/// into Morton order (MortonOrder) every so many steps so the grid lookups and neighbour queries stay coherent.
+/// With a stream chunk the pool threads are pinned and the per particle loops walk the state chunk by chunk with
+/// a static split, so a particle is always touched by the same thread and its pages stay on that thread's node.
+/// With a systems table every chunk of the pool pass is split at the system boundaries, which are c_chunkAlign
+/// aligned, and each piece is stepped with its system's force point and constants.
+//----------------------------------------------------------------------------------------------------------------------
+class CPUParticleSimulator : public ParticleSimulator
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _config uses numThreads (0 uses all the hardware threads), forceMode, the grid and the
+  /// neighbour settings, attractorPaths and stepMs, numEmitters and emitRate, reorderInterval and positionExtent,
+  /// streamChunk, particleSystems
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit CPUParticleSimulator(const SimulationConfig &_config);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with a systems table _numParticles is ignored, the table gives the count
+  //----------------------------------------------------------------------------------------------------------------------
+  void initialize(size_t _numParticles, uint32_t _seed) override;
+  bool restore(const CheckpointReader &_reader) override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with attractor paths only _count is used, the positions come from the paths on the next step
+  //----------------------------------------------------------------------------------------------------------------------
+  void setAttractors(const float *_xyz, size_t _count) override;
+  bool animatedAttractors() const override { return !m_paths.empty(); }
+  void setEmitters(const float *_xyzr, size_t _count) override;
+  void emitBurst(size_t _count) override { m_pendingBurst += _count; }
+  void step(float _dt) override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief without neighbour forces the substeps are fused per block of particles, see advance in the cpp
+  //----------------------------------------------------------------------------------------------------------------------
+  void advance(float _dt, size_t _steps) override;
+  void finish() override {}
+  void readPositions(float *o_xyzw, size_t _first, size_t _count) override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the state is on the host already so the copy is taken straight away and handed over by pollSnapshot
+  //----------------------------------------------------------------------------------------------------------------------
+  bool requestSnapshot() override;
+  bool pollSnapshot(checkpoint::Frame &o_frame) override;
+  size_t numParticles() const override { return m_numParticles; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the live particles are [0,liveCount())
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t liveCount() override { return m_liveCount; }
+  const char *name() const override { return "cpu"; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief number of threads used by the pool
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t numThreads() const { return m_pool.size(); }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write the current attractors as x,y,z,0 (the layout of the GPU attractor SSBO)
+  /// @param [out] o_xyzw must hold numAttractors()*4 floats, typically a mapped GL buffer
+  //----------------------------------------------------------------------------------------------------------------------
+  void writeAttractors(float *o_xyzw) const;
+  size_t numAttractors() const { return m_attractorX.size(); }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write the positions as interleaved x,y,z,w (the same layout as the GPU position SSBO)
+  /// @param [out] _dst must hold numParticles()*4 floats (or _count*4), typically a mapped GL buffer
+  /// @param [in] _indices only write these particles in this order, e.g. from cullVisible. nullptr writes all
+  /// @param [in] _count number of _indices
+  //----------------------------------------------------------------------------------------------------------------------
+  void writeInterleavedPositions(float *_dst, const uint32_t *_indices = nullptr, size_t _count = 0);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write the positions as the ParticleFormat::Compact position stream, half the bytes to upload
+  /// @param [out] _dst must hold numParticles()*2 words (or _count*2)
+  /// @param [in] _extent the quantisation box, see SimulationConfig::positionExtent
+  /// @param [in] _indices only write these particles, nullptr writes all
+  /// @param [in] _count number of _indices
+  //----------------------------------------------------------------------------------------------------------------------
+  void writePackedPositions(uint32_t *_dst, float _extent, const uint32_t *_indices = nullptr, size_t _count = 0);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the CPU version of shaders/ParticleCull.glsl, finds the live particles inside the view frustum
+  /// that survive the distance LOD. Only the live range is tested
+  /// @param [in] _mvp column major model view projection, as passed to glUniformMatrix4fv
+  /// @param [in] _lodDistance see SimulationConfig::lodDistance, 0 for no thinning
+  /// @param [out] o_indices must hold numParticles() indices, filled in ascending order
+  /// @returns the number of visible particles
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t cullVisible(const float _mvp[16], float _lodDistance, uint32_t *o_indices);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the LOD keeps a particle if the fraction index*c_lodHash/2^32 is below its keep probability, the
+  /// golden ratio spreads consecutive indices evenly. Must match LOD_HASH in ParticleCull.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr uint32_t c_lodHash = 0x9E3779B9u;
+  size_t memoryFootprint() const override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief override the chunk size handed to the thread pool, 0 picks one from the thread count
+  /// @param [in] _grain particles per chunk, rounded up to a multiple of c_chunkAlign
+  //----------------------------------------------------------------------------------------------------------------------
+  void setGrainSize(size_t _grain) { m_grainOverride = _grain; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief change the ForceMode::Grid resolution, the field is rebaked on the next step
+  //----------------------------------------------------------------------------------------------------------------------
+  void setGridResolution(size_t _resolution);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief change SimulationConfig::reorderInterval, 0 stops reordering
+  //----------------------------------------------------------------------------------------------------------------------
+  void setReorderInterval(size_t _interval) { m_reorderInterval = _interval; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the per attractor force at a point, either evaluated exactly or sampled from the baked grid.
+  /// Used to measure the accuracy of the grid against the analytic field.
+  /// @param [in] _baked sample the grid (baking it first if needed) rather than summing the attractors
+  //----------------------------------------------------------------------------------------------------------------------
+  std::array<float, 3> forceAt(float _x, float _y, float _z, bool _baked);
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief what the summed kernel needs of a system, the sum of its attractors and its constants
+  //----------------------------------------------------------------------------------------------------------------------
+  struct SystemForce
+  {
+    std::array<float, 3> forcePoint;
+    float kV;
+    float gauss;
+    float decay;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief step the particles in [_begin,_end), _begin must be a multiple of simd::c_width
+  /// @param [in] _step the step counter for the random numbers
+  /// @param [in] _system the force point and constants of the system the range belongs to
+  //----------------------------------------------------------------------------------------------------------------------
+  void stepRange(size_t _begin, size_t _end, float _newDT, uint32_t _step, const SystemForce &_system);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the batched version of stepRange, [_begin,_end) is split where the systems change
+  //----------------------------------------------------------------------------------------------------------------------
+  void stepSystems(size_t _begin, size_t _end, float _newDT, uint32_t _step);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief call the stepRange version for m_forceMode
+  //----------------------------------------------------------------------------------------------------------------------
+  void stepRangeMode(size_t _begin, size_t _end, float _newDT, uint32_t _step);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ForceMode::Tiled version of stepRange, every attractor pulls on every particle
+  //----------------------------------------------------------------------------------------------------------------------
+  void stepRangeTiled(size_t _begin, size_t _end, float _newDT, uint32_t _step);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ForceMode::Grid version of stepRange, the force is a trilinear lookup into m_field
+  //----------------------------------------------------------------------------------------------------------------------
+  void stepRangeGrid(size_t _begin, size_t _end, float _newDT, uint32_t _step);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief add the force from attractors [_begin,_end) at c_width points to _f
+  //----------------------------------------------------------------------------------------------------------------------
+  void accumulateForce(simd::Float _x, simd::Float _y, simd::Float _z, size_t _begin, size_t _end,
+                       simd::Float &io_fx, simd::Float &io_fy, simd::Float &io_fz) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief evaluate the per attractor force at the centre of every grid cell
+  //----------------------------------------------------------------------------------------------------------------------
+  void bakeField();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief trilinear lookup of the baked field at c_width points
+  //----------------------------------------------------------------------------------------------------------------------
+  void sampleField(simd::Float _x, simd::Float _y, simd::Float _z, simd::Float &o_fx, simd::Float &o_fy,
+                   simd::Float &o_fz) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bin the particles and sum the separation force from every neighbour within m_neighborRadius into
+  /// m_nx,m_ny,m_nz
+  //----------------------------------------------------------------------------------------------------------------------
+  void computeNeighborForces();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief swap the particles that expired this step out of [0,m_liveCount) and mark their slots dead
+  //----------------------------------------------------------------------------------------------------------------------
+  void compactLive();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief append this step's emitted particles after the live range
+  //----------------------------------------------------------------------------------------------------------------------
+  void emitParticles();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sort the live particles into Morton order when m_stepIndex is a multiple of m_reorderInterval
+  //----------------------------------------------------------------------------------------------------------------------
+  void reorderIfDue();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief move the attractors to their place on m_paths for step m_stepIndex
+  //----------------------------------------------------------------------------------------------------------------------
+  void animateAttractors();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the centre pull point used by the tiled and grid modes, the attractor centroid
+  //----------------------------------------------------------------------------------------------------------------------
+  std::array<float, 3> centroid() const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief apply the force _f and centre pull _pull to the c_width particles starting at _i, this is the
+  /// velocity / position / respawn part of main() in the shader shared by all force modes
+  //----------------------------------------------------------------------------------------------------------------------
+  void integrate(size_t _i, simd::Float _fx, simd::Float _fy, simd::Float _fz, simd::Float _pullX,
+                 simd::Float _pullY, simd::Float _pullZ, simd::Float _newDT, uint32_t _step,
+                 float _kV = ParticleSystems::c_defaultKV, float _decay = ParticleSystems::c_defaultDecay);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the jitter draw for the c_width particles starting at _i, the force modes without the summed noise
+  /// only need this one word of the step stream
+  //----------------------------------------------------------------------------------------------------------------------
+  simd::NativeInt jitterWord(size_t _i, uint32_t _step) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the chunk size handed to the pool for _count elements
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t grainSize(size_t _count) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _fn over the particle range [0,_count) : work stealing over the whole range, or with a stream chunk
+  /// one chunk at a time with parallelForStatic so each thread gets the same slice of every chunk on every call
+  //----------------------------------------------------------------------------------------------------------------------
+  void forEachParticle(size_t _count, const ThreadPool::RangeFunction &_fn);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief chunks are a multiple of this many particles, 64 floats is 4 cache lines per stream
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t c_chunkAlign = 64;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particles per block and attractors per tile in the tiled kernel
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t c_particleBlock = 256;
+  static constexpr size_t c_attractorTile = 256;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief force constants from calcForceFor in the shader
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr float c_gauss = 10000.0f;
+  static constexpr float c_kWeak = 1.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief cap on the neighbours visited per particle, the attractors pull particles into dense clumps and
+  /// without a cap those cells would go quadratic again. Matches MAX_NEIGHBORS in SpatialHash.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t c_maxNeighbors = 64;
+  ThreadPool m_pool;
+  ForceMode m_forceMode = ForceMode::Summed;
+  size_t m_numParticles = 0;
+  size_t m_grainOverride = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particles per chunk of the NUMA friendly static split, a multiple of c_chunkAlign, 0 when off
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_streamChunk = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the Philox key and the step counter, see Philox.h
+  //----------------------------------------------------------------------------------------------------------------------
+  uint32_t m_seed = 0;
+  uint32_t m_stepIndex = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the streams are padded up to c_chunkAlign so the last SIMD iteration never runs off the end
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_paddedCount = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the emitter lifecycle, on when SimulationConfig::numEmitters isn't 0. m_emitters is x,y,z,radius
+  /// quadruples and the burst is added to the rate on the next step
+  //----------------------------------------------------------------------------------------------------------------------
+  bool m_lifecycle = false;
+  size_t m_liveCount = 0;
+  size_t m_emitRate = 0;
+  size_t m_pendingBurst = 0;
+  std::vector<float> m_emitters;
+  simd::AlignedVector<float> m_px;
+  simd::AlignedVector<float> m_py;
+  simd::AlignedVector<float> m_pz;
+  simd::AlignedVector<float> m_pw;
+  simd::AlignedVector<float> m_vx;
+  simd::AlignedVector<float> m_vy;
+  simd::AlignedVector<float> m_vz;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sum of all the attractors, the shader uses this as the single force point
+  //----------------------------------------------------------------------------------------------------------------------
+  std::array<float, 3> m_forcePoint = {{0.0f, 0.0f, 0.0f}};
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the individual attractors for the tiled kernel
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> m_attractorX;
+  std::vector<float> m_attractorY;
+  std::vector<float> m_attractorZ;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the attractor paths, empty when the attractors are set from the host. m_pathPositions is the
+  /// evaluated x,y,z triples, kept so the per step evaluation doesn't allocate
+  //----------------------------------------------------------------------------------------------------------------------
+  AttractorPaths m_paths;
+  std::vector<float> m_pathPositions;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the batched systems and their force points, rebuilt with the attractors
+  //----------------------------------------------------------------------------------------------------------------------
+  ParticleSystems m_systems;
+  std::vector<SystemForce> m_systemForces;
+  float m_stepSeconds = 0.01f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ForceMode::Grid field, res^3 cells of x,y,z,pad covering [-m_gridExtent,m_gridExtent]^3
+  //----------------------------------------------------------------------------------------------------------------------
+  simd::AlignedVector<float> m_field;
+  size_t m_gridResolution = 64;
+  float m_gridExtent = 60.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set when the attractors change, the field is only rebaked then rather than every step
+  //----------------------------------------------------------------------------------------------------------------------
+  bool m_fieldDirty = true;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particle / particle interaction, off when the radius is 0
+  //----------------------------------------------------------------------------------------------------------------------
+  float m_neighborRadius = 0.0f;
+  float m_separation = 0.1f;
+  SpatialHash m_spatialHash;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the Morton sort, every m_reorderInterval steps over the m_reorderExtent box. Each stream is gathered
+  /// into m_reorderScratch and swapped with it so the reorder only needs one spare stream
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_reorderInterval = 0;
+  float m_reorderExtent = 128.0f;
+  MortonOrder m_mortonOrder;
+  simd::AlignedVector<float> m_reorderScratch;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the neighbour force for each particle, added to the attractor force in integrate
+  //----------------------------------------------------------------------------------------------------------------------
+  simd::AlignedVector<float> m_nx;
+  simd::AlignedVector<float> m_ny;
+  simd::AlignedVector<float> m_nz;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the copy taken by requestSnapshot until pollSnapshot collects it
+  //----------------------------------------------------------------------------------------------------------------------
+  checkpoint::Frame m_snapshot;
+  bool m_snapshotReady = false;
+};
+
+#endif
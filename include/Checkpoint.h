@@ -0,0 +1,122 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+#include "SimulationConfig.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Checkpoint.h
+/// @brief the particle checkpoint file layout shared by CheckpointWriter and CheckpointReader, and the Frame the
+/// simulators hand over for writing.
+/// A file is a FileHeader, a table of numBlocks BlockEntry and then the blocks, each starting on a c_blockAlign
+/// boundary. The particles are split into chunks of chunkParticles and every chunk stores the c_numStreams
+/// Stream blocks in order (chunk major), so the structure of arrays can be read a chunk at a time and an
+/// uncompressed block can be used in place from a memory mapping. The last block holds the attractors. Slots
+/// [0,liveCount) are the live particles, the writer packs them to the front. Everything is little endian.
+//----------------------------------------------------------------------------------------------------------------------
+namespace checkpoint
+{
+  constexpr uint32_t c_magic = 0x504b4350; // PCKP
+  constexpr uint32_t c_version = 1;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief blocks start on this many bytes so mapped float blocks are aligned for SIMD loads
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr uint64_t c_blockAlign = 64;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particles per chunk, 4MB per stream block
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr uint32_t c_chunkParticles = 1u << 20;
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the float streams of a chunk in file order, Attractors is x,y,z per attractor
+  //----------------------------------------------------------------------------------------------------------------------
+  enum class Stream : uint32_t
+  {
+    PositionX,
+    PositionY,
+    PositionZ,
+    Life,
+    VelocityX,
+    VelocityY,
+    VelocityZ,
+    Attractors
+  };
+  constexpr size_t c_numStreams = 7;
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief how a block is stored
+  /// None : the raw floats, usable in place from a mapping
+  /// ShuffleDeflate : the bytes of the floats regrouped by significance (all the first bytes, then all the
+  /// second bytes...) so the exponents sit together, then zlib deflate. Only written when built with zlib
+  //----------------------------------------------------------------------------------------------------------------------
+  enum class Compression : uint32_t
+  {
+    None,
+    ShuffleDeflate
+  };
+
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numParticles;
+    uint64_t liveCount;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the Philox key and the step the state was taken after, a restart carries on from there
+    //----------------------------------------------------------------------------------------------------------------------
+    uint32_t seed;
+    uint32_t stepIndex;
+    uint32_t numAttractors;
+    uint32_t numBlocks;
+    uint32_t chunkParticles;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(FileHeader) == 48, "FileHeader is written as is");
+
+  struct BlockEntry
+  {
+    uint32_t stream;
+    uint32_t compression;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the first particle (or attractor) in the block and how many, a block is count floats (count * 3
+    /// for the attractors) once decompressed
+    //----------------------------------------------------------------------------------------------------------------------
+    uint64_t first;
+    uint64_t count;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief where the block starts in the file and its size there
+    //----------------------------------------------------------------------------------------------------------------------
+    uint64_t offset;
+    uint64_t storedBytes;
+  };
+  static_assert(sizeof(BlockEntry) == 40, "BlockEntry is written as is");
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the state of a simulator at the end of a step, as copied out of its buffers. The particle data stays
+  /// in the backend's layout (see ParticleFormat.h) so taking it costs a copy and nothing else, CheckpointWriter
+  /// decodes it into the streams on its own thread
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Frame
+  {
+    uint64_t numParticles = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief slots with a life of 0 are free (SimulationConfig::numEmitters), they get packed behind the live ones
+    //----------------------------------------------------------------------------------------------------------------------
+    bool lifecycle = false;
+    uint32_t seed = 0;
+    uint32_t stepIndex = 0;
+    ParticleFormat format = ParticleFormat::Full;
+    float positionExtent = 128.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief numParticles positions and velocities, positionStride / velocityStride bytes each
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<unsigned char> positions;
+    std::vector<unsigned char> velocities;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief x,y,z of each attractor, filled in by the caller as only it knows where they are
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<float> attractors;
+  };
+} // end namespace checkpoint
+
+#endif
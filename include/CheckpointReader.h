@@ -0,0 +1,80 @@
+#ifndef CHECKPOINTREADER_H_
+#define CHECKPOINTREADER_H_
+#include "Checkpoint.h"
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file CheckpointReader.h
+/// @brief reads the files written by CheckpointWriter
+/// @class CheckpointReader
+/// @brief open maps the whole file read only (read into memory where mmap isn't available) and checks the
+/// header and every block entry against the file size, so later accesses can't run off the end. Uncompressed
+/// blocks are handed out as pointers into the mapping, the loaders copy them straight into the particle
+/// buffers. Chunks are independent so they can be read from several threads at once.
+//----------------------------------------------------------------------------------------------------------------------
+class ThreadPool;
+
+class CheckpointReader
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief every particle stream of one chunk, see readChunk. Keep one around so the scratch isn't reallocated
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Chunk
+  {
+    std::array<const float *, checkpoint::c_numStreams> streams = {};
+    std::array<std::vector<float>, checkpoint::c_numStreams> scratch;
+  };
+  CheckpointReader() = default;
+  ~CheckpointReader();
+  CheckpointReader(const CheckpointReader &) = delete;
+  CheckpointReader &operator=(const CheckpointReader &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief map _path and validate it
+  /// @returns false and prints why if it isn't a checkpoint this build can read
+  //----------------------------------------------------------------------------------------------------------------------
+  bool open(const std::string &_path);
+  const checkpoint::FileHeader &header() const { return m_header; }
+  size_t numChunks() const { return m_numChunks; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the first particle of a chunk and how many it holds
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t chunkFirst(size_t _chunk) const;
+  size_t chunkCount(size_t _chunk) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief one stream of a chunk, chunkCount floats
+  /// @param [in,out] io_scratch compressed blocks are inflated into this
+  /// @returns a pointer into the mapping or io_scratch, nullptr if the block is corrupt
+  //----------------------------------------------------------------------------------------------------------------------
+  const float *stream(size_t _chunk, checkpoint::Stream _stream, std::vector<float> &io_scratch) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief all the streams of a chunk, one per task on _pool so compressed blocks are inflated in parallel
+  /// @returns false if any block is corrupt
+  //----------------------------------------------------------------------------------------------------------------------
+  bool readChunk(size_t _chunk, ThreadPool &_pool, Chunk &io_chunk) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief x,y,z of each attractor
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> attractors() const;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief decode block _index, _floats long
+  //----------------------------------------------------------------------------------------------------------------------
+  const float *block(size_t _index, size_t _floats, std::vector<float> &io_scratch) const;
+  void close();
+  checkpoint::FileHeader m_header = {};
+  const checkpoint::BlockEntry *m_blocks = nullptr;
+  size_t m_numChunks = 0;
+  const unsigned char *m_data = nullptr;
+  size_t m_size = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the file contents when it couldn't be mapped
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<unsigned char> m_copy;
+  bool m_mapped = false;
+};
+
+#endif
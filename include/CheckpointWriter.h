@@ -0,0 +1,77 @@
+#ifndef CHECKPOINTWRITER_H_
+#define CHECKPOINTWRITER_H_
+#include "Checkpoint.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file CheckpointWriter.h
+/// @brief streams checkpoint::Frame to disk on a thread of its own
+/// @class CheckpointWriter
+/// @brief submit queues a frame and returns straight away, the writer thread decodes each one into the
+/// checkpoint streams (see Checkpoint.h), packing the live particles to the front, and writes it as
+/// DIR/step_<step>.pckp. Files are written under a temporary name and renamed into place so a reader never
+/// sees half a checkpoint. The queue is bounded, when the disk can't keep up frames are dropped rather than
+/// holding up the frame loop.
+//----------------------------------------------------------------------------------------------------------------------
+class CheckpointWriter
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start the writer thread
+  /// @param [in] _directory where the files go, created if needed
+  /// @param [in] _compress store the blocks as Compression::ShuffleDeflate, ignored without zlib
+  /// @param [in] _maxQueued frames waiting to be written before submit starts dropping them
+  //----------------------------------------------------------------------------------------------------------------------
+  CheckpointWriter(const std::string &_directory, bool _compress, size_t _maxQueued = 2);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief writes everything still queued then joins the thread
+  //----------------------------------------------------------------------------------------------------------------------
+  ~CheckpointWriter();
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief queue a frame for writing
+  /// @returns false if the queue was full and the frame was dropped
+  //----------------------------------------------------------------------------------------------------------------------
+  bool submit(checkpoint::Frame &&_frame);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief block until every queued frame is on disk
+  //----------------------------------------------------------------------------------------------------------------------
+  void flush();
+  size_t framesWritten() const { return m_written.load(); }
+  size_t framesDropped() const { return m_dropped.load(); }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write one frame on the calling thread
+  /// @returns false and prints why if the file couldn't be written
+  //----------------------------------------------------------------------------------------------------------------------
+  static bool write(const std::string &_path, const checkpoint::Frame &_frame, bool _compress);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the name a frame taken after step _step is written under
+  //----------------------------------------------------------------------------------------------------------------------
+  static std::string fileName(uint32_t _step);
+
+private:
+  void run();
+  std::string m_directory;
+  bool m_compress = false;
+  size_t m_maxQueued = 2;
+  std::deque<checkpoint::Frame> m_queue;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a frame has been taken off the queue but isn't on disk yet
+  //----------------------------------------------------------------------------------------------------------------------
+  bool m_busy = false;
+  bool m_quit = false;
+  std::atomic<size_t> m_written{0};
+  std::atomic<size_t> m_dropped{0};
+  std::thread m_thread;
+};
+
+#endif
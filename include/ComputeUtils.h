@@ -0,0 +1,44 @@
+#ifndef COMPUTEUTILS_H_
+#define COMPUTEUTILS_H_
+#include "ShaderVariantCache.h"
+#include <ngl/Types.h>
+#include <cstddef>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ComputeUtils.h
+/// @brief small helpers shared by the compute passes
+//----------------------------------------------------------------------------------------------------------------------
+namespace compute
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dispatch enough work groups of _workgroupSize to cover _count elements. The spec only guarantees
+  /// 65535 groups in x so large counts spill into y, shaders compute their element index as
+  /// (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x
+  /// and must bounds check it against the count as the last group is usually partial.
+  //----------------------------------------------------------------------------------------------------------------------
+  void dispatch1D(size_t _count, size_t _workgroupSize);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the largest local_size_x the driver supports
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t maxWorkgroupSize();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief build a compute pass with ShaderVariantCache::compute. A pass has no fallback, so if it fails to build
+  /// this prints which one and exits, as ngl::ShaderLib does with exitOnError
+  /// @returns the ngl::ShaderLib program name
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string requireProgram(const std::string &_path, const ShaderVariantCache::Defines &_defines);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set a uint uniform on an ngl::ShaderLib program, ShaderLib::setUniform only has signed ints
+  //----------------------------------------------------------------------------------------------------------------------
+  void setUniform(const std::string &_program, const char *_name, GLuint _value);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief in place exclusive prefix sum of a uint buffer with the three passes of shaders/PrefixSum.glsl,
+  /// ends with a storage barrier
+  /// @param [in] _data the _count values, replaced by their exclusive sums
+  /// @param [in] _blockSums scratch buffer of at least prefixSumBlocks(_count) uints
+  //----------------------------------------------------------------------------------------------------------------------
+  void prefixSum(GLuint _data, GLuint _blockSums, size_t _count);
+  size_t prefixSumBlocks(size_t _count);
+} // end namespace compute
+
+#endif
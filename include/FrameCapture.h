@@ -0,0 +1,97 @@
+#ifndef FRAMECAPTURE_H_
+#define FRAMECAPTURE_H_
+#include "FrameEncoder.h"
+#include <ngl/Types.h>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file FrameCapture.h
+/// @brief reads rendered frames back without stalling the frame loop
+/// @class FrameCapture
+/// @brief glReadPixels into a pixel pack buffer returns as soon as the copy is queued, so each frame is read into
+/// the next buffer of a ring and a fence is set behind it. collect hands every buffer whose fence has passed to
+/// the FrameEncoder, which reads the persistently mapped pixels in place and releases the buffer when done. The
+/// frame loop only waits when every buffer is still being copied or encoded, each of those waits is counted as
+/// a stall.
+//----------------------------------------------------------------------------------------------------------------------
+class FrameCapture
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief allocate the ring
+  /// @param [in] _encoder takes the finished frames, must outlive this
+  /// @param [in] _format the pixel layout _encoder expects
+  /// @param [in] _width,_height size of the frames read
+  /// @param [in] _ringSize number of pack buffers, frames that can be in flight at once
+  //----------------------------------------------------------------------------------------------------------------------
+  FrameCapture(FrameEncoder &_encoder, CaptureFormat _format, size_t _width, size_t _height, size_t _ringSize=3);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief waits for the encoder to be done with the buffers, the context must be current
+  //----------------------------------------------------------------------------------------------------------------------
+  ~FrameCapture();
+  FrameCapture(const FrameCapture &)=delete;
+  FrameCapture &operator=(const FrameCapture &)=delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the render target format that matches _format, GL_RGBA16F for EXR and GL_RGBA8 otherwise
+  //----------------------------------------------------------------------------------------------------------------------
+  static GLenum colourFormat(CaptureFormat _format);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief every buffer in the ring could be mapped, check before capturing
+  //----------------------------------------------------------------------------------------------------------------------
+  bool valid() const { return m_valid; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief queue a copy of the bound GL_READ_FRAMEBUFFER, does nothing if the ring couldn't be mapped
+  /// @param [in] _index frame number handed to the encoder
+  //----------------------------------------------------------------------------------------------------------------------
+  void capture(size_t _index);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief hand the frames whose copy has finished to the encoder, oldest first
+  /// @param [in] _wait wait for every queued copy instead of only taking the finished ones
+  //----------------------------------------------------------------------------------------------------------------------
+  void collect(bool _wait);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief collect everything and wait until the encoder has released every buffer
+  //----------------------------------------------------------------------------------------------------------------------
+  void finish();
+  size_t stalls() const { return m_stalls; }
+
+private:
+  struct Slot
+  {
+    GLuint buffer=0;
+    const unsigned char *mapped=nullptr;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set while the copy is queued on the GPU
+    //----------------------------------------------------------------------------------------------------------------------
+    GLsync fence=nullptr;
+    size_t index=0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set while a worker reads the pixels, guarded by m_mutex
+    //----------------------------------------------------------------------------------------------------------------------
+    bool encoding=false;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief hand the oldest queued copy to the encoder
+  /// @returns false if _wait is false and the copy hasn't finished yet
+  //----------------------------------------------------------------------------------------------------------------------
+  bool handOver(bool _wait);
+  FrameEncoder &m_encoder;
+  GLenum m_type;
+  size_t m_width;
+  size_t m_height;
+  std::vector<Slot> m_slots;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the queued copies are the m_queued slots from m_oldest on, m_next is written next
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_next=0;
+  size_t m_oldest=0;
+  size_t m_queued=0;
+  std::mutex m_mutex;
+  std::condition_variable m_released;
+  size_t m_stalls=0;
+  bool m_valid=false;
+};
+
+#endif
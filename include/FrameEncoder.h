@@ -0,0 +1,121 @@
+#ifndef FRAMEENCODER_H_
+#define FRAMEENCODER_H_
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file FrameEncoder.h
+/// @brief writes captured frames to disk or a pipe on a pool of worker threads
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how captured frames are stored
+/// PNG : 8 bit RGB, one deflated file per frame, needs zlib
+/// EXR : half float RGBA, one uncompressed scanline file per frame, keeps the additive blending above 1
+/// Raw : the RGBA8 pixels of every frame back to back in one stream, e.g. a pipe into ffmpeg
+//----------------------------------------------------------------------------------------------------------------------
+enum class CaptureFormat
+{
+  PNG,
+  EXR,
+  Raw
+};
+const char *toString(CaptureFormat _format);
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class FrameEncoder
+/// @brief submit queues a frame and returns straight away. A worker reads the pixels in place and calls the frame's
+/// done function once it no longer needs them, so a mapped pixel buffer can be handed over without a copy. PNG and
+/// EXR frames go to DIR/frame_<index>.<ext> and are encoded in parallel. Raw frames are written to the stream in
+/// index order, so they must be submitted in order. The pixels are bottom row first, as glReadPixels returns
+/// them, and every format is written top row first.
+//----------------------------------------------------------------------------------------------------------------------
+class FrameEncoder
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start the workers
+  /// @param [in] _format how to store the frames, sets the pixel layout submit expects (see bytesPerPixel)
+  /// @param [in] _width,_height frame size in pixels
+  /// @param [in] _output PNG and EXR : the directory, created if needed. Raw : a file, - for stdout or
+  /// |command to pipe into a command
+  /// @param [in] _numThreads workers, 0 uses one per hardware thread
+  //----------------------------------------------------------------------------------------------------------------------
+  FrameEncoder(CaptureFormat _format, size_t _width, size_t _height, const std::string &_output, size_t _numThreads);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief writes everything still queued, closes the stream and joins the workers
+  //----------------------------------------------------------------------------------------------------------------------
+  ~FrameEncoder();
+  FrameEncoder(const FrameEncoder &) = delete;
+  FrameEncoder &operator=(const FrameEncoder &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the output could be opened, check before submitting
+  //----------------------------------------------------------------------------------------------------------------------
+  bool valid() const { return m_valid; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief queue a frame
+  /// @param [in] _index frame number, used in the file name and for the raw stream order
+  /// @param [in] _pixels width*height*bytesPerPixel bytes, must stay untouched until _done is called
+  /// @param [in] _done called on a worker thread once the pixels have been read
+  //----------------------------------------------------------------------------------------------------------------------
+  void submit(size_t _index, const void *_pixels, std::function<void()> _done);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief block until every queued frame is written
+  //----------------------------------------------------------------------------------------------------------------------
+  void flush();
+  size_t framesWritten() const { return m_written.load(); }
+  size_t bytesWritten() const { return m_bytes.load(); }
+  size_t numThreads() const { return m_workers.size(); }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief RGBA8 for PNG and Raw, RGBA half floats for EXR
+  //----------------------------------------------------------------------------------------------------------------------
+  static size_t bytesPerPixel(CaptureFormat _format);
+
+private:
+  struct Job
+  {
+    size_t index;
+    const unsigned char *pixels;
+    std::function<void()> done;
+  };
+  void run();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief encode one frame
+  /// @returns the bytes written, 0 on failure after printing why
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t encode(const Job &_job);
+  size_t writeRaw(const Job &_job);
+  std::string fileName(size_t _index) const;
+  CaptureFormat m_format;
+  size_t m_width;
+  size_t m_height;
+  std::string m_output;
+  bool m_valid = false;
+  FILE *m_stream = nullptr;
+  bool m_pipe = false;
+  std::deque<Job> m_queue;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the next raw frame to go into the stream, the workers take turns in index order
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_nextRaw = 0;
+  bool m_rawStarted = false;
+  std::condition_variable m_rawTurn;
+  size_t m_busy = 0;
+  bool m_quit = false;
+  std::atomic<size_t> m_written{0};
+  std::atomic<size_t> m_bytes{0};
+  std::vector<std::thread> m_workers;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef GPUMORTONORDER_H_
+#define GPUMORTONORDER_H_
+#include "ShaderVariantCache.h"
+#include <ngl/Types.h>
+#include <cstddef>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file GPUMortonOrder.h
+/// @brief compute shader version of MortonOrder, sorts the particle buffers into Morton order in place
+/// @class GPUMortonOrder
+/// @brief reorder() runs KEY_PASS of shaders/MortonSort.glsl, then eight 4 bit radix passes (COUNT_PASS,
+/// compute::prefixSum over the digit major block counts, SCATTER_PASS) ping ponging the keys and slots, and
+/// finally PERMUTE_PASS gathers the position and velocity buffers into a spare pair that is swapped with the
+/// callers. Nothing is read back.
+//----------------------------------------------------------------------------------------------------------------------
+class GPUMortonOrder
+{
+public:
+  GPUMortonOrder()=default;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor releases the buffers, the context must still be current
+  //----------------------------------------------------------------------------------------------------------------------
+  ~GPUMortonOrder();
+  GPUMortonOrder(const GPUMortonOrder &)=delete;
+  GPUMortonOrder &operator=(const GPUMortonOrder &)=delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the ParticleFormat.glsl defines of the particle buffers and whether the slots have a lifecycle,
+  /// the passes are rebuilt on the next reorder()
+  //----------------------------------------------------------------------------------------------------------------------
+  void setFormat(const ShaderVariantCache::Defines &_formatDefines, size_t _positionStride, size_t _velocityStride,
+                 bool _lifecycle);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sort the particles, the buffer ids are swapped for the spare ones holding the sorted particles
+  /// @param [in,out] io_positionBuffer positions in the layout given to setFormat
+  /// @param [in,out] io_velocityBuffer velocities in the same layout
+  /// @param [in] _count number of particle slots
+  /// @param [in] _extent the curve covers [-_extent,_extent] on each axis
+  /// @param [in] _workgroupSize local_size_x for the per particle passes
+  /// @param [in] _currentList with the lifecycle dead slots sort to the end and the live ones are counted into
+  /// aliveCount[_currentList], which must be zero with the counters bound at 11
+  //----------------------------------------------------------------------------------------------------------------------
+  void reorder(GLuint &io_positionBuffer, GLuint &io_velocityBuffer, size_t _count, float _extent,
+               size_t _workgroupSize, GLuint _currentList);
+  size_t memoryFootprint() const;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief (re)create the buffers and passes for _count particles
+  //----------------------------------------------------------------------------------------------------------------------
+  void allocate(size_t _count, size_t _workgroupSize);
+  size_t m_count=0;
+  size_t m_numBlocks=0;
+  size_t m_workgroupSize=0;
+  size_t m_positionStride=16;
+  size_t m_velocityStride=16;
+  bool m_lifecycle=false;
+  ShaderVariantCache::Defines m_formatDefines;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief keys and slots, [0] holds the result after an even number of passes
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint m_keyID[2]={0,0};
+  GLuint m_valueID[2]={0,0};
+  GLuint m_blockCountID=0;
+  GLuint m_blockSumID=0;
+  GLuint m_sparePositionID=0;
+  GLuint m_spareVelocityID=0;
+  std::string m_keyProgram;
+  std::string m_countProgram;
+  std::string m_scatterProgram;
+  std::string m_permuteProgram;
+};
+
+#endif
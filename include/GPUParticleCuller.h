@@ -0,0 +1,66 @@
+#ifndef GPUPARTICLECULLER_H_
+#define GPUPARTICLECULLER_H_
+#include "SimulationConfig.h"
+#include <ngl/Mat4.h>
+#include <ngl/Types.h>
+#include <cstddef>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file GPUParticleCuller.h
+/// @brief compacts the visible particles into an index list and draws them with one indirect call
+/// @class GPUParticleCuller
+/// @brief cull() runs shaders/ParticleCull.glsl over a position buffer: particles outside the view frustum,
+/// dead ones and those thinned out by the distance LOD are dropped and the rest are appended to an index
+/// buffer whose length is counted straight into a DrawElementsIndirectCommand. draw() then issues
+/// glDrawElementsIndirect so the vertex work scales with what is visible and the CPU never waits for the count.
+//----------------------------------------------------------------------------------------------------------------------
+class GPUParticleCuller
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _config uses workgroupSize, particleFormat, positionExtent and lodDistance
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit GPUParticleCuller(const SimulationConfig &_config);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor releases the buffers, the context must still be current
+  //----------------------------------------------------------------------------------------------------------------------
+  ~GPUParticleCuller();
+  GPUParticleCuller(const GPUParticleCuller &)=delete;
+  GPUParticleCuller &operator=(const GPUParticleCuller &)=delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief build the visible list for this frame
+  /// @param [in] _positionBuffer positions in the config's ParticleFormat, the writes to it must be complete
+  /// @param [in] _count number of particles
+  /// @param [in] _mvp the matrix the points are drawn with
+  //----------------------------------------------------------------------------------------------------------------------
+  void cull(GLuint _positionBuffer, size_t _count, const ngl::Mat4 &_mvp);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief draw the visible particles as GL_POINTS, the bound VAO must source attribute 0 from the position
+  /// buffer given to cull()
+  //----------------------------------------------------------------------------------------------------------------------
+  void draw() const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the count of the last cull, reads back the command so it stalls, for testing and debugging only
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t visibleCount() const;
+  size_t memoryFootprint() const;
+
+private:
+  size_t m_capacity=0;
+  size_t m_workgroupSize=128;
+  float m_lodDistance=0.0f;
+  ParticleFormat m_format=ParticleFormat::Full;
+  float m_positionExtent=128.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the DrawElementsIndirectCommand (count, instanceCount, firstIndex, baseVertex, baseInstance)
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint m_commandID=0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the visible indices, used as the element buffer of the draw
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint m_visibleID=0;
+  std::string m_program;
+};
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef GPUPARTICLESIMULATOR_H_
+#define GPUPARTICLESIMULATOR_H_
+#include "AttractorPaths.h"
+#include "Checkpoint.h"
+#include "GPUMortonOrder.h"
+#include "GPUSpatialHash.h"
+#include "HostBuffer.h"
+#include "ParticleSimulator.h"
+#include "ParticleSystems.h"
+#include "ShaderVariantCache.h"
+#include "SimulationConfig.h"
+#include "StreamingBuffer.h"
+#include "ThreadPool.h"
+#include <ngl/Types.h>
+#include <array>
+#include <memory>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file GPUParticleSimulator.h
+/// @brief steps the particles with shaders/ParticlesCompute.glsl, needs a current GL 4.3+ context
+/// @class GPUParticleSimulator
+/// @brief owns the position / velocity / attractor SSBOs, the position buffer is also used directly as
+/// the vertex buffer for drawing so nothing is copied back to the host. The buffers are either full floats or
+/// the 16 byte per particle ParticleFormat::Compact layout, see ParticleFormat.glsl. With a neighbour radius set the
+/// particles are binned with a GPUSpatialHash each step and a neighbour pass adds a separation force. With
+/// attractor paths loaded AttractorAnimate.glsl moves the attractors at the start of every step in a buffer that
+/// never leaves the GPU. With emitters the slots have a lifecycle (ParticleLifecycle.glsl) : free slots are
+/// kept on a GPU stack, each step emitters pop slots off it and the simulate pass only runs over an alive list,
+/// dispatched with glDispatchComputeIndirect from the alive count so the host never reads it back. With a reorder
+/// interval a GPUMortonOrder sorts the slots into Morton order every so many steps, which swaps the position and
+/// velocity buffers, so don't hold on to positionBuffer() across steps. With a stream chunk the state lives in a
+/// HostBuffer instead and each step pipelines chunks through c_streamSlots sets of device buffers : while the GPU
+/// steps one chunk the pool copies the next into a persistently mapped upload buffer and the one before out of the
+/// download buffer, each slot guarded by its own fence. Only the first chunk is drawn. With a systems table the
+/// BATCHED variant looks up each particle's system in a small SSBO, so every system is stepped by one dispatch.
+//----------------------------------------------------------------------------------------------------------------------
+class GPUParticleSimulator : public ParticleSimulator
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _config uses workgroupSize (local_size_x, a variant is built for each size), forceMode, the
+  /// grid and the neighbour settings, initMode, numThreads, particleFormat, positionExtent, attractorPaths and stepMs,
+  /// numEmitters and emitRate, reorderInterval, streamChunk and stateFile, particleSystems
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit GPUParticleSimulator(const SimulationConfig &_config);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor releases the buffers, the context must still be current
+  //----------------------------------------------------------------------------------------------------------------------
+  ~GPUParticleSimulator() override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with a systems table _numParticles is ignored, the table gives the count
+  //----------------------------------------------------------------------------------------------------------------------
+  void initialize(size_t _numParticles, uint32_t _seed) override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief fills mappable buffers from the file with a ThreadPool like InitMode::Mapped, whatever the init mode
+  //----------------------------------------------------------------------------------------------------------------------
+  bool restore(const CheckpointReader &_reader) override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with attractor paths only _count is used, the positions are written by the next step
+  //----------------------------------------------------------------------------------------------------------------------
+  void setAttractors(const float *_xyz, size_t _count) override;
+  bool animatedAttractors() const override { return !m_paths.empty(); }
+  void setEmitters(const float *_xyzr, size_t _count) override;
+  void emitBurst(size_t _count) override { m_pendingBurst += _count; }
+  void step(float _dt) override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief submit all the substeps with only storage barriers between them and one fence at the end
+  //----------------------------------------------------------------------------------------------------------------------
+  void advance(float _dt, size_t _steps) override;
+  void finish() override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief reads back the buffer, compact positions are decoded to floats
+  //----------------------------------------------------------------------------------------------------------------------
+  void readPositions(float *o_xyzw, size_t _first, size_t _count) override;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief copies the particle buffers into a persistently mapped staging buffer behind the steps in flight and
+  /// fences it, pollSnapshot picks it up once the fence has passed so the frame loop never waits on the GPU
+  //----------------------------------------------------------------------------------------------------------------------
+  bool requestSnapshot() override;
+  bool pollSnapshot(checkpoint::Frame &o_frame) override;
+  size_t numParticles() const override { return m_numParticles; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief reads back the alive counter with the lifecycle so it waits for the steps in flight, keep it out of
+  /// the frame loop
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t liveCount() override;
+  size_t memoryFootprint() const override;
+  const char *name() const override { return "gpu"; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the position buffer, bind as GL_ARRAY_BUFFER to draw the particles. Full is a vec4 per particle,
+  /// Compact a uvec2 to decode with ParticleFormat.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint positionBuffer() const { return m_positionBufferID; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particles in positionBuffer(), all of them unless streaming where it holds a copy of the first chunk
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t residentCount() const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind the current attractors (vec4 each) to an SSBO binding, e.g. to draw them. Call fenceAttractors
+  /// after the commands reading them so the ring slot isn't rewritten while they are in flight
+  //----------------------------------------------------------------------------------------------------------------------
+  void bindAttractors(GLuint _index) const;
+  void fenceAttractors() { m_attractors.fence(); }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the defines selecting the buffer layout in ParticleFormat.glsl, any shader reading the particle
+  /// buffers (including the vertex shader drawing them) has to be built with these
+  //----------------------------------------------------------------------------------------------------------------------
+  static ShaderVariantCache::Defines formatDefines(ParticleFormat _format, float _extent);
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief get the ParticlesCompute.glsl variant for the current work group size and force mode
+  //----------------------------------------------------------------------------------------------------------------------
+  void createProgram();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ForceMode::Grid, evaluate the attractor field into m_fieldTexture with ForceFieldBake.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  void bakeField();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bin the particles and run the neighbour pass into m_neighborForceBufferID
+  //----------------------------------------------------------------------------------------------------------------------
+  void computeNeighborForces();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief new immutable particle buffers for m_numParticles, and the neighbour force buffer to match
+  /// @param [in] _flags glBufferStorage flags, GL_MAP_WRITE_BIT when the host fills them
+  //----------------------------------------------------------------------------------------------------------------------
+  void allocateParticles(GLbitfield _flags);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief InitMode::Compute, run ParticlesInit.glsl over the new buffers
+  //----------------------------------------------------------------------------------------------------------------------
+  void initializeCompute();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief InitMode::Mapped, map the new buffers and fill them with a ThreadPool
+  //----------------------------------------------------------------------------------------------------------------------
+  void initializeMapped();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief move the attractors in m_animatedAttractorsID to step m_stepIndex of their paths
+  //----------------------------------------------------------------------------------------------------------------------
+  void animateAttractors();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief (re)allocate the lifecycle buffers for m_numParticles slots and put every slot on the free list
+  /// @param [in] _alive the slots [0,_alive) already hold live particles (a restored checkpoint), these go on the
+  /// alive list instead
+  //----------------------------------------------------------------------------------------------------------------------
+  void resetLifecycle(size_t _alive = 0);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the begin and emit passes of ParticleLifecycle.glsl, leaves the simulate arguments in the counters
+  //----------------------------------------------------------------------------------------------------------------------
+  void emitParticles();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sort the slots into Morton order, with the lifecycle the live ones end up first and the lists are
+  /// rebuilt to match
+  //----------------------------------------------------------------------------------------------------------------------
+  void reorder();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief issue the passes for one step, the caller adds the barrier after it
+  //----------------------------------------------------------------------------------------------------------------------
+  void dispatchStep(float _dt);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief animate the attractors and bake / bind the grid, the per step work before the simulate pass
+  //----------------------------------------------------------------------------------------------------------------------
+  void prepareForces();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief use m_program and set everything but the particle buffers, numParticles, firstParticle and stepIndex
+  //----------------------------------------------------------------------------------------------------------------------
+  void bindSimulate(float _dt);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the start state of particles [_begin,_end) in the buffer layout, the arrays hold every particle
+  //----------------------------------------------------------------------------------------------------------------------
+  void writeInitialState(void *o_positions, void *o_velocities, size_t _begin, size_t _end) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief streaming, size m_hostState for m_numParticles and create the slots, staging and display buffers
+  /// @returns false if the host state couldn't be allocated
+  //----------------------------------------------------------------------------------------------------------------------
+  bool allocateStreaming();
+  void releaseStreaming();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief streaming, copy the first chunk of m_hostState into the display buffer after it was written on the host
+  //----------------------------------------------------------------------------------------------------------------------
+  void uploadDisplay();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief streaming, run _steps steps over every chunk. Without paths the attractors don't move within the batch
+  /// so each chunk runs all of them while it is resident, with paths every step streams the whole state
+  //----------------------------------------------------------------------------------------------------------------------
+  void streamSteps(float _dt, size_t _steps);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief wait for the fence of slot _slot and copy its chunk from the download buffer back into m_hostState
+  //----------------------------------------------------------------------------------------------------------------------
+  void retireSlot(size_t _slot);
+  size_t m_numParticles = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the Philox key and the step counter, see Philox.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  uint32_t m_seed = 0;
+  uint32_t m_stepIndex = 0;
+  size_t m_workgroupSize = 128;
+  ForceMode m_forceMode = ForceMode::Summed;
+  size_t m_gridResolution = 64;
+  float m_gridExtent = 60.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the baked force field, only rebuilt when the attractors change
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint m_fieldTexture = 0;
+  bool m_fieldDirty = true;
+  std::string m_bakeProgram;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particle / particle interaction, off when the radius is 0
+  //----------------------------------------------------------------------------------------------------------------------
+  float m_neighborRadius = 0.0f;
+  float m_separation = 0.1f;
+  GPUSpatialHash m_spatialHash;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the Morton sort every m_reorderInterval steps, over the positionExtent box
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_reorderInterval = 0;
+  GPUMortonOrder m_mortonOrder;
+  GLuint m_neighborForceBufferID = 0;
+  std::string m_neighborProgram;
+  std::string m_program;
+  std::string m_initProgram;
+  InitMode m_initMode = InitMode::Compute;
+  ParticleFormat m_format = ParticleFormat::Full;
+  float m_positionExtent = 128.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief threads used to fill the mapped buffers
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_numThreads = 0;
+  GLuint m_velocityBufferID = 0;
+  GLuint m_positionBufferID = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the attractors are uploaded as vec4 into a persistently mapped ring so updates never reallocate
+  //----------------------------------------------------------------------------------------------------------------------
+  StreamingBuffer m_attractors;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with paths the attractors live in m_animatedAttractorsID instead, written only by m_animateProgram
+  /// from the path and key buffers uploaded once
+  //----------------------------------------------------------------------------------------------------------------------
+  AttractorPaths m_paths;
+  float m_stepSeconds = 0.01f;
+  size_t m_numAttractors = 0;
+  std::string m_animateProgram;
+  GLuint m_pathBufferID = 0;
+  GLuint m_keyBufferID = 0;
+  GLuint m_animatedAttractorsID = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the batched systems, uploaded once into m_systemBufferID
+  //----------------------------------------------------------------------------------------------------------------------
+  ParticleSystems m_systems;
+  GLuint m_systemBufferID = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the emitter lifecycle, on when SimulationConfig::numEmitters isn't 0. m_currentList is the alive list
+  /// the next step simulates, see Lifecycle.glsl for the counter layout
+  //----------------------------------------------------------------------------------------------------------------------
+  bool m_lifecycle = false;
+  size_t m_emitRate = 0;
+  size_t m_pendingBurst = 0;
+  size_t m_numEmitters = 0;
+  GLuint m_currentList = 0;
+  GLuint m_emitterBufferID = 0;
+  GLuint m_counterBufferID = 0;
+  GLuint m_aliveBufferID = 0;
+  GLuint m_freeBufferID = 0;
+  std::string m_resetProgram;
+  std::string m_beginProgram;
+  std::string m_emitProgram;
+  std::string m_rebuildProgram;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the snapshot staging buffer, positions then velocities, mapped for its whole life. m_snapshotFence is
+  /// set while a copy is in flight
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint m_snapshotBufferID = 0;
+  size_t m_snapshotBytes = 0;
+  const unsigned char *m_snapshotMapping = nullptr;
+  GLsync m_snapshotFence = nullptr;
+  uint32_t m_snapshotStep = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief out of core state, off when m_streamChunk is 0. m_hostState holds positions then velocities in the
+  /// buffer layout, the upload and download buffers are mapped for their whole life with one region per slot
+  //----------------------------------------------------------------------------------------------------------------------
+  struct StreamSlot
+  {
+    GLuint positionBufferID = 0;
+    GLuint velocityBufferID = 0;
+    GLsync fence = nullptr;
+    size_t first = 0;
+    size_t count = 0;
+  };
+  static constexpr size_t c_streamSlots = 3;
+  size_t m_streamChunk = 0;
+  std::string m_stateFile;
+  HostBuffer m_hostState;
+  std::array<StreamSlot, c_streamSlots> m_slots;
+  size_t m_slotBytes = 0;
+  GLuint m_uploadBufferID = 0;
+  GLuint m_downloadBufferID = 0;
+  unsigned char *m_uploadMapping = nullptr;
+  const unsigned char *m_downloadMapping = nullptr;
+  std::unique_ptr<ThreadPool> m_copyPool;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief streaming snapshots come straight from m_hostState, which is current after every advance
+  //----------------------------------------------------------------------------------------------------------------------
+  checkpoint::Frame m_hostSnapshot;
+  bool m_hostSnapshotReady = false;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief byte offsets of simulateArgs and emitArgs in LifecycleCounters, and its size
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr GLintptr c_simulateArgsOffset = 16;
+  static constexpr GLintptr c_emitArgsOffset = 32;
+  static constexpr size_t c_counterBytes = 48;
+};
+
+#endif
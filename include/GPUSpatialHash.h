@@ -0,0 +1,65 @@
+#ifndef GPUSPATIALHASH_H_
+#define GPUSPATIALHASH_H_
+#include "ShaderVariantCache.h"
+#include <ngl/Types.h>
+#include <cstddef>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file GPUSpatialHash.h
+/// @brief compute shader version of SpatialHash, bins the particles of a position SSBO into a uniform grid
+/// @class GPUSpatialHash
+/// @brief build() runs HASH_PASS of shaders/SpatialHash.glsl (slot of each particle + atomic per slot counts),
+/// compute::prefixSum over the counts and then SCATTER_PASS, leaving the particle indices grouped by slot.
+/// bind() then makes the table available to a query pass (see NEIGHBOR_PASS) at bindings 3 (cellStart, which
+/// after the scatter holds the end of each slot), 4 (sortedIndex) and 5 (particleHash).
+//----------------------------------------------------------------------------------------------------------------------
+class GPUSpatialHash
+{
+public:
+  GPUSpatialHash()=default;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor releases the buffers, the context must still be current
+  //----------------------------------------------------------------------------------------------------------------------
+  ~GPUSpatialHash();
+  GPUSpatialHash(const GPUSpatialHash &)=delete;
+  GPUSpatialHash &operator=(const GPUSpatialHash &)=delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bin the particles
+  /// @param [in] _positionBuffer positions in the layout given to setPositionFormat
+  /// @param [in] _count number of particles
+  /// @param [in] _cellSize the cell edge length, use the interaction radius
+  /// @param [in] _workgroupSize local_size_x for the per particle passes
+  //----------------------------------------------------------------------------------------------------------------------
+  void build(GLuint _positionBuffer, size_t _count, float _cellSize, size_t _workgroupSize);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind the table buffers and set numParticles, tableMask and cellSize on a SpatialHash.glsl variant
+  //----------------------------------------------------------------------------------------------------------------------
+  void bind(const std::string &_program) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the ParticleFormat.glsl defines of the position buffer, see GPUParticleSimulator::formatDefines.
+  /// The passes are rebuilt on the next build()
+  //----------------------------------------------------------------------------------------------------------------------
+  void setPositionFormat(const ShaderVariantCache::Defines &_formatDefines);
+  size_t tableSize() const { return m_tableSize; }
+  size_t memoryFootprint() const;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief (re)create the buffers for _count particles
+  //----------------------------------------------------------------------------------------------------------------------
+  void allocate(size_t _count, size_t _workgroupSize);
+  size_t m_count=0;
+  size_t m_tableSize=0;
+  size_t m_numBlocks=0;
+  size_t m_workgroupSize=0;
+  float m_cellSize=1.0f;
+  ShaderVariantCache::Defines m_formatDefines;
+  GLuint m_cellStartID=0;
+  GLuint m_sortedIndexID=0;
+  GLuint m_particleHashID=0;
+  GLuint m_blockSumID=0;
+  std::string m_hashProgram;
+  std::string m_scatterProgram;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef GPUTIMER_H_
+#define GPUTIMER_H_
+#include "Profiler.h"
+#include <ngl/Types.h>
+#include <array>
+#include <cstdint>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file GPUTimer.h
+/// @brief GL_TIME_ELAPSED timing of a section of GL commands, reported through the Profiler
+/// @class GPUTimer
+/// @brief reading a query straight after issuing it would stall until the GPU catches up, so each timer
+/// alternates between two queries and reads the one issued the frame before. The sample is placed on the
+/// GPU track at the CPU time the section was issued, the GPU runs a little behind that. Time elapsed queries
+/// can't nest so timed sections must not overlap. Does nothing unless the Profiler is running.
+//----------------------------------------------------------------------------------------------------------------------
+class GPUTimer
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor, the queries are created on first use so this can be a member of the window
+  /// @param [in] _name the sample name, must be a string literal
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit GPUTimer(const char *_name) : m_name(_name) {}
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor deletes the queries, the context must be current or release() called before
+  //----------------------------------------------------------------------------------------------------------------------
+  ~GPUTimer();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief delete the queries now, for owners that are destroyed after their context goes away
+  //----------------------------------------------------------------------------------------------------------------------
+  void release();
+  GPUTimer(const GPUTimer &)=delete;
+  GPUTimer &operator=(const GPUTimer &)=delete;
+  void begin();
+  void end();
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief record the result of query _slot, if _wait is false only when it is already available
+  //----------------------------------------------------------------------------------------------------------------------
+  void collect(size_t _slot, bool _wait);
+  const char *m_name;
+  std::array<GLuint,2> m_queries={{0,0}};
+  std::array<uint64_t,2> m_issued={{0,0}};
+  std::array<bool,2> m_pending={{false,false}};
+  size_t m_current=0;
+  bool m_active=false;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class GPUScope
+/// @brief RAII begin / end of a GPUTimer
+//----------------------------------------------------------------------------------------------------------------------
+class GPUScope
+{
+public:
+  explicit GPUScope(GPUTimer &_timer) : m_timer(_timer) { m_timer.begin(); }
+  ~GPUScope() { m_timer.end(); }
+  GPUScope(const GPUScope &)=delete;
+  GPUScope &operator=(const GPUScope &)=delete;
+
+private:
+  GPUTimer &m_timer;
+};
+
+#endif
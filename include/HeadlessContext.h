@@ -0,0 +1,36 @@
+#ifndef HEADLESSCONTEXT_H_
+#define HEADLESSCONTEXT_H_
+//----------------------------------------------------------------------------------------------------------------------
+/// @file HeadlessContext.h
+/// @brief an OpenGL context without a window or display server
+/// @class HeadlessContext
+/// @brief an EGL context made current with no surface (EGL_KHR_surfaceless_context), everything is drawn into
+/// framebuffer objects. The Mesa surfaceless platform is tried first so it works on render nodes with no X or
+/// Wayland and with software GL (llvmpipe), otherwise the default EGL display is used.
+//----------------------------------------------------------------------------------------------------------------------
+class HeadlessContext
+{
+public:
+  HeadlessContext()=default;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief releases the context and the display
+  //----------------------------------------------------------------------------------------------------------------------
+  ~HeadlessContext();
+  HeadlessContext(const HeadlessContext &)=delete;
+  HeadlessContext &operator=(const HeadlessContext &)=delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create a core profile context and make it current on the calling thread
+  /// @param [in] _major,_minor the GL version to ask for
+  /// @returns false and prints why if EGL can't give us one
+  //----------------------------------------------------------------------------------------------------------------------
+  bool create(int _major=4, int _minor=5);
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief EGLDisplay and EGLContext, kept opaque so the EGL headers stay out of the callers
+  //----------------------------------------------------------------------------------------------------------------------
+  void *m_display=nullptr;
+  void *m_context=nullptr;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef HOSTBUFFER_H_
+#define HOSTBUFFER_H_
+#include <cstddef>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file HostBuffer.h
+/// @brief a large block of host memory, anonymous or backed by a file
+/// @class HostBuffer
+/// @brief holds particle state that doesn't fit on the device. The anonymous mapping is left untouched so the pages
+/// land on the node of whichever thread writes them first, a file mapping lets the state outgrow RAM and be paged
+/// by the OS. Falls back to a std::vector where mmap isn't available.
+//----------------------------------------------------------------------------------------------------------------------
+class HostBuffer
+{
+public:
+  HostBuffer() = default;
+  ~HostBuffer();
+  HostBuffer(const HostBuffer &) = delete;
+  HostBuffer &operator=(const HostBuffer &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief (re)allocate _bytes, the previous contents are lost
+  /// @param [in] _file map this file (created or resized to fit), empty for anonymous memory
+  /// @returns false and prints why if the memory or file couldn't be mapped
+  //----------------------------------------------------------------------------------------------------------------------
+  bool allocate(size_t _bytes, const std::string &_file = std::string());
+  void release();
+  unsigned char *data() { return m_data; }
+  const unsigned char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  bool fileBacked() const { return m_fileBacked; }
+
+private:
+  unsigned char *m_data = nullptr;
+  size_t m_size = 0;
+  bool m_mapped = false;
+  bool m_fileBacked = false;
+  std::vector<unsigned char> m_copy;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef LOCKFREERING_H_
+#define LOCKFREERING_H_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LockFreeRing.h
+/// @brief bounded multi producer / single consumer queue
+/// @class LockFreeRing
+/// @brief each slot carries a sequence number (the bounded queue from Dmitry Vyukov) so producers claim a slot
+/// with one CAS on the head and publish it with a release store, the consumer never takes a lock either.
+/// When the ring is full push fails rather than blocking, callers on a hot path just drop the item.
+/// T should be trivially copyable.
+//----------------------------------------------------------------------------------------------------------------------
+template <typename T>
+class LockFreeRing
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _capacity number of slots, rounded up to a power of two
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit LockFreeRing(size_t _capacity)
+  {
+    size_t capacity = 2;
+    while (capacity < _capacity)
+    {
+      capacity <<= 1;
+    }
+    m_mask = capacity - 1;
+    m_slots.reset(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; ++i)
+    {
+      m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  LockFreeRing(const LockFreeRing &) = delete;
+  LockFreeRing &operator=(const LockFreeRing &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief add an item, safe from any number of threads
+  /// @returns false if the ring is full
+  //----------------------------------------------------------------------------------------------------------------------
+  bool push(const T &_item)
+  {
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;)
+    {
+      slot = &m_slots[pos & m_mask];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0)
+      {
+        if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = m_head.load(std::memory_order_relaxed);
+      }
+    }
+    slot->item = _item;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief take the oldest item, only one thread may pop
+  /// @returns false if the ring is empty
+  //----------------------------------------------------------------------------------------------------------------------
+  bool pop(T &o_item)
+  {
+    Slot &slot = m_slots[m_tail & m_mask];
+    if (slot.sequence.load(std::memory_order_acquire) != m_tail + 1)
+    {
+      return false;
+    }
+    o_item = slot.item;
+    slot.sequence.store(m_tail + m_mask + 1, std::memory_order_release);
+    ++m_tail;
+    return true;
+  }
+  size_t capacity() const { return m_mask + 1; }
+
+private:
+  struct Slot
+  {
+    std::atomic<size_t> sequence{0};
+    T item;
+  };
+  std::unique_ptr<Slot[]> m_slots;
+  size_t m_mask = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief producers and the consumer on separate cache lines
+  //----------------------------------------------------------------------------------------------------------------------
+  alignas(64) std::atomic<size_t> m_head{0};
+  alignas(64) size_t m_tail = 0;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef MORTONORDER_H_
+#define MORTONORDER_H_
+#include "ThreadPool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MortonOrder.h
+/// @brief spatial sort of the particles along a Morton (Z order) curve, CPU version of shaders/MortonSort.glsl
+/// @class MortonOrder
+/// @brief after a few seconds of simulation neighbouring indices are scattered all over space, so any pass
+/// that looks particles up by position (the grid field, the neighbour search, the rasteriser) misses the cache.
+/// build() quantises each position to a 1024^3 grid over [-_extent,_extent], interleaves the bits into a 30
+/// bit Morton code and sorts the indices by it with a stable LSD radix sort. Each pass histograms the digit per
+/// chunk, scans the (digit, chunk) counts and scatters every chunk serially from its offset, so the result
+/// doesn't depend on the thread count. gather() then moves a particle stream into the new order.
+//----------------------------------------------------------------------------------------------------------------------
+class MortonOrder
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sort the particles by their Morton code
+  /// @param [in] _x,_y,_z the particle positions, _count of each
+  /// @param [in] _extent the curve covers [-_extent,_extent] on each axis, particles outside share its faces
+  /// @param [in] _pool the pool used for the passes
+  //----------------------------------------------------------------------------------------------------------------------
+  void build(const float *_x, const float *_y, const float *_z, size_t _count, float _extent, ThreadPool &_pool);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief order()[k] is the old index of the particle that moves to k
+  //----------------------------------------------------------------------------------------------------------------------
+  const std::vector<uint32_t> &order() const { return m_order; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief o_dst[k] = _src[order()[k]] for the particles of the last build
+  //----------------------------------------------------------------------------------------------------------------------
+  void gather(const float *_src, float *o_dst, ThreadPool &_pool) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the 30 bit code of a position, matches mortonCode in MortonSort.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  static uint32_t mortonCode(float _x, float _y, float _z, float _extent);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief spread the low 10 bits of _v out to every third bit
+  //----------------------------------------------------------------------------------------------------------------------
+  static uint32_t expandBits(uint32_t _v);
+  size_t memoryFootprint() const;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the chunk size handed to the pool, fixed for a build so the histograms line up between passes
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t m_grain = 1;
+  std::vector<uint32_t> m_keys;
+  std::vector<uint32_t> m_order;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the other half of the ping pong between radix passes
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint32_t> m_sortedKeys;
+  std::vector<uint32_t> m_sortedOrder;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief per (digit, chunk) counts then scatter offsets, digit major so the scan gives a stable order
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint32_t> m_histogram;
+};
+
+#endif
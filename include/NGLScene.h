@@ -1,11 +1,23 @@
 #ifndef NGLSCENE_H_
 #define NGLSCENE_H_
 #include "WindowParams.h"
+#include "CheckpointWriter.h"
+#include "GPUTimer.h"
+#include "GPUParticleCuller.h"
+#include "ParticleSimulator.h"
+#include "SimulationConfig.h"
+#include "SimulationThread.h"
+#include "StreamingBuffer.h"
 #include <ngl/Vec3.h>
 #include <ngl/Text.h>
 #include <QOpenGLWindow>
 #include <QElapsedTimer>
 #include <QTimer>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 //----------------------------------------------------------------------------------------------------------------------
 /// @file NGLScene.h
 /// @brief this class inherits from the Qt OpenGLWindow and allows us to use NGL to draw OpenGL
@@ -25,9 +37,9 @@ class NGLScene : public QOpenGLWindow
 public:
   //----------------------------------------------------------------------------------------------------------------------
   /// @brief ctor for our NGL drawing class
-  /// @param [in] parent the parent window to the class
+  /// @param [in] _config the startup options, selects the simulation backend
   //----------------------------------------------------------------------------------------------------------------------
-  NGLScene();
+  NGLScene(const SimulationConfig &_config);
   //----------------------------------------------------------------------------------------------------------------------
   /// @brief dtor must close down ngl and release OpenGL resources
   //----------------------------------------------------------------------------------------------------------------------
@@ -96,18 +108,123 @@ private:
   void timerEvent(QTimerEvent *_event) override;
 
 
-  // create compute shader buffers
-  void createComputeBuffers();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the simulator selected in m_config and the initial attractors
+  //----------------------------------------------------------------------------------------------------------------------
+  void createSimulator();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind the positions to draw as attribute 0, for the CPU backend these are uploaded every frame
+  /// @param [in] _mvp the CPU backend culls against this and only uploads the visible particles
+  /// @returns the number of points to draw for the CPU backend
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t bindParticlePositions(const ngl::Mat4 &_mvp);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _steps fixed steps, moving the attractors and stopping at the step counts the config asks for
+  /// @returns false once stopAfter steps have run and the app should quit
+  //----------------------------------------------------------------------------------------------------------------------
+  bool simulate(size_t _steps);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with a simulation thread, write what the next frames draw, runs on the simulation thread
+  /// @param [out] o_frame the culled positions in the draw format and the attractors
+  //----------------------------------------------------------------------------------------------------------------------
+  void publishFrame(SimulationThread::Frame &o_frame);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _command where the simulator lives, posted to the simulation thread or straight away with the
+  /// context current
+  //----------------------------------------------------------------------------------------------------------------------
+  void onSimulator(std::function<void()> _command);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief move the attractors along their path and upload them, the context must be current
+  //----------------------------------------------------------------------------------------------------------------------
+  void updateAttractors();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief hand m_attractors to the simulator (and the CPU backend's sphere buffer)
+  //----------------------------------------------------------------------------------------------------------------------
+  void uploadAttractors();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief hand a finished snapshot to m_checkpoints, never waits for the GPU
+  //----------------------------------------------------------------------------------------------------------------------
+  void collectSnapshot();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief draw a sphere at every attractor with one instanced call
+  /// @param [in] _mvp the global transform, the instance offsets are added in the shader
+  //----------------------------------------------------------------------------------------------------------------------
+  void drawAttractors(const ngl::Mat4 &_mvp);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief in a deterministic run the attractors move every this many steps, 800ms of 10ms steps
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t c_attractorSteps = 80;
   GLuint m_vao;
-  // Compute Shader Buffers
-  GLuint m_velocityBufferID;
-  GLuint m_positionBufferID;
-  GLuint m_attractorBufferID;
-  const size_t c_numParticles=1000000;
-  const size_t c_numAttractors=4;
-  int m_attractorUpdateTimer;
-  float m_dt=0.4f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief startup options
+  //----------------------------------------------------------------------------------------------------------------------
+  SimulationConfig m_config;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the active simulation backend
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<ParticleSimulator> m_simulator;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ring of vertex buffers the CPU backend writes its positions into for drawing
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<StreamingBuffer> m_cpuPositions;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the point drawing program, a ShaderVariantCache variant for the particle format
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_particleShader;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief GPU backend culling, builds the indirect draw of the visible particles. Null with culling off
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<GPUParticleCuller> m_culler;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief CPU backend culling, the visible indices of this frame. Empty with culling off
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint32_t> m_visible;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the instanced attractor sphere program
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_attractorShader;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the CPU backend has no attractor SSBO of its own so the spheres read this one, written only when
+  /// the attractors move
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<StreamingBuffer> m_cpuAttractors;
+  int m_attractorUpdateTimer=0;
   QElapsedTimer m_elapsedTimer;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief wall clock milliseconds not yet covered by a fixed step
+  //----------------------------------------------------------------------------------------------------------------------
+  double m_accumulator=0.0;
+  size_t m_stepCount=0;
+  float m_attractorPhase=0.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief GPU time of the simulation step, the particle draw and the attractor spheres
+  //----------------------------------------------------------------------------------------------------------------------
+  GPUTimer m_simulateTimer{"simulate"};
+  GPUTimer m_pointsTimer{"draw points"};
+  GPUTimer m_spheresTimer{"draw attractors"};
+  GPUTimer m_cullTimer{"cull"};
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the profiler summary is shown in the title bar, refreshed at most once a second
+  //----------------------------------------------------------------------------------------------------------------------
+  QElapsedTimer m_titleTimer;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with hot reload the shader files are checked for changes twice a second
+  //----------------------------------------------------------------------------------------------------------------------
+  QElapsedTimer m_reloadTimer;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief writes the snapshots taken every checkpointInterval steps (or on C) on its own thread
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<CheckpointWriter> m_checkpoints;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief steps the simulator with --sim-thread, null when paintGL steps it. Once it runs, the simulator,
+  /// m_attractors, m_visible, m_stepCount and m_checkpoints belong to that thread
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<SimulationThread> m_simThread;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the view the simulation thread culls against, the last one paintGL drew with
+  //----------------------------------------------------------------------------------------------------------------------
+  std::mutex m_cullMutex;
+  ngl::Mat4 m_cullMVP;
   std::vector<ngl::Vec3> m_attractors;
   ngl::Mat4 m_view;
   ngl::Mat4 m_projection;
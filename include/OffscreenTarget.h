@@ -0,0 +1,52 @@
+#ifndef OFFSCREENTARGET_H_
+#define OFFSCREENTARGET_H_
+#include <ngl/Types.h>
+#include <cstddef>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file OffscreenTarget.h
+/// @brief a framebuffer object to render into in place of a window
+/// @class OffscreenTarget
+/// @brief colour and depth renderbuffers, multisampled like the window's QSurfaceFormat when asked for. A
+/// multisampled target is resolved into a single sample colour buffer, that is what resolve binds for reading.
+//----------------------------------------------------------------------------------------------------------------------
+class OffscreenTarget
+{
+public:
+  OffscreenTarget()=default;
+  ~OffscreenTarget();
+  OffscreenTarget(const OffscreenTarget &)=delete;
+  OffscreenTarget &operator=(const OffscreenTarget &)=delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief (re)create the buffers
+  /// @param [in] _width,_height size in pixels
+  /// @param [in] _samples samples per pixel, 0 or 1 for none
+  /// @param [in] _colourFormat e.g. GL_RGBA8, or GL_RGBA16F to keep the additive blend above 1
+  /// @returns false and prints why if the framebuffer is incomplete
+  //----------------------------------------------------------------------------------------------------------------------
+  bool allocate(size_t _width, size_t _height, size_t _samples, GLenum _colourFormat);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief draw into the target, also sets the viewport
+  //----------------------------------------------------------------------------------------------------------------------
+  void bind() const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief resolve the samples and bind the result as GL_READ_FRAMEBUFFER for glReadPixels
+  //----------------------------------------------------------------------------------------------------------------------
+  void resolve() const;
+  size_t width() const { return m_width; }
+  size_t height() const { return m_height; }
+
+private:
+  void release();
+  GLuint m_framebuffer=0;
+  GLuint m_colour=0;
+  GLuint m_depth=0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the single sample copy of a multisampled target, 0 otherwise
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint m_resolveFramebuffer=0;
+  GLuint m_resolveColour=0;
+  size_t m_width=0;
+  size_t m_height=0;
+};
+
+#endif
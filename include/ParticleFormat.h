@@ -0,0 +1,132 @@
+#ifndef PARTICLEFORMAT_H_
+#define PARTICLEFORMAT_H_
+#include "SimulationConfig.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ParticleFormat.h
+/// @brief pack / unpack of the ParticleFormat::Compact buffer layout, the C++ twin of shaders/ParticleFormat.glsl.
+/// Full is a vec4 position (xyz, life in w) and a vec3 velocity at the std430 16 byte stride, 32 bytes per
+/// particle. Compact is 16 bytes :
+/// position uvec2 : x = x16 | y16 << 16, y = z16 | life8 << 16 (top 8 bits spare)
+///   x,y,z are 16 bit unorm over [-extent,extent], life is 8 bit unorm over [0,c_lifeScale]
+/// velocity uvec2 : x = half x | half y << 16, y = half z
+/// The encodes avoid a multiply followed by an add so no compiler can fuse them and round differently to GLSL.
+//----------------------------------------------------------------------------------------------------------------------
+namespace particleformat
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief life is at most 1.1 at startup (respawns are 0.99), must match LIFE_SCALE in ParticleFormat.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr float c_lifeScale = 1.1f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bytes of position (the vertex stream) and velocity per particle
+  //----------------------------------------------------------------------------------------------------------------------
+  inline size_t positionStride(ParticleFormat _format) { return _format == ParticleFormat::Compact ? 8 : 16; }
+  inline size_t velocityStride(ParticleFormat _format) { return _format == ParticleFormat::Compact ? 8 : 16; }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief IEEE binary16 conversion with round to nearest even, what packHalf2x16 does on current drivers
+  //----------------------------------------------------------------------------------------------------------------------
+  inline uint16_t floatToHalf(float _f)
+  {
+    uint32_t x;
+    std::memcpy(&x, &_f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t biased = (x >> 23) & 0xFFu;
+    uint32_t mantissa = x & 0x7FFFFFu;
+    if (biased == 0xFFu)
+    {
+      return static_cast<uint16_t>(sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u));
+    }
+    int32_t exponent = static_cast<int32_t>(biased) - 127 + 15;
+    if (exponent >= 31)
+    {
+      return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+    uint32_t shift = 13;
+    uint32_t half = 0;
+    if (exponent <= 0)
+    {
+      // subnormal half, shift the implicit bit down into the mantissa
+      if (exponent < -10)
+      {
+        return static_cast<uint16_t>(sign);
+      }
+      mantissa |= 0x800000u;
+      shift = static_cast<uint32_t>(14 - exponent);
+      half = mantissa >> shift;
+    }
+    else
+    {
+      half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> shift);
+    }
+    // a carry out of the mantissa correctly bumps the exponent
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t midpoint = 1u << (shift - 1);
+    if (rest > midpoint || (rest == midpoint && (half & 1u) != 0))
+    {
+      ++half;
+    }
+    return static_cast<uint16_t>(sign | half);
+  }
+  inline float halfToFloat(uint16_t _h)
+  {
+    uint32_t sign = static_cast<uint32_t>(_h & 0x8000u) << 16;
+    uint32_t exponent = (_h >> 10) & 0x1Fu;
+    uint32_t mantissa = _h & 0x3FFu;
+    if (exponent == 0)
+    {
+      float f = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+      return sign != 0 ? -f : f;
+    }
+    uint32_t bits = sign | (exponent == 31 ? 0x7F800000u : (exponent + 112) << 23) | (mantissa << 13);
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief quantise x,y,z and life, values outside the box are clamped to its faces
+  /// @param [in] _p x,y,z,life
+  /// @param [in] _extent the box is [-_extent,_extent] on each axis
+  /// @param [out] o_packed two words
+  //----------------------------------------------------------------------------------------------------------------------
+  inline void encodePosition(const float _p[4], float _extent, uint32_t o_packed[2])
+  {
+    uint32_t q[3];
+    for (size_t c = 0; c < 3; ++c)
+    {
+      float t = std::min(std::max((_p[c] + _extent) / (2.0f * _extent), 0.0f), 1.0f);
+      q[c] = static_cast<uint32_t>(std::nearbyint(t * 65535.0f));
+    }
+    float life = std::min(std::max(_p[3] / c_lifeScale, 0.0f), 1.0f);
+    uint32_t l = static_cast<uint32_t>(std::nearbyint(life * 255.0f));
+    o_packed[0] = q[0] | (q[1] << 16);
+    o_packed[1] = q[2] | (l << 16);
+  }
+  inline void decodePosition(const uint32_t _packed[2], float _extent, float o_p[4])
+  {
+    const float scale = 2.0f * _extent / 65535.0f;
+    o_p[0] = static_cast<float>(_packed[0] & 0xFFFFu) * scale - _extent;
+    o_p[1] = static_cast<float>(_packed[0] >> 16) * scale - _extent;
+    o_p[2] = static_cast<float>(_packed[1] & 0xFFFFu) * scale - _extent;
+    o_p[3] = static_cast<float>((_packed[1] >> 16) & 0xFFu) * (c_lifeScale / 255.0f);
+  }
+  inline void encodeVelocity(const float _v[3], uint32_t o_packed[2])
+  {
+    o_packed[0] = floatToHalf(_v[0]) | (static_cast<uint32_t>(floatToHalf(_v[1])) << 16);
+    o_packed[1] = floatToHalf(_v[2]);
+  }
+  inline void decodeVelocity(const uint32_t _packed[2], float o_v[3])
+  {
+    o_v[0] = halfToFloat(static_cast<uint16_t>(_packed[0] & 0xFFFFu));
+    o_v[1] = halfToFloat(static_cast<uint16_t>(_packed[0] >> 16));
+    o_v[2] = halfToFloat(static_cast<uint16_t>(_packed[1] & 0xFFFFu));
+  }
+} // end namespace particleformat
+
+#endif
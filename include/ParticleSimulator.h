@@ -0,0 +1,135 @@
+#ifndef PARTICLESIMULATOR_H_
+#define PARTICLESIMULATOR_H_
+#include <cstddef>
+#include <cstdint>
+class CheckpointReader;
+namespace checkpoint
+{
+  struct Frame;
+}
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ParticleSimulator.h
+/// @brief common interface for the particle backends, the GLSL compute shader and the multithreaded CPU version
+/// both implement the same step as shaders/ParticlesCompute.glsl so they can be swapped at startup.
+/// The interface deliberately has no GL or ngl types in it so the CPU backend can be built and run without
+/// a context (see the benchmark target).
+/// @class ParticleSimulator
+//----------------------------------------------------------------------------------------------------------------------
+class ParticleSimulator
+{
+public:
+  virtual ~ParticleSimulator() = default;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief allocate the particle state and fill it with the initial random distribution
+  /// @param [in] _numParticles the number of particles to simulate, ignored when a systems table gives the count
+  /// @param [in] _seed seed for the initial distribution
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void initialize(size_t _numParticles, uint32_t _seed) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief allocate the particle state from a checkpoint instead, the particle count, seed and step counter all
+  /// come from the file so the run carries on where it was saved. The attractors aren't touched, set them from
+  /// CheckpointReader::attractors
+  /// @returns false if a block of the file is corrupt, the state is then undefined so initialize again
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual bool restore(const CheckpointReader &_reader) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set the attractor positions
+  /// @param [in] _xyz tightly packed x,y,z triples (the same layout as a std::vector<ngl::Vec3>)
+  /// @param [in] _count the number of attractors
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void setAttractors(const float *_xyz, size_t _count) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief true when the backend moves the attractors itself along SimulationConfig::attractorPaths, the caller
+  /// then only sets their count and doesn't need to upload them again
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual bool animatedAttractors() const = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set the emitters, only used when SimulationConfig::numEmitters turned the lifecycle on. The pool then
+  /// starts empty, each step spawns emitRate particles into free slots spread over the emitters in turn and
+  /// expired particles go back to the free list instead of respawning in place
+  /// @param [in] _xyzr x,y,z and the spawn radius of each emitter
+  /// @param [in] _count the number of emitters
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void setEmitters(const float *_xyzr, size_t _count) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief spawn _count particles on top of the rate on the next step, as many as there are free slots
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void emitBurst(size_t _count) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief advance all particles by one step
+  /// @param [in] _dt the delta time, scaled by 100 inside the step exactly like the shader
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void step(float _dt) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief advance by _steps steps of _dt back to back, the result is the same as calling step _steps times
+  /// but backends can batch the work (one submission on the GPU, one pass over memory on the CPU)
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void advance(float _dt, size_t _steps)
+  {
+    for (size_t i = 0; i < _steps; ++i)
+    {
+      step(_dt);
+    }
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief block until all the work issued by step has completed, used for timing
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void finish() = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the number of particle slots, readPositions covers all of them and dead slots have a life of 0
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual size_t numParticles() const = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the number of live particles, numParticles() without the lifecycle. The GPU reads back a counter
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual size_t liveCount() = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief copy positions [_first,_first+_count) to the host, waits for any steps still in flight
+  /// @param [out] o_xyzw _count x,y,z,w quadruples
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual void readPositions(float *o_xyzw, size_t _first, size_t _count) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start taking a copy of the state as it is after the steps issued so far, for a CheckpointWriter. Only
+  /// one snapshot is in flight at a time
+  /// @returns false if the last one hasn't been collected with pollSnapshot yet
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual bool requestSnapshot() = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief collect the snapshot if it is ready, never waits. Everything but the attractors is filled in
+  /// @returns true when o_frame was written
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual bool pollSnapshot(checkpoint::Frame &o_frame) = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief FNV-1a hash of the position bits, two deterministic runs with the same seed, config and step count
+  /// give the same value
+  //----------------------------------------------------------------------------------------------------------------------
+  uint64_t positionChecksum();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bytes of particle state held by the backend (host memory for the CPU, buffer storage for the GPU)
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual size_t memoryFootprint() const = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a short name used in logs and benchmark output
+  //----------------------------------------------------------------------------------------------------------------------
+  virtual const char *name() const = 0;
+
+protected:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the start state of particle _index, drawn from Philox so every backend starts from the same bits.
+  /// Must match shaders/ParticlesInit.glsl
+  /// @param [out] o_position x,y,z in [-40,40) and life in [0.1,1.1)
+  /// @param [out] o_velocity x,y,z in [-0.499,0.501)
+  //----------------------------------------------------------------------------------------------------------------------
+  static void initialState(uint32_t _index, uint32_t _seed, float o_position[4], float o_velocity[3]);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the state of a particle emitted into slot _index on step _step. Must match the EMIT_PASS of
+  /// shaders/ParticleLifecycle.glsl
+  /// @param [in] _emitter x,y,z and spawn radius
+  /// @param [out] o_position within the radius of the emitter on each axis and life in [0.5,0.99)
+  /// @param [out] o_velocity x,y,z in [-0.5,0.5)
+  //----------------------------------------------------------------------------------------------------------------------
+  static void emittedState(uint32_t _index, uint32_t _step, uint32_t _seed, const float _emitter[4],
+                           float o_position[4], float o_velocity[3]);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PARTICLESYSTEMS_H_
+#define PARTICLESYSTEMS_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ParticleSystems.h
+/// @brief independent particle systems stepped as one batch, e.g. for parameter sweeps
+/// @class ParticleSystems
+/// @brief the systems share the particle and attractor buffers, system i owns a contiguous range of each. Its
+/// particle count is rounded up to c_align so a SIMD pack or cache line never straddles two systems. The
+/// table is uploaded as is for the BATCHED variant of ParticlesCompute.glsl.
+/// The file has one system per line, # starts a comment, the last three values are optional :
+///   particles attractors [k_v gauss decay]
+//----------------------------------------------------------------------------------------------------------------------
+class ParticleSystems
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief one system, the same std430 layout as the System struct in ParticlesCompute.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  struct System
+  {
+    uint32_t first;          ///< first particle
+    uint32_t count;          ///< number of particles, a multiple of c_align
+    uint32_t firstAttractor; ///< first attractor in the attractor array
+    uint32_t numAttractors;
+    float kV;    ///< speed the velocity is normalised to
+    float gauss; ///< falloff of the attractor force, exp(-distance^2/gauss)
+    float decay; ///< life lost per unit of scaled time
+    float pad;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the constants of the original kernel, what every particle uses without a table
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr float c_defaultKV = 1.5f;
+  static constexpr float c_defaultGauss = 10000.0f;
+  static constexpr float c_defaultDecay = 0.0001f;
+  static constexpr size_t c_align = 64;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief replace the systems with the ones in a file
+  /// @param [in] _path the file to read
+  /// @returns false and prints a message if the file can't be read or a line is malformed, the table is then
+  /// left empty
+  //----------------------------------------------------------------------------------------------------------------------
+  bool load(const std::string &_path);
+  bool empty() const { return m_systems.empty(); }
+  size_t numSystems() const { return m_systems.size(); }
+  const std::vector<System> &systems() const { return m_systems; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief totals over every system, the particle and attractor counts of the whole batch
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t numParticles() const { return m_numParticles; }
+  size_t numAttractors() const { return m_numAttractors; }
+
+private:
+  std::vector<System> m_systems;
+  size_t m_numParticles = 0;
+  size_t m_numAttractors = 0;
+};
+
+static_assert(sizeof(ParticleSystems::System) == 32, "System must match the std430 struct in ParticlesCompute.glsl");
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef PHILOX_H_
+#define PHILOX_H_
+#include "SimdMath.h"
+#include <array>
+#include <cstdint>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Philox.h
+/// @brief Philox4x32-7 counter based random numbers (Salmon et al. "Parallel random numbers: as easy as 1, 2, 3"),
+/// the C++ twin of shaders/Philox.glsl. There is no generator state, four random words are a pure function of a 128 bit counter and a 64 bit
+/// key. The particles use the key (seed, 0) and the counter (particle index, step, stream, 0) so any particle can
+/// draw its numbers for any step in any order, on any thread or backend, and always get the same bits. It is
+/// integer only (seven rounds of two 32x32 multiplies) so unlike the old sin() hash it is exact on every driver.
+//----------------------------------------------------------------------------------------------------------------------
+namespace philox
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the third counter word, separate streams for each use so they never share numbers.
+  /// Must match the STREAM_ defines in Philox.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  enum Stream : uint32_t
+  {
+    c_initPosition = 0, ///< x,y,z,life of the start state
+    c_initVelocity = 1, ///< x,y,z of the start velocity
+    c_step = 2,         ///< force noise and jitter each step
+    c_respawn = 3,      ///< new position of an expired particle
+    c_emitPosition = 4, ///< x,y,z offset from the emitter and life of an emitted particle
+    c_emitVelocity = 5  ///< x,y,z of the emitted velocity
+  };
+  constexpr uint32_t c_m0 = 0xD2511F53u;
+  constexpr uint32_t c_m1 = 0xCD9E8D57u;
+  constexpr uint32_t c_w0 = 0x9E3779B9u;
+  constexpr uint32_t c_w1 = 0xBB67AE85u;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief 7 rounds is the fewest the paper found to pass BigCrush, the usual 10 only adds margin we don't need
+  /// for particle noise and makes the CPU step in ComputeShadersBench about 1.5x slower. Must match PHILOX_ROUNDS
+  /// in Philox.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr int c_rounds = 7;
+
+  inline void mulHiLo(uint32_t _a, uint32_t _b, uint32_t &o_hi, uint32_t &o_lo)
+  {
+    uint64_t product = uint64_t(_a) * _b;
+    o_hi = static_cast<uint32_t>(product >> 32);
+    o_lo = static_cast<uint32_t>(product);
+  }
+  inline uint32_t wordXor(uint32_t _a, uint32_t _b) { return _a ^ _b; }
+  inline void splat(uint32_t _value, uint32_t &o_word) { o_word = _value; }
+  using simd::mulHiLo;
+  inline simd::NativeInt wordXor(simd::NativeInt _a, simd::NativeInt _b) { return simd::ixor(_a, _b); }
+  inline void splat(uint32_t _value, simd::NativeInt &o_word) { o_word = simd::iset(static_cast<int32_t>(_value)); }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the rounds, shared by the scalar (uint32_t) and SIMD (one counter per lane) versions
+  //----------------------------------------------------------------------------------------------------------------------
+  template <typename Word>
+  inline void rounds(Word &io_c0, Word &io_c1, Word &io_c2, Word &io_c3, uint32_t _k0, uint32_t _k1)
+  {
+    for (int r = 0; r < c_rounds; ++r)
+    {
+      Word hi0, lo0, hi1, lo1;
+      mulHiLo(io_c0, c_m0, hi0, lo0);
+      mulHiLo(io_c2, c_m1, hi1, lo1);
+      Word k0, k1;
+      splat(_k0, k0);
+      splat(_k1, k1);
+      io_c0 = wordXor(wordXor(hi1, io_c1), k0);
+      io_c1 = lo1;
+      io_c2 = wordXor(wordXor(hi0, io_c3), k1);
+      io_c3 = lo0;
+      _k0 += c_w0;
+      _k1 += c_w1;
+    }
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief four random words for one counter
+  //----------------------------------------------------------------------------------------------------------------------
+  inline std::array<uint32_t, 4> generate(uint32_t _index, uint32_t _step, uint32_t _stream, uint32_t _seed)
+  {
+    uint32_t c0 = _index;
+    uint32_t c1 = _step;
+    uint32_t c2 = _stream;
+    uint32_t c3 = 0;
+    rounds(c0, c1, c2, c3, _seed, 0);
+    return {{c0, c1, c2, c3}};
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the top 24 bits as a float in [0,1), exact so it is bit identical to the GLSL version
+  //----------------------------------------------------------------------------------------------------------------------
+  inline float uniform(uint32_t _word) { return static_cast<float>(_word >> 8) * (1.0f / 16777216.0f); }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the numbers for c_width consecutive particles, lane l gets the same words as generate(index + l, ...)
+  /// @param [in] _index the first counter word per lane, see laneIndices
+  /// @param [out] o_words the four random words per lane
+  //----------------------------------------------------------------------------------------------------------------------
+  inline void generate(simd::NativeInt _index, uint32_t _step, uint32_t _stream, uint32_t _seed,
+                       simd::NativeInt o_words[4])
+  {
+    o_words[0] = _index;
+    o_words[1] = simd::iset(static_cast<int32_t>(_step));
+    o_words[2] = simd::iset(static_cast<int32_t>(_stream));
+    o_words[3] = simd::iset(0);
+    rounds(o_words[0], o_words[1], o_words[2], o_words[3], _seed, 0);
+  }
+  inline simd::Float uniform(simd::NativeInt _word)
+  {
+    // the shifted value fits in 24 bits so the signed conversion is exact
+    return simd::toFloat(simd::isrl(_word, 8)) * simd::Float(1.0f / 16777216.0f);
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particle indices _first, _first+1 ... _first+c_width-1 as the first counter word
+  //----------------------------------------------------------------------------------------------------------------------
+  inline simd::NativeInt laneIndices(size_t _first)
+  {
+    return simd::iadd(simd::iset(static_cast<int32_t>(static_cast<uint32_t>(_first))), simd::iramp());
+  }
+} // end namespace philox
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Profiler.h
+/// @brief low overhead timing of CPU scopes (and GPU queries, see GPUTimer) with Chrome trace export
+/// @class Profiler
+/// @brief recording a sample is a push into a lock free ring, nothing is formatted or written on the calling
+/// thread. A writer thread drains the ring, appends the samples to a Chrome trace_event JSON file (load it in
+/// chrome://tracing or ui.perfetto.dev) and keeps a rolling per scope average that is printed every couple of
+/// seconds and available from summary(). Like ngl::ShaderLib everything is static. Until start() is called
+/// recording is a no-op so the scopes can stay in the code.
+//----------------------------------------------------------------------------------------------------------------------
+class Profiler
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief which timeline a sample is drawn on
+  //----------------------------------------------------------------------------------------------------------------------
+  enum class Track : uint8_t
+  {
+    CPU,
+    GPU
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start the writer thread
+  /// @param [in] _tracePath the Chrome trace file to write, empty to only keep the summary
+  /// @param [in] _printSummary print the rolling summary to stdout
+  //----------------------------------------------------------------------------------------------------------------------
+  static void start(const std::string &_tracePath, bool _printSummary);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief drain the ring, finish the trace file and join the writer
+  //----------------------------------------------------------------------------------------------------------------------
+  static void stop();
+  static bool enabled();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief nanoseconds on the profiler clock
+  //----------------------------------------------------------------------------------------------------------------------
+  static uint64_t now();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief record a finished sample, dropped if the ring is full
+  /// @param [in] _name must outlive the profiler, use string literals
+  /// @param [in] _startNs start on the now() clock
+  /// @param [in] _durationNs length of the sample
+  /// @param [in] _track CPU samples go on the calling thread's timeline, GPU samples on a GPU timeline
+  //----------------------------------------------------------------------------------------------------------------------
+  static void record(const char *_name, uint64_t _startNs, uint64_t _durationNs, Track _track = Track::CPU);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the latest rolling summary, average ms per scope over the last interval
+  //----------------------------------------------------------------------------------------------------------------------
+  static std::string summary();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief samples lost because the ring was full
+  //----------------------------------------------------------------------------------------------------------------------
+  static size_t dropped();
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class ProfileScope
+/// @brief RAII CPU sample covering the lifetime of the object, use PROFILE_SCOPE("name")
+//----------------------------------------------------------------------------------------------------------------------
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char *_name) : m_name(_name), m_start(Profiler::enabled() ? Profiler::now() : 0) {}
+  ~ProfileScope()
+  {
+    // m_start is 0 if the profiler was started inside the scope
+    if (m_start != 0 && Profiler::enabled())
+    {
+      Profiler::record(m_name, m_start, Profiler::now() - m_start);
+    }
+  }
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  const char *m_name;
+  uint64_t m_start;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#endif
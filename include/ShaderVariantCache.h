@@ -0,0 +1,80 @@
+#ifndef SHADERVARIANTCACHE_H_
+#define SHADERVARIANTCACHE_H_
+#include <ngl/ShaderLib.h>
+#include <string>
+#include <utility>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShaderVariantCache.h
+/// @brief builds specialised versions of a shader by injecting #defines after the #version line and expanding
+/// #include "file" lines
+/// @class ShaderVariantCache
+/// @brief each unique (stages, defines) combination is compiled and linked once into an ngl::ShaderLib program
+/// whose name encodes the key, later requests just return the existing name. Like ngl::ShaderLib everything
+/// is static as there is only ever one GL context.
+/// With setBinaryCache the linked programs are also saved with glGetProgramBinary, one file per program key
+/// stamped with a hash of the final sources (defines and #includes expanded) and the driver vendor, renderer
+/// and version strings, so the next start loads them with glProgramBinary instead of compiling. A file whose
+/// stamp no longer matches, or that the driver rejects, is removed and the program rebuilt from source and saved
+/// in its place, so edits and driver updates never leave dead files behind. reloadChanged rebuilds the programs whose files were edited in place, keeping the
+/// ngl name and GL id so the callers never notice.
+//----------------------------------------------------------------------------------------------------------------------
+class ShaderVariantCache
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a list of NAME VALUE pairs turned into #define NAME VALUE
+  //----------------------------------------------------------------------------------------------------------------------
+  using Defines = std::vector<std::pair<std::string, std::string>>;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief one shader stage of a program
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stage
+  {
+    ngl::ShaderType type;
+    std::string path;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief get (building if needed) the program for these stages and defines
+  /// @param [in] _stages the shader files making up the program
+  /// @param [in] _defines the defines injected into every stage
+  /// @param [out] o_name the ngl::ShaderLib program name to pass to use / setUniform, empty on failure
+  /// @returns false if compile or link failed, the log has been printed and o_name must not be used
+  //----------------------------------------------------------------------------------------------------------------------
+  static bool program(const std::vector<Stage> &_stages, const Defines &_defines, std::string &o_name);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief convenience for single stage compute programs
+  //----------------------------------------------------------------------------------------------------------------------
+  static bool compute(const std::string &_path, const Defines &_defines, std::string &o_name);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief insert the defines after the #version line of _source
+  //----------------------------------------------------------------------------------------------------------------------
+  static std::string injectDefines(const std::string &_source, const Defines &_defines);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief replace each #include "file" line with the contents of file (relative to _directory), GLSL has no
+  /// include of its own. Included files should have their own #ifndef guard.
+  /// @param [out] o_files if not null every file pulled in is appended to it
+  //----------------------------------------------------------------------------------------------------------------------
+  static std::string resolveIncludes(const std::string &_source, const std::string &_directory, int _depth = 0,
+                                     std::vector<std::string> *o_files = nullptr);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief load a text file, empty string if it can't be opened
+  //----------------------------------------------------------------------------------------------------------------------
+  static std::string loadFile(const std::string &_path);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief keep the program binaries in _directory (created on the first save), empty turns the cache off.
+  /// Files left by an older version of the cache are removed. Set before the first program is built, the context
+  /// must be current
+  //----------------------------------------------------------------------------------------------------------------------
+  static void setBinaryCache(const std::string &_directory);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief rebuild every program one of whose files (stages or #includes) changed since it was built. A
+  /// program whose new source fails to compile or link keeps running the old one. Relinking resets the
+  /// uniforms so callers must set them before each use, as they all do. Call between frames with the context
+  /// current
+  /// @returns the number of programs swapped
+  //----------------------------------------------------------------------------------------------------------------------
+  static size_t reloadChanged();
+};
+
+#endif
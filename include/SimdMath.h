@@ -0,0 +1,331 @@
+#ifndef SIMDMATH_H_
+#define SIMDMATH_H_
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+#include <vector>
+// SIMD_SCALAR forces the scalar path even where SSE2 / AVX2 are available, so it can be built and checked on x86
+#if !defined(SIMD_SCALAR) && defined(__AVX2__)
+#define SIMD_AVX2
+#elif !defined(SIMD_SCALAR) && defined(__SSE2__)
+#define SIMD_SSE2
+#endif
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+#include <immintrin.h>
+#endif
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SimdMath.h
+/// @brief a very small SIMD wrapper used by the CPU simulation backend. It picks AVX2 (8 wide), SSE2 (4 wide)
+/// or plain scalar code at compile time so the same kernel source can be used on every target.
+/// The transcendental functions are the Cephes style approximations, they are accurate to a few ulp in the
+/// ranges the particle kernel uses which is more than enough to mirror the GLSL builtins.
+//----------------------------------------------------------------------------------------------------------------------
+namespace simd
+{
+#if defined(SIMD_AVX2)
+  constexpr size_t c_width = 8;
+  using NativeFloat = __m256;
+  using NativeInt   = __m256i;
+#elif defined(SIMD_SSE2)
+  constexpr size_t c_width = 4;
+  using NativeFloat = __m128;
+  using NativeInt   = __m128i;
+#else
+  constexpr size_t c_width = 1;
+  using NativeFloat = float;
+  using NativeInt   = int32_t;
+#endif
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief alignment used for all SoA particle arrays, a cache line so chunks never share lines between threads
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr size_t c_alignment = 64;
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a pack of c_width floats, comparison results are also returned as a Float (all bits set per lane)
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Float
+  {
+    NativeFloat v;
+    Float() = default;
+#if defined(SIMD_AVX2)
+    Float(NativeFloat _v) : v(_v) {}
+    Float(float _s) : v(_mm256_set1_ps(_s)) {}
+    static Float load(const float *_p) { return _mm256_loadu_ps(_p); }
+    void store(float *_p) const { _mm256_storeu_ps(_p, v); }
+#elif defined(SIMD_SSE2)
+    Float(NativeFloat _v) : v(_v) {}
+    Float(float _s) : v(_mm_set1_ps(_s)) {}
+    static Float load(const float *_p) { return _mm_loadu_ps(_p); }
+    void store(float *_p) const { _mm_storeu_ps(_p, v); }
+#else
+    // NativeFloat is float here, one constructor covers both
+    Float(float _s) : v(_s) {}
+    static Float load(const float *_p) { return *_p; }
+    void store(float *_p) const { *_p = v; }
+#endif
+  };
+
+#if defined(SIMD_AVX2)
+  inline Float operator+(Float _a, Float _b) { return _mm256_add_ps(_a.v, _b.v); }
+  inline Float operator-(Float _a, Float _b) { return _mm256_sub_ps(_a.v, _b.v); }
+  inline Float operator*(Float _a, Float _b) { return _mm256_mul_ps(_a.v, _b.v); }
+  inline Float operator/(Float _a, Float _b) { return _mm256_div_ps(_a.v, _b.v); }
+  inline Float operator-(Float _a) { return _mm256_xor_ps(_a.v, _mm256_set1_ps(-0.0f)); }
+  inline Float sqrt(Float _a) { return _mm256_sqrt_ps(_a.v); }
+  inline Float min(Float _a, Float _b) { return _mm256_min_ps(_a.v, _b.v); }
+  inline Float max(Float _a, Float _b) { return _mm256_max_ps(_a.v, _b.v); }
+  inline Float floor(Float _a) { return _mm256_floor_ps(_a.v); }
+  inline Float abs(Float _a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _a.v); }
+  inline Float lessEqual(Float _a, Float _b) { return _mm256_cmp_ps(_a.v, _b.v, _CMP_LE_OQ); }
+  inline Float less(Float _a, Float _b) { return _mm256_cmp_ps(_a.v, _b.v, _CMP_LT_OQ); }
+  /// @brief per lane _mask ? _a : _b
+  inline Float select(Float _mask, Float _a, Float _b) { return _mm256_blendv_ps(_b.v, _a.v, _mask.v); }
+  inline bool any(Float _mask) { return _mm256_movemask_ps(_mask.v) != 0; }
+  inline uint32_t maskBits(Float _mask) { return static_cast<uint32_t>(_mm256_movemask_ps(_mask.v)); }
+  inline NativeInt toInt(Float _a) { return _mm256_cvttps_epi32(_a.v); }
+  inline Float toFloat(NativeInt _i) { return _mm256_cvtepi32_ps(_i); }
+  inline NativeInt iadd(NativeInt _a, NativeInt _b) { return _mm256_add_epi32(_a, _b); }
+  inline NativeInt iand(NativeInt _a, int32_t _b) { return _mm256_and_si256(_a, _mm256_set1_epi32(_b)); }
+  inline NativeInt iset(int32_t _a) { return _mm256_set1_epi32(_a); }
+  inline NativeInt ishl(NativeInt _a, int _b) { return _mm256_slli_epi32(_a, _b); }
+  inline Float ieqMask(NativeInt _a, int32_t _b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_a, _mm256_set1_epi32(_b))); }
+  inline Float bitsToFloat(NativeInt _i) { return _mm256_castsi256_ps(_i); }
+  inline Float maskAnd(Float _a, Float _b) { return _mm256_and_ps(_a.v, _b.v); }
+  inline Float maskXor(Float _a, Float _b) { return _mm256_xor_ps(_a.v, _b.v); }
+  inline NativeInt ixor(NativeInt _a, NativeInt _b) { return _mm256_xor_si256(_a, _b); }
+  inline NativeInt isrl(NativeInt _a, int _b) { return _mm256_srli_epi32(_a, _b); }
+  inline NativeInt iramp() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+  /// @brief full 32x32 -> 64 bit unsigned product of each lane with _b split into the high and low words
+  inline void mulHiLo(NativeInt _a, uint32_t _b, NativeInt &o_hi, NativeInt &o_lo)
+  {
+    // mul_epu32 only multiplies the even lanes, so do the odd lanes shifted down and recombine
+    NativeInt b = _mm256_set1_epi32(static_cast<int32_t>(_b));
+    NativeInt even = _mm256_mul_epu32(_a, b);
+    NativeInt odd = _mm256_mul_epu32(_mm256_srli_epi64(_a, 32), b);
+    o_lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    o_hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+  }
+#elif defined(SIMD_SSE2)
+  inline Float operator+(Float _a, Float _b) { return _mm_add_ps(_a.v, _b.v); }
+  inline Float operator-(Float _a, Float _b) { return _mm_sub_ps(_a.v, _b.v); }
+  inline Float operator*(Float _a, Float _b) { return _mm_mul_ps(_a.v, _b.v); }
+  inline Float operator/(Float _a, Float _b) { return _mm_div_ps(_a.v, _b.v); }
+  inline Float operator-(Float _a) { return _mm_xor_ps(_a.v, _mm_set1_ps(-0.0f)); }
+  inline Float sqrt(Float _a) { return _mm_sqrt_ps(_a.v); }
+  inline Float min(Float _a, Float _b) { return _mm_min_ps(_a.v, _b.v); }
+  inline Float max(Float _a, Float _b) { return _mm_max_ps(_a.v, _b.v); }
+  inline Float abs(Float _a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), _a.v); }
+  inline Float lessEqual(Float _a, Float _b) { return _mm_cmple_ps(_a.v, _b.v); }
+  inline Float less(Float _a, Float _b) { return _mm_cmplt_ps(_a.v, _b.v); }
+  inline Float select(Float _mask, Float _a, Float _b)
+  {
+    return _mm_or_ps(_mm_and_ps(_mask.v, _a.v), _mm_andnot_ps(_mask.v, _b.v));
+  }
+  inline bool any(Float _mask) { return _mm_movemask_ps(_mask.v) != 0; }
+  inline uint32_t maskBits(Float _mask) { return static_cast<uint32_t>(_mm_movemask_ps(_mask.v)); }
+  inline NativeInt toInt(Float _a) { return _mm_cvttps_epi32(_a.v); }
+  inline Float toFloat(NativeInt _i) { return _mm_cvtepi32_ps(_i); }
+  inline Float floor(Float _a)
+  {
+    // SSE2 has no round instruction so truncate and fix up the negative values
+    Float t = toFloat(toInt(_a));
+    return t - _mm_and_ps(_mm_cmpgt_ps(t.v, _a.v), _mm_set1_ps(1.0f));
+  }
+  inline NativeInt iadd(NativeInt _a, NativeInt _b) { return _mm_add_epi32(_a, _b); }
+  inline NativeInt iand(NativeInt _a, int32_t _b) { return _mm_and_si128(_a, _mm_set1_epi32(_b)); }
+  inline NativeInt iset(int32_t _a) { return _mm_set1_epi32(_a); }
+  inline NativeInt ishl(NativeInt _a, int _b) { return _mm_slli_epi32(_a, _b); }
+  inline Float ieqMask(NativeInt _a, int32_t _b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(_a, _mm_set1_epi32(_b))); }
+  inline Float bitsToFloat(NativeInt _i) { return _mm_castsi128_ps(_i); }
+  inline Float maskAnd(Float _a, Float _b) { return _mm_and_ps(_a.v, _b.v); }
+  inline Float maskXor(Float _a, Float _b) { return _mm_xor_ps(_a.v, _b.v); }
+  inline NativeInt ixor(NativeInt _a, NativeInt _b) { return _mm_xor_si128(_a, _b); }
+  inline NativeInt isrl(NativeInt _a, int _b) { return _mm_srli_epi32(_a, _b); }
+  inline NativeInt iramp() { return _mm_setr_epi32(0, 1, 2, 3); }
+  inline void mulHiLo(NativeInt _a, uint32_t _b, NativeInt &o_hi, NativeInt &o_lo)
+  {
+    // no blend before SSE4.1 so mask the halves of the 64 bit products together
+    NativeInt b = _mm_set1_epi32(static_cast<int32_t>(_b));
+    NativeInt even = _mm_mul_epu32(_a, b);
+    NativeInt odd = _mm_mul_epu32(_mm_srli_epi64(_a, 32), b);
+    NativeInt lowWords = _mm_set_epi32(0, -1, 0, -1);
+    o_lo = _mm_or_si128(_mm_and_si128(even, lowWords), _mm_slli_epi64(odd, 32));
+    o_hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(lowWords, odd));
+  }
+#endif
+
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief e^x, range reduction to 2^n * e^r then a degree 5 polynomial
+  //----------------------------------------------------------------------------------------------------------------------
+  inline Float exp(Float _x)
+  {
+    Float x = min(max(_x, Float(-87.3f)), Float(88.3f));
+    Float n = floor(x * Float(1.44269504088896341f) + Float(0.5f));
+    x = x - n * Float(0.693359375f);
+    x = x - n * Float(-2.12194440e-4f);
+    Float z = x * x;
+    Float y = Float(1.9875691500E-4f);
+    y = y * x + Float(1.3981999507E-3f);
+    y = y * x + Float(8.3334519073E-3f);
+    y = y * x + Float(4.1665795894E-2f);
+    y = y * x + Float(1.6666665459E-1f);
+    y = y * x + Float(5.0000001201E-1f);
+    y = y * z + x + Float(1.0f);
+    // build 2^n directly in the exponent bits
+    Float pow2n = bitsToFloat(ishl(iadd(toInt(n), iset(127)), 23));
+    return y * pow2n;
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sin(x) using the Cephes octant reduction, good for |x| up to a few thousand which covers the hash use
+  //----------------------------------------------------------------------------------------------------------------------
+  inline Float sin(Float _x)
+  {
+    Float signBit = maskAnd(_x, Float(-0.0f));
+    Float x = abs(_x);
+    NativeInt j = toInt(x * Float(1.27323954473516f));
+    j = iand(iadd(j, iset(1)), ~1);
+    Float y = toFloat(j);
+    // octants 4-7 flip the sign, octants 2,3,6,7 use the cosine polynomial
+    signBit = maskXor(signBit, bitsToFloat(ishl(iand(j, 4), 29)));
+    Float polyMask = ieqMask(iand(j, 2), 2);
+    x = ((x - y * Float(0.78515625f)) - y * Float(2.4187564849853515625e-4f)) - y * Float(3.77489497744594108e-8f);
+    Float z = x * x;
+    Float c = Float(2.443315711809948E-005f);
+    c = c * z - Float(1.388731625493765E-003f);
+    c = c * z + Float(4.166664568298827E-002f);
+    c = c * z * z - z * Float(0.5f) + Float(1.0f);
+    Float s = Float(-1.9515295891E-4f);
+    s = s * z + Float(8.3321608736E-3f);
+    s = s * z - Float(1.6666654611E-1f);
+    s = s * z * x + x;
+    return maskXor(select(polyMask, c, s), signBit);
+  }
+#else
+  inline Float operator+(Float _a, Float _b) { return _a.v + _b.v; }
+  inline Float operator-(Float _a, Float _b) { return _a.v - _b.v; }
+  inline Float operator*(Float _a, Float _b) { return _a.v * _b.v; }
+  inline Float operator/(Float _a, Float _b) { return _a.v / _b.v; }
+  inline Float operator-(Float _a) { return -_a.v; }
+  inline Float sqrt(Float _a) { return std::sqrt(_a.v); }
+  inline Float min(Float _a, Float _b) { return _a.v < _b.v ? _a.v : _b.v; }
+  inline Float max(Float _a, Float _b) { return _a.v > _b.v ? _a.v : _b.v; }
+  inline Float floor(Float _a) { return std::floor(_a.v); }
+  inline Float abs(Float _a) { return std::fabs(_a.v); }
+  inline Float exp(Float _a) { return std::exp(_a.v); }
+  inline Float sin(Float _a) { return std::sin(_a.v); }
+  // masks in the scalar path are 1.0f / 0.0f
+  inline Float lessEqual(Float _a, Float _b) { return _a.v <= _b.v ? 1.0f : 0.0f; }
+  inline Float less(Float _a, Float _b) { return _a.v < _b.v ? 1.0f : 0.0f; }
+  inline Float select(Float _mask, Float _a, Float _b) { return _mask.v != 0.0f ? _a : _b; }
+  inline bool any(Float _mask) { return _mask.v != 0.0f; }
+  inline uint32_t maskBits(Float _mask) { return _mask.v != 0.0f ? 1u : 0u; }
+  inline Float maskAnd(Float _a, Float _b) { return _a.v != 0.0f && _b.v != 0.0f ? 1.0f : 0.0f; }
+  inline Float toFloat(NativeInt _i) { return static_cast<float>(_i); }
+  inline NativeInt iadd(NativeInt _a, NativeInt _b)
+  {
+    return static_cast<NativeInt>(static_cast<uint32_t>(_a) + static_cast<uint32_t>(_b));
+  }
+  inline NativeInt iset(int32_t _a) { return _a; }
+  inline NativeInt ixor(NativeInt _a, NativeInt _b) { return _a ^ _b; }
+  inline NativeInt isrl(NativeInt _a, int _b) { return static_cast<NativeInt>(static_cast<uint32_t>(_a) >> _b); }
+  inline NativeInt iramp() { return 0; }
+  inline void mulHiLo(NativeInt _a, uint32_t _b, NativeInt &o_hi, NativeInt &o_lo)
+  {
+    uint64_t product = uint64_t(static_cast<uint32_t>(_a)) * _b;
+    o_hi = static_cast<NativeInt>(product >> 32);
+    o_lo = static_cast<NativeInt>(product);
+  }
+#endif
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief GLSL style helpers built on the primitives above
+  //----------------------------------------------------------------------------------------------------------------------
+  inline Float fract(Float _a) { return _a - floor(_a); }
+  inline Float dot(Float _ax, Float _ay, Float _az, Float _bx, Float _by, Float _bz)
+  {
+    return _ax * _bx + _ay * _by + _az * _bz;
+  }
+  inline float horizontalAdd(Float _a)
+  {
+    alignas(c_alignment) float lanes[c_width];
+    _a.store(lanes);
+    float sum = 0.0f;
+    for (size_t i = 0; i < c_width; ++i)
+    {
+      sum += lanes[i];
+    }
+    return sum;
+  }
+  inline void normalize(Float &io_x, Float &io_y, Float &io_z)
+  {
+    Float inv = Float(1.0f) / sqrt(dot(io_x, io_y, io_z, io_x, io_y, io_z));
+    io_x = io_x * inv;
+    io_y = io_y * inv;
+    io_z = io_z * inv;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief minimal aligned allocator so std::vector can hold the SoA particle streams
+  //----------------------------------------------------------------------------------------------------------------------
+  template <typename T>
+  struct AlignedAllocator
+  {
+    using value_type = T;
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U> &) {}
+    T *allocate(size_t _n)
+    {
+      size_t bytes = (_n * sizeof(T) + c_alignment - 1) / c_alignment * c_alignment;
+#if defined(_WIN32)
+      void *p = _aligned_malloc(bytes, c_alignment);
+#else
+      void *p = std::aligned_alloc(c_alignment, bytes);
+#endif
+      if (p == nullptr)
+      {
+        throw std::bad_alloc();
+      }
+      return static_cast<T *>(p);
+    }
+    void deallocate(T *_p, size_t)
+    {
+#if defined(_WIN32)
+      _aligned_free(_p);
+#else
+      std::free(_p);
+#endif
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief resize() default initialises rather than zero filling, so a large stream isn't written once on the
+    /// calling thread before the parallel fill, and each page is first touched by the thread that fills it
+    //----------------------------------------------------------------------------------------------------------------------
+    template <typename U>
+    void construct(U *_p) noexcept
+    {
+      ::new (static_cast<void *>(_p)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U *_p, Args &&..._args)
+    {
+      ::new (static_cast<void *>(_p)) U(std::forward<Args>(_args)...);
+    }
+    template <typename U>
+    bool operator==(const AlignedAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U> &) const { return false; }
+  };
+
+  template <typename T>
+  using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+} // end namespace simd
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef SIMULATIONCONFIG_H_
+#define SIMULATIONCONFIG_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SimulationConfig.h
+/// @brief startup options for the simulation, filled in from the command line
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief which simulator implementation to use
+//----------------------------------------------------------------------------------------------------------------------
+enum class SimulatorBackend
+{
+  GPU,
+  CPU
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how the attractor force is evaluated
+/// Summed : the original kernel, all attractors are added into one force point
+/// Tiled : every attractor applies its own force, attractors are streamed through shared memory (GPU) or L1
+/// sized tiles (CPU) so thousands of attractors are practical
+/// Grid : the Tiled field is baked into a 3D grid (a texture on the GPU) when the attractors change and
+/// particles sample it with trilinear filtering, the cost no longer depends on the attractor count
+//----------------------------------------------------------------------------------------------------------------------
+enum class ForceMode
+{
+  Summed,
+  Tiled,
+  Grid
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how the GPU backend fills the particle buffers at startup
+/// Compute : a compute pass writes the start state straight into the buffers, nothing is staged on the host
+/// Mapped : the immutable buffers are mapped and filled in parallel on the CPU, no intermediate copy
+//----------------------------------------------------------------------------------------------------------------------
+enum class InitMode
+{
+  Compute,
+  Mapped
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief storage of the GPU particle buffers and the vertex stream, see ParticleFormat.h
+/// Full : vec4 position + life and a vec3 velocity, 32 bytes per particle
+/// Compact : 16 bit quantised position, 8 bit life and half float velocity, 16 bytes per particle
+//----------------------------------------------------------------------------------------------------------------------
+enum class ParticleFormat
+{
+  Full,
+  Compact
+};
+
+struct SimulationConfig
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the backend used to step the particles
+  //----------------------------------------------------------------------------------------------------------------------
+  SimulatorBackend backend = SimulatorBackend::GPU;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief number of particles to simulate
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t numParticles = 1000000;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief number of attractors
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t numAttractors = 4;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief number of particle emitters, 0 keeps every particle alive and respawns expired ones in place.
+  /// Otherwise numParticles is the pool size, it starts empty and emitters spawn into free slots
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t numEmitters = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particles spawned per step over all the emitters
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t emitRate = 2000;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief how the attractor forces are evaluated
+  //----------------------------------------------------------------------------------------------------------------------
+  ForceMode forceMode = ForceMode::Summed;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief how the GPU buffers are initialised, both give the same start state as the CPU backend
+  //----------------------------------------------------------------------------------------------------------------------
+  InitMode initMode = InitMode::Compute;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief layout of the particle buffers, Compact halves the memory traffic of every step and draw
+  //----------------------------------------------------------------------------------------------------------------------
+  ParticleFormat particleFormat = ParticleFormat::Full;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ParticleFormat::Compact positions cover [-positionExtent,positionExtent] on each axis, the step is
+  /// 2*positionExtent/65535 and particles outside are clamped to the box
+  //----------------------------------------------------------------------------------------------------------------------
+  float positionExtent = 128.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief draw only the particles inside the view frustum (and alive), compacted into an index list each
+  /// frame and drawn indirectly
+  //----------------------------------------------------------------------------------------------------------------------
+  bool cull = true;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief beyond this view distance particles are thinned out, a fraction (lodDistance/distance)^2 is kept
+  /// so the screen density stays about constant. Which ones is a fixed function of the index so the
+  /// selection doesn't flicker. 0 keeps everything
+  //----------------------------------------------------------------------------------------------------------------------
+  float lodDistance = 0.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief cells per side of the ForceMode::Grid field
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t gridResolution = 64;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the grid covers [-gridExtent,gridExtent] on each axis, particles outside get the edge value
+  //----------------------------------------------------------------------------------------------------------------------
+  float gridExtent = 60.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particles closer than this push each other apart, found with a uniform grid of cells this size.
+  /// 0 turns the particle / particle pass off
+  //----------------------------------------------------------------------------------------------------------------------
+  float neighborRadius = 0.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief strength of the neighbour force, negative values pull neighbours together (cohesion)
+  //----------------------------------------------------------------------------------------------------------------------
+  float separation = 0.1f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sort the particle slots into Morton order over the positionExtent box every this many steps so
+  /// particles close in space are close in memory, 0 never reorders
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t reorderInterval = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief compute shader local_size_x, each value gets its own shader variant
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t workgroupSize = 128;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief number of threads for the CPU backend, 0 uses all hardware threads
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t numThreads = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief seed for the initial particle distribution
+  //----------------------------------------------------------------------------------------------------------------------
+  uint32_t seed = 1234;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief wall clock milliseconds covered by one fixed simulation step, the step dt is stepMs / 60 (the
+  /// original elapsed()/60)
+  //----------------------------------------------------------------------------------------------------------------------
+  float stepMs = 10.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief most fixed steps run for one rendered frame, after a hitch the rest of the backlog is dropped
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t maxSubsteps = 4;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ignore the wall clock, run exactly one fixed step per frame and move the attractors every
+  /// c_attractorSteps steps from the seed so the same seed and step count give the same state
+  //----------------------------------------------------------------------------------------------------------------------
+  bool deterministic = false;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a file of attractor paths (see AttractorPaths.h), the simulators then move the attractors along them
+  /// every step on their own. Empty keeps the host driven attractors
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string attractorPaths;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a table of independent particle systems (see ParticleSystems.h) stepped together in one pass, their
+  /// totals replace numParticles and numAttractors. Empty runs a single system
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string particleSystems;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief print the position checksum and quit after this many steps, 0 runs until closed
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t stopAfter = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write a Chrome trace_event file of the profiler samples here, empty for no trace
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string traceFile;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief directory of the linked program binaries ShaderVariantCache loads on the next start instead of
+  /// compiling, empty always compiles from source
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string shaderCache = "shadercache";
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief watch the shader files and rebuild the programs that change between frames
+  //----------------------------------------------------------------------------------------------------------------------
+  bool hotReload = false;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief step the simulation on a thread of its own (see SimulationThread) rather than from paintGL, so the
+  /// window and the simulation run at their own rates. CPU backend only
+  //----------------------------------------------------------------------------------------------------------------------
+  bool simThread = false;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write the particle state to checkpointDir every this many steps (see CheckpointWriter), 0 never does
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t checkpointInterval = 0;
+  std::string checkpointDir = "checkpoints";
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief deflate the checkpoint streams, slower to write but noticeably smaller
+  //----------------------------------------------------------------------------------------------------------------------
+  bool checkpointCompress = false;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a checkpoint to start from, its particle count and seed replace numParticles and seed. Empty starts
+  /// from the seed
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string loadCheckpoint;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particles per chunk of the out of core mode, 0 keeps every particle resident. The GPU backend keeps
+  /// the state in host memory and streams chunks this size through a few device buffers, the CPU backend pins
+  /// its threads and always gives a thread the same slice of each chunk
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t streamChunk = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief with streamChunk the GPU host state is mapped from this file so it can outgrow RAM, empty keeps it in
+  /// anonymous memory
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string stateFile;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief parse the options listed by printUsage, unknown options are left for the caller
+  /// @param [in] _argc argument count
+  /// @param [in] _argv arguments
+  /// @returns false and prints a message if an option has a bad value
+  //----------------------------------------------------------------------------------------------------------------------
+  bool parse(int _argc, char **_argv);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief load options from a text file, one "name value" pair per line using the command line names
+  /// without the leading -- (e.g. particles 5e6), # starts a comment
+  /// @param [in] _path the file to read
+  /// @returns false if the file can't be read or has a bad value
+  //----------------------------------------------------------------------------------------------------------------------
+  bool loadFile(const std::string &_path);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief print the supported options
+  //----------------------------------------------------------------------------------------------------------------------
+  static void printUsage(const char *_program);
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief convert a backend to the string used on the command line
+//----------------------------------------------------------------------------------------------------------------------
+const char *toString(SimulatorBackend _backend);
+const char *toString(ForceMode _mode);
+const char *toString(InitMode _mode);
+const char *toString(ParticleFormat _format);
+
+#endif
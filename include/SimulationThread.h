@@ -0,0 +1,106 @@
+#ifndef SIMULATIONTHREAD_H_
+#define SIMULATIONTHREAD_H_
+#include "SimulationConfig.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SimulationThread.h
+/// @brief runs the fixed step loop on a thread of its own so the window never holds up the simulation
+/// @class SimulationThread
+/// @brief banks the wall clock time and spends it in whole steps of stepMs, at most maxSubsteps at a time, the
+/// same loop paintGL runs otherwise (a deterministic run just steps as fast as it can). After every batch the
+/// publish function fills the back frame of a triple buffer and it becomes the newest frame. The render thread
+/// takes the newest frame with acquire, the two threads never share a frame and never wait for each other, so a
+/// slow frame or a window resize no longer stalls the simulation. Anything else that has to touch the simulator,
+/// a key press or the attractor timer, is posted and runs on the simulation thread between two batches.
+//----------------------------------------------------------------------------------------------------------------------
+class SimulationThread
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief what the render thread draws, filled on the simulation thread
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Frame
+  {
+    std::vector<unsigned char> positions; ///< in the position format of the particle draw
+    size_t count = 0;                     ///< particles in positions
+    std::vector<float> attractors;        ///< x,y,z,0 per attractor
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief runs _steps fixed steps, returns false when the run is over and the thread should stop
+  //----------------------------------------------------------------------------------------------------------------------
+  using StepFunction = std::function<bool(size_t _steps)>;
+  using PublishFunction = std::function<void(Frame &o_frame)>;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start the thread, it publishes the current state straight away
+  /// @param [in] _config stepMs, maxSubsteps and deterministic set the pace
+  /// @param [in] _step advances the simulation, only ever called on the simulation thread
+  /// @param [in] _publish writes the state to draw into a frame, only ever called on the simulation thread
+  //----------------------------------------------------------------------------------------------------------------------
+  SimulationThread(const SimulationConfig &_config, StepFunction _step, PublishFunction _publish);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief finishes the batch in progress and joins the thread
+  //----------------------------------------------------------------------------------------------------------------------
+  ~SimulationThread();
+  SimulationThread(const SimulationThread &) = delete;
+  SimulationThread &operator=(const SimulationThread &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _command on the simulation thread before its next batch
+  //----------------------------------------------------------------------------------------------------------------------
+  void post(std::function<void()> _command);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief render thread only, swap in the newest published frame if there is one
+  /// @returns the frame to draw, it stays untouched until the next acquire
+  //----------------------------------------------------------------------------------------------------------------------
+  const Frame &acquire();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief render thread only, the frame the last acquire returned
+  //----------------------------------------------------------------------------------------------------------------------
+  const Frame &front() const { return m_frames[m_front]; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the step function has ended the run
+  //----------------------------------------------------------------------------------------------------------------------
+  bool finished() const { return m_finished.load(); }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief simulation rate over the last second
+  //----------------------------------------------------------------------------------------------------------------------
+  float stepsPerSecond() const { return m_stepsPerSecond.load(); }
+
+private:
+  void run();
+  void runCommands();
+  void publish();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set in m_ready when the frame it names hasn't been acquired yet
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr uint32_t c_fresh = 4;
+  float m_stepMs = 10.0f;
+  size_t m_maxSubsteps = 4;
+  bool m_deterministic = false;
+  StepFunction m_step;
+  PublishFunction m_publish;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the triple buffer, the simulation thread owns m_back, the render thread m_front and the newest
+  /// finished frame is whichever m_ready names. Publishing and acquiring each swap their frame with m_ready
+  //----------------------------------------------------------------------------------------------------------------------
+  std::array<Frame, 3> m_frames;
+  size_t m_back = 0;
+  size_t m_front = 1;
+  std::atomic<uint32_t> m_ready{2};
+  std::vector<std::function<void()>> m_commands;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_quit = false;
+  std::atomic<bool> m_finished{false};
+  std::atomic<float> m_stepsPerSecond{0.0f};
+  std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef SPATIALHASH_H_
+#define SPATIALHASH_H_
+#include "ThreadPool.h"
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SpatialHash.h
+/// @brief uniform grid binning of the particles for neighbour queries, CPU version of shaders/SpatialHash.glsl
+/// @class SpatialHash
+/// @brief the world is split into cubic cells of _cellSize and each cell is hashed into a power of two table
+/// (at least the particle count so most cells get a slot to themselves). build() runs the same three passes as
+/// the compute version: hash every particle and count per slot, exclusive prefix sum of the counts into slot
+/// starts, then scatter the particle indices so each slot's particles are contiguous. A query with radius
+/// <= _cellSize then only has to visit the 27 cells around a point, O(N) overall instead of O(N^2).
+/// Different cells can share a slot so callers must still check the distance.
+//----------------------------------------------------------------------------------------------------------------------
+class SpatialHash
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bin the particles
+  /// @param [in] _x,_y,_z the particle positions, _count of each
+  /// @param [in] _cellSize the cell edge length, use the interaction radius
+  /// @param [in] _pool the pool used for the passes
+  //----------------------------------------------------------------------------------------------------------------------
+  void build(const float *_x, const float *_y, const float *_z, size_t _count, float _cellSize, ThreadPool &_pool);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief call _fn(begin, end) with the sorted range of each of the 27 cells around a point, the positions
+  /// are sortedX()[begin..end) etc. so a cell can be scanned contiguously (and with SIMD). The ranges include any
+  /// particle at the point itself. _fn returns false to stop early.
+  //----------------------------------------------------------------------------------------------------------------------
+  template <typename Fn>
+  void forEachNeighborRange(float _x, float _y, float _z, Fn &&_fn) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the table slot for integer cell coordinates, matches hashCell in shaders/SpatialHash.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  static uint32_t hashCell(int32_t _cx, int32_t _cy, int32_t _cz, uint32_t _mask)
+  {
+    return ((static_cast<uint32_t>(_cx) * 73856093u) ^ (static_cast<uint32_t>(_cy) * 19349663u) ^
+            (static_cast<uint32_t>(_cz) * 83492791u)) &
+           _mask;
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the table size for _count particles, a power of two of at least 1024
+  //----------------------------------------------------------------------------------------------------------------------
+  static size_t tableSizeFor(size_t _count);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief particle indices sorted by slot, visiting particles in this order keeps neighbours close in cache
+  //----------------------------------------------------------------------------------------------------------------------
+  const std::vector<uint32_t> &sortedIndices() const { return m_sorted; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the positions in m_sorted order, padded by c_padding so a SIMD load at the end of a range is safe
+  //----------------------------------------------------------------------------------------------------------------------
+  const float *sortedX() const { return m_sortedX.data(); }
+  const float *sortedY() const { return m_sortedY.data(); }
+  const float *sortedZ() const { return m_sortedZ.data(); }
+  static constexpr size_t c_padding = 16;
+  size_t tableSize() const { return m_cellStart.empty() ? 0 : m_cellStart.size() - 1; }
+  size_t memoryFootprint() const;
+
+private:
+  float m_invCellSize = 1.0f;
+  uint32_t m_mask = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the slot of each particle from the hash pass
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint32_t> m_particleHash;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief slot s holds particles m_sorted[m_cellStart[s] .. m_cellStart[s+1])
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint32_t> m_cellStart;
+  std::vector<uint32_t> m_sorted;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the positions gathered into m_sorted order, reading the neighbours through the original indices
+  /// is a cache miss per candidate
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> m_sortedX;
+  std::vector<float> m_sortedY;
+  std::vector<float> m_sortedZ;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief per slot counts then write cursors, atomic as any thread can hit any slot
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<std::atomic<uint32_t>[]> m_cellFill;
+  size_t m_cellFillSize = 0;
+};
+
+template <typename Fn>
+void SpatialHash::forEachNeighborRange(float _x, float _y, float _z, Fn &&_fn) const
+{
+  if (m_sorted.empty())
+  {
+    return;
+  }
+  int32_t cx = static_cast<int32_t>(std::floor(_x * m_invCellSize));
+  int32_t cy = static_cast<int32_t>(std::floor(_y * m_invCellSize));
+  int32_t cz = static_cast<int32_t>(std::floor(_z * m_invCellSize));
+  // two of the 27 cells can land in the same slot, only visit it once so nothing is counted twice
+  uint32_t visited[27];
+  size_t numVisited = 0;
+  for (int32_t z = cz - 1; z <= cz + 1; ++z)
+  {
+    for (int32_t y = cy - 1; y <= cy + 1; ++y)
+    {
+      for (int32_t x = cx - 1; x <= cx + 1; ++x)
+      {
+        uint32_t slot = hashCell(x, y, z, m_mask);
+        bool seen = false;
+        for (size_t v = 0; v < numVisited; ++v)
+        {
+          seen |= visited[v] == slot;
+        }
+        if (seen)
+        {
+          continue;
+        }
+        visited[numVisited++] = slot;
+        if (m_cellStart[slot] != m_cellStart[slot + 1] && !_fn(m_cellStart[slot], m_cellStart[slot + 1]))
+        {
+          return;
+        }
+      }
+    }
+  }
+}
+
+#endif
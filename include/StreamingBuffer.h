@@ -0,0 +1,84 @@
+#ifndef STREAMINGBUFFER_H_
+#define STREAMINGBUFFER_H_
+#include <ngl/Types.h>
+#include <array>
+#include <cstddef>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file StreamingBuffer.h
+/// @brief a persistently mapped ring of buffer slots for per frame uploads
+/// @class StreamingBuffer
+/// @brief the storage is allocated once with glBufferStorage and mapped with
+/// GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT, so an upload is just a memcpy into the next free slot.
+/// Each slot carries a fence that is set after the GPU commands reading it have been issued, writing to a
+/// slot waits on that fence so we never overwrite data still in flight. With three slots the wait is
+/// almost always already signalled. Needs GL 4.4 (or ARB_buffer_storage).
+//----------------------------------------------------------------------------------------------------------------------
+class StreamingBuffer
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the number of slots in the ring
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t c_numSlots = 3;
+  StreamingBuffer() = default;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor unmaps and deletes the buffer and fences, the context must be current
+  //----------------------------------------------------------------------------------------------------------------------
+  ~StreamingBuffer();
+  StreamingBuffer(const StreamingBuffer &) = delete;
+  StreamingBuffer &operator=(const StreamingBuffer &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief allocate the ring, any previous storage is released
+  /// @param [in] _slotSize the largest upload in bytes, rounded up to the SSBO / UBO offset alignment
+  //----------------------------------------------------------------------------------------------------------------------
+  void allocate(size_t _slotSize);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief move to the next slot, waiting for the GPU to finish with it, and return a pointer to write into
+  /// @returns the mapped slot, valid until the next call to beginWrite
+  //----------------------------------------------------------------------------------------------------------------------
+  void *beginWrite();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief finish the write started with beginWrite, the slot becomes the current one
+  /// @param [in] _bytes the number of bytes written, used as the size for bindRange
+  //----------------------------------------------------------------------------------------------------------------------
+  void endWrite(size_t _bytes);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief convenience for beginWrite / memcpy / endWrite, grows the ring if _bytes is larger than a slot
+  //----------------------------------------------------------------------------------------------------------------------
+  void write(const void *_data, size_t _bytes);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind the current slot to an indexed target (GL_SHADER_STORAGE_BUFFER / GL_UNIFORM_BUFFER)
+  //----------------------------------------------------------------------------------------------------------------------
+  void bindRange(GLenum _target, GLuint _index) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief mark the current slot as in use by all the commands issued so far, call after the draw / dispatch
+  //----------------------------------------------------------------------------------------------------------------------
+  void fence();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the GL buffer name, bind as GL_ARRAY_BUFFER and use currentOffset() as the attribute offset
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint id() const { return m_id; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief byte offset of the current slot
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t currentOffset() const { return m_current * m_slotSize; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bytes written into the current slot
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t currentSize() const { return m_currentSize; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the usable size of each slot
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t slotSize() const { return m_slotSize; }
+
+private:
+  void release();
+  GLuint m_id = 0;
+  unsigned char *m_mapped = nullptr;
+  size_t m_slotSize = 0;
+  size_t m_current = 0;
+  size_t m_currentSize = 0;
+  std::array<GLsync, c_numSlots> m_fences = {{nullptr, nullptr, nullptr}};
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ThreadPool.h
+/// @brief a fixed size pool of worker threads used to split particle ranges into chunks
+/// @class ThreadPool
+/// @brief workers sleep until parallelFor publishes a job, then pull chunk indices from an atomic counter
+/// so faster threads simply take more chunks. The calling thread also processes chunks so a pool of size
+/// N uses N-1 extra threads. For NUMA machines the workers can be pinned to cores and parallelForStatic always
+/// gives a worker the same slice of a range, so the pages it touches first stay on its node.
+//----------------------------------------------------------------------------------------------------------------------
+class ThreadPool
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the range callback, called with a half open [begin,end) range
+  //----------------------------------------------------------------------------------------------------------------------
+  using RangeFunction = std::function<void(size_t _begin, size_t _end)>;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _numThreads total threads including the caller, 0 means std::thread::hardware_concurrency
+  /// @param [in] _pinThreads pin worker i to core i (Linux only), consecutive cores are usually on one node
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit ThreadPool(size_t _numThreads = 0, bool _pinThreads = false);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor joins all the workers
+  //----------------------------------------------------------------------------------------------------------------------
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the number of threads that take part in a parallelFor (workers + caller)
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t size() const { return m_workers.size() + 1; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _fn over [0,_count) split into chunks of _grain elements, blocks until all chunks are done
+  /// @param [in] _count the number of elements
+  /// @param [in] _grain the chunk size, every chunk except the last starts on a multiple of this
+  /// @param [in] _fn the function to call for each chunk
+  //----------------------------------------------------------------------------------------------------------------------
+  void parallelFor(size_t _count, size_t _grain, const RangeFunction &_fn);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _fn over [0,_count) split into one contiguous slice per worker, worker t always gets slice t. The
+  /// caller only waits so every slice runs on a (possibly pinned) worker, a pool without workers runs it inline
+  /// @param [in] _align the slice boundaries are multiples of this
+  //----------------------------------------------------------------------------------------------------------------------
+  void parallelForStatic(size_t _count, size_t _align, const RangeFunction &_fn);
+
+private:
+  void workerLoop(size_t _index);
+  void runChunks();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief publish the job in m_job etc. to the workers and wait for them
+  /// @param [in] _help the caller takes chunks too
+  //----------------------------------------------------------------------------------------------------------------------
+  void runJob(bool _help);
+  std::vector<std::thread> m_workers;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief only one parallelFor may be in flight at a time
+  //----------------------------------------------------------------------------------------------------------------------
+  std::mutex m_submitMutex;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  const RangeFunction *m_job = nullptr;
+  size_t m_count = 0;
+  size_t m_grain = 1;
+  size_t m_numChunks = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a parallelForStatic job, worker t runs [t*m_grain,(t+1)*m_grain) instead of pulling chunks
+  //----------------------------------------------------------------------------------------------------------------------
+  bool m_static = false;
+  std::atomic<size_t> m_nextChunk{0};
+  size_t m_active = 0;
+  uint64_t m_generation = 0;
+  bool m_quit = false;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#version 430 core
+
+// Moves the attractors along their paths at the start of every step, writing the attractor buffer in
+// place so nothing is uploaded from the host. The GPU version of AttractorPaths::evaluate, see
+// AttractorPaths.h for the path types and the file format.
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 64
+#endif
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+#define PATH_LISSAJOUS 0u
+#define PATH_SPLINE 1u
+
+layout (std430, binding = 2) writeonly buffer AttractorBuffer
+{
+  vec4 attractors[];
+};
+// must match AttractorPaths::Path
+struct Path
+{
+  uint type;
+  uint first;
+  uint count;
+  float period;
+};
+layout (std430, binding = 9) readonly buffer PathBuffer
+{
+  Path paths[];
+};
+layout (std430, binding = 10) readonly buffer KeyBuffer
+{
+  vec4 keys[];
+};
+
+uniform uint numAttractors;
+uniform uint stepIndex;
+// simulation seconds per step, the time is a function of the step count only
+uniform float stepSeconds;
+
+vec3 catmullRom(vec3 p0, vec3 p1, vec3 p2, vec3 p3, float s)
+{
+  float s2 = s * s;
+  float s3 = s2 * s;
+  return 0.5 * (2.0 * p1 + (p2 - p0) * s + (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * s2 +
+                (3.0 * p1 - p0 - 3.0 * p2 + p3) * s3);
+}
+
+void main()
+{
+  uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+  if (index >= numAttractors)
+  {
+    return;
+  }
+  uint numPaths = uint(paths.length());
+  Path path = paths[index % numPaths];
+  // the attractors sharing this path are offset by an equal fraction of it
+  uint copies = (numAttractors - index % numPaths + numPaths - 1u) / numPaths;
+  float time = float(stepIndex) * stepSeconds;
+  float cycle = fract(time / path.period + float(index / numPaths) / float(copies));
+  vec3 p;
+  if (path.type == PATH_LISSAJOUS)
+  {
+    vec3 centre = keys[path.first].xyz;
+    vec3 amplitude = keys[path.first + 1u].xyz;
+    vec3 frequency = keys[path.first + 2u].xyz;
+    vec3 phase = keys[path.first + 3u].xyz;
+    p = centre + amplitude * sin(6.28318531 * (frequency * cycle + phase));
+  }
+  else
+  {
+    float u = cycle * float(path.count);
+    uint k = min(uint(u), path.count - 1u);
+    float s = u - float(k);
+    p = catmullRom(keys[path.first + (k + path.count - 1u) % path.count].xyz, keys[path.first + k].xyz,
+                   keys[path.first + (k + 1u) % path.count].xyz, keys[path.first + (k + 2u) % path.count].xyz, s);
+  }
+  attractors[index] = vec4(p, 0.0);
+}
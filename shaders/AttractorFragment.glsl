@@ -0,0 +1,12 @@
+#version 430 core
+
+// white diffuse with the light along +z, the values the nglDiffuseShader setup used
+in vec3 fragmentNormal;
+
+layout (location = 0) out vec4 fragColour;
+
+void main()
+{
+  const vec3 lightPos = vec3(0.0, 0.0, 1.0);
+  fragColour = vec4(vec3(max(dot(normalize(fragmentNormal), lightPos), 0.0)), 1.0);
+}
@@ -0,0 +1,22 @@
+#version 430 core
+
+// One instance per attractor, the sphere is offset by the attractor position read straight from the
+// simulation's attractor SSBO so nothing is computed or uploaded per sphere on the CPU.
+// Attribute locations match the ngl::VAOPrimitives layout.
+layout (location = 0) in vec3 inVert;
+layout (location = 2) in vec3 inNormal;
+
+layout (std430, binding = 2) readonly buffer AttractorBuffer
+{
+  vec4 attractors[];
+};
+
+uniform mat4 MVP;
+out vec3 fragmentNormal;
+
+void main()
+{
+  // like the nglDiffuseShader version it replaced the normal stays in object space
+  fragmentNormal = inNormal;
+  gl_Position = MVP * vec4(inVert + attractors[gl_InstanceID].xyz, 1.0);
+}
@@ -0,0 +1,37 @@
+#version 430 core
+
+// Bakes the per attractor force (the TILED_ATTRACTORS field in ParticlesCompute.glsl) at the
+// centre of every cell of a 3D grid, only run when the attractors change
+layout (local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout (std430, binding = 2) buffer AttractorBuffer
+{
+  vec4 attractors[];
+};
+
+layout (rgba32f, binding = 0) writeonly uniform image3D forceField;
+
+// the grid covers -gridExtent..gridExtent on each axis
+uniform float gridExtent;
+
+void main()
+{
+  ivec3 size = imageSize(forceField);
+  ivec3 cell = ivec3(gl_GlobalInvocationID);
+  if (any(greaterThanEqual(cell, size)))
+  {
+    return;
+  }
+  vec3 pos = -gridExtent + (vec3(cell) + 0.5) * (2.0 * gridExtent / vec3(size));
+
+  float gauss = 10000.0;
+  float k_weak = 1.0;
+  vec3 f = vec3(0);
+  for (int i = 0; i < attractors.length(); ++i)
+  {
+    vec3 dir = attractors[i].xyz - pos;
+    float len2 = dot(dir, dir);
+    f += dir * inversesqrt(len2) * (k_weak / 10.0) * exp(-len2 / gauss);
+  }
+  imageStore(forceField, cell, vec4(f, 0.0));
+}
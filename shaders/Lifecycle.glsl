@@ -0,0 +1,32 @@
+// The counters and slot lists of the emitter lifecycle, shared by ParticleLifecycle.glsl and the
+// LIFECYCLE variant of ParticlesCompute.glsl. numParticles is the pool size.
+#ifndef LIFECYCLE_GLSL
+#define LIFECYCLE_GLSL
+
+// the layout GPUParticleSimulator reads the indirect arguments from
+layout (std430, binding = 11) buffer LifecycleCounters
+{
+  // entries in each alive list
+  uint aliveCount[2];
+  // the free list is a stack, freeList[0,freeCount) are free slots
+  uint freeCount;
+  // slots taken off the top of the free list this step
+  uint spawnCount;
+  // glDispatchComputeIndirect arguments of the simulate and emit passes, w is padding
+  uvec4 simulateArgs;
+  uvec4 emitArgs;
+};
+// two lists of numParticles slots back to back, list l starts at l * numParticles
+layout (std430, binding = 12) buffer AliveBuffer
+{
+  uint aliveList[];
+};
+layout (std430, binding = 13) buffer FreeBuffer
+{
+  uint freeList[];
+};
+
+// the alive list stepped this step, the other one collects the survivors and the new particles
+uniform uint currentList;
+
+#endif
@@ -0,0 +1,251 @@
+#version 430 core
+
+// Morton order of the particle slots with a stable LSD radix sort, the GPU version of MortonOrder.cpp. Each
+// pass is its own variant selected by ShaderVariantCache :
+// KEY_PASS     the 30 bit Morton code of every particle with its slot as the value. With LIFECYCLE dead slots
+//              get DEAD_KEY so they sort to the end and the live ones are counted into the current alive count
+// COUNT_PASS   per block count of the RADIX_BITS digit at digitShift, stored digit major so PrefixSum.glsl
+//              turns the counts into the output start of every (digit, block)
+// SCATTER_PASS move each key and value to its digit's range, ranked within the block by a work group scan so
+//              equal digits keep their order and the sort gives the same result every run
+// PERMUTE_PASS gather the particle buffers into the sorted order
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 128
+#endif
+#if defined(COUNT_PASS) || defined(SCATTER_PASS)
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+#else
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+#endif
+
+// the count and scatter passes take KEYS_PER_INVOCATION consecutive keys per invocation, SORT_BLOCK per group
+#define KEYS_PER_INVOCATION 4u
+#define SORT_BLOCK 1024u
+#define RADIX_BITS 4u
+#define RADIX 16u
+#define DEAD_KEY 0xFFFFFFFFu
+
+#include "ParticleFormat.glsl"
+
+layout (std430, binding = 0) readonly buffer PositionBuffer
+{
+  PositionType positions[];
+};
+layout (std430, binding = 3) buffer KeyBuffer
+{
+  uint keys[];
+};
+layout (std430, binding = 4) buffer ValueBuffer
+{
+  uint values[];
+};
+#if defined(COUNT_PASS) || defined(SCATTER_PASS)
+layout (std430, binding = 7) buffer BlockCountBuffer
+{
+  uint blockCounts[];
+};
+#endif
+#if defined(SCATTER_PASS)
+layout (std430, binding = 5) writeonly buffer SortedKeyBuffer
+{
+  uint sortedKeys[];
+};
+layout (std430, binding = 6) writeonly buffer SortedValueBuffer
+{
+  uint sortedValues[];
+};
+#elif defined(PERMUTE_PASS)
+layout (std430, binding = 1) readonly buffer VelocityBuffer
+{
+  VelocityType velocities[];
+};
+layout (std430, binding = 5) writeonly buffer SortedPositionBuffer
+{
+  PositionType sortedPositions[];
+};
+layout (std430, binding = 6) writeonly buffer SortedVelocityBuffer
+{
+  VelocityType sortedVelocities[];
+};
+#endif
+
+uniform uint numParticles;
+// number of SORT_BLOCK blocks
+uniform uint numBlocks;
+// the digit sorted by this pass is (key >> digitShift) & (RADIX - 1)
+uniform uint digitShift;
+// the curve covers -extent..extent on each axis
+uniform float extent;
+
+#if defined(KEY_PASS) && defined(LIFECYCLE)
+#include "Lifecycle.glsl"
+shared uint groupAlive;
+#endif
+
+// spread the low 10 bits of v out to every third bit, matches MortonOrder::expandBits
+uint expandBits(uint v)
+{
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// matches MortonOrder::mortonCode
+uint mortonCode(vec3 pos)
+{
+  uvec3 q = uvec3(min(clamp((pos + extent) / (2.0 * extent), 0.0, 1.0) * 1024.0, vec3(1023.0)));
+  return expandBits(q.x) | (expandBits(q.y) << 1) | (expandBits(q.z) << 2);
+}
+
+uint digitOf(uint key)
+{
+  return (key >> digitShift) & (RADIX - 1u);
+}
+
+#if defined(SCATTER_PASS)
+// RADIX counters packed two to a word, digit d is the 16 bit half (d & 1) of word d >> 1. A block has at most
+// SORT_BLOCK keys so a half never overflows and packed sums never carry into the next counter
+shared uvec4 partialLo[256];
+shared uvec4 partialHi[256];
+
+void addDigit(inout uvec4 lo, inout uvec4 hi, uint d)
+{
+  uint word = d >> 1;
+  uint add = 1u << ((d & 1u) * 16u);
+  if (word < 4u)
+  {
+    lo[word] += add;
+  }
+  else
+  {
+    hi[word - 4u] += add;
+  }
+}
+
+uint digitCount(uvec4 lo, uvec4 hi, uint d)
+{
+  uint word = d >> 1;
+  uint counters = word < 4u ? lo[word] : hi[word - 4u];
+  return (counters >> ((d & 1u) * 16u)) & 0xFFFFu;
+}
+#elif defined(COUNT_PASS)
+shared uint blockDigits[RADIX];
+#endif
+
+void main()
+{
+#if defined(KEY_PASS) || defined(PERMUTE_PASS)
+  // large dispatches spill into y, see compute::dispatch1D
+  uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+#endif
+#if defined(KEY_PASS)
+#ifdef LIFECYCLE
+  if (gl_LocalInvocationID.x == 0u)
+  {
+    groupAlive = 0u;
+  }
+  barrier();
+#endif
+  if (index < numParticles)
+  {
+    vec4 p = decodePosition(positions[index]);
+    uint key = mortonCode(p.xyz);
+#ifdef LIFECYCLE
+    if (p.w > 0.0)
+    {
+      atomicAdd(groupAlive, 1u);
+    }
+    else
+    {
+      key = DEAD_KEY;
+    }
+#endif
+    keys[index] = key;
+    values[index] = index;
+  }
+#ifdef LIFECYCLE
+  barrier();
+  if (gl_LocalInvocationID.x == 0u && groupAlive != 0u)
+  {
+    atomicAdd(aliveCount[currentList], groupAlive);
+  }
+#endif
+#elif defined(PERMUTE_PASS)
+  if (index >= numParticles)
+  {
+    return;
+  }
+  uint source = values[index];
+  sortedPositions[index] = positions[source];
+  sortedVelocities[index] = velocities[source];
+#else
+  uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+  // the spill into y can leave whole groups past the end, they leave together before any barrier
+  if (block >= numBlocks)
+  {
+    return;
+  }
+  uint lid = gl_LocalInvocationID.x;
+  uint first = block * SORT_BLOCK + lid * KEYS_PER_INVOCATION;
+#if defined(COUNT_PASS)
+  if (lid < RADIX)
+  {
+    blockDigits[lid] = 0u;
+  }
+  barrier();
+  for (uint i = 0u; i < KEYS_PER_INVOCATION; ++i)
+  {
+    if (first + i < numParticles)
+    {
+      atomicAdd(blockDigits[digitOf(keys[first + i])], 1u);
+    }
+  }
+  barrier();
+  if (lid < RADIX)
+  {
+    blockCounts[lid * numBlocks + block] = blockDigits[lid];
+  }
+#elif defined(SCATTER_PASS)
+  uint key[KEYS_PER_INVOCATION];
+  uvec4 ownLo = uvec4(0u);
+  uvec4 ownHi = uvec4(0u);
+  for (uint i = 0u; i < KEYS_PER_INVOCATION; ++i)
+  {
+    key[i] = first + i < numParticles ? keys[first + i] : 0u;
+    if (first + i < numParticles)
+    {
+      addDigit(ownLo, ownHi, digitOf(key[i]));
+    }
+  }
+  // inclusive scan of the packed counters across the work group, as scanWorkGroup in PrefixSum.glsl
+  partialLo[lid] = ownLo;
+  partialHi[lid] = ownHi;
+  barrier();
+  for (uint offset = 1u; offset < 256u; offset <<= 1)
+  {
+    uvec4 addLo = lid >= offset ? partialLo[lid - offset] : uvec4(0u);
+    uvec4 addHi = lid >= offset ? partialHi[lid - offset] : uvec4(0u);
+    barrier();
+    partialLo[lid] += addLo;
+    partialHi[lid] += addHi;
+    barrier();
+  }
+  // keys of each digit in the earlier invocations of this block, then bumped past each of our own
+  uvec4 beforeLo = partialLo[lid] - ownLo;
+  uvec4 beforeHi = partialHi[lid] - ownHi;
+  for (uint i = 0u; i < KEYS_PER_INVOCATION; ++i)
+  {
+    if (first + i < numParticles)
+    {
+      uint d = digitOf(key[i]);
+      uint dst = blockCounts[d * numBlocks + block] + digitCount(beforeLo, beforeHi, d);
+      addDigit(beforeLo, beforeHi, d);
+      sortedKeys[dst] = key[i];
+      sortedValues[dst] = values[first + i];
+    }
+  }
+#endif
+#endif
+}
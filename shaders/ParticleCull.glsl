@@ -0,0 +1,83 @@
+#version 430 core
+
+// Frustum and distance LOD culling of the particles into a compact index list drawn with
+// glDrawElementsIndirect, the GPU version of CPUParticleSimulator::cullVisible. The visible indices are
+// appended with one global atomic per work group rather than one per particle.
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 128
+#endif
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+#include "ParticleFormat.glsl"
+
+// must match CPUParticleSimulator::c_lodHash
+#define LOD_HASH 0x9E3779B9u
+
+layout (std430, binding = 0) readonly buffer PositionBuffer
+{
+  PositionType positions[];
+};
+// DrawElementsIndirectCommand, count is the append counter and is cleared before the pass
+layout (std430, binding = 7) buffer DrawCommand
+{
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int baseVertex;
+  uint baseInstance;
+};
+layout (std430, binding = 8) writeonly buffer VisibleBuffer
+{
+  uint visibleIndex[];
+};
+
+uniform mat4 MVP;
+uniform uint numParticles;
+// 0 turns the thinning off, see SimulationConfig::lodDistance
+uniform float lodDistance;
+
+shared uint groupCount;
+shared uint groupBase;
+
+bool isVisible(uint index)
+{
+  vec4 p = decodePosition(positions[index]);
+  vec4 clip = MVP * vec4(p.xyz, 1.0);
+  // points behind the camera have a negative w and fail every test
+  bool visible = p.w > 0.0 && all(lessThanEqual(abs(clip.xyz), vec3(clip.w)));
+  if (lodDistance > 0.0)
+  {
+    // keep with probability (lodDistance / w)^2, written without the divide
+    float fraction = float((index * LOD_HASH) >> 8) * (1.0 / 16777216.0);
+    visible = visible && fraction * clip.w * clip.w < lodDistance * lodDistance;
+  }
+  return visible;
+}
+
+void main()
+{
+  // large dispatches spill into y, see compute::dispatch1D
+  uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+  if (gl_LocalInvocationID.x == 0)
+  {
+    groupCount = 0;
+  }
+  barrier();
+  // the tail of the last work group still has to reach the barriers
+  bool visible = index < numParticles && isVisible(index);
+  uint slot = 0;
+  if (visible)
+  {
+    slot = atomicAdd(groupCount, 1u);
+  }
+  barrier();
+  if (gl_LocalInvocationID.x == 0 && groupCount != 0)
+  {
+    groupBase = atomicAdd(count, groupCount);
+  }
+  barrier();
+  if (visible)
+  {
+    visibleIndex[groupBase + slot] = index;
+  }
+}
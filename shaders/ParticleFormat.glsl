@@ -0,0 +1,87 @@
+// Storage format of the particle buffers, the GLSL twin of include/ParticleFormat.h. Shaders declare their
+// buffers with PositionType / VelocityType and go through the encode / decode functions so the same source
+// handles both formats. COMPACT_FORMAT and POSITION_EXTENT are injected by ShaderVariantCache.
+#ifndef PARTICLE_FORMAT_GLSL
+#define PARTICLE_FORMAT_GLSL
+
+#ifdef COMPACT_FORMAT
+// 16 bytes per particle
+// position : x = x16 | y16 << 16, y = z16 | life8 << 16, unorm over -POSITION_EXTENT..POSITION_EXTENT / 0..LIFE_SCALE
+// velocity : x = half x | half y << 16, y = half z
+#ifndef POSITION_EXTENT
+#define POSITION_EXTENT 128.0
+#endif
+#define LIFE_SCALE 1.1
+#define PositionType uvec2
+#define VelocityType uvec2
+
+vec4 decodePosition(uvec2 p)
+{
+  vec3 q = vec3(uvec3(p.x & 0xFFFFu, p.x >> 16, p.y & 0xFFFFu));
+  return vec4(q * (2.0 * POSITION_EXTENT / 65535.0) - POSITION_EXTENT, float((p.y >> 16) & 0xFFu) * (LIFE_SCALE / 255.0));
+}
+
+uvec3 quantizePosition(vec3 pos)
+{
+  // no multiply then add so nothing can be fused into an fma and round differently to the C++ encode
+  return uvec3(roundEven(clamp((pos + POSITION_EXTENT) / (2.0 * POSITION_EXTENT), 0.0, 1.0) * 65535.0));
+}
+
+// round to nearest, matches particleformat::encodePosition
+uvec2 encodePosition(vec4 p)
+{
+  uvec3 q = quantizePosition(p.xyz);
+  uint life = uint(roundEven(clamp(p.w / LIFE_SCALE, 0.0, 1.0) * 255.0));
+  return uvec2(q.x | (q.y << 16), q.z | (life << 16));
+}
+
+// the life only drops by a fraction of an 8 bit step each frame, a random dither in [0,1) makes the rounding
+// stochastic so those decrements still add up on average instead of always rounding back
+uvec2 encodePositionDithered(vec4 p, float dither)
+{
+  uvec3 q = quantizePosition(p.xyz);
+  uint life = min(uint(floor(clamp(p.w / LIFE_SCALE, 0.0, 1.0) * 255.0 + dither)), 255u);
+  return uvec2(q.x | (q.y << 16), q.z | (life << 16));
+}
+
+vec3 decodeVelocity(uvec2 v)
+{
+  return vec3(unpackHalf2x16(v.x), unpackHalf2x16(v.y).x);
+}
+
+uvec2 encodeVelocity(vec3 v)
+{
+  return uvec2(packHalf2x16(v.xy), packHalf2x16(vec2(v.z, 0.0)));
+}
+#else
+// vec4 position with the life in w and a vec3 velocity (16 byte std430 stride), 32 bytes per particle
+#define PositionType vec4
+#define VelocityType vec4
+
+vec4 decodePosition(vec4 p)
+{
+  return p;
+}
+
+vec4 encodePosition(vec4 p)
+{
+  return p;
+}
+
+vec4 encodePositionDithered(vec4 p, float dither)
+{
+  return p;
+}
+
+vec3 decodeVelocity(vec4 v)
+{
+  return v.xyz;
+}
+
+vec4 encodeVelocity(vec3 v)
+{
+  return vec4(v, 0.0);
+}
+#endif
+
+#endif
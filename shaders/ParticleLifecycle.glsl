@@ -0,0 +1,121 @@
+#version 430 core
+
+// The emitter / free list lifecycle of the particles, one pass per define like SpatialHash.glsl
+// RESET_PASS  every slot dead and on the free list, the pool starts empty
+// BEGIN_PASS  a single invocation, takes this step's spawns off the top of the free list and writes the
+//             indirect dispatch sizes of the emit and simulate passes from the counters
+// EMIT_PASS   start a particle in each taken slot and append it to the next alive list, the GPU version of
+//             ParticleSimulator::emittedState
+// REBUILD_PASS after a Morton reorder (MortonSort.glsl) the live particles are slots [0,aliveCount), rewrite
+//             the current alive list and the free list to match
+// The simulate pass (ParticlesCompute.glsl with LIFECYCLE) then steps the current alive list, appending the
+// survivors to the next list and pushing the expired slots back on the free list.
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 128
+#endif
+#ifdef BEGIN_PASS
+layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+#else
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+#endif
+
+#include "ParticleFormat.glsl"
+
+layout (std430, binding = 0) buffer PositionBuffer
+{
+  PositionType positions[];
+};
+layout (std430, binding = 1) buffer VelocityBuffer
+{
+  VelocityType velocities[];
+};
+// x,y,z and the spawn radius
+layout (std430, binding = 14) readonly buffer EmitterBuffer
+{
+  vec4 emitters[];
+};
+
+uniform uint numParticles;
+uniform uint seed;
+uniform uint stepIndex;
+// particles to spawn this step, the rate plus any burst
+uniform uint spawnRequest;
+
+#include "Lifecycle.glsl"
+#include "Philox.glsl"
+
+#if defined(BEGIN_PASS)
+// work groups for count invocations, split into y like compute::dispatch1D
+uvec4 groupsFor(uint count)
+{
+  uint groups = (count + WORKGROUP_SIZE - 1u) / WORKGROUP_SIZE;
+  uint x = min(groups, 65535u);
+  uint y = x == 0u ? 1u : (groups + x - 1u) / x;
+  return uvec4(x, y, 1u, 0u);
+}
+
+void main()
+{
+  uint spawn = min(spawnRequest, freeCount);
+  freeCount -= spawn;
+  spawnCount = spawn;
+  emitArgs = groupsFor(spawn);
+  simulateArgs = groupsFor(aliveCount[currentList]);
+  aliveCount[1u - currentList] = 0u;
+}
+#else
+void main()
+{
+  uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+#if defined(RESET_PASS)
+  if (index >= numParticles)
+  {
+    return;
+  }
+  // the stack is filled backwards so the first spawns take the lowest slots
+  freeList[index] = numParticles - 1u - index;
+  positions[index] = encodePosition(vec4(0.0));
+  if (index == 0u)
+  {
+    aliveCount[0] = 0u;
+    aliveCount[1] = 0u;
+    freeCount = numParticles;
+    spawnCount = 0u;
+  }
+#elif defined(EMIT_PASS)
+  if (index >= spawnCount)
+  {
+    return;
+  }
+  // the begin pass lowered freeCount below the taken slots
+  uint slot = freeList[freeCount + index];
+  vec4 emitter = emitters[index % uint(emitters.length())];
+  vec4 p = philoxUniform(slot, stepIndex, STREAM_EMIT_POSITION, seed);
+  vec4 v = philoxUniform(slot, stepIndex, STREAM_EMIT_VELOCITY, seed);
+  vec3 pos = emitter.xyz + (p.xyz * 2.0 - 1.0) * emitter.w;
+  float life = 0.5 + p.w * 0.49;
+  positions[slot] = encodePosition(vec4(pos, life));
+  velocities[slot] = encodeVelocity(v.xyz - 0.5);
+  aliveList[(1u - currentList) * numParticles + atomicAdd(aliveCount[1u - currentList], 1u)] = slot;
+#elif defined(REBUILD_PASS)
+  if (index >= numParticles)
+  {
+    return;
+  }
+  uint alive = aliveCount[currentList];
+  if (index < alive)
+  {
+    aliveList[currentList * numParticles + index] = index;
+  }
+  else
+  {
+    // backwards like the reset so the next spawns fill the slots straight after the live ones
+    freeList[numParticles - 1u - index] = index;
+  }
+  if (index == 0u)
+  {
+    freeCount = numParticles - alive;
+  }
+#endif
+}
+#endif
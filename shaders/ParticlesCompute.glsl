@@ -1,87 +1,271 @@
 #version 430 core
 
-// Process particles in blocks of 128
-layout (local_size_x = 128, local_size_y = 1, local_size_z = 1) in;
+// Process particles in blocks of WORKGROUP_SIZE, injected by ShaderVariantCache
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 128
+#endif
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+#include "ParticleFormat.glsl"
 
 layout (std430, binding = 0) buffer PositionBuffer
 {
-  vec4 positions[];
+  PositionType positions[];
 };
 layout (std430, binding = 1) buffer VelocityBuffer
 {
-  vec3 velocities[];
+  VelocityType velocities[];
 };
-layout (binding = 2) buffer AttractorBuffer
+layout (std430, binding = 2) buffer AttractorBuffer
 {
-  vec3 attractors[];
+  vec4 attractors[];
 };
 
 // Delta time
 uniform float dt;
+// the last work group is usually only partly used
+uniform uint numParticles;
+// key and step counter for the random numbers, see Philox.glsl
+uniform uint seed;
+uniform uint stepIndex;
+// index of buffer element 0 in the whole system, non zero when a chunk is streamed through the buffers so the
+// random numbers stay keyed on the global particle index
+uniform uint firstParticle;
 
+#include "Philox.glsl"
 
-highp float rand(vec2 co)
-{
-  return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);
-}
+#ifdef LIFECYCLE
+// the dispatch is sized indirectly from the alive count and each invocation steps one live slot, see
+// ParticleLifecycle.glsl. The survivors and the expired slots are appended with one global atomic per
+// work group rather than one per particle
+#include "Lifecycle.glsl"
+shared uint groupAlive;
+shared uint groupFree;
+shared uint aliveBase;
+shared uint freeBase;
+#endif
 
 
-vec3 calcForceFor (vec3 forcePoint, vec3 pos)
+vec3 calcForceFor (vec3 forcePoint, vec3 pos, vec4 noise, float gauss)
 {
   // Force:
-  float gauss = 10000.0;
   float e = 2.71828183;
   float k_weak = 1.0;
   vec3 dir = forcePoint - pos.xyz;
   float g = pow (e, -pow(length(dir), 2) / gauss);
-  vec3 f = normalize(dir) * k_weak * (1+ mod(rand(dir.xy), 10) - mod(rand(dir.yz), 10)) / 10.0 * g;
+  vec3 f = normalize(dir) * k_weak * (1+ noise.x - noise.y) / 10.0 * g;
+  return f;
+}
+
+#ifdef BATCHED
+// independent systems sharing the buffers, each owns a contiguous range of particles and attractors. The table is
+// ParticleSystems::System and sorted by first
+struct System
+{
+  uint first;
+  uint count;
+  uint firstAttractor;
+  uint numAttractors;
+  float kV;
+  float gauss;
+  float decay;
+  float pad;
+};
+layout (std430, binding = 15) readonly buffer SystemBuffer
+{
+  System systems[];
+};
+
+// the last system starting at or before particle
+uint findSystem(uint particle)
+{
+  uint lo = 0u;
+  uint hi = uint(systems.length());
+  while (hi - lo > 1u)
+  {
+    uint mid = (lo + hi) / 2u;
+    if (systems[mid].first <= particle)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+#endif
+
+#ifdef NEIGHBOR_FORCE
+// particle / particle force from the NEIGHBOR_PASS of SpatialHash.glsl
+layout (std430, binding = 6) readonly buffer NeighborForceBuffer
+{
+  vec4 neighborForce[];
+};
+#endif
+
+#ifdef GRID_FORCE
+// the baked per attractor field from ForceFieldBake.glsl covering -gridExtent..gridExtent
+layout (binding = 0) uniform sampler3D forceField;
+uniform float gridExtent;
+#endif
+
+#ifdef TILED_ATTRACTORS
+// attractors are streamed through shared memory one work group sized tile at a time so each
+// attractor is read from the SSBO once per work group rather than once per particle
+shared vec4 attractorTile[WORKGROUP_SIZE];
+
+// sum of the individual attractor forces, the hash noise in calcForceFor averages to 1/10 so use that
+vec3 tiledForce(vec3 pos)
+{
+  float gauss = 10000.0;
+  float k_weak = 1.0;
+  vec3 f = vec3(0);
+  uint numAttractors = uint(attractors.length());
+  for (uint tile = 0; tile < numAttractors; tile += WORKGROUP_SIZE)
+  {
+    uint a = tile + gl_LocalInvocationID.x;
+    attractorTile[gl_LocalInvocationID.x] = a < numAttractors ? attractors[a] : vec4(0);
+    barrier();
+    uint count = min(uint(WORKGROUP_SIZE), numAttractors - tile);
+    for (uint i = 0; i < count; ++i)
+    {
+      vec3 dir = attractorTile[i].xyz - pos;
+      float len2 = dot(dir, dir);
+      f += dir * inversesqrt(len2) * (k_weak / 10.0) * exp(-len2 / gauss);
+    }
+    barrier();
+  }
   return f;
 }
+#endif
 
 void main()
 {
-  uint index = gl_GlobalInvocationID.x;
+  // large dispatches spill into y, see compute::dispatch1D
+  uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+  // the tail of the last work group still has to reach the barriers in tiledForce so clamp the
+  // read and only skip the write
+#ifdef LIFECYCLE
+  uint liveCount = aliveCount[currentList];
+  bool inRange = index < liveCount;
+  uint readIndex = aliveList[currentList * numParticles + min(index, liveCount - 1u)];
+#else
+  bool inRange = index < numParticles;
+  uint readIndex = min(index, numParticles - 1);
+#endif
 
   int i;
   float newDT = dt * 100.0;
 
+#ifdef BATCHED
+  System system = systems[findSystem(firstParticle + readIndex)];
+  int attractorBegin = int(system.firstAttractor);
+  int attractorEnd = min(int(system.firstAttractor + system.numAttractors), attractors.length());
+  float k_v = system.kV;
+  float gauss = system.gauss;
+  float decay = system.decay;
+#else
+  int attractorBegin = 0;
+  int attractorEnd = attractors.length();
+  float k_v = 1.5;
+  float gauss = 10000.0;
+  float decay = 0.0001;
+#endif
 
   vec3 forcePoint = vec3(0);
 
-  for (i = 0; i < attractors.length(); i++)
+  for (i = attractorBegin; i < attractorEnd; i++)
   {
-    forcePoint += attractors[i];
+    forcePoint += attractors[i].xyz;
   }
 
   // Read the current position and velocity from the buffers
-  vec3 vel = velocities[index];
-  vec3 pos = positions[index].xyz;
-  float newW = positions[index].w;
+  vec3 vel = decodeVelocity(velocities[readIndex]);
+  vec4 current = decodePosition(positions[readIndex]);
+  vec3 pos = current.xyz;
+  float newW = current.w;
 
-  float k_v = 1.5;
+  // force noise in xy, the jitter in z and the dither of the compact life in w, one draw per particle per step
+  vec4 noise = philoxUniform(firstParticle + readIndex, stepIndex, STREAM_STEP, seed);
 
-  vec3 f = calcForceFor(forcePoint, pos) + rand(pos.xz)/100.0;
+#if defined(TILED_ATTRACTORS)
+  vec3 f = tiledForce(pos) + noise.z/100.0;
+  // pull towards the centre of the attractors rather than their sum
+  vec3 pullPoint = attractors.length() > 0 ? forcePoint / float(attractors.length()) : vec3(0);
+#elif defined(GRID_FORCE)
+  // trilinear filtered lookup, clamped to the edge outside the grid
+  vec3 f = textureLod(forceField, (pos + gridExtent) / (2.0 * gridExtent), 0.0).xyz + noise.z/100.0;
+  vec3 pullPoint = attractors.length() > 0 ? forcePoint / float(attractors.length()) : vec3(0);
+#else
+  vec3 f = calcForceFor(forcePoint, pos, noise, gauss) + noise.z/100.0;
+  vec3 pullPoint = forcePoint;
+#endif
+#ifdef NEIGHBOR_FORCE
+  f += neighborForce[readIndex].xyz;
+#endif
 
   // Velocity:
   vec3 v = normalize(vel.xyz + (f * newDT)) * k_v;
 
-  v += (forcePoint-pos) * 0.005;
+  v += (pullPoint-pos) * 0.005;
 
   // Pos:
   vec3 s = pos + v * newDT;
 
-  newW -= 0.0001f * newDT;
+  newW -= decay * newDT;
 
+#ifdef LIFECYCLE
+  // an expired particle is left dead (drawn as nothing) and its slot goes back on the free list
+  bool expired = newW <= 0;
+  newW = max(newW, 0.0);
+  if (gl_LocalInvocationID.x == 0)
+  {
+    groupAlive = 0;
+    groupFree = 0;
+  }
+  barrier();
+  uint slot = 0;
+  if (inRange)
+  {
+    slot = expired ? atomicAdd(groupFree, 1u) : atomicAdd(groupAlive, 1u);
+  }
+  barrier();
+  if (gl_LocalInvocationID.x == 0)
+  {
+    aliveBase = groupAlive != 0 ? atomicAdd(aliveCount[1u - currentList], groupAlive) : 0u;
+    freeBase = groupFree != 0 ? atomicAdd(freeCount, groupFree) : 0u;
+  }
+  barrier();
+  if (!inRange)
+  {
+    return;
+  }
+  if (expired)
+  {
+    freeList[freeBase + slot] = readIndex;
+  }
+  else
+  {
+    aliveList[(1u - currentList) * numParticles + aliveBase + slot] = readIndex;
+  }
+#else
   // If the particle expires, reset it
   if (newW <= 0)
   {
-    s  = -s + rand(s.xy)*40.0 -rand(s.yz)*40.0;
+    vec4 r = philoxUniform(firstParticle + readIndex, stepIndex, STREAM_RESPAWN, seed);
+    s  = -s + r.x*40.0 - r.y*40.0;
     newW = 0.99f;
   }
 
-  positions[index].w = newW;
-  // Store the new position and velocity back into the buffers
-  positions[index].xyz = s;
-  velocities[index] = v;
+  if (!inRange)
+  {
+    return;
+  }
+#endif
+  // Store the new position and velocity back into the buffers, readIndex is index without the lifecycle
+  positions[readIndex] = encodePositionDithered(vec4(s, newW), noise.w);
+  velocities[readIndex] = encodeVelocity(v);
 
 }
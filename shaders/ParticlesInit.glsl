@@ -0,0 +1,41 @@
+#version 430 core
+
+// Writes the start state of every particle straight into the buffers, the GPU version of
+// ParticleSimulator::initialState so no host staging is needed
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 128
+#endif
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+#include "ParticleFormat.glsl"
+
+layout (std430, binding = 0) writeonly buffer PositionBuffer
+{
+  PositionType positions[];
+};
+layout (std430, binding = 1) writeonly buffer VelocityBuffer
+{
+  VelocityType velocities[];
+};
+
+uniform uint numParticles;
+uniform uint seed;
+
+#include "Philox.glsl"
+
+void main()
+{
+  uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+  if (index >= numParticles)
+  {
+    return;
+  }
+  vec4 p = philoxUniform(index, 0u, STREAM_INIT_POSITION, seed);
+  vec4 v = philoxUniform(index, 0u, STREAM_INIT_VELOCITY, seed);
+  // precise keeps the exact operation order of the C++ version so both give the same bits
+  precise vec3 pos = (p.xyz - 0.5) * 80.0;
+  precise float life = p.w + 0.1;
+  precise vec3 vel = (0.001 + v.xyz) - 0.5;
+  positions[index] = encodePosition(vec4(pos, life));
+  velocities[index] = encodeVelocity(vel);
+}
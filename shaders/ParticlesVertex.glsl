@@ -1,11 +1,20 @@
 #version 430 core
 
-layout (location = 0) in vec4 vertPos;
+// the vertex stream is the simulation position buffer, COMPACT_FORMAT is injected by ShaderVariantCache
+#include "ParticleFormat.glsl"
+
+layout (location = 0) in PositionType packedPos;
 uniform mat4 MVP;
 out float color;
 
 void main()
 {
+  vec4 vertPos = decodePosition(packedPos);
   color = vertPos.w;
   gl_Position =  MVP * vec4(vertPos.xyz, 1.0);
+  // dead slots of an emitter pool have no life left, put them outside the clip volume
+  if (vertPos.w <= 0.0)
+  {
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+  }
 }
@@ -0,0 +1,36 @@
+// Philox4x32-7 counter based random numbers, the GLSL twin of include/Philox.h. Pulled into other
+// shaders with #include "Philox.glsl" (expanded by ShaderVariantCache).
+#ifndef PHILOX_GLSL
+#define PHILOX_GLSL
+
+// the third counter word, must match philox::Stream
+#define STREAM_INIT_POSITION 0u
+#define STREAM_INIT_VELOCITY 1u
+#define STREAM_STEP 2u
+#define STREAM_RESPAWN 3u
+#define STREAM_EMIT_POSITION 4u
+#define STREAM_EMIT_VELOCITY 5u
+// must match philox::c_rounds
+#define PHILOX_ROUNDS 7
+
+// four random words from a counter and key, integer only so every driver gives the same bits
+uvec4 philox(uvec4 ctr, uvec2 key)
+{
+  for (int r = 0; r < PHILOX_ROUNDS; ++r)
+  {
+    uint hi0, lo0, hi1, lo1;
+    umulExtended(0xD2511F53u, ctr.x, hi0, lo0);
+    umulExtended(0xCD9E8D57u, ctr.z, hi1, lo1);
+    ctr = uvec4(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+    key += uvec2(0x9E3779B9u, 0xBB67AE85u);
+  }
+  return ctr;
+}
+
+// four floats in [0,1) for a particle / step / stream, the top 24 bits so the conversion is exact
+vec4 philoxUniform(uint index, uint step, uint stream, uint seed)
+{
+  return vec4(philox(uvec4(index, step, stream, 0u), uvec2(seed, 0u)) >> 8u) * (1.0 / 16777216.0);
+}
+
+#endif
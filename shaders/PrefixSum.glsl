@@ -0,0 +1,112 @@
+#version 430 core
+
+// In place exclusive prefix sum of a uint buffer in three passes, each its own variant :
+// SCAN_BLOCKS  every work group scans a block of BLOCK_SIZE values and writes the block total
+// SCAN_SUMS    a single work group scans the block totals
+// ADD_SUMS     add the scanned block totals back onto each block
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// each invocation handles 4 consecutive values
+#define BLOCK_SIZE 1024
+
+layout (std430, binding = 0) buffer DataBuffer
+{
+  uint data[];
+};
+layout (std430, binding = 1) buffer BlockSumBuffer
+{
+  uint blockSums[];
+};
+
+// number of values in data (number of blocks for SCAN_SUMS)
+uniform uint count;
+
+shared uint partial[256];
+
+// inclusive scan of one value per invocation across the work group, all invocations must call it
+uint scanWorkGroup(uint value)
+{
+  uint lid = gl_LocalInvocationID.x;
+  partial[lid] = value;
+  barrier();
+  for (uint offset = 1; offset < 256; offset <<= 1)
+  {
+    uint add = lid >= offset ? partial[lid - offset] : 0;
+    barrier();
+    partial[lid] += add;
+    barrier();
+  }
+  return partial[lid];
+}
+
+// exclusive scan of 4 consecutive values per invocation (a whole block) starting from carry, all
+// invocations must call it
+void scanBlock(inout uint v[4], uint carry, out uint total)
+{
+  uint sum = v[0] + v[1] + v[2] + v[3];
+  uint running = scanWorkGroup(sum) - sum + carry;
+  total = partial[255];
+  // partial is reused by the next call
+  barrier();
+  for (uint i = 0; i < 4; ++i)
+  {
+    uint value = v[i];
+    v[i] = running;
+    running += value;
+  }
+}
+
+void main()
+{
+  // large dispatches spill into y, see compute::dispatch1D
+  uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+  uint v[4];
+  uint total;
+#if defined(SCAN_BLOCKS)
+  uint first = block * BLOCK_SIZE + gl_LocalInvocationID.x * 4;
+  for (uint i = 0; i < 4; ++i)
+  {
+    v[i] = first + i < count ? data[first + i] : 0;
+  }
+  scanBlock(v, 0, total);
+  for (uint i = 0; i < 4; ++i)
+  {
+    if (first + i < count)
+    {
+      data[first + i] = v[i];
+    }
+  }
+  if (gl_LocalInvocationID.x == 0)
+  {
+    blockSums[block] = total;
+  }
+#elif defined(SCAN_SUMS)
+  uint carry = 0;
+  for (uint base = 0; base < count; base += BLOCK_SIZE)
+  {
+    uint first = base + gl_LocalInvocationID.x * 4;
+    for (uint i = 0; i < 4; ++i)
+    {
+      v[i] = first + i < count ? blockSums[first + i] : 0;
+    }
+    scanBlock(v, carry, total);
+    for (uint i = 0; i < 4; ++i)
+    {
+      if (first + i < count)
+      {
+        blockSums[first + i] = v[i];
+      }
+    }
+    carry += total;
+  }
+#elif defined(ADD_SUMS)
+  uint first = block * BLOCK_SIZE + gl_LocalInvocationID.x * 4;
+  for (uint i = 0; i < 4; ++i)
+  {
+    if (first + i < count)
+    {
+      data[first + i] += blockSums[block];
+    }
+  }
+#endif
+}
@@ -0,0 +1,120 @@
+#version 430 core
+
+// Uniform grid binning of the particles, the same passes as SpatialHash.cpp. Each pass is its own
+// variant selected by ShaderVariantCache :
+// HASH_PASS     slot of every particle and the per slot counts
+//               (PrefixSum.glsl then turns the counts into slot starts)
+// SCATTER_PASS  write each particle index into its slot range, afterwards cellStart[s] holds the end of
+//               slot s, so slot s covers sortedIndex[s == 0 ? 0 : cellStart[s - 1] .. cellStart[s])
+// NEIGHBOR_PASS sum the separation force from the particles in the 27 cells around each particle
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 128
+#endif
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+#include "ParticleFormat.glsl"
+
+layout (std430, binding = 0) readonly buffer PositionBuffer
+{
+  PositionType positions[];
+};
+layout (std430, binding = 3) buffer CellStartBuffer
+{
+  uint cellStart[];
+};
+layout (std430, binding = 4) buffer SortedIndexBuffer
+{
+  uint sortedIndex[];
+};
+layout (std430, binding = 5) buffer ParticleHashBuffer
+{
+  uint particleHash[];
+};
+#ifdef NEIGHBOR_PASS
+layout (std430, binding = 6) writeonly buffer NeighborForceBuffer
+{
+  vec4 neighborForce[];
+};
+#endif
+
+uniform uint numParticles;
+// the table size is a power of two
+uniform uint tableMask;
+uniform float cellSize;
+uniform float separation;
+
+// matches SpatialHash::hashCell
+uint hashCell(ivec3 cell)
+{
+  return ((uint(cell.x) * 73856093u) ^ (uint(cell.y) * 19349663u) ^ (uint(cell.z) * 83492791u)) & tableMask;
+}
+
+ivec3 cellOf(vec3 pos)
+{
+  return ivec3(floor(pos / cellSize));
+}
+
+// cap on the neighbours per particle, the clumps around the attractors would otherwise go quadratic
+#define MAX_NEIGHBORS 64
+
+void main()
+{
+  // large dispatches spill into y, see compute::dispatch1D
+  uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+  if (index >= numParticles)
+  {
+    return;
+  }
+#if defined(HASH_PASS)
+  uint slot = hashCell(cellOf(decodePosition(positions[index]).xyz));
+  particleHash[index] = slot;
+  atomicAdd(cellStart[slot], 1);
+#elif defined(SCATTER_PASS)
+  // the order within a slot depends on scheduling, which doesn't matter for the neighbour sum
+  sortedIndex[atomicAdd(cellStart[particleHash[index]], 1)] = index;
+#elif defined(NEIGHBOR_PASS)
+  vec3 pos = decodePosition(positions[index]).xyz;
+  ivec3 cell = cellOf(pos);
+  float radius2 = cellSize * cellSize;
+  vec3 f = vec3(0);
+  uint count = 0;
+  // two of the 27 cells can share a slot, only visit it once
+  uint visited[27];
+  uint numVisited = 0;
+  for (int z = -1; z <= 1 && count < MAX_NEIGHBORS; ++z)
+  {
+    for (int y = -1; y <= 1 && count < MAX_NEIGHBORS; ++y)
+    {
+      for (int x = -1; x <= 1 && count < MAX_NEIGHBORS; ++x)
+      {
+        uint slot = hashCell(cell + ivec3(x, y, z));
+        bool seen = false;
+        for (uint v = 0; v < numVisited; ++v)
+        {
+          seen = seen || visited[v] == slot;
+        }
+        if (seen)
+        {
+          continue;
+        }
+        visited[numVisited++] = slot;
+        uint first = slot == 0 ? 0 : cellStart[slot - 1];
+        uint last = cellStart[slot];
+        for (uint k = first; k < last && count < MAX_NEIGHBORS; ++k)
+        {
+          vec3 dir = pos - decodePosition(positions[sortedIndex[k]]).xyz;
+          float d2 = dot(dir, dir);
+          // also skips this particle and exact overlaps which have no direction
+          if (d2 < radius2 && d2 > 0.0)
+          {
+            float d = sqrt(d2);
+            f += dir * (separation * (1.0 - d / cellSize) / d);
+            ++count;
+          }
+        }
+      }
+    }
+  }
+  neighborForce[index] = vec4(f, 0.0);
+#endif
+}
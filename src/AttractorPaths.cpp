@@ -0,0 +1,126 @@
+#include "AttractorPaths.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+  constexpr float c_twoPi = 6.28318531f;
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief uniform Catmull-Rom between _p1 and _p2, the same expression as catmullRom in AttractorAnimate.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  float catmullRom(float _p0, float _p1, float _p2, float _p3, float _s)
+  {
+    float s2 = _s * _s;
+    float s3 = s2 * _s;
+    return 0.5f * (2.0f * _p1 + (_p2 - _p0) * _s + (2.0f * _p0 - 5.0f * _p1 + 4.0f * _p2 - _p3) * s2 +
+                   (3.0f * _p1 - _p0 - 3.0f * _p2 + _p3) * s3);
+  }
+} // end anon namespace
+
+bool AttractorPaths::load(const std::string &_path)
+{
+  m_paths.clear();
+  m_keys.clear();
+  std::ifstream in(_path);
+  if (!in)
+  {
+    std::cerr << "unable to open attractor path file " << _path << "\n";
+    return false;
+  }
+  std::string line;
+  size_t lineNumber = 0;
+  while (std::getline(in, line))
+  {
+    ++lineNumber;
+    std::istringstream ss(line.substr(0, line.find('#')));
+    std::string type;
+    if (!(ss >> type))
+    {
+      continue;
+    }
+    float period = 0.0f;
+    std::vector<float> values;
+    ss >> period;
+    for (float v; ss >> v;)
+    {
+      values.push_back(v);
+    }
+    Path path;
+    path.first = static_cast<uint32_t>(m_keys.size() / 4);
+    path.period = period;
+    bool valid = period > 0.0f && ss.eof();
+    if (type == "lissajous")
+    {
+      path.type = Type::Lissajous;
+      valid = valid && values.size() == 12;
+    }
+    else if (type == "spline")
+    {
+      path.type = Type::Spline;
+      valid = valid && !values.empty() && values.size() % 3 == 0;
+    }
+    else
+    {
+      valid = false;
+    }
+    if (!valid)
+    {
+      std::cerr << _path << ":" << lineNumber << " expected lissajous period cx cy cz ax ay az fx fy fz px py pz or "
+                << "spline period x y z ... with a positive period\n";
+      m_paths.clear();
+      m_keys.clear();
+      return false;
+    }
+    path.count = static_cast<uint32_t>(values.size() / 3);
+    for (size_t i = 0; i < values.size(); i += 3)
+    {
+      m_keys.insert(m_keys.end(), {values[i], values[i + 1], values[i + 2], 0.0f});
+    }
+    m_paths.push_back(path);
+  }
+  if (m_paths.empty())
+  {
+    std::cerr << "no paths in attractor path file " << _path << "\n";
+    return false;
+  }
+  return true;
+}
+
+void AttractorPaths::evaluate(uint32_t _step, float _stepSeconds, size_t _count, float *o_xyz) const
+{
+  const size_t numPaths = m_paths.size();
+  const float time = static_cast<float>(_step) * _stepSeconds;
+  for (size_t i = 0; i < _count; ++i)
+  {
+    const Path &path = m_paths[i % numPaths];
+    // the attractors sharing this path are offset by an equal fraction of it
+    size_t copies = (_count - i % numPaths + numPaths - 1) / numPaths;
+    float cycle = time / path.period + static_cast<float>(i / numPaths) / static_cast<float>(copies);
+    cycle -= std::floor(cycle);
+    const float *key = &m_keys[path.first * 4];
+    float *dst = o_xyz + i * 3;
+    if (path.type == Type::Lissajous)
+    {
+      for (size_t c = 0; c < 3; ++c)
+      {
+        dst[c] = key[c] + key[4 + c] * std::sin(c_twoPi * (key[8 + c] * cycle + key[12 + c]));
+      }
+      continue;
+    }
+    float u = cycle * static_cast<float>(path.count);
+    uint32_t k = std::min(static_cast<uint32_t>(u), path.count - 1);
+    float s = u - static_cast<float>(k);
+    const float *p0 = key + ((k + path.count - 1) % path.count) * 4;
+    const float *p1 = key + k * 4;
+    const float *p2 = key + ((k + 1) % path.count) * 4;
+    const float *p3 = key + ((k + 2) % path.count) * 4;
+    for (size_t c = 0; c < 3; ++c)
+    {
+      dst[c] = catmullRom(p0[c], p1[c], p2[c], p3[c], s);
+    }
+  }
+}
@@ -0,0 +1,404 @@
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Benchmark.cpp
+/// @brief headless benchmark for the particle step, no window or GL context is created so it runs on CI / render
+/// nodes. Sweeps the particle count (and the CPU chunk size, our equivalent of the workgroup size) and writes
+/// the results as JSON to stdout or --output.
+//----------------------------------------------------------------------------------------------------------------------
+#include "CPUParticleSimulator.h"
+#include "ParticleSystems.h"
+#include "Profiler.h"
+#include "SimulationConfig.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+  struct BenchOptions
+  {
+    std::vector<size_t> counts = {100000, 1000000, 10000000, 100000000};
+    std::vector<size_t> grains = {0};
+    // empty means just the SimulationConfig resolution
+    std::vector<size_t> gridResolutions;
+    // empty means just the SimulationConfig --reorder interval
+    std::vector<size_t> reorderIntervals;
+    size_t steps = 50;
+    size_t warmup = 5;
+    // fixed steps per advance call, the GUI runs up to maxSubsteps per frame
+    size_t substeps = 1;
+    // the GUI fixed step is stepMs/60 with a default stepMs of 10
+    float dt = 10.0f / 60.0f;
+    std::string output;
+  };
+
+  struct BenchResult
+  {
+    size_t particles = 0;
+    size_t grain = 0;
+    size_t gridResolution = 0;
+    size_t reorderInterval = 0;
+    double fieldError = 0.0;
+    double initMs = 0.0;
+    double firstStepMs = 0.0;
+    double particlesPerSec = 0.0;
+    double nsPerParticle = 0.0;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double meanMs = 0.0;
+    size_t memoryBytes = 0;
+    size_t liveParticles = 0;
+    size_t peakRSSBytes = 0;
+    uint64_t checksum = 0;
+  };
+
+  std::vector<size_t> parseList(const char *_list)
+  {
+    // accepts 1e5,1000000 style lists
+    std::vector<size_t> values;
+    std::stringstream ss(_list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+      values.push_back(static_cast<size_t>(std::strtod(item.c_str(), nullptr)));
+    }
+    return values;
+  }
+
+  void printUsage(const char *_program)
+  {
+    SimulationConfig::printUsage(_program);
+    std::cout << "benchmark options\n"
+              << "  --counts a,b,c      particle counts to sweep (default 1e5,1e6,1e7,1e8)\n"
+              << "  --grains a,b,c      CPU chunk sizes to sweep, 0 = auto (default 0)\n"
+              << "  --grid-res a,b,c    grid resolutions to sweep with --force grid\n"
+              << "  --reorders a,b,c    Morton reorder intervals to sweep, 0 = never\n"
+              << "  --steps N           timed steps per case (default 50)\n"
+              << "  --warmup N          untimed steps per case (default 5)\n"
+              << "  --substeps N        fixed steps per timed advance call, times are per step (default 1)\n"
+              << "  --dt F              time step passed to the kernel (default 10/60)\n"
+              << "  --output FILE       write the JSON here instead of stdout\n";
+  }
+
+  bool parseOptions(int _argc, char **_argv, BenchOptions &o_options)
+  {
+    for (int i = 1; i < _argc; ++i)
+    {
+      const char *arg = _argv[i];
+      const char *next = i + 1 < _argc ? _argv[i + 1] : nullptr;
+      auto is = [&](const char *_name) { return std::strcmp(arg, _name) == 0; };
+      if (is("--help") || is("-h"))
+      {
+        printUsage(_argv[0]);
+        return false;
+      }
+      if (next == nullptr)
+      {
+        continue;
+      }
+      if (is("--counts"))
+      {
+        o_options.counts = parseList(next);
+      }
+      else if (is("--grains"))
+      {
+        o_options.grains = parseList(next);
+      }
+      else if (is("--grid-res"))
+      {
+        o_options.gridResolutions = parseList(next);
+      }
+      else if (is("--reorders"))
+      {
+        o_options.reorderIntervals = parseList(next);
+      }
+      else if (is("--steps"))
+      {
+        o_options.steps = std::max<size_t>(1, std::strtoul(next, nullptr, 10));
+      }
+      else if (is("--substeps"))
+      {
+        o_options.substeps = std::max<size_t>(1, std::strtoul(next, nullptr, 10));
+      }
+      else if (is("--warmup"))
+      {
+        o_options.warmup = std::strtoul(next, nullptr, 10);
+      }
+      else if (is("--dt"))
+      {
+        o_options.dt = std::strtof(next, nullptr);
+      }
+      else if (is("--output"))
+      {
+        o_options.output = next;
+      }
+      else
+      {
+        continue;
+      }
+      ++i;
+    }
+    return true;
+  }
+
+  size_t peakRSS()
+  {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+  }
+
+  double percentile(std::vector<double> _sorted, double _p)
+  {
+    std::sort(_sorted.begin(), _sorted.end());
+    size_t index = static_cast<size_t>(_p * (_sorted.size() - 1) + 0.5);
+    return _sorted[std::min(index, _sorted.size() - 1)];
+  }
+
+  BenchResult runCase(ParticleSimulator &_sim, const BenchOptions &_options, const std::vector<float> &_attractors,
+                      const std::vector<float> &_emitters, size_t _count, uint32_t _seed)
+  {
+    using Clock = std::chrono::steady_clock;
+    // startup, allocating and filling the particle state
+    auto initStart = Clock::now();
+    _sim.initialize(_count, _seed);
+    _sim.finish();
+    double initMs = std::chrono::duration<double, std::milli>(Clock::now() - initStart).count();
+    _sim.setAttractors(_attractors.data(), _attractors.size() / 3);
+    _sim.setEmitters(_emitters.data(), _emitters.size() / 4);
+    // the first step also pays for any one off work such as baking the force field
+    auto firstStart = Clock::now();
+    _sim.step(_options.dt);
+    _sim.finish();
+    double firstStepMs = std::chrono::duration<double, std::milli>(Clock::now() - firstStart).count();
+    for (size_t i = 0; i < _options.warmup; ++i)
+    {
+      _sim.step(_options.dt);
+    }
+    _sim.finish();
+
+    std::vector<double> times;
+    times.reserve(_options.steps);
+    for (size_t i = 0; i < _options.steps; ++i)
+    {
+      auto start = Clock::now();
+      _sim.advance(_options.dt, _options.substeps);
+      _sim.finish();
+      times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count() / _options.substeps);
+    }
+
+    BenchResult r;
+    r.particles = _count;
+    r.initMs = initMs;
+    r.firstStepMs = firstStepMs;
+    double total = 0.0;
+    for (auto t : times)
+    {
+      total += t;
+    }
+    r.meanMs = total / times.size();
+    r.p50Ms = percentile(times, 0.50);
+    r.p99Ms = percentile(times, 0.99);
+    r.particlesPerSec = _count / (r.meanMs * 1e-3);
+    r.nsPerParticle = r.meanMs * 1e6 / _count;
+    r.memoryBytes = _sim.memoryFootprint();
+    r.liveParticles = _sim.liveCount();
+    r.peakRSSBytes = peakRSS();
+    return r;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief relative RMS error of the baked grid against the exact per attractor force at random points in the
+  /// region the particles live in
+  //----------------------------------------------------------------------------------------------------------------------
+  double fieldError(CPUParticleSimulator &_sim, uint32_t _seed)
+  {
+    std::mt19937 gen(_seed);
+    std::uniform_real_distribution<float> dist(-40.0f, 40.0f);
+    double error = 0.0;
+    double magnitude = 0.0;
+    for (size_t i = 0; i < 4096; ++i)
+    {
+      float x = dist(gen);
+      float y = dist(gen);
+      float z = dist(gen);
+      auto exact = _sim.forceAt(x, y, z, false);
+      auto baked = _sim.forceAt(x, y, z, true);
+      for (size_t c = 0; c < 3; ++c)
+      {
+        error += (baked[c] - exact[c]) * (baked[c] - exact[c]);
+        magnitude += exact[c] * exact[c];
+      }
+    }
+    return magnitude > 0.0 ? std::sqrt(error / magnitude) : 0.0;
+  }
+
+  void writeJSON(std::ostream &_out, const SimulationConfig &_config, const BenchOptions &_options,
+                 size_t _threads, const std::vector<BenchResult> &_results)
+  {
+    _out << "{\n"
+         << "  \"backend\": \"" << toString(_config.backend) << "\",\n"
+         << "  \"threads\": " << _threads << ",\n"
+         << "  \"simd_width\": " << simd::c_width << ",\n"
+         << "  \"steps\": " << _options.steps << ",\n"
+         << "  \"substeps\": " << _options.substeps << ",\n"
+         << "  \"attractors\": " << _config.numAttractors << ",\n"
+         << "  \"force_mode\": \"" << toString(_config.forceMode) << "\",\n"
+         << "  \"neighbor_radius\": " << _config.neighborRadius << ",\n"
+         << "  \"emitters\": " << _config.numEmitters << ",\n"
+         << "  \"emit_rate\": " << _config.emitRate << ",\n"
+         << "  \"dt\": " << _options.dt << ",\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < _results.size(); ++i)
+    {
+      const auto &r = _results[i];
+      _out << "    {\"particles\": " << r.particles << ", \"grain\": " << r.grain
+           << ", \"particles_per_sec\": " << r.particlesPerSec << ", \"ns_per_particle\": " << r.nsPerParticle
+           << ", \"step_ms_mean\": " << r.meanMs << ", \"step_ms_p50\": " << r.p50Ms
+           << ", \"step_ms_p99\": " << r.p99Ms << ", \"memory_bytes\": " << r.memoryBytes
+           << ", \"peak_rss_bytes\": " << r.peakRSSBytes << ", \"init_ms\": " << r.initMs
+           << ", \"first_step_ms\": " << r.firstStepMs << ", \"live_particles\": " << r.liveParticles
+           << ", \"reorder_interval\": " << r.reorderInterval;
+      if (_config.forceMode == ForceMode::Grid)
+      {
+        _out << ", \"grid_res\": " << r.gridResolution << ", \"field_rel_rms_error\": " << r.fieldError;
+      }
+      if (_config.deterministic)
+      {
+        _out << ", \"checksum\": \"" << std::hex << r.checksum << std::dec << "\"";
+      }
+      _out << "}" << (i + 1 < _results.size() ? "," : "") << "\n";
+    }
+    _out << "  ]\n}\n";
+  }
+} // end anon namespace
+
+int main(int argc, char **argv)
+{
+  SimulationConfig config;
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options) || !config.parse(argc, argv))
+  {
+    return EXIT_FAILURE;
+  }
+  if (config.backend != SimulatorBackend::CPU)
+  {
+    std::cerr << "the headless benchmark has no GL context, using the cpu backend\n";
+    config.backend = SimulatorBackend::CPU;
+  }
+  if (!config.loadCheckpoint.empty() || config.checkpointInterval != 0 || config.checkpointCompress)
+  {
+    // every run starts from the seed so the timings and checksums of two runs can be compared
+    std::cerr << "the headless benchmark doesn't load or write checkpoints, ignoring --load, --checkpoint-every and "
+                 "--compress\n";
+    config.loadCheckpoint.clear();
+    config.checkpointInterval = 0;
+    config.checkpointCompress = false;
+  }
+
+  // a systems table fixes the counts, every system is stepped in the same pool pass
+  std::vector<size_t> counts = options.counts;
+  if (!config.particleSystems.empty())
+  {
+    ParticleSystems systems;
+    if (!systems.load(config.particleSystems))
+    {
+      return EXIT_FAILURE;
+    }
+    counts = {systems.numParticles()};
+    config.numAttractors = systems.numAttractors();
+  }
+  // same distribution as ngl::Random::getRandomPoint(20,20,20) in the GUI
+  std::mt19937 gen(config.seed);
+  std::uniform_real_distribution<float> dist(-20.0f, 20.0f);
+  std::vector<float> attractors(config.numAttractors * 3);
+  for (auto &a : attractors)
+  {
+    a = dist(gen);
+  }
+  // emitters from the same distribution with a spawn radius of 2, as in the GUI
+  std::vector<float> emitters(config.numEmitters * 4);
+  for (size_t i = 0; i < emitters.size(); ++i)
+  {
+    emitters[i] = i % 4 == 3 ? 2.0f : dist(gen);
+  }
+
+  // stdout may be the JSON so only the trace file, no console summary
+  if (!config.traceFile.empty())
+  {
+    Profiler::start(config.traceFile, false);
+  }
+  CPUParticleSimulator sim(config);
+  std::vector<size_t> gridResolutions = options.gridResolutions;
+  if (gridResolutions.empty() || config.forceMode != ForceMode::Grid)
+  {
+    gridResolutions = {config.gridResolution};
+  }
+  std::vector<size_t> reorderIntervals = options.reorderIntervals;
+  if (reorderIntervals.empty())
+  {
+    reorderIntervals = {config.reorderInterval};
+  }
+  std::vector<BenchResult> results;
+  for (auto count : counts)
+  {
+    for (auto grain : options.grains)
+    {
+      for (auto res : gridResolutions)
+      {
+        for (auto reorder : reorderIntervals)
+        {
+          sim.setGrainSize(grain);
+          sim.setGridResolution(res);
+          sim.setReorderInterval(reorder);
+          results.push_back(runCase(sim, options, attractors, emitters, count, config.seed));
+          auto &r = results.back();
+          r.grain = grain;
+          r.gridResolution = res;
+          r.reorderInterval = reorder;
+          if (config.forceMode == ForceMode::Grid)
+          {
+            r.fieldError = fieldError(sim, config.seed);
+          }
+          // the position hash after the fixed number of steps, compare across runs / thread counts / substeps
+          if (config.deterministic)
+          {
+            r.checksum = sim.positionChecksum();
+          }
+          std::cerr << count << " particles grain " << grain << " reorder " << reorder << " : " << r.nsPerParticle
+                    << " ns/particle p99 " << r.p99Ms << " ms\n";
+        }
+      }
+    }
+  }
+
+  Profiler::stop();
+  if (options.output.empty())
+  {
+    writeJSON(std::cout, config, options, sim.numThreads(), results);
+  }
+  else
+  {
+    std::ofstream file(options.output);
+    writeJSON(file, config, options, sim.numThreads(), results);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,979 @@
+#include "CPUParticleSimulator.h"
+#include "CheckpointReader.h"
+#include "ParticleFormat.h"
+#include "Philox.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using simd::Float;
+
+CPUParticleSimulator::CPUParticleSimulator(const SimulationConfig &_config)
+  : m_pool(_config.numThreads, _config.streamChunk != 0), m_forceMode(_config.forceMode),
+    m_streamChunk((_config.streamChunk + c_chunkAlign - 1) / c_chunkAlign * c_chunkAlign),
+    m_lifecycle(_config.numEmitters != 0),
+    m_emitRate(_config.emitRate), m_stepSeconds(_config.stepMs / 1000.0f),
+    m_gridResolution(_config.gridResolution), m_gridExtent(_config.gridExtent),
+    m_neighborRadius(_config.neighborRadius), m_separation(_config.separation),
+    m_reorderInterval(_config.reorderInterval), m_reorderExtent(_config.positionExtent)
+{
+  // load prints why a file is rejected, the attractors then just stay where the host puts them
+  if (!_config.attractorPaths.empty())
+  {
+    m_paths.load(_config.attractorPaths);
+  }
+  if (!_config.particleSystems.empty())
+  {
+    m_systems.load(_config.particleSystems);
+  }
+}
+
+size_t CPUParticleSimulator::grainSize(size_t _count) const
+{
+  if (m_grainOverride != 0)
+  {
+    return (m_grainOverride + c_chunkAlign - 1) / c_chunkAlign * c_chunkAlign;
+  }
+  // aim for a few chunks per thread so the atomic work stealing can even out the load
+  size_t chunks = m_pool.size() * 8;
+  size_t grain = (_count + chunks - 1) / chunks;
+  grain = (grain + c_chunkAlign - 1) / c_chunkAlign * c_chunkAlign;
+  return std::max(grain, c_chunkAlign * 16);
+}
+
+void CPUParticleSimulator::forEachParticle(size_t _count, const ThreadPool::RangeFunction &_fn)
+{
+  if (m_streamChunk == 0)
+  {
+    m_pool.parallelFor(_count, grainSize(_count), _fn);
+    return;
+  }
+  for (size_t first = 0; first < _count; first += m_streamChunk)
+  {
+    m_pool.parallelForStatic(std::min(m_streamChunk, _count - first), c_chunkAlign,
+                             [&](size_t _begin, size_t _end) { _fn(first + _begin, first + _end); });
+  }
+}
+
+void CPUParticleSimulator::initialize(size_t _numParticles, uint32_t _seed)
+{
+  PROFILE_SCOPE("initialize");
+  m_numParticles = m_systems.empty() ? _numParticles : m_systems.numParticles();
+  m_paddedCount = (m_numParticles + c_chunkAlign - 1) / c_chunkAlign * c_chunkAlign;
+  // no zero fill, every element including the padding is written by the parallel loop below
+  for (auto *stream : {&m_px, &m_py, &m_pz, &m_pw, &m_vx, &m_vy, &m_vz})
+  {
+    stream->resize(m_paddedCount);
+  }
+  if (m_neighborRadius > 0.0f)
+  {
+    // the padding stays zero so the SIMD loads past the last particle add nothing
+    for (auto *stream : {&m_nx, &m_ny, &m_nz})
+    {
+      stream->assign(m_paddedCount, 0.0f);
+    }
+  }
+  m_seed = _seed;
+  m_stepIndex = 0;
+  // every particle's start state is a function of its index and the seed so the chunking doesn't matter, the
+  // padding is filled too so it never produces NaNs. This is initialState c_width particles at a time, the same
+  // operations in the same order so the bits match the GPU backend.
+  forEachParticle(m_paddedCount, [&](size_t _begin, size_t _end) {
+    const Float half(0.5f);
+    const Float range(80.0f);
+    for (size_t i = _begin; i < _end; i += simd::c_width)
+    {
+      simd::NativeInt p[4];
+      simd::NativeInt v[4];
+      philox::generate(philox::laneIndices(i), 0, philox::c_initPosition, _seed, p);
+      philox::generate(philox::laneIndices(i), 0, philox::c_initVelocity, _seed, v);
+      ((philox::uniform(p[0]) - half) * range).store(&m_px[i]);
+      ((philox::uniform(p[1]) - half) * range).store(&m_py[i]);
+      ((philox::uniform(p[2]) - half) * range).store(&m_pz[i]);
+      (philox::uniform(p[3]) + Float(0.1f)).store(&m_pw[i]);
+      ((Float(0.001f) + philox::uniform(v[0])) - half).store(&m_vx[i]);
+      ((Float(0.001f) + philox::uniform(v[1])) - half).store(&m_vy[i]);
+      ((Float(0.001f) + philox::uniform(v[2])) - half).store(&m_vz[i]);
+    }
+  });
+  // an emitter pool starts empty, the slots still get the start state so they hold finite values
+  m_liveCount = m_numParticles;
+  m_pendingBurst = 0;
+  if (m_lifecycle)
+  {
+    std::fill(m_pw.begin(), m_pw.end(), 0.0f);
+    m_liveCount = 0;
+  }
+}
+
+bool CPUParticleSimulator::restore(const CheckpointReader &_reader)
+{
+  PROFILE_SCOPE("restore checkpoint");
+  const checkpoint::FileHeader &header = _reader.header();
+  if (!m_systems.empty() && header.numParticles != m_systems.numParticles())
+  {
+    std::cerr << "the checkpoint has " << header.numParticles << " particles, the systems " << m_systems.numParticles()
+              << '\n';
+    return false;
+  }
+  m_numParticles = static_cast<size_t>(header.numParticles);
+  m_paddedCount = (m_numParticles + c_chunkAlign - 1) / c_chunkAlign * c_chunkAlign;
+  for (auto *stream : {&m_px, &m_py, &m_pz, &m_pw, &m_vx, &m_vy, &m_vz})
+  {
+    stream->resize(m_paddedCount);
+  }
+  if (m_streamChunk != 0)
+  {
+    // the chunks below are copied a stream per thread, touch the pages with the static split first
+    forEachParticle(m_paddedCount, [&](size_t _begin, size_t _end) {
+      for (auto *stream : {&m_px, &m_py, &m_pz, &m_pw, &m_vx, &m_vy, &m_vz})
+      {
+        std::fill(stream->begin() + _begin, stream->begin() + _end, 0.0f);
+      }
+    });
+  }
+  if (m_neighborRadius > 0.0f)
+  {
+    for (auto *stream : {&m_nx, &m_ny, &m_nz})
+    {
+      stream->assign(m_paddedCount, 0.0f);
+    }
+  }
+  m_seed = header.seed;
+  m_stepIndex = header.stepIndex;
+  m_pendingBurst = 0;
+  m_snapshotReady = false;
+  // the file packs the live particles first, just what the lifecycle wants
+  m_liveCount = m_lifecycle ? static_cast<size_t>(header.liveCount) : m_numParticles;
+  // in checkpoint::Stream order
+  simd::AlignedVector<float> *streams[checkpoint::c_numStreams] = {&m_px, &m_py, &m_pz, &m_pw, &m_vx, &m_vy, &m_vz};
+  CheckpointReader::Chunk chunk;
+  for (size_t c = 0; c < _reader.numChunks(); ++c)
+  {
+    if (!_reader.readChunk(c, m_pool, chunk))
+    {
+      return false;
+    }
+    const size_t first = _reader.chunkFirst(c);
+    const size_t count = _reader.chunkCount(c);
+    m_pool.parallelFor(checkpoint::c_numStreams, 1, [&](size_t _begin, size_t _end) {
+      for (size_t s = _begin; s < _end; ++s)
+      {
+        std::copy(chunk.streams[s], chunk.streams[s] + count, streams[s]->begin() + first);
+      }
+    });
+  }
+  // the padding gets a start state like initialize so its lanes stay finite
+  for (size_t i = m_numParticles; i < m_paddedCount; ++i)
+  {
+    float p[4];
+    float v[3];
+    initialState(static_cast<uint32_t>(i), m_seed, p, v);
+    m_px[i] = p[0];
+    m_py[i] = p[1];
+    m_pz[i] = p[2];
+    m_pw[i] = m_lifecycle ? 0.0f : p[3];
+    m_vx[i] = v[0];
+    m_vy[i] = v[1];
+    m_vz[i] = v[2];
+  }
+  return true;
+}
+
+bool CPUParticleSimulator::requestSnapshot()
+{
+  if (m_snapshotReady)
+  {
+    return false;
+  }
+  PROFILE_SCOPE("snapshot");
+  m_snapshot.numParticles = m_numParticles;
+  m_snapshot.lifecycle = m_lifecycle;
+  m_snapshot.seed = m_seed;
+  m_snapshot.stepIndex = m_stepIndex;
+  m_snapshot.format = ParticleFormat::Full;
+  m_snapshot.positions.resize(m_numParticles * particleformat::positionStride(ParticleFormat::Full));
+  m_snapshot.velocities.resize(m_numParticles * particleformat::velocityStride(ParticleFormat::Full));
+  // the GPU Full layout, x,y,z,life and x,y,z,0
+  auto positions = reinterpret_cast<float *>(m_snapshot.positions.data());
+  auto velocities = reinterpret_cast<float *>(m_snapshot.velocities.data());
+  m_pool.parallelFor(m_numParticles, grainSize(m_numParticles), [&](size_t _begin, size_t _end) {
+    for (size_t i = _begin; i < _end; ++i)
+    {
+      positions[i * 4 + 0] = m_px[i];
+      positions[i * 4 + 1] = m_py[i];
+      positions[i * 4 + 2] = m_pz[i];
+      positions[i * 4 + 3] = m_pw[i];
+      velocities[i * 4 + 0] = m_vx[i];
+      velocities[i * 4 + 1] = m_vy[i];
+      velocities[i * 4 + 2] = m_vz[i];
+      velocities[i * 4 + 3] = 0.0f;
+    }
+  });
+  m_snapshotReady = true;
+  return true;
+}
+
+bool CPUParticleSimulator::pollSnapshot(checkpoint::Frame &o_frame)
+{
+  if (!m_snapshotReady)
+  {
+    return false;
+  }
+  o_frame = std::move(m_snapshot);
+  m_snapshot = checkpoint::Frame();
+  m_snapshotReady = false;
+  return true;
+}
+
+void CPUParticleSimulator::setEmitters(const float *_xyzr, size_t _count)
+{
+  m_emitters.assign(_xyzr, _xyzr + _count * 4);
+}
+
+void CPUParticleSimulator::compactLive()
+{
+  PROFILE_SCOPE("compact");
+  // only the particles that died this step are moved so the cost is the scan plus the deaths. Whole packs
+  // without a dead lane are skipped with one compare.
+  const Float zero(0.0f);
+  size_t live = m_liveCount;
+  size_t i = 0;
+  while (i < live)
+  {
+    if (i + simd::c_width <= live && simd::maskBits(simd::lessEqual(Float::load(&m_pw[i]), zero)) == 0)
+    {
+      i += simd::c_width;
+      continue;
+    }
+    if (m_pw[i] > 0.0f)
+    {
+      ++i;
+      continue;
+    }
+    // fill the hole from the end, the moved particle is checked again as it may have expired too
+    --live;
+    for (auto *stream : {&m_px, &m_py, &m_pz, &m_pw, &m_vx, &m_vy, &m_vz})
+    {
+      (*stream)[i] = (*stream)[live];
+    }
+    m_pw[live] = 0.0f;
+  }
+  m_liveCount = live;
+}
+
+void CPUParticleSimulator::emitParticles()
+{
+  size_t request = m_emitters.empty() ? 0 : m_emitRate + m_pendingBurst;
+  size_t spawn = std::min(request, m_numParticles - m_liveCount);
+  m_pendingBurst = 0;
+  if (spawn == 0)
+  {
+    return;
+  }
+  PROFILE_SCOPE("emit");
+  const size_t first = m_liveCount;
+  const size_t numEmitters = m_emitters.size() / 4;
+  // emitted particle k comes from emitter k % numEmitters
+  m_pool.parallelFor(spawn, std::max<size_t>(4096, grainSize(spawn)), [&](size_t _begin, size_t _end) {
+    for (size_t k = _begin; k < _end; ++k)
+    {
+      size_t slot = first + k;
+      float p[4];
+      float v[3];
+      emittedState(static_cast<uint32_t>(slot), m_stepIndex, m_seed, &m_emitters[(k % numEmitters) * 4], p, v);
+      m_px[slot] = p[0];
+      m_py[slot] = p[1];
+      m_pz[slot] = p[2];
+      m_pw[slot] = p[3];
+      m_vx[slot] = v[0];
+      m_vy[slot] = v[1];
+      m_vz[slot] = v[2];
+    }
+  });
+  m_liveCount += spawn;
+}
+
+void CPUParticleSimulator::setAttractors(const float *_xyz, size_t _count)
+{
+  // the summed kernel only ever uses the sum of the attractors so do that once here rather than per particle
+  m_forcePoint = {{0.0f, 0.0f, 0.0f}};
+  for (size_t i = 0; i < _count; ++i)
+  {
+    m_forcePoint[0] += _xyz[i * 3 + 0];
+    m_forcePoint[1] += _xyz[i * 3 + 1];
+    m_forcePoint[2] += _xyz[i * 3 + 2];
+  }
+  // the tiled kernel wants them as SoA so a tile can be broadcast one attractor at a time
+  m_attractorX.resize(_count);
+  m_attractorY.resize(_count);
+  m_attractorZ.resize(_count);
+  for (size_t i = 0; i < _count; ++i)
+  {
+    m_attractorX[i] = _xyz[i * 3 + 0];
+    m_attractorY[i] = _xyz[i * 3 + 1];
+    m_attractorZ[i] = _xyz[i * 3 + 2];
+  }
+  // each system sums its own slice, in the same order as the BATCHED shader
+  m_systemForces.clear();
+  for (const auto &system : m_systems.systems())
+  {
+    SystemForce force = {{{0.0f, 0.0f, 0.0f}}, system.kV, system.gauss, system.decay};
+    size_t end = std::min<size_t>(system.firstAttractor + system.numAttractors, _count);
+    for (size_t i = system.firstAttractor; i < end; ++i)
+    {
+      force.forcePoint[0] += _xyz[i * 3 + 0];
+      force.forcePoint[1] += _xyz[i * 3 + 1];
+      force.forcePoint[2] += _xyz[i * 3 + 2];
+    }
+    m_systemForces.push_back(force);
+  }
+  m_fieldDirty = true;
+}
+
+void CPUParticleSimulator::animateAttractors()
+{
+  m_pathPositions.resize(m_attractorX.size() * 3);
+  m_paths.evaluate(m_stepIndex, m_stepSeconds, m_attractorX.size(), m_pathPositions.data());
+  setAttractors(m_pathPositions.data(), m_attractorX.size());
+}
+
+void CPUParticleSimulator::writeAttractors(float *o_xyzw) const
+{
+  for (size_t i = 0; i < m_attractorX.size(); ++i)
+  {
+    o_xyzw[i * 4 + 0] = m_attractorX[i];
+    o_xyzw[i * 4 + 1] = m_attractorY[i];
+    o_xyzw[i * 4 + 2] = m_attractorZ[i];
+    o_xyzw[i * 4 + 3] = 0.0f;
+  }
+}
+
+void CPUParticleSimulator::setGridResolution(size_t _resolution)
+{
+  m_gridResolution = std::max<size_t>(_resolution, 2);
+  m_fieldDirty = true;
+}
+
+std::array<float, 3> CPUParticleSimulator::centroid() const
+{
+  size_t n = m_attractorX.size();
+  if (n == 0)
+  {
+    return {{0.0f, 0.0f, 0.0f}};
+  }
+  return {{m_forcePoint[0] / n, m_forcePoint[1] / n, m_forcePoint[2] / n}};
+}
+
+void CPUParticleSimulator::step(float _dt)
+{
+  PROFILE_SCOPE("cpu step");
+  float newDT = _dt * 100.0f;
+  if (!m_paths.empty())
+  {
+    PROFILE_SCOPE("animate attractors");
+    animateAttractors();
+  }
+  if (m_forceMode == ForceMode::Grid && m_fieldDirty)
+  {
+    PROFILE_SCOPE("bake field");
+    bakeField();
+  }
+  if (m_neighborRadius > 0.0f)
+  {
+    PROFILE_SCOPE("neighbor forces");
+    computeNeighborForces();
+  }
+  // with the lifecycle only the packed live range is stepped, the dead lanes of its last chunk are harmless
+  size_t active = m_paddedCount;
+  if (m_lifecycle)
+  {
+    active = std::min((m_liveCount + c_chunkAlign - 1) / c_chunkAlign * c_chunkAlign, m_paddedCount);
+  }
+  {
+    PROFILE_SCOPE("integrate");
+    forEachParticle(active, [&](size_t _begin, size_t _end) { stepRangeMode(_begin, _end, newDT, m_stepIndex); });
+  }
+  if (m_lifecycle)
+  {
+    compactLive();
+    emitParticles();
+  }
+  ++m_stepIndex;
+  reorderIfDue();
+}
+
+void CPUParticleSimulator::reorderIfDue()
+{
+  if (m_reorderInterval == 0 || m_stepIndex % m_reorderInterval != 0)
+  {
+    return;
+  }
+  PROFILE_SCOPE("morton reorder");
+  // the live particles are [0,m_liveCount) with or without the lifecycle, the padding and dead slots stay put
+  m_mortonOrder.build(m_px.data(), m_py.data(), m_pz.data(), m_liveCount, m_reorderExtent, m_pool);
+  m_reorderScratch.resize(m_paddedCount);
+  for (auto *stream : {&m_px, &m_py, &m_pz, &m_pw, &m_vx, &m_vy, &m_vz})
+  {
+    m_mortonOrder.gather(stream->data(), m_reorderScratch.data(), m_pool);
+    std::copy(stream->begin() + m_liveCount, stream->end(), m_reorderScratch.begin() + m_liveCount);
+    stream->swap(m_reorderScratch);
+  }
+}
+
+void CPUParticleSimulator::advance(float _dt, size_t _steps)
+{
+  // the neighbour force couples every particle to the previous step of all the others so those steps can't be
+  // fused, nor can a single step gain anything from it. Animated attractors move between the substeps and
+  // the lifecycle reshuffles the particles after every one.
+  if (m_neighborRadius > 0.0f || _steps < 2 || !m_paths.empty() || m_lifecycle)
+  {
+    ParticleSimulator::advance(_dt, _steps);
+    return;
+  }
+  PROFILE_SCOPE("cpu advance");
+  float newDT = _dt * 100.0f;
+  if (m_forceMode == ForceMode::Grid && m_fieldDirty)
+  {
+    PROFILE_SCOPE("bake field");
+    bakeField();
+  }
+  // otherwise each particle only depends on itself and the attractors, so run all the substeps on one block
+  // while it is in L1 instead of streaming the whole state through memory once per substep. The arithmetic is
+  // the same as _steps calls to step.
+  // the substeps are only fused up to the next reorder, which needs every particle at the same step
+  while (_steps != 0)
+  {
+    size_t run = _steps;
+    if (m_reorderInterval != 0)
+    {
+      run = std::min(run, m_reorderInterval - m_stepIndex % m_reorderInterval);
+    }
+    forEachParticle(m_paddedCount, [&](size_t _begin, size_t _end) {
+      for (size_t block = _begin; block < _end; block += c_particleBlock)
+      {
+        size_t blockEnd = std::min(block + c_particleBlock, _end);
+        for (size_t s = 0; s < run; ++s)
+        {
+          stepRangeMode(block, blockEnd, newDT, m_stepIndex + static_cast<uint32_t>(s));
+        }
+      }
+    });
+    m_stepIndex += static_cast<uint32_t>(run);
+    _steps -= run;
+    reorderIfDue();
+  }
+}
+
+void CPUParticleSimulator::stepRangeMode(size_t _begin, size_t _end, float _newDT, uint32_t _step)
+{
+  switch (m_forceMode)
+  {
+    case ForceMode::Summed:
+      if (m_systems.empty())
+      {
+        stepRange(_begin, _end, _newDT, _step,
+                  {m_forcePoint, ParticleSystems::c_defaultKV, ParticleSystems::c_defaultGauss,
+                   ParticleSystems::c_defaultDecay});
+      }
+      else
+      {
+        stepSystems(_begin, _end, _newDT, _step);
+      }
+      break;
+    case ForceMode::Tiled:
+      stepRangeTiled(_begin, _end, _newDT, _step);
+      break;
+    case ForceMode::Grid:
+      stepRangeGrid(_begin, _end, _newDT, _step);
+      break;
+  }
+}
+
+void CPUParticleSimulator::readPositions(float *o_xyzw, size_t _first, size_t _count)
+{
+  for (size_t i = 0; i < _count; ++i)
+  {
+    o_xyzw[i * 4 + 0] = m_px[_first + i];
+    o_xyzw[i * 4 + 1] = m_py[_first + i];
+    o_xyzw[i * 4 + 2] = m_pz[_first + i];
+    o_xyzw[i * 4 + 3] = m_pw[_first + i];
+  }
+}
+
+void CPUParticleSimulator::computeNeighborForces()
+{
+  {
+    PROFILE_SCOPE("spatial hash");
+    m_spatialHash.build(m_px.data(), m_py.data(), m_pz.data(), m_numParticles, m_neighborRadius, m_pool);
+  }
+  const auto &sorted = m_spatialHash.sortedIndices();
+  const float *sortedX = m_spatialHash.sortedX();
+  const float *sortedY = m_spatialHash.sortedY();
+  const float *sortedZ = m_spatialHash.sortedZ();
+  const Float radius2(m_neighborRadius * m_neighborRadius);
+  const Float invRadius(1.0f / m_neighborRadius);
+  const Float separation(m_separation);
+  const Float zero(0.0f);
+  const Float one(1.0f);
+  // walk the particles in cell order so consecutive queries touch the same neighbours
+  m_pool.parallelFor(m_numParticles, grainSize(m_numParticles), [&](size_t _begin, size_t _end) {
+    alignas(simd::c_alignment) float lane[simd::c_width];
+    for (size_t l = 0; l < simd::c_width; ++l)
+    {
+      lane[l] = static_cast<float>(l);
+    }
+    const Float laneOffset = Float::load(lane);
+    for (size_t k = _begin; k < _end; ++k)
+    {
+      const Float x(sortedX[k]);
+      const Float y(sortedY[k]);
+      const Float z(sortedZ[k]);
+      Float fx(0.0f);
+      Float fy(0.0f);
+      Float fz(0.0f);
+      Float count(0.0f);
+      // the dense clumps around the attractors give hundreds of candidates per particle so each cell is
+      // scanned c_width candidates at a time, the cap is checked once per cell
+      m_spatialHash.forEachNeighborRange(sortedX[k], sortedY[k], sortedZ[k], [&](uint32_t _first, uint32_t _last) {
+        for (uint32_t j = _first; j < _last; j += simd::c_width)
+        {
+          Float dx = x - Float::load(sortedX + j);
+          Float dy = y - Float::load(sortedY + j);
+          Float dz = z - Float::load(sortedZ + j);
+          Float d2 = simd::dot(dx, dy, dz, dx, dy, dz);
+          // lanes past _last belong to the next slot, d2 > 0 skips the particle itself and exact overlaps
+          Float inside = simd::maskAnd(simd::maskAnd(simd::less(d2, radius2), simd::less(zero, d2)),
+                                       simd::less(laneOffset, Float(static_cast<float>(_last - j))));
+          Float d = simd::sqrt(simd::max(d2, Float(1e-12f)));
+          Float scale = simd::select(inside, separation * (one - d * invRadius) / d, zero);
+          fx = fx + dx * scale;
+          fy = fy + dy * scale;
+          fz = fz + dz * scale;
+          count = count + simd::select(inside, one, zero);
+        }
+        return simd::horizontalAdd(count) < c_maxNeighbors;
+      });
+      uint32_t i = sorted[k];
+      m_nx[i] = simd::horizontalAdd(fx);
+      m_ny[i] = simd::horizontalAdd(fy);
+      m_nz[i] = simd::horizontalAdd(fz);
+    }
+  });
+}
+
+void CPUParticleSimulator::integrate(size_t _i, Float _fx, Float _fy, Float _fz, Float _pullX, Float _pullY,
+                                     Float _pullZ, Float _newDT, uint32_t _step, float _kV, float _decay)
+{
+  const Float kV(_kV);
+  if (m_neighborRadius > 0.0f)
+  {
+    _fx = _fx + Float::load(&m_nx[_i]);
+    _fy = _fy + Float::load(&m_ny[_i]);
+    _fz = _fz + Float::load(&m_nz[_i]);
+  }
+  Float x = Float::load(&m_px[_i]);
+  Float y = Float::load(&m_py[_i]);
+  Float z = Float::load(&m_pz[_i]);
+  Float w = Float::load(&m_pw[_i]);
+
+  // velocity
+  Float nvx = Float::load(&m_vx[_i]) + _fx * _newDT;
+  Float nvy = Float::load(&m_vy[_i]) + _fy * _newDT;
+  Float nvz = Float::load(&m_vz[_i]) + _fz * _newDT;
+  simd::normalize(nvx, nvy, nvz);
+  nvx = nvx * kV + _pullX * Float(0.005f);
+  nvy = nvy * kV + _pullY * Float(0.005f);
+  nvz = nvz * kV + _pullZ * Float(0.005f);
+
+  // position
+  Float sx = x + nvx * _newDT;
+  Float sy = y + nvy * _newDT;
+  Float sz = z + nvz * _newDT;
+  w = w - Float(_decay) * _newDT;
+
+  // expired particles are respawned, only pay for the extra draw if a lane needs it. With the lifecycle they
+  // are left dead for compactLive instead
+  Float expired = simd::lessEqual(w, Float(0.0f));
+  if (m_lifecycle)
+  {
+    w = simd::select(expired, Float(0.0f), w);
+  }
+  else if (simd::any(expired))
+  {
+    simd::NativeInt words[4];
+    philox::generate(philox::laneIndices(_i), _step, philox::c_respawn, m_seed, words);
+    Float r = philox::uniform(words[0]) * Float(40.0f) - philox::uniform(words[1]) * Float(40.0f);
+    sx = simd::select(expired, -sx + r, sx);
+    sy = simd::select(expired, -sy + r, sy);
+    sz = simd::select(expired, -sz + r, sz);
+    w = simd::select(expired, Float(0.99f), w);
+  }
+
+  sx.store(&m_px[_i]);
+  sy.store(&m_py[_i]);
+  sz.store(&m_pz[_i]);
+  w.store(&m_pw[_i]);
+  nvx.store(&m_vx[_i]);
+  nvy.store(&m_vy[_i]);
+  nvz.store(&m_vz[_i]);
+}
+
+void CPUParticleSimulator::stepSystems(size_t _begin, size_t _end, float _newDT, uint32_t _step)
+{
+  const auto &systems = m_systems.systems();
+  // the first system ending after _begin, the ranges are sorted and contiguous
+  auto system = std::upper_bound(systems.begin(), systems.end(), _begin,
+                                 [](size_t _i, const ParticleSystems::System &_s) { return _i < _s.first + _s.count; });
+  for (; system != systems.end() && system->first < _end; ++system)
+  {
+    const size_t index = static_cast<size_t>(system - systems.begin());
+    stepRange(std::max<size_t>(_begin, system->first), std::min<size_t>(_end, system->first + system->count), _newDT,
+              _step, m_systemForces[index]);
+  }
+}
+
+void CPUParticleSimulator::stepRange(size_t _begin, size_t _end, float _newDT, uint32_t _step,
+                                     const SystemForce &_system)
+{
+  // constants from calcForceFor / main in ParticlesCompute.glsl
+  const Float fpx(_system.forcePoint[0]);
+  const Float fpy(_system.forcePoint[1]);
+  const Float fpz(_system.forcePoint[2]);
+  const Float newDT(_newDT);
+
+  for (size_t i = _begin; i < _end; i += simd::c_width)
+  {
+    Float x = Float::load(&m_px[i]);
+    Float y = Float::load(&m_py[i]);
+    Float z = Float::load(&m_pz[i]);
+    // force noise in words 0,1 and the jitter in word 2, as in the shader
+    simd::NativeInt words[4];
+    philox::generate(philox::laneIndices(i), _step, philox::c_step, m_seed, words);
+
+    // calcForceFor(forcePoint,pos,noise)
+    Float dx = fpx - x;
+    Float dy = fpy - y;
+    Float dz = fpz - z;
+    Float len2 = simd::dot(dx, dy, dz, dx, dy, dz);
+    Float g = simd::exp(-len2 / Float(_system.gauss));
+    Float scale = Float(c_kWeak) * (Float(1.0f) + philox::uniform(words[0]) - philox::uniform(words[1])) /
+                  Float(10.0f) * g;
+    Float invLen = Float(1.0f) / simd::sqrt(len2);
+    Float jitter = philox::uniform(words[2]) / Float(100.0f);
+    integrate(i, dx * invLen * scale + jitter, dy * invLen * scale + jitter, dz * invLen * scale + jitter, dx, dy, dz,
+              newDT, _step, _system.kV, _system.decay);
+  }
+}
+
+simd::NativeInt CPUParticleSimulator::jitterWord(size_t _i, uint32_t _step) const
+{
+  simd::NativeInt words[4];
+  philox::generate(philox::laneIndices(_i), _step, philox::c_step, m_seed, words);
+  return words[2];
+}
+
+void CPUParticleSimulator::accumulateForce(Float _x, Float _y, Float _z, size_t _begin, size_t _end, Float &io_fx,
+                                           Float &io_fy, Float &io_fz) const
+{
+  // the hash noise in calcForceFor averages to 1/10 so the per attractor modes use that
+  const Float invGauss(-1.0f / c_gauss);
+  const Float strength(c_kWeak / 10.0f);
+  for (size_t a = _begin; a < _end; ++a)
+  {
+    Float dx = Float(m_attractorX[a]) - _x;
+    Float dy = Float(m_attractorY[a]) - _y;
+    Float dz = Float(m_attractorZ[a]) - _z;
+    Float len2 = simd::dot(dx, dy, dz, dx, dy, dz);
+    Float scale = strength * simd::exp(len2 * invGauss) / simd::sqrt(len2);
+    io_fx = io_fx + dx * scale;
+    io_fy = io_fy + dy * scale;
+    io_fz = io_fz + dz * scale;
+  }
+}
+
+void CPUParticleSimulator::stepRangeTiled(size_t _begin, size_t _end, float _newDT, uint32_t _step)
+{
+  const size_t numAttractors = m_attractorX.size();
+  const Float newDT(_newDT);
+  auto c = centroid();
+  const Float cx(c[0]);
+  const Float cy(c[1]);
+  const Float cz(c[2]);
+  // force accumulators for one block of particles, small enough to stay in L1 along with an attractor tile
+  alignas(simd::c_alignment) float fx[c_particleBlock];
+  alignas(simd::c_alignment) float fy[c_particleBlock];
+  alignas(simd::c_alignment) float fz[c_particleBlock];
+
+  for (size_t block = _begin; block < _end; block += c_particleBlock)
+  {
+    size_t blockEnd = std::min(block + c_particleBlock, _end);
+    std::fill(fx, fx + c_particleBlock, 0.0f);
+    std::fill(fy, fy + c_particleBlock, 0.0f);
+    std::fill(fz, fz + c_particleBlock, 0.0f);
+    // same loop order as the shared memory tiles in the shader, each attractor tile is reused by the whole block
+    for (size_t tile = 0; tile < numAttractors; tile += c_attractorTile)
+    {
+      size_t tileEnd = std::min(tile + c_attractorTile, numAttractors);
+      for (size_t i = block; i < blockEnd; i += simd::c_width)
+      {
+        Float x = Float::load(&m_px[i]);
+        Float y = Float::load(&m_py[i]);
+        Float z = Float::load(&m_pz[i]);
+        size_t local = i - block;
+        Float ax = Float::load(fx + local);
+        Float ay = Float::load(fy + local);
+        Float az = Float::load(fz + local);
+        accumulateForce(x, y, z, tile, tileEnd, ax, ay, az);
+        ax.store(fx + local);
+        ay.store(fy + local);
+        az.store(fz + local);
+      }
+    }
+    for (size_t i = block; i < blockEnd; i += simd::c_width)
+    {
+      size_t local = i - block;
+      Float x = Float::load(&m_px[i]);
+      Float y = Float::load(&m_py[i]);
+      Float z = Float::load(&m_pz[i]);
+      Float jitter = philox::uniform(jitterWord(i, _step)) / Float(100.0f);
+      integrate(i, Float::load(fx + local) + jitter, Float::load(fy + local) + jitter, Float::load(fz + local) + jitter,
+                cx - x, cy - y, cz - z, newDT, _step);
+    }
+  }
+}
+
+void CPUParticleSimulator::bakeField()
+{
+  const size_t res = m_gridResolution;
+  const float cellSize = 2.0f * m_gridExtent / res;
+  m_field.assign(res * res * res * 4, 0.0f);
+  // one row of x cells at a time, c_width cells per SIMD iteration
+  m_pool.parallelFor(res * res, 1, [&](size_t _begin, size_t _end) {
+    alignas(simd::c_alignment) float lane[simd::c_width];
+    for (size_t i = 0; i < simd::c_width; ++i)
+    {
+      lane[i] = static_cast<float>(i);
+    }
+    const Float laneOffset = Float::load(lane);
+    alignas(simd::c_alignment) float fx[simd::c_width];
+    alignas(simd::c_alignment) float fy[simd::c_width];
+    alignas(simd::c_alignment) float fz[simd::c_width];
+    for (size_t row = _begin; row < _end; ++row)
+    {
+      size_t y = row % res;
+      size_t z = row / res;
+      // cell centres so a texel centre lookup returns exactly the baked value
+      Float py(-m_gridExtent + (y + 0.5f) * cellSize);
+      Float pz(-m_gridExtent + (z + 0.5f) * cellSize);
+      for (size_t x = 0; x < res; x += simd::c_width)
+      {
+        Float px = Float(-m_gridExtent) + (Float(static_cast<float>(x) + 0.5f) + laneOffset) * Float(cellSize);
+        Float ax(0.0f);
+        Float ay(0.0f);
+        Float az(0.0f);
+        accumulateForce(px, py, pz, 0, m_attractorX.size(), ax, ay, az);
+        ax.store(fx);
+        ay.store(fy);
+        az.store(fz);
+        for (size_t i = 0; i < simd::c_width && x + i < res; ++i)
+        {
+          float *cell = &m_field[((row * res) + x + i) * 4];
+          cell[0] = fx[i];
+          cell[1] = fy[i];
+          cell[2] = fz[i];
+        }
+      }
+    }
+  });
+  m_fieldDirty = false;
+}
+
+void CPUParticleSimulator::sampleField(Float _x, Float _y, Float _z, Float &o_fx, Float &o_fy, Float &o_fz) const
+{
+  const size_t res = m_gridResolution;
+  const Float toGrid(res / (2.0f * m_gridExtent));
+  const Float maxCoord(static_cast<float>(res - 1));
+  // grid space with cell centres on integers, clamped like GL_CLAMP_TO_EDGE
+  alignas(simd::c_alignment) float u[3][simd::c_width];
+  simd::min(simd::max((_x + Float(m_gridExtent)) * toGrid - Float(0.5f), Float(0.0f)), maxCoord).store(u[0]);
+  simd::min(simd::max((_y + Float(m_gridExtent)) * toGrid - Float(0.5f), Float(0.0f)), maxCoord).store(u[1]);
+  simd::min(simd::max((_z + Float(m_gridExtent)) * toGrid - Float(0.5f), Float(0.0f)), maxCoord).store(u[2]);
+  alignas(simd::c_alignment) float f[3][simd::c_width];
+  for (size_t lane = 0; lane < simd::c_width; ++lane)
+  {
+    size_t i0[3];
+    float t[3];
+    for (size_t a = 0; a < 3; ++a)
+    {
+      i0[a] = std::min(static_cast<size_t>(u[a][lane]), res - 2);
+      t[a] = u[a][lane] - i0[a];
+    }
+    float result[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t corner = 0; corner < 8; ++corner)
+    {
+      size_t cx = i0[0] + (corner & 1);
+      size_t cy = i0[1] + ((corner >> 1) & 1);
+      size_t cz = i0[2] + ((corner >> 2) & 1);
+      float w = ((corner & 1) ? t[0] : 1.0f - t[0]) * (((corner >> 1) & 1) ? t[1] : 1.0f - t[1]) *
+                (((corner >> 2) & 1) ? t[2] : 1.0f - t[2]);
+      const float *cell = &m_field[((cz * res + cy) * res + cx) * 4];
+      result[0] += w * cell[0];
+      result[1] += w * cell[1];
+      result[2] += w * cell[2];
+    }
+    f[0][lane] = result[0];
+    f[1][lane] = result[1];
+    f[2][lane] = result[2];
+  }
+  o_fx = Float::load(f[0]);
+  o_fy = Float::load(f[1]);
+  o_fz = Float::load(f[2]);
+}
+
+void CPUParticleSimulator::stepRangeGrid(size_t _begin, size_t _end, float _newDT, uint32_t _step)
+{
+  const Float newDT(_newDT);
+  auto c = centroid();
+  const Float cx(c[0]);
+  const Float cy(c[1]);
+  const Float cz(c[2]);
+  for (size_t i = _begin; i < _end; i += simd::c_width)
+  {
+    Float x = Float::load(&m_px[i]);
+    Float y = Float::load(&m_py[i]);
+    Float z = Float::load(&m_pz[i]);
+    Float fx;
+    Float fy;
+    Float fz;
+    sampleField(x, y, z, fx, fy, fz);
+    Float jitter = philox::uniform(jitterWord(i, _step)) / Float(100.0f);
+    integrate(i, fx + jitter, fy + jitter, fz + jitter, cx - x, cy - y, cz - z, newDT, _step);
+  }
+}
+
+std::array<float, 3> CPUParticleSimulator::forceAt(float _x, float _y, float _z, bool _baked)
+{
+  Float fx(0.0f);
+  Float fy(0.0f);
+  Float fz(0.0f);
+  if (_baked)
+  {
+    if (m_fieldDirty)
+    {
+      bakeField();
+    }
+    sampleField(Float(_x), Float(_y), Float(_z), fx, fy, fz);
+  }
+  else
+  {
+    accumulateForce(Float(_x), Float(_y), Float(_z), 0, m_attractorX.size(), fx, fy, fz);
+  }
+  alignas(simd::c_alignment) float out[3][simd::c_width];
+  fx.store(out[0]);
+  fy.store(out[1]);
+  fz.store(out[2]);
+  return {{out[0][0], out[1][0], out[2][0]}};
+}
+
+void CPUParticleSimulator::writeInterleavedPositions(float *_dst, const uint32_t *_indices, size_t _count)
+{
+  size_t count = _indices != nullptr ? _count : m_numParticles;
+  m_pool.parallelFor(count, grainSize(count), [&](size_t _begin, size_t _end) {
+    for (size_t k = _begin; k < _end; ++k)
+    {
+      size_t i = _indices != nullptr ? _indices[k] : k;
+      _dst[k * 4 + 0] = m_px[i];
+      _dst[k * 4 + 1] = m_py[i];
+      _dst[k * 4 + 2] = m_pz[i];
+      _dst[k * 4 + 3] = m_pw[i];
+    }
+  });
+}
+
+void CPUParticleSimulator::writePackedPositions(uint32_t *_dst, float _extent, const uint32_t *_indices,
+                                                size_t _count)
+{
+  size_t count = _indices != nullptr ? _count : m_numParticles;
+  m_pool.parallelFor(count, grainSize(count), [&](size_t _begin, size_t _end) {
+    for (size_t k = _begin; k < _end; ++k)
+    {
+      size_t i = _indices != nullptr ? _indices[k] : k;
+      const float p[4] = {m_px[i], m_py[i], m_pz[i], m_pw[i]};
+      particleformat::encodePosition(p, _extent, _dst + k * 2);
+    }
+  });
+}
+
+size_t CPUParticleSimulator::cullVisible(const float _mvp[16], float _lodDistance, uint32_t *o_indices)
+{
+  PROFILE_SCOPE("cull");
+  // each chunk compacts its visible indices into the start of its own range of o_indices (a chunk never has
+  // more visible particles than its size) and the ranges are closed up afterwards, so the output is ordered
+  size_t grain = grainSize(m_liveCount);
+  size_t numChunks = (m_liveCount + grain - 1) / grain;
+  std::vector<size_t> chunkCount(numChunks, 0);
+  const Float lod2(_lodDistance * _lodDistance);
+  m_pool.parallelFor(m_liveCount, grain, [&](size_t _begin, size_t _end) {
+    Float m[16];
+    for (size_t k = 0; k < 16; ++k)
+    {
+      m[k] = Float(_mvp[k]);
+    }
+    uint32_t *out = o_indices + _begin;
+    size_t count = 0;
+    // chunks start on a c_chunkAlign boundary and the streams are padded so whole packs can always be loaded
+    for (size_t i = _begin; i < _end; i += simd::c_width)
+    {
+      Float x = Float::load(&m_px[i]);
+      Float y = Float::load(&m_py[i]);
+      Float z = Float::load(&m_pz[i]);
+      Float cx = m[0] * x + m[4] * y + m[8] * z + m[12];
+      Float cy = m[1] * x + m[5] * y + m[9] * z + m[13];
+      Float cz = m[2] * x + m[6] * y + m[10] * z + m[14];
+      Float cw = m[3] * x + m[7] * y + m[11] * z + m[15];
+      // inside the clip volume, points behind the camera have a negative w and fail every test
+      Float inX = simd::lessEqual(simd::abs(cx), cw);
+      Float inY = simd::lessEqual(simd::abs(cy), cw);
+      Float inZ = simd::lessEqual(simd::abs(cz), cw);
+      Float alive = simd::less(Float(0.0f), Float::load(&m_pw[i]));
+      Float visible = simd::maskAnd(simd::maskAnd(inX, inY), simd::maskAnd(inZ, alive));
+      if (_lodDistance > 0.0f)
+      {
+        // keep with probability (lod / w)^2, written without the divide
+        simd::NativeInt hi;
+        simd::NativeInt lo;
+        simd::mulHiLo(simd::iadd(simd::iset(static_cast<int32_t>(i)), simd::iramp()), c_lodHash, hi, lo);
+        Float fraction = simd::toFloat(simd::isrl(lo, 8)) * Float(1.0f / 16777216.0f);
+        visible = simd::maskAnd(visible, simd::less(fraction * cw * cw, lod2));
+      }
+      // branch free compaction, every lane is written but only the visible ones advance the output
+      uint32_t bits = simd::maskBits(visible);
+      size_t lanes = std::min(simd::c_width, _end - i);
+      for (size_t l = 0; l < lanes; ++l)
+      {
+        out[count] = static_cast<uint32_t>(i + l);
+        count += (bits >> l) & 1u;
+      }
+    }
+    chunkCount[_begin / grain] = count;
+  });
+  size_t total = 0;
+  for (size_t c = 0; c < numChunks; ++c)
+  {
+    if (total != c * grain)
+    {
+      std::memmove(o_indices + total, o_indices + c * grain, chunkCount[c] * sizeof(uint32_t));
+    }
+    total += chunkCount[c];
+  }
+  return total;
+}
+
+size_t CPUParticleSimulator::memoryFootprint() const
+{
+  return (m_paddedCount * 7 + m_field.size() + m_nx.size() * 3 + m_reorderScratch.size()) * sizeof(float) +
+         m_spatialHash.memoryFootprint() + m_mortonOrder.memoryFootprint();
+}
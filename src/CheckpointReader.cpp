@@ -0,0 +1,212 @@
+#include "CheckpointReader.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CHECKPOINT_USE_MMAP
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+CheckpointReader::~CheckpointReader()
+{
+  close();
+}
+
+void CheckpointReader::close()
+{
+#ifdef CHECKPOINT_USE_MMAP
+  if (m_mapped)
+  {
+    munmap(const_cast<unsigned char *>(m_data), m_size);
+  }
+#endif
+  m_mapped = false;
+  m_data = nullptr;
+  m_size = 0;
+  m_copy.clear();
+  m_blocks = nullptr;
+  m_numChunks = 0;
+  m_header = {};
+}
+
+bool CheckpointReader::open(const std::string &_path)
+{
+  close();
+#ifdef CHECKPOINT_USE_MMAP
+  int fd = ::open(_path.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0)
+  {
+    void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+    {
+      m_data = static_cast<const unsigned char *>(data);
+      m_size = static_cast<size_t>(info.st_size);
+      m_mapped = true;
+    }
+  }
+  if (fd >= 0)
+  {
+    ::close(fd);
+  }
+#endif
+  if (!m_mapped)
+  {
+    std::ifstream in(_path, std::ios::binary);
+    if (!in)
+    {
+      std::cerr << "unable to open checkpoint " << _path << '\n';
+      return false;
+    }
+    m_copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    m_data = m_copy.data();
+    m_size = m_copy.size();
+  }
+
+  auto fail = [&](const char *_why) {
+    std::cerr << _path << " is not a usable checkpoint, " << _why << '\n';
+    close();
+    return false;
+  };
+  if (m_size < sizeof(checkpoint::FileHeader))
+  {
+    return fail("too short");
+  }
+  std::memcpy(&m_header, m_data, sizeof(m_header));
+  if (m_header.magic != checkpoint::c_magic)
+  {
+    return fail("bad magic");
+  }
+  if (m_header.version != checkpoint::c_version)
+  {
+    return fail("unsupported version");
+  }
+  if (m_header.chunkParticles == 0 || m_header.liveCount > m_header.numParticles ||
+      m_header.numParticles > 0xFFFFFFFFull)
+  {
+    return fail("bad particle counts");
+  }
+  m_numChunks = static_cast<size_t>((m_header.numParticles + m_header.chunkParticles - 1) / m_header.chunkParticles);
+  const uint64_t tableEnd =
+      sizeof(checkpoint::FileHeader) + uint64_t(m_header.numBlocks) * sizeof(checkpoint::BlockEntry);
+  if (m_header.numBlocks != m_numChunks * checkpoint::c_numStreams + 1 || tableEnd > m_size)
+  {
+    return fail("bad block table");
+  }
+  // the table sits right after the 48 byte header so it is 8 byte aligned in the mapping
+  m_blocks = reinterpret_cast<const checkpoint::BlockEntry *>(m_data + sizeof(checkpoint::FileHeader));
+  for (size_t i = 0; i < m_header.numBlocks; ++i)
+  {
+    const checkpoint::BlockEntry &b = m_blocks[i];
+    const bool attractors = i + 1 == m_header.numBlocks;
+    const size_t chunk = i / checkpoint::c_numStreams;
+    const uint32_t stream = attractors ? static_cast<uint32_t>(checkpoint::Stream::Attractors)
+                                       : static_cast<uint32_t>(i % checkpoint::c_numStreams);
+    const uint64_t first = attractors ? 0 : chunkFirst(chunk);
+    const uint64_t count = attractors ? m_header.numAttractors : chunkCount(chunk);
+    const uint64_t floats = attractors ? count * 3 : count;
+    bool valid = b.stream == stream && b.first == first && b.count == count && b.offset >= tableEnd &&
+                 b.offset <= m_size && b.storedBytes <= m_size - b.offset;
+    if (b.compression == static_cast<uint32_t>(checkpoint::Compression::None))
+    {
+      valid = valid && b.storedBytes == floats * sizeof(float) && b.offset % alignof(float) == 0;
+    }
+    else if (b.compression == static_cast<uint32_t>(checkpoint::Compression::ShuffleDeflate))
+    {
+#ifndef HAVE_ZLIB
+      return fail("compressed and this build has no zlib");
+#endif
+    }
+    else
+    {
+      valid = false;
+    }
+    if (!valid)
+    {
+      return fail("block entry out of range");
+    }
+  }
+  return true;
+}
+
+size_t CheckpointReader::chunkFirst(size_t _chunk) const
+{
+  return _chunk * m_header.chunkParticles;
+}
+
+size_t CheckpointReader::chunkCount(size_t _chunk) const
+{
+  const size_t first = chunkFirst(_chunk);
+  return std::min<size_t>(m_header.chunkParticles, static_cast<size_t>(m_header.numParticles) - first);
+}
+
+const float *CheckpointReader::stream(size_t _chunk, checkpoint::Stream _stream,
+                                      std::vector<float> &io_scratch) const
+{
+  if (_chunk >= m_numChunks || _stream == checkpoint::Stream::Attractors)
+  {
+    return nullptr;
+  }
+  return block(_chunk * checkpoint::c_numStreams + static_cast<size_t>(_stream), chunkCount(_chunk), io_scratch);
+}
+
+bool CheckpointReader::readChunk(size_t _chunk, ThreadPool &_pool, Chunk &io_chunk) const
+{
+  _pool.parallelFor(checkpoint::c_numStreams, 1, [&](size_t _begin, size_t _end) {
+    for (size_t s = _begin; s < _end; ++s)
+    {
+      io_chunk.streams[s] = stream(_chunk, static_cast<checkpoint::Stream>(s), io_chunk.scratch[s]);
+    }
+  });
+  return std::all_of(io_chunk.streams.begin(), io_chunk.streams.end(), [](const float *_p) { return _p != nullptr; });
+}
+
+std::vector<float> CheckpointReader::attractors() const
+{
+  std::vector<float> scratch;
+  const size_t floats = size_t(m_header.numAttractors) * 3;
+  const float *xyz = m_data != nullptr ? block(m_header.numBlocks - 1, floats, scratch) : nullptr;
+  return xyz != nullptr ? std::vector<float>(xyz, xyz + floats) : std::vector<float>();
+}
+
+const float *CheckpointReader::block(size_t _index, size_t _floats, std::vector<float> &io_scratch) const
+{
+  const checkpoint::BlockEntry &b = m_blocks[_index];
+  const unsigned char *stored = m_data + b.offset;
+  if (b.compression == static_cast<uint32_t>(checkpoint::Compression::None))
+  {
+    return reinterpret_cast<const float *>(stored);
+  }
+#ifdef HAVE_ZLIB
+  const size_t bytes = _floats * sizeof(float);
+  std::vector<unsigned char> shuffled(bytes);
+  uLongf length = static_cast<uLongf>(bytes);
+  if (uncompress(shuffled.data(), &length, stored, static_cast<uLong>(b.storedBytes)) != Z_OK || length != bytes)
+  {
+    std::cerr << "checkpoint block " << _index << " is corrupt\n";
+    return nullptr;
+  }
+  io_scratch.resize(_floats);
+  unsigned char *out = reinterpret_cast<unsigned char *>(io_scratch.data());
+  for (size_t i = 0; i < _floats; ++i)
+  {
+    for (size_t c = 0; c < sizeof(float); ++c)
+    {
+      out[i * sizeof(float) + c] = shuffled[c * _floats + i];
+    }
+  }
+  return io_scratch.data();
+#else
+  (void)_floats;
+  (void)io_scratch;
+  return nullptr;
+#endif
+}
@@ -0,0 +1,316 @@
+#include "CheckpointWriter.h"
+#include "ParticleFormat.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace
+{
+  using Streams = std::array<std::vector<float>, checkpoint::c_numStreams>;
+
+  uint64_t alignUp(uint64_t _offset)
+  {
+    return (_offset + checkpoint::c_blockAlign - 1) & ~(checkpoint::c_blockAlign - 1);
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief decode slots _slots[0.._count) of the frame into the streams of one chunk
+  //----------------------------------------------------------------------------------------------------------------------
+  void decodeChunk(const checkpoint::Frame &_frame, const uint32_t *_slots, size_t _count, Streams &o_streams)
+  {
+    for (auto &s : o_streams)
+    {
+      s.resize(_count);
+    }
+    const size_t positionStride = particleformat::positionStride(_frame.format);
+    const size_t velocityStride = particleformat::velocityStride(_frame.format);
+    for (size_t i = 0; i < _count; ++i)
+    {
+      const unsigned char *position = _frame.positions.data() + size_t(_slots[i]) * positionStride;
+      const unsigned char *velocity = _frame.velocities.data() + size_t(_slots[i]) * velocityStride;
+      float p[4];
+      float v[3];
+      if (_frame.format == ParticleFormat::Compact)
+      {
+        uint32_t packed[2];
+        std::memcpy(packed, position, sizeof(packed));
+        particleformat::decodePosition(packed, _frame.positionExtent, p);
+        std::memcpy(packed, velocity, sizeof(packed));
+        particleformat::decodeVelocity(packed, v);
+      }
+      else
+      {
+        std::memcpy(p, position, sizeof(p));
+        std::memcpy(v, velocity, sizeof(v));
+      }
+      for (size_t c = 0; c < 4; ++c)
+      {
+        o_streams[c][i] = p[c];
+      }
+      for (size_t c = 0; c < 3; ++c)
+      {
+        o_streams[4 + c][i] = v[c];
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the bytes of a block as stored, o_bytes is only used when compressing
+  /// @returns the stored bytes and the compression that was used, None if deflate didn't make it smaller
+  //----------------------------------------------------------------------------------------------------------------------
+  std::pair<const unsigned char *, size_t> encodeBlock(const std::vector<float> &_values, bool _compress,
+                                                       std::vector<unsigned char> &o_bytes,
+                                                       checkpoint::Compression &o_compression)
+  {
+    o_compression = checkpoint::Compression::None;
+    const size_t bytes = _values.size() * sizeof(float);
+    auto raw = std::make_pair(reinterpret_cast<const unsigned char *>(_values.data()), bytes);
+#ifdef HAVE_ZLIB
+    if (!_compress || bytes == 0)
+    {
+      return raw;
+    }
+    // byte plane k holds byte k of every float, the sign / exponent planes are nearly constant and deflate well
+    std::vector<unsigned char> shuffled(bytes);
+    const unsigned char *in = raw.first;
+    const size_t count = _values.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+      for (size_t b = 0; b < sizeof(float); ++b)
+      {
+        shuffled[b * count + i] = in[i * sizeof(float) + b];
+      }
+    }
+    uLongf stored = compressBound(static_cast<uLong>(bytes));
+    o_bytes.resize(stored);
+    if (compress2(o_bytes.data(), &stored, shuffled.data(), static_cast<uLong>(bytes), 1) != Z_OK || stored >= bytes)
+    {
+      return raw;
+    }
+    o_compression = checkpoint::Compression::ShuffleDeflate;
+    return std::make_pair(o_bytes.data(), static_cast<size_t>(stored));
+#else
+    (void)_compress;
+    (void)o_bytes;
+    return raw;
+#endif
+  }
+} // end anon namespace
+
+CheckpointWriter::CheckpointWriter(const std::string &_directory, bool _compress, size_t _maxQueued)
+    : m_directory(_directory), m_compress(_compress), m_maxQueued(std::max<size_t>(_maxQueued, 1))
+{
+#ifndef HAVE_ZLIB
+  if (m_compress)
+  {
+    std::cerr << "built without zlib, checkpoints are written uncompressed\n";
+  }
+#endif
+  std::error_code error;
+  std::filesystem::create_directories(m_directory, error);
+  m_thread = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+}
+
+bool CheckpointWriter::submit(checkpoint::Frame &&_frame)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_queue.size() >= m_maxQueued)
+    {
+      ++m_dropped;
+      return false;
+    }
+    m_queue.push_back(std::move(_frame));
+  }
+  m_wake.notify_one();
+  return true;
+}
+
+void CheckpointWriter::flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+std::string CheckpointWriter::fileName(uint32_t _step)
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "step_%010u.pckp", _step);
+  return name;
+}
+
+void CheckpointWriter::run()
+{
+  for (;;)
+  {
+    checkpoint::Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+      // quit only once the queue is empty so the destructor doesn't lose frames
+      if (m_queue.empty())
+      {
+        return;
+      }
+      frame = std::move(m_queue.front());
+      m_queue.pop_front();
+      m_busy = true;
+    }
+    std::filesystem::path path = std::filesystem::path(m_directory) / fileName(frame.stepIndex);
+    if (write(path.string(), frame, m_compress))
+    {
+      ++m_written;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_busy = false;
+    }
+    m_idle.notify_all();
+  }
+}
+
+bool CheckpointWriter::write(const std::string &_path, const checkpoint::Frame &_frame, bool _compress)
+{
+  PROFILE_SCOPE("write checkpoint");
+  const size_t count = static_cast<size_t>(_frame.numParticles);
+  if (_frame.positions.size() < count * particleformat::positionStride(_frame.format) ||
+      _frame.velocities.size() < count * particleformat::velocityStride(_frame.format) ||
+      _frame.attractors.size() % 3 != 0)
+  {
+    std::cerr << "checkpoint frame for step " << _frame.stepIndex << " is incomplete, not written\n";
+    return false;
+  }
+  // the slots in file order, with the lifecycle the live ones first so a load can rebuild the lists from the count
+  std::vector<uint32_t> slots(count);
+  size_t live = 0;
+  if (_frame.lifecycle)
+  {
+    std::vector<uint32_t> dead;
+    const size_t stride = particleformat::positionStride(_frame.format);
+    for (size_t i = 0; i < count; ++i)
+    {
+      const unsigned char *position = _frame.positions.data() + i * stride;
+      float life;
+      if (_frame.format == ParticleFormat::Compact)
+      {
+        uint32_t packed[2];
+        float p[4];
+        std::memcpy(packed, position, sizeof(packed));
+        particleformat::decodePosition(packed, _frame.positionExtent, p);
+        life = p[3];
+      }
+      else
+      {
+        std::memcpy(&life, position + 3 * sizeof(float), sizeof(life));
+      }
+      if (life > 0.0f)
+      {
+        slots[live++] = static_cast<uint32_t>(i);
+      }
+      else
+      {
+        dead.push_back(static_cast<uint32_t>(i));
+      }
+    }
+    std::copy(dead.begin(), dead.end(), slots.begin() + static_cast<std::ptrdiff_t>(live));
+  }
+  else
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      slots[i] = static_cast<uint32_t>(i);
+    }
+    live = count;
+  }
+
+  const size_t numChunks = (count + checkpoint::c_chunkParticles - 1) / checkpoint::c_chunkParticles;
+  checkpoint::FileHeader header = {};
+  header.magic = checkpoint::c_magic;
+  header.version = checkpoint::c_version;
+  header.numParticles = count;
+  header.liveCount = live;
+  header.seed = _frame.seed;
+  header.stepIndex = _frame.stepIndex;
+  header.numAttractors = static_cast<uint32_t>(_frame.attractors.size() / 3);
+  header.numBlocks = static_cast<uint32_t>(numChunks * checkpoint::c_numStreams + 1);
+  header.chunkParticles = checkpoint::c_chunkParticles;
+  std::vector<checkpoint::BlockEntry> table(header.numBlocks);
+
+  const std::string temporary = _path + ".tmp";
+  std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    std::cerr << "unable to open checkpoint " << temporary << '\n';
+    return false;
+  }
+  // the table is filled in as the blocks go out and written again at the end
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(table.data()),
+            static_cast<std::streamsize>(table.size() * sizeof(checkpoint::BlockEntry)));
+  uint64_t offset = sizeof(header) + table.size() * sizeof(checkpoint::BlockEntry);
+  std::vector<unsigned char> scratch;
+  auto writeBlock = [&](size_t _index, checkpoint::Stream _stream, uint64_t _first, uint64_t _count,
+                        const std::vector<float> &_values) {
+    checkpoint::Compression compression;
+    auto stored = encodeBlock(_values, _compress, scratch, compression);
+    const uint64_t start = alignUp(offset);
+    static const char zeros[checkpoint::c_blockAlign] = {};
+    out.write(zeros, static_cast<std::streamsize>(start - offset));
+    out.write(reinterpret_cast<const char *>(stored.first), static_cast<std::streamsize>(stored.second));
+    table[_index] = {static_cast<uint32_t>(_stream), static_cast<uint32_t>(compression), _first, _count, start,
+                     stored.second};
+    offset = start + stored.second;
+  };
+
+  Streams streams;
+  for (size_t chunk = 0; chunk < numChunks; ++chunk)
+  {
+    const size_t first = chunk * checkpoint::c_chunkParticles;
+    const size_t chunkCount = std::min<size_t>(checkpoint::c_chunkParticles, count - first);
+    decodeChunk(_frame, slots.data() + first, chunkCount, streams);
+    for (size_t s = 0; s < checkpoint::c_numStreams; ++s)
+    {
+      writeBlock(chunk * checkpoint::c_numStreams + s, static_cast<checkpoint::Stream>(s), first, chunkCount,
+                 streams[s]);
+    }
+  }
+  writeBlock(table.size() - 1, checkpoint::Stream::Attractors, 0, header.numAttractors, _frame.attractors);
+  out.seekp(sizeof(header));
+  out.write(reinterpret_cast<const char *>(table.data()),
+            static_cast<std::streamsize>(table.size() * sizeof(checkpoint::BlockEntry)));
+  out.close();
+  if (!out)
+  {
+    std::cerr << "unable to write checkpoint " << temporary << '\n';
+    std::remove(temporary.c_str());
+    return false;
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, _path, error);
+  if (error)
+  {
+    std::cerr << "unable to rename " << temporary << " to " << _path << " : " << error.message() << '\n';
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
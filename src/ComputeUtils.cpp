@@ -0,0 +1,81 @@
+#include "ComputeUtils.h"
+#include "ShaderVariantCache.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace compute
+{
+  void dispatch1D(size_t _count, size_t _workgroupSize)
+  {
+    static GLint s_maxGroupsX=0;
+    if(s_maxGroupsX==0)
+    {
+      glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &s_maxGroupsX);
+      s_maxGroupsX=std::max(s_maxGroupsX,65535);
+    }
+    size_t groups=(_count+_workgroupSize-1)/_workgroupSize;
+    if(groups==0)
+    {
+      return;
+    }
+    size_t x=std::min(groups,static_cast<size_t>(s_maxGroupsX));
+    size_t y=(groups+x-1)/x;
+    glDispatchCompute(static_cast<GLuint>(x), static_cast<GLuint>(y), 1);
+  }
+
+  size_t maxWorkgroupSize()
+  {
+    GLint size=0;
+    GLint invocations=0;
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &size);
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &invocations);
+    return static_cast<size_t>(std::min(size,invocations));
+  }
+
+  std::string requireProgram(const std::string &_path, const ShaderVariantCache::Defines &_defines)
+  {
+    std::string name;
+    if(!ShaderVariantCache::compute(_path,_defines,name))
+    {
+      std::cerr<<"unable to build the compute pass "<<_path<<", the GPU backend can't run without it\n";
+      std::exit(EXIT_FAILURE);
+    }
+    return name;
+  }
+
+  void setUniform(const std::string &_program, const char *_name, GLuint _value)
+  {
+    GLuint id=ngl::ShaderLib::getProgramID(_program);
+    glProgramUniform1ui(id, glGetUniformLocation(id,_name), _value);
+  }
+
+  size_t prefixSumBlocks(size_t _count)
+  {
+    // BLOCK_SIZE in PrefixSum.glsl
+    return (_count+1023)/1024;
+  }
+
+  void prefixSum(GLuint _data, GLuint _blockSums, size_t _count)
+  {
+    static const std::string s_scanBlocks=requireProgram("shaders/PrefixSum.glsl",{{"SCAN_BLOCKS","1"}});
+    static const std::string s_scanSums=requireProgram("shaders/PrefixSum.glsl",{{"SCAN_SUMS","1"}});
+    static const std::string s_addSums=requireProgram("shaders/PrefixSum.glsl",{{"ADD_SUMS","1"}});
+    size_t numBlocks=prefixSumBlocks(_count);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _data);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _blockSums);
+    ngl::ShaderLib::use(s_scanBlocks);
+    setUniform(s_scanBlocks,"count",static_cast<GLuint>(_count));
+    dispatch1D(numBlocks*256, 256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    ngl::ShaderLib::use(s_scanSums);
+    setUniform(s_scanSums,"count",static_cast<GLuint>(numBlocks));
+    glDispatchCompute(1,1,1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    ngl::ShaderLib::use(s_addSums);
+    setUniform(s_addSums,"count",static_cast<GLuint>(_count));
+    dispatch1D(numBlocks*256, 256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+} // end namespace compute
@@ -0,0 +1,126 @@
+#include "FrameCapture.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <iostream>
+
+FrameCapture::FrameCapture(FrameEncoder &_encoder, CaptureFormat _format, size_t _width, size_t _height,
+                           size_t _ringSize) :
+  m_encoder(_encoder),m_type(_format==CaptureFormat::EXR ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE),
+  m_width(_width),m_height(_height),m_slots(std::max<size_t>(_ringSize,1))
+{
+  // persistent and coherent so a worker can read the pixels in place once the fence has passed
+  const GLbitfield flags=GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  const GLsizeiptr bytes=static_cast<GLsizeiptr>(_width*_height*FrameEncoder::bytesPerPixel(_format));
+  for(auto &slot : m_slots)
+  {
+    glGenBuffers(1,&slot.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,slot.buffer);
+    glBufferStorage(GL_PIXEL_PACK_BUFFER,bytes,nullptr,flags | GL_CLIENT_STORAGE_BIT);
+    slot.mapped=static_cast<const unsigned char *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER,0,bytes,flags));
+    if(slot.mapped==nullptr)
+    {
+      std::cerr<<"unable to map the capture buffer\n";
+      glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+      return;
+    }
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+  m_valid=true;
+}
+
+FrameCapture::~FrameCapture()
+{
+  finish();
+  for(auto &slot : m_slots)
+  {
+    glDeleteBuffers(1,&slot.buffer);
+  }
+}
+
+GLenum FrameCapture::colourFormat(CaptureFormat _format)
+{
+  return _format==CaptureFormat::EXR ? GL_RGBA16F : GL_RGBA8;
+}
+
+void FrameCapture::capture(size_t _index)
+{
+  PROFILE_SCOPE("capture");
+  if(!m_valid)
+  {
+    return;
+  }
+  Slot &slot=m_slots[m_next];
+  // the ring is full of copies the GPU hasn't finished
+  if(slot.fence!=nullptr)
+  {
+    ++m_stalls;
+    handOver(true);
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(slot.encoding)
+    {
+      // the encoder is behind, waiting here keeps the ring from being overwritten under it
+      ++m_stalls;
+      m_released.wait(lock,[&slot]{ return !slot.encoding; });
+    }
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,slot.buffer);
+  glPixelStorei(GL_PACK_ALIGNMENT,1);
+  glReadPixels(0,0,static_cast<GLsizei>(m_width),static_cast<GLsizei>(m_height),GL_RGBA,m_type,nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+  slot.fence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+  slot.index=_index;
+  m_next=(m_next+1)%m_slots.size();
+  ++m_queued;
+}
+
+bool FrameCapture::handOver(bool _wait)
+{
+  Slot &slot=m_slots[m_oldest];
+  if(_wait)
+  {
+    while(glClientWaitSync(slot.fence,GL_SYNC_FLUSH_COMMANDS_BIT,1000000)==GL_TIMEOUT_EXPIRED)
+    {
+    }
+  }
+  else if(glClientWaitSync(slot.fence,GL_SYNC_FLUSH_COMMANDS_BIT,0)==GL_TIMEOUT_EXPIRED)
+  {
+    return false;
+  }
+  glDeleteSync(slot.fence);
+  slot.fence=nullptr;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slot.encoding=true;
+  }
+  m_encoder.submit(slot.index,slot.mapped,[this,&slot]
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      slot.encoding=false;
+    }
+    m_released.notify_all();
+  });
+  m_oldest=(m_oldest+1)%m_slots.size();
+  --m_queued;
+  return true;
+}
+
+void FrameCapture::collect(bool _wait)
+{
+  // the copies finish in order so stop at the first one still running
+  while(m_queued!=0 && handOver(_wait))
+  {
+  }
+}
+
+void FrameCapture::finish()
+{
+  collect(true);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_released.wait(lock,[this]
+  {
+    return std::none_of(m_slots.begin(),m_slots.end(),[](const Slot &_slot){ return _slot.encoding; });
+  });
+}
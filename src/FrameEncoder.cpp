@@ -0,0 +1,396 @@
+#include "FrameEncoder.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace
+{
+  void putBigEndian(std::vector<unsigned char> &o_bytes, uint32_t _value)
+  {
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+      o_bytes.push_back(static_cast<unsigned char>(_value >> shift));
+    }
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief append _value as stored in the file, EXR is little endian like every host we build for
+  //----------------------------------------------------------------------------------------------------------------------
+  template <typename T>
+  void putLittleEndian(std::vector<unsigned char> &o_bytes, T _value)
+  {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &_value, sizeof(T));
+    o_bytes.insert(o_bytes.end(), bytes, bytes + sizeof(T));
+  }
+
+  void putString(std::vector<unsigned char> &o_bytes, const char *_string)
+  {
+    o_bytes.insert(o_bytes.end(), _string, _string + std::strlen(_string) + 1);
+  }
+
+#ifdef HAVE_ZLIB
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief append a PNG chunk, the CRC covers the type and the data
+  //----------------------------------------------------------------------------------------------------------------------
+  void putChunk(std::vector<unsigned char> &o_bytes, const char *_type, const unsigned char *_data, size_t _size)
+  {
+    putBigEndian(o_bytes, static_cast<uint32_t>(_size));
+    const size_t start = o_bytes.size();
+    o_bytes.insert(o_bytes.end(), _type, _type + 4);
+    o_bytes.insert(o_bytes.end(), _data, _data + _size);
+    uLong crc = crc32(0L, o_bytes.data() + start, static_cast<uInt>(o_bytes.size() - start));
+    putBigEndian(o_bytes, static_cast<uint32_t>(crc));
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief 8 bit RGB, the alpha of the additive blend carries nothing. No row filter, the frames are mostly black
+  /// and deflate already packs them well, Z_BEST_SPEED keeps the workers ahead of the GPU
+  //----------------------------------------------------------------------------------------------------------------------
+  bool encodePNG(const unsigned char *_rgba, size_t _width, size_t _height, std::vector<unsigned char> &o_file)
+  {
+    const size_t stride = 1 + _width * 3;
+    std::vector<unsigned char> rows(stride * _height);
+    for (size_t y = 0; y < _height; ++y)
+    {
+      const unsigned char *src = _rgba + (_height - 1 - y) * _width * 4;
+      unsigned char *dst = rows.data() + y * stride;
+      *dst++ = 0;
+      for (size_t x = 0; x < _width; ++x)
+      {
+        *dst++ = src[x * 4 + 0];
+        *dst++ = src[x * 4 + 1];
+        *dst++ = src[x * 4 + 2];
+      }
+    }
+    uLongf size = compressBound(static_cast<uLong>(rows.size()));
+    std::vector<unsigned char> deflated(size);
+    if (compress2(deflated.data(), &size, rows.data(), static_cast<uLong>(rows.size()), Z_BEST_SPEED) != Z_OK)
+    {
+      return false;
+    }
+    static const unsigned char c_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<unsigned char> header;
+    putBigEndian(header, static_cast<uint32_t>(_width));
+    putBigEndian(header, static_cast<uint32_t>(_height));
+    // 8 bit depth, truecolour, deflate, adaptive filtering (every row uses none), no interlace
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+    o_file.assign(c_signature, c_signature + 8);
+    putChunk(o_file, "IHDR", header.data(), header.size());
+    putChunk(o_file, "IDAT", deflated.data(), size);
+    putChunk(o_file, "IEND", nullptr, 0);
+    return true;
+  }
+#endif
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a single part scanline OpenEXR file with HALF A,B,G,R channels and no compression, the pixels are GL
+  /// RGBA half floats so each row is just split into the four channels (stored alphabetically)
+  //----------------------------------------------------------------------------------------------------------------------
+  void encodeEXR(const uint16_t *_rgba, size_t _width, size_t _height, std::vector<unsigned char> &o_file)
+  {
+    const int32_t maxX = static_cast<int32_t>(_width) - 1;
+    const int32_t maxY = static_cast<int32_t>(_height) - 1;
+    o_file.clear();
+    putLittleEndian<uint32_t>(o_file, 20000630);
+    // version 2, single part scanline
+    putLittleEndian<uint32_t>(o_file, 2);
+    auto attribute = [&](const char *_name, const char *_type, uint32_t _size) {
+      putString(o_file, _name);
+      putString(o_file, _type);
+      putLittleEndian(o_file, _size);
+    };
+    static const char *const c_channels[4] = {"A", "B", "G", "R"};
+    attribute("channels", "chlist", 4 * 18 + 1);
+    for (const char *channel : c_channels)
+    {
+      putString(o_file, channel);
+      // HALF, not linear, three reserved bytes, x and y sampling of 1
+      putLittleEndian<int32_t>(o_file, 1);
+      putLittleEndian<uint32_t>(o_file, 0);
+      putLittleEndian<int32_t>(o_file, 1);
+      putLittleEndian<int32_t>(o_file, 1);
+    }
+    o_file.push_back(0);
+    attribute("compression", "compression", 1);
+    o_file.push_back(0);
+    for (const char *window : {"dataWindow", "displayWindow"})
+    {
+      attribute(window, "box2i", 16);
+      for (int32_t v : {0, 0, maxX, maxY})
+      {
+        putLittleEndian(o_file, v);
+      }
+    }
+    attribute("lineOrder", "lineOrder", 1);
+    o_file.push_back(0);
+    attribute("pixelAspectRatio", "float", 4);
+    putLittleEndian(o_file, 1.0f);
+    attribute("screenWindowCenter", "v2f", 8);
+    putLittleEndian(o_file, 0.0f);
+    putLittleEndian(o_file, 0.0f);
+    attribute("screenWindowWidth", "float", 4);
+    putLittleEndian(o_file, 1.0f);
+    o_file.push_back(0);
+    // the offset table then one block per row, y and the byte count ahead of the channels
+    const size_t rowBytes = _width * 4 * sizeof(uint16_t);
+    const uint64_t firstRow = o_file.size() + _height * sizeof(uint64_t);
+    for (size_t y = 0; y < _height; ++y)
+    {
+      putLittleEndian<uint64_t>(o_file, firstRow + y * (8 + rowBytes));
+    }
+    o_file.reserve(o_file.size() + _height * (8 + rowBytes));
+    std::vector<uint16_t> row(_width * 4);
+    for (size_t y = 0; y < _height; ++y)
+    {
+      const uint16_t *src = _rgba + (_height - 1 - y) * _width * 4;
+      for (size_t c = 0; c < 4; ++c)
+      {
+        // A,B,G,R
+        const size_t component = 3 - c;
+        for (size_t x = 0; x < _width; ++x)
+        {
+          row[c * _width + x] = src[x * 4 + component];
+        }
+      }
+      putLittleEndian(o_file, static_cast<int32_t>(y));
+      putLittleEndian(o_file, static_cast<uint32_t>(rowBytes));
+      auto bytes = reinterpret_cast<const unsigned char *>(row.data());
+      o_file.insert(o_file.end(), bytes, bytes + rowBytes);
+    }
+  }
+} // end namespace
+
+const char *toString(CaptureFormat _format)
+{
+  switch (_format)
+  {
+    case CaptureFormat::PNG:
+      return "png";
+    case CaptureFormat::EXR:
+      return "exr";
+    case CaptureFormat::Raw:
+      return "raw";
+  }
+  return "unknown";
+}
+
+size_t FrameEncoder::bytesPerPixel(CaptureFormat _format)
+{
+  return _format == CaptureFormat::EXR ? 4 * sizeof(uint16_t) : 4;
+}
+
+FrameEncoder::FrameEncoder(CaptureFormat _format, size_t _width, size_t _height, const std::string &_output,
+                           size_t _numThreads)
+    : m_format(_format), m_width(_width), m_height(_height), m_output(_output)
+{
+  if (m_format == CaptureFormat::Raw)
+  {
+    if (m_output == "-")
+    {
+      m_stream = stdout;
+    }
+    else if (!m_output.empty() && m_output[0] == '|')
+    {
+#ifdef SIGPIPE
+      // a reader that quits early shows up as a failed write rather than killing us
+      std::signal(SIGPIPE, SIG_IGN);
+#endif
+      m_stream = popen(m_output.c_str() + 1, "w");
+      m_pipe = true;
+    }
+    else
+    {
+      m_stream = std::fopen(m_output.c_str(), "wb");
+    }
+    if (m_stream == nullptr)
+    {
+      std::cerr << "unable to open " << m_output << " for the raw frames\n";
+      return;
+    }
+  }
+  else
+  {
+#ifndef HAVE_ZLIB
+    if (m_format == CaptureFormat::PNG)
+    {
+      std::cerr << "built without zlib, PNG capture needs it, use exr or raw\n";
+      return;
+    }
+#endif
+    std::error_code error;
+    std::filesystem::create_directories(m_output, error);
+    if (error)
+    {
+      std::cerr << "unable to create " << m_output << " : " << error.message() << '\n';
+      return;
+    }
+  }
+  m_valid = true;
+  // raw frames are only copied into the stream one at a time, more threads would just wait for their turn
+  size_t numThreads = _numThreads != 0 ? _numThreads : std::max(1u, std::thread::hardware_concurrency());
+  if (m_format == CaptureFormat::Raw)
+  {
+    numThreads = 1;
+  }
+  for (size_t i = 0; i < numThreads; ++i)
+  {
+    m_workers.emplace_back(&FrameEncoder::run, this);
+  }
+}
+
+FrameEncoder::~FrameEncoder()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers)
+  {
+    worker.join();
+  }
+  if (m_pipe)
+  {
+    pclose(m_stream);
+  }
+  else if (m_stream == stdout)
+  {
+    std::fflush(m_stream);
+  }
+  else if (m_stream != nullptr)
+  {
+    std::fclose(m_stream);
+  }
+}
+
+void FrameEncoder::submit(size_t _index, const void *_pixels, std::function<void()> _done)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_rawStarted)
+    {
+      m_nextRaw = _index;
+      m_rawStarted = true;
+    }
+    m_queue.push_back({_index, static_cast<const unsigned char *>(_pixels), std::move(_done)});
+  }
+  m_wake.notify_one();
+}
+
+void FrameEncoder::flush()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_queue.empty() && m_busy == 0; });
+  }
+  if (m_stream != nullptr)
+  {
+    std::fflush(m_stream);
+  }
+}
+
+std::string FrameEncoder::fileName(size_t _index) const
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "frame_%06zu.%s", _index, toString(m_format));
+  return (std::filesystem::path(m_output) / name).string();
+}
+
+void FrameEncoder::run()
+{
+  for (;;)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+      // quit only once the queue is empty so the destructor doesn't lose frames
+      if (m_queue.empty())
+      {
+        return;
+      }
+      job = std::move(m_queue.front());
+      m_queue.pop_front();
+      ++m_busy;
+    }
+    size_t bytes = m_format == CaptureFormat::Raw ? writeRaw(job) : encode(job);
+    if (bytes != 0)
+    {
+      m_written.fetch_add(1);
+      m_bytes.fetch_add(bytes);
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_busy;
+    }
+    m_idle.notify_all();
+  }
+}
+
+size_t FrameEncoder::encode(const Job &_job)
+{
+  PROFILE_SCOPE("encode frame");
+  // each worker keeps its file buffer so the steady state doesn't allocate
+  thread_local std::vector<unsigned char> file;
+  bool encoded = true;
+#ifdef HAVE_ZLIB
+  if (m_format == CaptureFormat::PNG)
+  {
+    encoded = encodePNG(_job.pixels, m_width, m_height, file);
+  }
+#endif
+  if (m_format == CaptureFormat::EXR)
+  {
+    encodeEXR(reinterpret_cast<const uint16_t *>(_job.pixels), m_width, m_height, file);
+  }
+  // the pixels are copied into file, the capture can reuse them while it is written
+  _job.done();
+  const std::string path = fileName(_job.index);
+  std::ofstream out(path, std::ios::binary);
+  if (!encoded || !out.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size())))
+  {
+    std::cerr << "unable to write " << path << '\n';
+    return 0;
+  }
+  return file.size();
+}
+
+size_t FrameEncoder::writeRaw(const Job &_job)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_rawTurn.wait(lock, [&] { return m_nextRaw == _job.index; });
+  }
+  PROFILE_SCOPE("write raw frame");
+  const size_t rowBytes = m_width * 4;
+  size_t bytes = 0;
+  for (size_t y = m_height; y-- > 0;)
+  {
+    bytes += std::fwrite(_job.pixels + y * rowBytes, 1, rowBytes, m_stream);
+  }
+  _job.done();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_nextRaw;
+  }
+  m_rawTurn.notify_all();
+  if (bytes != rowBytes * m_height)
+  {
+    std::cerr << "unable to write frame " << _job.index << " to " << m_output << '\n';
+    return 0;
+  }
+  return bytes;
+}
@@ -0,0 +1,153 @@
+#include "GPUMortonOrder.h"
+#include "ComputeUtils.h"
+#include "ShaderVariantCache.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief keys per work group of the count and scatter passes and the digit layout, must match MortonSort.glsl.
+  /// Eight passes also sort the lifecycle's DEAD_KEY to the end
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr size_t c_sortBlock=1024;
+  constexpr size_t c_radix=16;
+  constexpr GLuint c_radixBits=4;
+  constexpr GLuint c_keyBits=32;
+} // end anon namespace
+
+GPUMortonOrder::~GPUMortonOrder()
+{
+  glDeleteBuffers(2,m_keyID);
+  glDeleteBuffers(2,m_valueID);
+  glDeleteBuffers(1,&m_blockCountID);
+  glDeleteBuffers(1,&m_blockSumID);
+  glDeleteBuffers(1,&m_sparePositionID);
+  glDeleteBuffers(1,&m_spareVelocityID);
+}
+
+void GPUMortonOrder::setFormat(const ShaderVariantCache::Defines &_formatDefines, size_t _positionStride,
+                               size_t _velocityStride, bool _lifecycle)
+{
+  m_formatDefines=_formatDefines;
+  m_positionStride=_positionStride;
+  m_velocityStride=_velocityStride;
+  m_lifecycle=_lifecycle;
+  // forces allocate to fetch the matching variants and spare buffers
+  m_count=0;
+}
+
+void GPUMortonOrder::allocate(size_t _count, size_t _workgroupSize)
+{
+  glDeleteBuffers(2,m_keyID);
+  glDeleteBuffers(2,m_valueID);
+  glDeleteBuffers(1,&m_blockCountID);
+  glDeleteBuffers(1,&m_blockSumID);
+  glDeleteBuffers(1,&m_sparePositionID);
+  glDeleteBuffers(1,&m_spareVelocityID);
+  glGenBuffers(2,m_keyID);
+  glGenBuffers(2,m_valueID);
+  glGenBuffers(1,&m_blockCountID);
+  glGenBuffers(1,&m_blockSumID);
+  glGenBuffers(1,&m_sparePositionID);
+  glGenBuffers(1,&m_spareVelocityID);
+  m_count=_count;
+  m_workgroupSize=_workgroupSize;
+  m_numBlocks=(_count+c_sortBlock-1)/c_sortBlock;
+  // immutable like the particle buffers, the spares trade places with them on every reorder
+  auto storage=[](GLuint _id, size_t _bytes)
+  {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,_id);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,static_cast<GLsizeiptr>(std::max<size_t>(_bytes,4)),nullptr,0);
+  };
+  for(size_t i=0; i<2; ++i)
+  {
+    storage(m_keyID[i],_count*sizeof(GLuint));
+    storage(m_valueID[i],_count*sizeof(GLuint));
+  }
+  storage(m_blockCountID,c_radix*m_numBlocks*sizeof(GLuint));
+  storage(m_blockSumID,compute::prefixSumBlocks(c_radix*m_numBlocks)*sizeof(GLuint));
+  storage(m_sparePositionID,_count*m_positionStride);
+  storage(m_spareVelocityID,_count*m_velocityStride);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+
+  ShaderVariantCache::Defines particle={{"WORKGROUP_SIZE",std::to_string(_workgroupSize)}};
+  particle.insert(particle.end(),m_formatDefines.begin(),m_formatDefines.end());
+  ShaderVariantCache::Defines key=particle;
+  key.push_back({"KEY_PASS","1"});
+  if(m_lifecycle)
+  {
+    key.push_back({"LIFECYCLE","1"});
+  }
+  ShaderVariantCache::Defines permute=particle;
+  permute.push_back({"PERMUTE_PASS","1"});
+  m_keyProgram=compute::requireProgram("shaders/MortonSort.glsl",key);
+  m_permuteProgram=compute::requireProgram("shaders/MortonSort.glsl",permute);
+  m_countProgram=compute::requireProgram("shaders/MortonSort.glsl",{{"COUNT_PASS","1"}});
+  m_scatterProgram=compute::requireProgram("shaders/MortonSort.glsl",{{"SCATTER_PASS","1"}});
+}
+
+void GPUMortonOrder::reorder(GLuint &io_positionBuffer, GLuint &io_velocityBuffer, size_t _count, float _extent,
+                             size_t _workgroupSize, GLuint _currentList)
+{
+  if(_count!=m_count || _workgroupSize!=m_workgroupSize)
+  {
+    allocate(_count,_workgroupSize);
+  }
+  // codes and slots
+  ngl::ShaderLib::use(m_keyProgram);
+  ngl::ShaderLib::setUniform("extent",_extent);
+  compute::setUniform(m_keyProgram,"numParticles",static_cast<GLuint>(m_count));
+  compute::setUniform(m_keyProgram,"currentList",_currentList);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, io_positionBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_keyID[0]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_valueID[0]);
+  compute::dispatch1D(m_count, m_workgroupSize);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  // the count and scatter passes only differ in the digit, set everything else once
+  for(const auto &program : {m_countProgram,m_scatterProgram})
+  {
+    compute::setUniform(program,"numParticles",static_cast<GLuint>(m_count));
+    compute::setUniform(program,"numBlocks",static_cast<GLuint>(m_numBlocks));
+  }
+  size_t in=0;
+  for(GLuint shift=0; shift<c_keyBits; shift+=c_radixBits)
+  {
+    compute::setUniform(m_countProgram,"digitShift",shift);
+    compute::setUniform(m_scatterProgram,"digitShift",shift);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_keyID[in]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_valueID[in]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_blockCountID);
+    ngl::ShaderLib::use(m_countProgram);
+    compute::dispatch1D(m_numBlocks*256, 256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    // prefixSum rebinds 0 and 1 for itself
+    compute::prefixSum(m_blockCountID, m_blockSumID, c_radix*m_numBlocks);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_keyID[1-in]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_valueID[1-in]);
+    ngl::ShaderLib::use(m_scatterProgram);
+    compute::dispatch1D(m_numBlocks*256, 256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    in=1-in;
+  }
+
+  ngl::ShaderLib::use(m_permuteProgram);
+  compute::setUniform(m_permuteProgram,"numParticles",static_cast<GLuint>(m_count));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, io_positionBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, io_velocityBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_valueID[in]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_sparePositionID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_spareVelocityID);
+  compute::dispatch1D(m_count, m_workgroupSize);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  std::swap(io_positionBuffer,m_sparePositionID);
+  std::swap(io_velocityBuffer,m_spareVelocityID);
+}
+
+size_t GPUMortonOrder::memoryFootprint() const
+{
+  return m_count*(4*sizeof(GLuint)+m_positionStride+m_velocityStride)+
+         (c_radix*m_numBlocks+compute::prefixSumBlocks(c_radix*m_numBlocks))*sizeof(GLuint);
+}
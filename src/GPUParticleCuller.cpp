@@ -0,0 +1,85 @@
+#include "GPUParticleCuller.h"
+#include "ComputeUtils.h"
+#include "GPUParticleSimulator.h"
+#include "ShaderVariantCache.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+
+GPUParticleCuller::GPUParticleCuller(const SimulationConfig &_config)
+  : m_workgroupSize(_config.workgroupSize), m_lodDistance(_config.lodDistance), m_format(_config.particleFormat),
+    m_positionExtent(_config.positionExtent)
+{
+}
+
+GPUParticleCuller::~GPUParticleCuller()
+{
+  glDeleteBuffers(1,&m_commandID);
+  glDeleteBuffers(1,&m_visibleID);
+}
+
+void GPUParticleCuller::cull(GLuint _positionBuffer, size_t _count, const ngl::Mat4 &_mvp)
+{
+  if(m_program.empty())
+  {
+    // the simulator has already reported a bad size, fall back the same way
+    size_t maxSize=compute::maxWorkgroupSize();
+    if(m_workgroupSize==0 || m_workgroupSize>maxSize)
+    {
+      m_workgroupSize=std::min<size_t>(128,maxSize);
+    }
+    ShaderVariantCache::Defines defines={{"WORKGROUP_SIZE",std::to_string(m_workgroupSize)}};
+    ShaderVariantCache::Defines format=GPUParticleSimulator::formatDefines(m_format,m_positionExtent);
+    defines.insert(defines.end(),format.begin(),format.end());
+    m_program=compute::requireProgram("shaders/ParticleCull.glsl",defines);
+    glGenBuffers(1,&m_commandID);
+    glGenBuffers(1,&m_visibleID);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_commandID);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,5*sizeof(GLuint),nullptr,GL_DYNAMIC_COPY);
+  }
+  if(_count>m_capacity)
+  {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_visibleID);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,static_cast<GLsizeiptr>(_count*sizeof(GLuint)),nullptr,GL_DYNAMIC_COPY);
+    m_capacity=_count;
+  }
+  // a fresh command every frame, the count is then accumulated by the shader. The update is ordered after the
+  // previous frame's draw by GL so the buffer can be reused straight away
+  const GLuint command[5]={0,1,0,0,0};
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_commandID);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER,0,sizeof(command),command);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+
+  ngl::ShaderLib::use(m_program);
+  ngl::ShaderLib::setUniform("MVP",_mvp);
+  ngl::ShaderLib::setUniform("lodDistance",m_lodDistance);
+  compute::setUniform(m_program,"numParticles",static_cast<GLuint>(_count));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _positionBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_commandID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_visibleID);
+  compute::dispatch1D(_count, m_workgroupSize);
+  // the draw reads the command and the indices written above
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
+}
+
+void GPUParticleCuller::draw() const
+{
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,m_commandID);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_visibleID);
+  glDrawElementsIndirect(GL_POINTS,GL_UNSIGNED_INT,nullptr);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+}
+
+size_t GPUParticleCuller::visibleCount() const
+{
+  GLuint count=0;
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_commandID);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER,0,sizeof(count),&count);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  return count;
+}
+
+size_t GPUParticleCuller::memoryFootprint() const
+{
+  return m_capacity*sizeof(GLuint)+(m_commandID!=0 ? 5*sizeof(GLuint) : 0);
+}
@@ -0,0 +1,1052 @@
+#include "GPUParticleSimulator.h"
+#include "CheckpointReader.h"
+#include "ComputeUtils.h"
+#include "ParticleFormat.h"
+#include "Profiler.h"
+#include "ShaderVariantCache.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <ngl/ShaderLib.h>
+#include <ngl/Vec3.h>
+#include <ngl/Vec4.h>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief memcpy split over the pool, one thread can't saturate the memory bus
+  //----------------------------------------------------------------------------------------------------------------------
+  void parallelCopy(ThreadPool &_pool, void *o_dst, const void *_src, size_t _bytes)
+  {
+    _pool.parallelFor(_bytes, 1<<20, [&](size_t _begin, size_t _end)
+    {
+      std::memcpy(static_cast<unsigned char *>(o_dst)+_begin, static_cast<const unsigned char *>(_src)+_begin,
+                  _end-_begin);
+    });
+  }
+} // end anon namespace
+
+GPUParticleSimulator::GPUParticleSimulator(const SimulationConfig &_config)
+  : m_workgroupSize(_config.workgroupSize), m_forceMode(_config.forceMode),
+    m_gridResolution(_config.gridResolution), m_gridExtent(_config.gridExtent),
+    m_neighborRadius(_config.neighborRadius), m_separation(_config.separation),
+    m_reorderInterval(_config.reorderInterval), m_initMode(_config.initMode), m_format(_config.particleFormat),
+    m_positionExtent(_config.positionExtent), m_numThreads(_config.numThreads),
+    m_stepSeconds(_config.stepMs/1000.0f), m_lifecycle(_config.numEmitters!=0), m_emitRate(_config.emitRate),
+    m_streamChunk(_config.streamChunk), m_stateFile(_config.stateFile)
+{
+  // load prints why a file is rejected, the attractors then just stay where the host puts them
+  if(!_config.attractorPaths.empty())
+  {
+    m_paths.load(_config.attractorPaths);
+  }
+  if(!_config.particleSystems.empty())
+  {
+    m_systems.load(_config.particleSystems);
+  }
+}
+
+GPUParticleSimulator::~GPUParticleSimulator()
+{
+  releaseStreaming();
+  glDeleteBuffers(1,&m_positionBufferID);
+  glDeleteBuffers(1,&m_velocityBufferID);
+  glDeleteBuffers(1,&m_neighborForceBufferID);
+  glDeleteBuffers(1,&m_pathBufferID);
+  glDeleteBuffers(1,&m_keyBufferID);
+  glDeleteBuffers(1,&m_animatedAttractorsID);
+  glDeleteBuffers(1,&m_emitterBufferID);
+  glDeleteBuffers(1,&m_counterBufferID);
+  glDeleteBuffers(1,&m_aliveBufferID);
+  glDeleteBuffers(1,&m_freeBufferID);
+  glDeleteBuffers(1,&m_snapshotBufferID);
+  glDeleteBuffers(1,&m_systemBufferID);
+  glDeleteSync(m_snapshotFence);
+  glDeleteTextures(1,&m_fieldTexture);
+}
+
+ShaderVariantCache::Defines GPUParticleSimulator::formatDefines(ParticleFormat _format, float _extent)
+{
+  if(_format==ParticleFormat::Full)
+  {
+    return {};
+  }
+  // enough digits that the shader decodes with exactly the extent the C++ side uses, showpoint keeps it a float
+  std::ostringstream extent;
+  extent<<std::setprecision(9)<<std::showpoint<<_extent;
+  return {{"COMPACT_FORMAT","1"},{"POSITION_EXTENT",extent.str()}};
+}
+
+void GPUParticleSimulator::createProgram()
+{
+  size_t maxSize=compute::maxWorkgroupSize();
+  if(m_workgroupSize==0 || m_workgroupSize>maxSize)
+  {
+    std::cerr<<"work group size "<<m_workgroupSize<<" not supported, using "<<std::min<size_t>(128,maxSize)<<'\n';
+    m_workgroupSize=std::min<size_t>(128,maxSize);
+  }
+  // everything touching the particle buffers needs the work group size and the buffer layout
+  ShaderVariantCache::Defines particle={{"WORKGROUP_SIZE",std::to_string(m_workgroupSize)}};
+  ShaderVariantCache::Defines format=formatDefines(m_format,m_positionExtent);
+  particle.insert(particle.end(),format.begin(),format.end());
+  m_spatialHash.setPositionFormat(format);
+  m_mortonOrder.setFormat(format,particleformat::positionStride(m_format),particleformat::velocityStride(m_format),
+                          m_lifecycle);
+  ShaderVariantCache::Defines defines=particle;
+  if(m_forceMode==ForceMode::Tiled)
+  {
+    defines.push_back({"TILED_ATTRACTORS","1"});
+  }
+  else if(m_forceMode==ForceMode::Grid)
+  {
+    defines.push_back({"GRID_FORCE","1"});
+    m_bakeProgram=compute::requireProgram("shaders/ForceFieldBake.glsl",{});
+    GLsizei res=static_cast<GLsizei>(m_gridResolution);
+    glGenTextures(1,&m_fieldTexture);
+    glBindTexture(GL_TEXTURE_3D,m_fieldTexture);
+    glTexStorage3D(GL_TEXTURE_3D,1,GL_RGBA32F,res,res,res);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D,0);
+  }
+  if(m_neighborRadius>0.0f)
+  {
+    ShaderVariantCache::Defines neighbor=particle;
+    neighbor.push_back({"NEIGHBOR_PASS","1"});
+    m_neighborProgram=compute::requireProgram("shaders/SpatialHash.glsl",neighbor);
+    defines.push_back({"NEIGHBOR_FORCE","1"});
+  }
+  if(m_lifecycle)
+  {
+    defines.push_back({"LIFECYCLE","1"});
+    auto pass=[&](const char *_pass)
+    {
+      ShaderVariantCache::Defines lifecycle=particle;
+      lifecycle.push_back({_pass,"1"});
+      return compute::requireProgram("shaders/ParticleLifecycle.glsl",lifecycle);
+    };
+    m_resetProgram=pass("RESET_PASS");
+    m_beginProgram=pass("BEGIN_PASS");
+    m_emitProgram=pass("EMIT_PASS");
+    m_rebuildProgram=pass("REBUILD_PASS");
+  }
+  if(!m_systems.empty())
+  {
+    defines.push_back({"BATCHED","1"});
+    const auto &systems=m_systems.systems();
+    glGenBuffers(1,&m_systemBufferID);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_systemBufferID);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,systems.size()*sizeof(ParticleSystems::System),systems.data(),0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  }
+  m_program=compute::requireProgram("shaders/ParticlesCompute.glsl",defines);
+  m_initProgram=compute::requireProgram("shaders/ParticlesInit.glsl",particle);
+  if(!m_paths.empty())
+  {
+    // the paths never change so they go into immutable buffers once
+    m_animateProgram=compute::requireProgram("shaders/AttractorAnimate.glsl",{});
+    const auto &paths=m_paths.paths();
+    const auto &keys=m_paths.keys();
+    glGenBuffers(1,&m_pathBufferID);
+    glGenBuffers(1,&m_keyBufferID);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_pathBufferID);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,paths.size()*sizeof(AttractorPaths::Path),paths.data(),0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_keyBufferID);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,keys.size()*sizeof(float),keys.data(),0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  }
+}
+
+void GPUParticleSimulator::initialize(size_t _numParticles, uint32_t _seed)
+{
+  PROFILE_SCOPE("initialize");
+  if(m_program.empty())
+  {
+    createProgram();
+  }
+  m_numParticles= m_systems.empty() ? _numParticles : m_systems.numParticles();
+  m_seed=_seed;
+  m_stepIndex=0;
+  if(m_streamChunk!=0)
+  {
+    // the whole state is written on the host, the pool threads touch the pages first
+    if(allocateStreaming())
+    {
+      unsigned char *pos=m_hostState.data();
+      unsigned char *vel=pos+m_numParticles*particleformat::positionStride(m_format);
+      m_copyPool->parallelFor(m_numParticles, std::max<size_t>(4096, m_numParticles/(m_copyPool->size()*8)+1),
+                              [&](size_t _begin, size_t _end) { writeInitialState(pos,vel,_begin,_end); });
+      uploadDisplay();
+    }
+    return;
+  }
+  // only the mapped path needs the buffers to be host visible, the compute path leaves the driver free to put
+  // them anywhere
+  allocateParticles(m_initMode==InitMode::Mapped ? GL_MAP_WRITE_BIT : 0);
+  if(m_initMode==InitMode::Mapped)
+  {
+    initializeMapped();
+  }
+  else
+  {
+    initializeCompute();
+  }
+
+  if(m_lifecycle)
+  {
+    resetLifecycle();
+  }
+}
+
+bool GPUParticleSimulator::restore(const CheckpointReader &_reader)
+{
+  PROFILE_SCOPE("restore checkpoint");
+  if(m_program.empty())
+  {
+    createProgram();
+  }
+  const checkpoint::FileHeader &header=_reader.header();
+  if(!m_systems.empty() && header.numParticles!=m_systems.numParticles())
+  {
+    std::cerr<<"the checkpoint has "<<header.numParticles<<" particles, the systems "<<m_systems.numParticles()<<'\n';
+    return false;
+  }
+  m_numParticles=static_cast<size_t>(header.numParticles);
+  m_seed=header.seed;
+  m_stepIndex=header.stepIndex;
+  void *pos=nullptr;
+  void *vel=nullptr;
+  if(m_streamChunk!=0)
+  {
+    // straight into the host state, the display chunk follows at the end
+    if(!allocateStreaming())
+    {
+      return false;
+    }
+    pos=m_hostState.data();
+    vel=m_hostState.data()+m_numParticles*particleformat::positionStride(m_format);
+  }
+  else
+  {
+    allocateParticles(GL_MAP_WRITE_BIT);
+    // the same two mappings as initializeMapped, each chunk is inflated then interleaved into them by the pool
+    glBindBuffer(GL_ARRAY_BUFFER, m_positionBufferID);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_velocityBufferID);
+    GLbitfield access=GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    pos=glMapBufferRange(GL_ARRAY_BUFFER, 0, m_numParticles * particleformat::positionStride(m_format), access);
+    vel=glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_numParticles * particleformat::velocityStride(m_format), access);
+    if(pos==nullptr || vel==nullptr)
+    {
+      std::cerr<<"unable to map the particle buffers\n";
+    }
+  }
+  bool loaded=pos!=nullptr && vel!=nullptr;
+  ThreadPool pool(m_numThreads);
+  CheckpointReader::Chunk chunk;
+  for(size_t c=0; loaded && c<_reader.numChunks(); ++c)
+  {
+    loaded=_reader.readChunk(c,pool,chunk);
+    if(!loaded)
+    {
+      break;
+    }
+    const size_t first=_reader.chunkFirst(c);
+    const auto &in=chunk.streams;
+    pool.parallelFor(_reader.chunkCount(c), 4096, [&](size_t _begin, size_t _end)
+    {
+      for(size_t i=_begin; i<_end; ++i)
+      {
+        float p[4]={in[0][i],in[1][i],in[2][i],in[3][i]};
+        float v[4]={in[4][i],in[5][i],in[6][i],0.0f};
+        if(m_format==ParticleFormat::Compact)
+        {
+          particleformat::encodePosition(p,m_positionExtent,static_cast<uint32_t *>(pos)+(first+i)*2);
+          particleformat::encodeVelocity(v,static_cast<uint32_t *>(vel)+(first+i)*2);
+        }
+        else
+        {
+          std::copy(p,p+4,static_cast<float *>(pos)+(first+i)*4);
+          std::copy(v,v+4,static_cast<float *>(vel)+(first+i)*4);
+        }
+      }
+    });
+  }
+  if(m_streamChunk!=0)
+  {
+    uploadDisplay();
+    return loaded;
+  }
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  if(m_lifecycle)
+  {
+    // the file has the live particles first so the lists are rebuilt from the count alone
+    resetLifecycle(static_cast<size_t>(header.liveCount));
+  }
+  return loaded;
+}
+
+void GPUParticleSimulator::allocateParticles(GLbitfield _flags)
+{
+  // immutable storage can't be resized so every initialize gets new buffers, a snapshot of the old ones is void
+  glDeleteSync(m_snapshotFence);
+  m_snapshotFence=nullptr;
+  glDeleteBuffers(1,&m_positionBufferID);
+  glDeleteBuffers(1,&m_velocityBufferID);
+  glGenBuffers(1, &m_positionBufferID);
+  glGenBuffers(1, &m_velocityBufferID);
+  glBindBuffer(GL_ARRAY_BUFFER, m_positionBufferID);
+  glBufferStorage(GL_ARRAY_BUFFER, m_numParticles * particleformat::positionStride(m_format), nullptr, _flags);
+  // std430 gives vec3 array elements a 16 byte stride
+  glBindBuffer(GL_ARRAY_BUFFER, m_velocityBufferID);
+  glBufferStorage(GL_ARRAY_BUFFER, m_numParticles * particleformat::velocityStride(m_format), nullptr, _flags);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if(m_neighborRadius>0.0f)
+  {
+    if(m_neighborForceBufferID==0)
+    {
+      glGenBuffers(1, &m_neighborForceBufferID);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_neighborForceBufferID);
+    glBufferData(GL_ARRAY_BUFFER, m_numParticles * sizeof(ngl::Vec4), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+}
+
+void GPUParticleSimulator::initializeCompute()
+{
+  ngl::ShaderLib::use(m_initProgram);
+  compute::setUniform(m_initProgram,"numParticles",static_cast<GLuint>(m_numParticles));
+  compute::setUniform(m_initProgram,"seed",static_cast<GLuint>(m_seed));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_positionBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_velocityBufferID);
+  compute::dispatch1D(m_numParticles, m_workgroupSize);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GPUParticleSimulator::initializeMapped()
+{
+  // both buffers mapped at once through different targets, the threads write straight into the mappings.
+  // Every particle's state only depends on its index so the split across threads doesn't change the result.
+  glBindBuffer(GL_ARRAY_BUFFER, m_positionBufferID);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_velocityBufferID);
+  GLbitfield access=GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+  size_t positionBytes=m_numParticles * particleformat::positionStride(m_format);
+  size_t velocityBytes=m_numParticles * particleformat::velocityStride(m_format);
+  void *pos=glMapBufferRange(GL_ARRAY_BUFFER, 0, positionBytes, access);
+  void *vel=glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, velocityBytes, access);
+  if(pos!=nullptr && vel!=nullptr)
+  {
+    ThreadPool pool(m_numThreads);
+    pool.parallelFor(m_numParticles, std::max<size_t>(4096, m_numParticles/(pool.size()*8)+1),
+                     [&](size_t _begin, size_t _end) { writeInitialState(pos,vel,_begin,_end); });
+  }
+  else
+  {
+    std::cerr<<"unable to map the particle buffers\n";
+  }
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GPUParticleSimulator::writeInitialState(void *o_positions, void *o_velocities, size_t _begin, size_t _end) const
+{
+  if(m_format==ParticleFormat::Compact)
+  {
+    // the same rounding as encodePosition / encodeVelocity in ParticleFormat.glsl
+    auto packedPos=static_cast<uint32_t *>(o_positions);
+    auto packedVel=static_cast<uint32_t *>(o_velocities);
+    for(size_t i=_begin; i<_end; ++i)
+    {
+      float p[4];
+      float v[3];
+      initialState(static_cast<uint32_t>(i),m_seed,p,v);
+      particleformat::encodePosition(p,m_positionExtent,packedPos+i*2);
+      particleformat::encodeVelocity(v,packedVel+i*2);
+    }
+    return;
+  }
+  auto fullPos=static_cast<float *>(o_positions);
+  auto fullVel=static_cast<float *>(o_velocities);
+  for(size_t i=_begin; i<_end; ++i)
+  {
+    initialState(static_cast<uint32_t>(i),m_seed,fullPos+i*4,fullVel+i*4);
+    fullVel[i*4+3]=0.0f;
+  }
+}
+
+void GPUParticleSimulator::resetLifecycle(size_t _alive)
+{
+  glDeleteBuffers(1,&m_counterBufferID);
+  glDeleteBuffers(1,&m_aliveBufferID);
+  glDeleteBuffers(1,&m_freeBufferID);
+  glGenBuffers(1,&m_counterBufferID);
+  glGenBuffers(1,&m_aliveBufferID);
+  glGenBuffers(1,&m_freeBufferID);
+  // nothing here is ever touched by the host after the reset pass, apart from liveCount reading a counter
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_counterBufferID);
+  glBufferStorage(GL_SHADER_STORAGE_BUFFER,c_counterBytes,nullptr,0);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_aliveBufferID);
+  glBufferStorage(GL_SHADER_STORAGE_BUFFER,2*m_numParticles*sizeof(GLuint),nullptr,0);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_freeBufferID);
+  glBufferStorage(GL_SHADER_STORAGE_BUFFER,m_numParticles*sizeof(GLuint),nullptr,0);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  m_currentList=0;
+  m_pendingBurst=0;
+
+  if(_alive!=0)
+  {
+    // start from zeroed counters with the live count in aliveCount[0], the rebuild pass lists the slots
+    GLuint alive=static_cast<GLuint>(_alive);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_counterBufferID);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT,
+                         &alive);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    ngl::ShaderLib::use(m_rebuildProgram);
+    compute::setUniform(m_rebuildProgram,"numParticles",static_cast<GLuint>(m_numParticles));
+    compute::setUniform(m_rebuildProgram,"currentList",m_currentList);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_counterBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_aliveBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, m_freeBufferID);
+    compute::dispatch1D(m_numParticles, m_workgroupSize);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    return;
+  }
+  ngl::ShaderLib::use(m_resetProgram);
+  compute::setUniform(m_resetProgram,"numParticles",static_cast<GLuint>(m_numParticles));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_positionBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_counterBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_aliveBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, m_freeBufferID);
+  compute::dispatch1D(m_numParticles, m_workgroupSize);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GPUParticleSimulator::setEmitters(const float *_xyzr, size_t _count)
+{
+  if(!m_lifecycle)
+  {
+    return;
+  }
+  if(m_emitterBufferID==0)
+  {
+    glGenBuffers(1,&m_emitterBufferID);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_emitterBufferID);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,std::max<size_t>(_count,1)*sizeof(ngl::Vec4),_xyzr,GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  m_numEmitters=_count;
+}
+
+void GPUParticleSimulator::emitParticles()
+{
+  // the free count is only known on the GPU so the begin pass clamps the request and sizes both dispatches
+  size_t request= m_numEmitters!=0 ? m_emitRate+m_pendingBurst : 0;
+  m_pendingBurst=0;
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_positionBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_velocityBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_counterBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_aliveBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, m_freeBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_emitterBufferID);
+  ngl::ShaderLib::use(m_beginProgram);
+  compute::setUniform(m_beginProgram,"spawnRequest",static_cast<GLuint>(request));
+  compute::setUniform(m_beginProgram,"currentList",m_currentList);
+  glDispatchCompute(1,1,1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+  ngl::ShaderLib::use(m_emitProgram);
+  compute::setUniform(m_emitProgram,"numParticles",static_cast<GLuint>(m_numParticles));
+  compute::setUniform(m_emitProgram,"seed",static_cast<GLuint>(m_seed));
+  compute::setUniform(m_emitProgram,"stepIndex",static_cast<GLuint>(m_stepIndex));
+  compute::setUniform(m_emitProgram,"currentList",m_currentList);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,m_counterBufferID);
+  glDispatchComputeIndirect(c_emitArgsOffset);
+  // the simulate pass pushes expired slots over the ones just taken so the emit reads must be done
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+size_t GPUParticleSimulator::liveCount()
+{
+  if(!m_lifecycle)
+  {
+    return m_numParticles;
+  }
+  GLuint count=0;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_counterBufferID);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER,m_currentList*sizeof(GLuint),sizeof(GLuint),&count);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  return count;
+}
+
+void GPUParticleSimulator::setAttractors(const float *_xyz, size_t _count)
+{
+  if(!m_paths.empty())
+  {
+    // the buffer only ever has to be resized, its contents are written by every step
+    if(_count!=m_numAttractors || m_animatedAttractorsID==0)
+    {
+      glDeleteBuffers(1,&m_animatedAttractorsID);
+      glGenBuffers(1,&m_animatedAttractorsID);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_animatedAttractorsID);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER,std::max<size_t>(_count,1)*sizeof(ngl::Vec4),nullptr,0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+      m_numAttractors=_count;
+    }
+    m_fieldDirty=true;
+    return;
+  }
+  // std430 pads vec3 array elements to 16 bytes so write vec4s straight into the next ring slot
+  size_t bytes=_count*sizeof(ngl::Vec4);
+  if(m_attractors.id()==0 || bytes > m_attractors.slotSize())
+  {
+    m_attractors.allocate(bytes);
+  }
+  auto dst=static_cast<float *>(m_attractors.beginWrite());
+  for(size_t i=0; i<_count; ++i)
+  {
+    dst[i*4+0]=_xyz[i*3+0];
+    dst[i*4+1]=_xyz[i*3+1];
+    dst[i*4+2]=_xyz[i*3+2];
+    dst[i*4+3]=0.0f;
+  }
+  m_attractors.endWrite(bytes);
+  m_fieldDirty=true;
+}
+
+void GPUParticleSimulator::bindAttractors(GLuint _index) const
+{
+  if(m_animatedAttractorsID!=0)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, _index, m_animatedAttractorsID);
+  }
+  else
+  {
+    m_attractors.bindRange(GL_SHADER_STORAGE_BUFFER, _index);
+  }
+}
+
+void GPUParticleSimulator::animateAttractors()
+{
+  ngl::ShaderLib::use(m_animateProgram);
+  ngl::ShaderLib::setUniform("stepSeconds",m_stepSeconds);
+  compute::setUniform(m_animateProgram,"numAttractors",static_cast<GLuint>(m_numAttractors));
+  compute::setUniform(m_animateProgram,"stepIndex",static_cast<GLuint>(m_stepIndex));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_animatedAttractorsID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, m_pathBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, m_keyBufferID);
+  compute::dispatch1D(m_numAttractors, 64);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  // the grid is a function of the attractors so it has to follow them, every step
+  m_fieldDirty=true;
+}
+
+void GPUParticleSimulator::bakeField()
+{
+  ngl::ShaderLib::use(m_bakeProgram);
+  ngl::ShaderLib::setUniform("gridExtent",m_gridExtent);
+  bindAttractors(2);
+  glBindImageTexture(0, m_fieldTexture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+  GLuint groups=static_cast<GLuint>((m_gridResolution+3)/4);
+  glDispatchCompute(groups, groups, groups);
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  m_fieldDirty=false;
+}
+
+void GPUParticleSimulator::computeNeighborForces()
+{
+  m_spatialHash.build(m_positionBufferID, m_numParticles, m_neighborRadius, m_workgroupSize);
+  m_spatialHash.bind(m_neighborProgram);
+  ngl::ShaderLib::setUniform("separation",m_separation);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_positionBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_neighborForceBufferID);
+  compute::dispatch1D(m_numParticles, m_workgroupSize);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GPUParticleSimulator::step(float _dt)
+{
+  advance(_dt,1);
+}
+
+void GPUParticleSimulator::advance(float _dt, size_t _steps)
+{
+  if(m_streamChunk!=0)
+  {
+    streamSteps(_dt,_steps);
+    return;
+  }
+  PROFILE_SCOPE("submit gpu step");
+  // the substeps only read and write the SSBOs so they just need a storage barrier between them, the full
+  // barrier and the attractor fence are paid once for the whole batch
+  for(size_t i=0; i<_steps; ++i)
+  {
+    dispatchStep(_dt);
+    glMemoryBarrier(i+1<_steps ? GL_SHADER_STORAGE_BARRIER_BIT : GL_ALL_BARRIER_BITS);
+  }
+  if(_steps!=0)
+  {
+    m_attractors.fence();
+  }
+}
+
+void GPUParticleSimulator::prepareForces()
+{
+  if(m_animatedAttractorsID!=0 && m_numAttractors!=0)
+  {
+    animateAttractors();
+  }
+  if(m_forceMode==ForceMode::Grid)
+  {
+    if(m_fieldDirty)
+    {
+      bakeField();
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D,m_fieldTexture);
+  }
+}
+
+void GPUParticleSimulator::bindSimulate(float _dt)
+{
+  ngl::ShaderLib::use(m_program);
+  if(m_forceMode==ForceMode::Grid)
+  {
+    ngl::ShaderLib::setUniform("gridExtent",m_gridExtent);
+  }
+  ngl::ShaderLib::setUniform("dt",_dt);
+  compute::setUniform(m_program,"seed",static_cast<GLuint>(m_seed));
+  bindAttractors(2);
+  if(m_systemBufferID!=0)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, m_systemBufferID);
+  }
+}
+
+void GPUParticleSimulator::dispatchStep(float _dt)
+{
+  prepareForces();
+  if(m_neighborRadius>0.0f)
+  {
+    computeNeighborForces();
+  }
+  if(m_lifecycle)
+  {
+    emitParticles();
+  }
+  bindSimulate(_dt);
+  compute::setUniform(m_program,"numParticles",static_cast<GLuint>(m_numParticles));
+  compute::setUniform(m_program,"firstParticle",0u);
+  compute::setUniform(m_program,"stepIndex",static_cast<GLuint>(m_stepIndex++));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_positionBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_velocityBufferID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_neighborForceBufferID);
+
+  if(m_lifecycle)
+  {
+    // emitParticles left the counters, lists and indirect buffer bound. The list just filled is stepped next
+    compute::setUniform(m_program,"currentList",m_currentList);
+    glDispatchComputeIndirect(c_simulateArgsOffset);
+    m_currentList^=1u;
+  }
+  else
+  {
+    compute::dispatch1D(m_numParticles, m_workgroupSize);
+  }
+  if(m_reorderInterval!=0 && m_stepIndex%m_reorderInterval==0)
+  {
+    reorder();
+  }
+}
+
+bool GPUParticleSimulator::allocateStreaming()
+{
+  releaseStreaming();
+  const size_t positionStride=particleformat::positionStride(m_format);
+  const size_t velocityStride=particleformat::velocityStride(m_format);
+  if(!m_hostState.allocate(m_numParticles*(positionStride+velocityStride),m_stateFile))
+  {
+    m_numParticles=0;
+    return false;
+  }
+  if(!m_copyPool)
+  {
+    m_copyPool=std::make_unique<ThreadPool>(m_numThreads);
+  }
+  const size_t chunk=std::min(m_streamChunk,m_numParticles);
+  for(auto &slot : m_slots)
+  {
+    glGenBuffers(1,&slot.positionBufferID);
+    glGenBuffers(1,&slot.velocityBufferID);
+    glBindBuffer(GL_COPY_WRITE_BUFFER,slot.positionBufferID);
+    glBufferStorage(GL_COPY_WRITE_BUFFER,chunk*positionStride,nullptr,0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER,slot.velocityBufferID);
+    glBufferStorage(GL_COPY_WRITE_BUFFER,chunk*velocityStride,nullptr,0);
+  }
+  // one region per slot in each direction, mapped once. Client storage asks for cached host memory to read back from
+  m_slotBytes=chunk*(positionStride+velocityStride);
+  const size_t stagingBytes=m_slotBytes*c_streamSlots;
+  GLbitfield persistent=GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1,&m_uploadBufferID);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,m_uploadBufferID);
+  glBufferStorage(GL_COPY_WRITE_BUFFER,stagingBytes,nullptr,GL_MAP_WRITE_BIT | persistent);
+  m_uploadMapping=static_cast<unsigned char *>(
+      glMapBufferRange(GL_COPY_WRITE_BUFFER,0,stagingBytes,GL_MAP_WRITE_BIT | persistent));
+  glGenBuffers(1,&m_downloadBufferID);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,m_downloadBufferID);
+  glBufferStorage(GL_COPY_WRITE_BUFFER,stagingBytes,nullptr,GL_MAP_READ_BIT | persistent | GL_CLIENT_STORAGE_BIT);
+  m_downloadMapping=static_cast<const unsigned char *>(
+      glMapBufferRange(GL_COPY_WRITE_BUFFER,0,stagingBytes,GL_MAP_READ_BIT | persistent));
+  // the first chunk is copied here after every batch for drawing
+  glGenBuffers(1,&m_positionBufferID);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,m_positionBufferID);
+  glBufferStorage(GL_COPY_WRITE_BUFFER,chunk*positionStride,nullptr,GL_DYNAMIC_STORAGE_BIT);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+  if(m_uploadMapping==nullptr || m_downloadMapping==nullptr)
+  {
+    std::cerr<<"unable to map the streaming buffers\n";
+    releaseStreaming();
+    m_numParticles=0;
+    return false;
+  }
+  return true;
+}
+
+void GPUParticleSimulator::releaseStreaming()
+{
+  for(auto &slot : m_slots)
+  {
+    glDeleteSync(slot.fence);
+    glDeleteBuffers(1,&slot.positionBufferID);
+    glDeleteBuffers(1,&slot.velocityBufferID);
+    slot=StreamSlot();
+  }
+  // deleting a mapped buffer unmaps it
+  glDeleteBuffers(1,&m_uploadBufferID);
+  glDeleteBuffers(1,&m_downloadBufferID);
+  glDeleteBuffers(1,&m_positionBufferID);
+  m_uploadBufferID=0;
+  m_downloadBufferID=0;
+  m_positionBufferID=0;
+  m_uploadMapping=nullptr;
+  m_downloadMapping=nullptr;
+  m_slotBytes=0;
+  m_hostSnapshotReady=false;
+}
+
+void GPUParticleSimulator::uploadDisplay()
+{
+  glBindBuffer(GL_COPY_WRITE_BUFFER,m_positionBufferID);
+  glBufferSubData(GL_COPY_WRITE_BUFFER,0,residentCount()*particleformat::positionStride(m_format),m_hostState.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+}
+
+size_t GPUParticleSimulator::residentCount() const
+{
+  return m_streamChunk!=0 ? std::min(m_streamChunk,m_numParticles) : m_numParticles;
+}
+
+void GPUParticleSimulator::retireSlot(size_t _slot)
+{
+  StreamSlot &slot=m_slots[_slot];
+  if(slot.fence==nullptr)
+  {
+    return;
+  }
+  {
+    PROFILE_SCOPE("wait stream slot");
+    while(glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+    {
+    }
+  }
+  glDeleteSync(slot.fence);
+  slot.fence=nullptr;
+  const size_t positionStride=particleformat::positionStride(m_format);
+  const size_t velocityStride=particleformat::velocityStride(m_format);
+  const unsigned char *download=m_downloadMapping+_slot*m_slotBytes;
+  unsigned char *hostVelocities=m_hostState.data()+m_numParticles*positionStride;
+  parallelCopy(*m_copyPool,m_hostState.data()+slot.first*positionStride,download,slot.count*positionStride);
+  parallelCopy(*m_copyPool,hostVelocities+slot.first*velocityStride,download+slot.count*positionStride,
+               slot.count*velocityStride);
+}
+
+void GPUParticleSimulator::streamSteps(float _dt, size_t _steps)
+{
+  if(m_numParticles==0 || _steps==0)
+  {
+    return;
+  }
+  PROFILE_SCOPE("stream gpu steps");
+  const size_t positionStride=particleformat::positionStride(m_format);
+  const size_t velocityStride=particleformat::velocityStride(m_format);
+  const unsigned char *hostVelocities=m_hostState.data()+m_numParticles*positionStride;
+  const size_t numChunks=(m_numParticles+m_streamChunk-1)/m_streamChunk;
+  const size_t fused= m_animatedAttractorsID!=0 ? 1 : _steps;
+  for(size_t done=0; done<_steps; done+=fused)
+  {
+    prepareForces();
+    bindSimulate(_dt);
+    for(size_t c=0; c<numChunks; ++c)
+    {
+      // the slot last held chunk c-c_streamSlots, bring it home before its staging regions are reused. The GPU
+      // meanwhile works on the chunks queued after it
+      const size_t index=c%c_streamSlots;
+      retireSlot(index);
+      StreamSlot &slot=m_slots[index];
+      slot.first=c*m_streamChunk;
+      slot.count=std::min(m_streamChunk,m_numParticles-slot.first);
+      const GLintptr region=static_cast<GLintptr>(index*m_slotBytes);
+      const size_t positionBytes=slot.count*positionStride;
+      const size_t velocityBytes=slot.count*velocityStride;
+      parallelCopy(*m_copyPool,m_uploadMapping+region,m_hostState.data()+slot.first*positionStride,positionBytes);
+      parallelCopy(*m_copyPool,m_uploadMapping+region+positionBytes,hostVelocities+slot.first*velocityStride,
+                   velocityBytes);
+
+      glBindBuffer(GL_COPY_READ_BUFFER,m_uploadBufferID);
+      glBindBuffer(GL_COPY_WRITE_BUFFER,slot.positionBufferID);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,region,0,positionBytes);
+      glBindBuffer(GL_COPY_WRITE_BUFFER,slot.velocityBufferID);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,region+positionBytes,0,velocityBytes);
+
+      // the Philox key is the global index so a chunk steps exactly as it would resident
+      compute::setUniform(m_program,"numParticles",static_cast<GLuint>(slot.count));
+      compute::setUniform(m_program,"firstParticle",static_cast<GLuint>(slot.first));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, slot.positionBufferID);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, slot.velocityBufferID);
+      for(size_t k=0; k<fused; ++k)
+      {
+        compute::setUniform(m_program,"stepIndex",static_cast<GLuint>(m_stepIndex+k));
+        compute::dispatch1D(slot.count, m_workgroupSize);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      }
+
+      glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+      glBindBuffer(GL_COPY_READ_BUFFER,slot.positionBufferID);
+      glBindBuffer(GL_COPY_WRITE_BUFFER,m_downloadBufferID);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,region,positionBytes);
+      if(c==0)
+      {
+        glBindBuffer(GL_COPY_WRITE_BUFFER,m_positionBufferID);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,0,positionBytes);
+        glBindBuffer(GL_COPY_WRITE_BUFFER,m_downloadBufferID);
+      }
+      glBindBuffer(GL_COPY_READ_BUFFER,slot.velocityBufferID);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,region+positionBytes,velocityBytes);
+      glBindBuffer(GL_COPY_READ_BUFFER,0);
+      glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+      // flushed so the GPU starts on the chunk while the host stages the next one
+      slot.fence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+      glFlush();
+    }
+    // oldest first, the host state is complete again when these are done
+    for(size_t c=numChunks; c<numChunks+c_streamSlots; ++c)
+    {
+      retireSlot(c%c_streamSlots);
+    }
+    m_stepIndex+=static_cast<uint32_t>(fused);
+  }
+  m_attractors.fence();
+}
+
+void GPUParticleSimulator::reorder()
+{
+  PROFILE_SCOPE("morton reorder");
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+  if(m_lifecycle)
+  {
+    // the key pass recounts the live slots of the list the next step runs over
+    GLuint zero=0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_counterBufferID);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, m_currentList*sizeof(GLuint), sizeof(GLuint),
+                         GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_counterBufferID);
+  }
+  m_mortonOrder.reorder(m_positionBufferID,m_velocityBufferID,m_numParticles,m_positionExtent,m_workgroupSize,
+                        m_currentList);
+  if(m_lifecycle)
+  {
+    ngl::ShaderLib::use(m_rebuildProgram);
+    compute::setUniform(m_rebuildProgram,"numParticles",static_cast<GLuint>(m_numParticles));
+    compute::setUniform(m_rebuildProgram,"currentList",m_currentList);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_counterBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_aliveBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, m_freeBufferID);
+    compute::dispatch1D(m_numParticles, m_workgroupSize);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+}
+
+bool GPUParticleSimulator::requestSnapshot()
+{
+  if(m_streamChunk!=0)
+  {
+    if(m_hostSnapshotReady)
+    {
+      return false;
+    }
+    PROFILE_SCOPE("request snapshot");
+    const size_t positionBytes=m_numParticles * particleformat::positionStride(m_format);
+    const unsigned char *state=m_hostState.data();
+    m_hostSnapshot.numParticles=m_numParticles;
+    m_hostSnapshot.lifecycle=false;
+    m_hostSnapshot.seed=m_seed;
+    m_hostSnapshot.stepIndex=m_stepIndex;
+    m_hostSnapshot.format=m_format;
+    m_hostSnapshot.positionExtent=m_positionExtent;
+    m_hostSnapshot.positions.assign(state,state+positionBytes);
+    m_hostSnapshot.velocities.assign(state+positionBytes,state+m_hostState.size());
+    m_hostSnapshotReady=true;
+    return true;
+  }
+  if(m_snapshotFence!=nullptr)
+  {
+    return false;
+  }
+  PROFILE_SCOPE("request snapshot");
+  size_t positionBytes=m_numParticles * particleformat::positionStride(m_format);
+  size_t velocityBytes=m_numParticles * particleformat::velocityStride(m_format);
+  if(m_snapshotBytes!=positionBytes+velocityBytes)
+  {
+    // persistent and coherent so the copy can be read in place once the fence has passed, no map per snapshot
+    m_snapshotBytes=positionBytes+velocityBytes;
+    GLbitfield flags=GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glDeleteBuffers(1,&m_snapshotBufferID);
+    glGenBuffers(1,&m_snapshotBufferID);
+    glBindBuffer(GL_COPY_WRITE_BUFFER,m_snapshotBufferID);
+    glBufferStorage(GL_COPY_WRITE_BUFFER,std::max<size_t>(m_snapshotBytes,4),nullptr,flags);
+    m_snapshotMapping=static_cast<const unsigned char *>(
+        glMapBufferRange(GL_COPY_WRITE_BUFFER,0,std::max<size_t>(m_snapshotBytes,4),flags));
+    if(m_snapshotMapping==nullptr)
+    {
+      std::cerr<<"unable to map the snapshot buffer\n";
+      glDeleteBuffers(1,&m_snapshotBufferID);
+      m_snapshotBufferID=0;
+      m_snapshotBytes=0;
+      return false;
+    }
+  }
+  // the copies are queued behind the steps already submitted, the compute writes have to land first
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,m_snapshotBufferID);
+  glBindBuffer(GL_COPY_READ_BUFFER,m_positionBufferID);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,0,positionBytes);
+  glBindBuffer(GL_COPY_READ_BUFFER,m_velocityBufferID);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,positionBytes,velocityBytes);
+  glBindBuffer(GL_COPY_READ_BUFFER,0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+  m_snapshotFence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+  m_snapshotStep=m_stepIndex;
+  return true;
+}
+
+bool GPUParticleSimulator::pollSnapshot(checkpoint::Frame &o_frame)
+{
+  if(m_hostSnapshotReady)
+  {
+    o_frame=std::move(m_hostSnapshot);
+    m_hostSnapshotReady=false;
+    return true;
+  }
+  if(m_snapshotFence==nullptr)
+  {
+    return false;
+  }
+  // a zero timeout only asks, the flush makes sure the fence gets to the GPU if nothing else is submitted
+  GLenum state=glClientWaitSync(m_snapshotFence,GL_SYNC_FLUSH_COMMANDS_BIT,0);
+  if(state==GL_TIMEOUT_EXPIRED)
+  {
+    return false;
+  }
+  glDeleteSync(m_snapshotFence);
+  m_snapshotFence=nullptr;
+  if(state==GL_WAIT_FAILED)
+  {
+    return false;
+  }
+  PROFILE_SCOPE("collect snapshot");
+  size_t positionBytes=m_numParticles * particleformat::positionStride(m_format);
+  o_frame.numParticles=m_numParticles;
+  o_frame.lifecycle=m_lifecycle;
+  o_frame.seed=m_seed;
+  o_frame.stepIndex=m_snapshotStep;
+  o_frame.format=m_format;
+  o_frame.positionExtent=m_positionExtent;
+  o_frame.positions.assign(m_snapshotMapping,m_snapshotMapping+positionBytes);
+  o_frame.velocities.assign(m_snapshotMapping+positionBytes,m_snapshotMapping+m_snapshotBytes);
+  return true;
+}
+
+void GPUParticleSimulator::finish()
+{
+  glFinish();
+}
+
+void GPUParticleSimulator::readPositions(float *o_xyzw, size_t _first, size_t _count)
+{
+  if(m_streamChunk!=0)
+  {
+    // every batch ends with the whole state back on the host
+    const unsigned char *state=m_hostState.data();
+    for(size_t i=0; i<_count; ++i)
+    {
+      if(m_format==ParticleFormat::Full)
+      {
+        std::memcpy(o_xyzw+i*4,state+(_first+i)*sizeof(ngl::Vec4),sizeof(ngl::Vec4));
+      }
+      else
+      {
+        uint32_t packed[2];
+        std::memcpy(packed,state+(_first+i)*8,sizeof(packed));
+        particleformat::decodePosition(packed,m_positionExtent,o_xyzw+i*4);
+      }
+    }
+    return;
+  }
+  // glGetBufferSubData waits for the dispatches writing the buffer
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_positionBufferID);
+  if(m_format==ParticleFormat::Full)
+  {
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, _first*sizeof(ngl::Vec4), _count*sizeof(ngl::Vec4), o_xyzw);
+  }
+  else
+  {
+    std::vector<uint32_t> packed(_count*2);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, _first*8, _count*8, packed.data());
+    for(size_t i=0; i<_count; ++i)
+    {
+      particleformat::decodePosition(&packed[i*2],m_positionExtent,o_xyzw+i*4);
+    }
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+size_t GPUParticleSimulator::memoryFootprint() const
+{
+  size_t field= m_fieldTexture!=0 ? m_gridResolution*m_gridResolution*m_gridResolution*sizeof(ngl::Vec4) : 0;
+  size_t neighbors= m_neighborForceBufferID!=0 ? m_numParticles*sizeof(ngl::Vec4)+m_spatialHash.memoryFootprint() : 0;
+  size_t particles=m_numParticles * (particleformat::positionStride(m_format)+particleformat::velocityStride(m_format));
+  if(m_streamChunk!=0)
+  {
+    // the host state, the device and staging buffers of every slot and the display chunk
+    size_t display=residentCount()*particleformat::positionStride(m_format);
+    return particles + 3*m_slotBytes*c_streamSlots + display + field + m_snapshotBytes;
+  }
+  // two alive lists and the free list
+  size_t lifecycle= m_lifecycle ? m_numParticles*3*sizeof(GLuint) : 0;
+  return particles + field + neighbors + lifecycle + m_snapshotBytes + m_mortonOrder.memoryFootprint();
+}
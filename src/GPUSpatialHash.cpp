@@ -0,0 +1,96 @@
+#include "GPUSpatialHash.h"
+#include "ComputeUtils.h"
+#include "ShaderVariantCache.h"
+#include "SpatialHash.h"
+#include <ngl/ShaderLib.h>
+
+GPUSpatialHash::~GPUSpatialHash()
+{
+  glDeleteBuffers(1,&m_cellStartID);
+  glDeleteBuffers(1,&m_sortedIndexID);
+  glDeleteBuffers(1,&m_particleHashID);
+  glDeleteBuffers(1,&m_blockSumID);
+}
+
+void GPUSpatialHash::allocate(size_t _count, size_t _workgroupSize)
+{
+  if(m_cellStartID==0)
+  {
+    glGenBuffers(1,&m_cellStartID);
+    glGenBuffers(1,&m_sortedIndexID);
+    glGenBuffers(1,&m_particleHashID);
+    glGenBuffers(1,&m_blockSumID);
+  }
+  m_count=_count;
+  m_workgroupSize=_workgroupSize;
+  // same table size as the CPU version so both bin identically
+  m_tableSize=SpatialHash::tableSizeFor(_count);
+  m_numBlocks=compute::prefixSumBlocks(m_tableSize);
+  auto storage=[](GLuint _id, size_t _bytes)
+  {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,_id);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,static_cast<GLsizeiptr>(_bytes),nullptr,GL_DYNAMIC_COPY);
+  };
+  storage(m_cellStartID,m_tableSize*sizeof(GLuint));
+  storage(m_sortedIndexID,_count*sizeof(GLuint));
+  storage(m_particleHashID,_count*sizeof(GLuint));
+  storage(m_blockSumID,m_numBlocks*sizeof(GLuint));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+
+  ShaderVariantCache::Defines wg={{"WORKGROUP_SIZE",std::to_string(_workgroupSize)}};
+  ShaderVariantCache::Defines hash=wg;
+  hash.insert(hash.end(),m_formatDefines.begin(),m_formatDefines.end());
+  hash.push_back({"HASH_PASS","1"});
+  m_hashProgram=compute::requireProgram("shaders/SpatialHash.glsl",hash);
+  m_scatterProgram=compute::requireProgram("shaders/SpatialHash.glsl",{wg[0],{"SCATTER_PASS","1"}});
+}
+
+void GPUSpatialHash::bind(const std::string &_program) const
+{
+  ngl::ShaderLib::use(_program);
+  ngl::ShaderLib::setUniform("cellSize",m_cellSize);
+  compute::setUniform(_program,"numParticles",static_cast<GLuint>(m_count));
+  compute::setUniform(_program,"tableMask",static_cast<GLuint>(m_tableSize-1));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_cellStartID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_sortedIndexID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_particleHashID);
+}
+
+void GPUSpatialHash::setPositionFormat(const ShaderVariantCache::Defines &_formatDefines)
+{
+  m_formatDefines=_formatDefines;
+  // forces allocate to fetch the matching HASH_PASS variant
+  m_count=0;
+}
+
+void GPUSpatialHash::build(GLuint _positionBuffer, size_t _count, float _cellSize, size_t _workgroupSize)
+{
+  if(_count!=m_count || _workgroupSize!=m_workgroupSize)
+  {
+    allocate(_count,_workgroupSize);
+  }
+  m_cellSize=_cellSize;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_cellStartID);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+
+  // hash and count
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _positionBuffer);
+  bind(m_hashProgram);
+  compute::dispatch1D(m_count, m_workgroupSize);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  // counts -> slot starts
+  compute::prefixSum(m_cellStartID, m_blockSumID, m_tableSize);
+
+  // scatter, turns the starts into ends
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _positionBuffer);
+  bind(m_scatterProgram);
+  compute::dispatch1D(m_count, m_workgroupSize);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+size_t GPUSpatialHash::memoryFootprint() const
+{
+  return (m_tableSize+m_count*2+m_numBlocks)*sizeof(GLuint);
+}
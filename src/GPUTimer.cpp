@@ -0,0 +1,68 @@
+#include "GPUTimer.h"
+
+GPUTimer::~GPUTimer()
+{
+  release();
+}
+
+void GPUTimer::release()
+{
+  if(m_queries[0]!=0)
+  {
+    glDeleteQueries(2,m_queries.data());
+    m_queries={{0,0}};
+    m_pending={{false,false}};
+  }
+}
+
+void GPUTimer::collect(size_t _slot, bool _wait)
+{
+  if(!m_pending[_slot])
+  {
+    return;
+  }
+  GLint available=GL_FALSE;
+  glGetQueryObjectiv(m_queries[_slot], GL_QUERY_RESULT_AVAILABLE, &available);
+  if(available==GL_FALSE && !_wait)
+  {
+    return;
+  }
+  GLuint64 elapsed=0;
+  glGetQueryObjectui64v(m_queries[_slot], GL_QUERY_RESULT, &elapsed);
+  m_pending[_slot]=false;
+  if(Profiler::enabled())
+  {
+    Profiler::record(m_name, m_issued[_slot], elapsed, Profiler::Track::GPU);
+  }
+}
+
+void GPUTimer::begin()
+{
+  if(!Profiler::enabled())
+  {
+    return;
+  }
+  if(m_queries[0]==0)
+  {
+    glGenQueries(2,m_queries.data());
+  }
+  // this query was issued two sections ago so is almost always ready, it has to be read before reuse
+  collect(m_current,true);
+  m_issued[m_current]=Profiler::now();
+  glBeginQuery(GL_TIME_ELAPSED, m_queries[m_current]);
+  m_active=true;
+}
+
+void GPUTimer::end()
+{
+  if(!m_active)
+  {
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+  m_active=false;
+  m_pending[m_current]=true;
+  m_current^=1;
+  // pick up the previous section if it has finished so the summary doesn't lag a frame
+  collect(m_current,false);
+}
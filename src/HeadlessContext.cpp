@@ -0,0 +1,78 @@
+#include "HeadlessContext.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+#include <iostream>
+
+HeadlessContext::~HeadlessContext()
+{
+  if(m_display!=nullptr)
+  {
+    eglMakeCurrent(m_display,EGL_NO_SURFACE,EGL_NO_SURFACE,EGL_NO_CONTEXT);
+    if(m_context!=nullptr)
+    {
+      eglDestroyContext(m_display,m_context);
+    }
+    eglTerminate(m_display);
+  }
+}
+
+bool HeadlessContext::create(int _major, int _minor)
+{
+  auto hasExtension=[](const char *_list, const char *_name)
+  {
+    return _list!=nullptr && std::strstr(_list,_name)!=nullptr;
+  };
+  EGLDisplay display=EGL_NO_DISPLAY;
+  // client extensions, queried without a display
+  const char *client=eglQueryString(EGL_NO_DISPLAY,EGL_EXTENSIONS);
+  if(hasExtension(client,"EGL_MESA_platform_surfaceless"))
+  {
+    auto getPlatformDisplay=reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if(getPlatformDisplay!=nullptr)
+    {
+      display=getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,EGL_DEFAULT_DISPLAY,nullptr);
+    }
+  }
+  if(display==EGL_NO_DISPLAY)
+  {
+    display=eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  EGLint major=0;
+  EGLint minor=0;
+  if(display==EGL_NO_DISPLAY || !eglInitialize(display,&major,&minor))
+  {
+    std::cerr<<"unable to initialise an EGL display\n";
+    return false;
+  }
+  m_display=display;
+  const char *extensions=eglQueryString(display,EGL_EXTENSIONS);
+  if(!hasExtension(extensions,"EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API))
+  {
+    std::cerr<<"EGL "<<major<<"."<<minor<<" has no surfaceless desktop GL contexts\n";
+    return false;
+  }
+  // there is no surface so any config will do, and with EGL_KHR_no_config_context none is needed at all
+  EGLConfig config=EGL_NO_CONFIG_KHR;
+  if(!hasExtension(extensions,"EGL_KHR_no_config_context"))
+  {
+    const EGLint attributes[]={EGL_RENDERABLE_TYPE,EGL_OPENGL_BIT,EGL_NONE};
+    EGLint count=0;
+    if(!eglChooseConfig(display,attributes,&config,1,&count) || count==0)
+    {
+      std::cerr<<"no EGL config supports desktop GL\n";
+      return false;
+    }
+  }
+  const EGLint attributes[]={EGL_CONTEXT_MAJOR_VERSION,_major,EGL_CONTEXT_MINOR_VERSION,_minor,
+                             EGL_CONTEXT_OPENGL_PROFILE_MASK,EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,EGL_NONE};
+  m_context=eglCreateContext(display,config,EGL_NO_CONTEXT,attributes);
+  if(m_context==EGL_NO_CONTEXT || !eglMakeCurrent(display,EGL_NO_SURFACE,EGL_NO_SURFACE,m_context))
+  {
+    std::cerr<<"unable to create a GL "<<_major<<"."<<_minor<<" core context, EGL error 0x"<<std::hex
+             <<eglGetError()<<std::dec<<'\n';
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,77 @@
+#include "HostBuffer.h"
+#include <iostream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define HOSTBUFFER_USE_MMAP
+#endif
+
+HostBuffer::~HostBuffer()
+{
+  release();
+}
+
+void HostBuffer::release()
+{
+#ifdef HOSTBUFFER_USE_MMAP
+  if (m_mapped)
+  {
+    munmap(m_data, m_size);
+  }
+#endif
+  m_copy.clear();
+  m_copy.shrink_to_fit();
+  m_data = nullptr;
+  m_size = 0;
+  m_mapped = false;
+  m_fileBacked = false;
+}
+
+bool HostBuffer::allocate(size_t _bytes, const std::string &_file)
+{
+  release();
+  if (_bytes == 0)
+  {
+    return true;
+  }
+#ifdef HOSTBUFFER_USE_MMAP
+  void *data = MAP_FAILED;
+  if (_file.empty())
+  {
+    data = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  else
+  {
+    int fd = ::open(_file.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(_bytes)) != 0)
+    {
+      std::cerr << "unable to create state file " << _file << '\n';
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+      return false;
+    }
+    data = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+  }
+  if (data == MAP_FAILED)
+  {
+    std::cerr << "unable to map " << _bytes << " bytes of particle state\n";
+    return false;
+  }
+  m_data = static_cast<unsigned char *>(data);
+  m_mapped = true;
+#else
+  if (!_file.empty())
+  {
+    std::cerr << "state files need mmap, keeping the particle state in memory\n";
+  }
+  m_copy.resize(_bytes);
+  m_data = m_copy.data();
+#endif
+  m_size = _bytes;
+  m_fileBacked = m_mapped && !_file.empty();
+  return true;
+}
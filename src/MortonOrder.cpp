@@ -0,0 +1,118 @@
+#include "MortonOrder.h"
+#include <algorithm>
+
+namespace
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bits per radix pass, four passes cover the 30 bit codes
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr uint32_t c_radixBits = 8;
+  constexpr size_t c_radix = size_t(1) << c_radixBits;
+  constexpr uint32_t c_keyBits = 30;
+} // end anon namespace
+
+uint32_t MortonOrder::expandBits(uint32_t _v)
+{
+  _v = (_v * 0x00010001u) & 0xFF0000FFu;
+  _v = (_v * 0x00000101u) & 0x0F00F00Fu;
+  _v = (_v * 0x00000011u) & 0xC30C30C3u;
+  _v = (_v * 0x00000005u) & 0x49249249u;
+  return _v;
+}
+
+uint32_t MortonOrder::mortonCode(float _x, float _y, float _z, float _extent)
+{
+  auto quantise = [_extent](float _p) {
+    float t = std::min(std::max((_p + _extent) / (2.0f * _extent), 0.0f), 1.0f);
+    return std::min(static_cast<uint32_t>(t * 1024.0f), 1023u);
+  };
+  return expandBits(quantise(_x)) | (expandBits(quantise(_y)) << 1) | (expandBits(quantise(_z)) << 2);
+}
+
+void MortonOrder::build(const float *_x, const float *_y, const float *_z, size_t _count, float _extent,
+                        ThreadPool &_pool)
+{
+  m_keys.resize(_count);
+  m_order.resize(_count);
+  m_sortedKeys.resize(_count);
+  m_sortedOrder.resize(_count);
+  size_t chunks = _pool.size() * 4;
+  m_grain = std::max<size_t>(16384, (_count + chunks - 1) / chunks);
+  const size_t numChunks = (_count + m_grain - 1) / m_grain;
+  m_histogram.resize(c_radix * numChunks);
+
+  _pool.parallelFor(_count, m_grain, [&](size_t _begin, size_t _end) {
+    for (size_t i = _begin; i < _end; ++i)
+    {
+      m_keys[i] = mortonCode(_x[i], _y[i], _z[i], _extent);
+      m_order[i] = static_cast<uint32_t>(i);
+    }
+  });
+
+  for (uint32_t shift = 0; shift < c_keyBits; shift += c_radixBits)
+  {
+    _pool.parallelFor(_count, m_grain, [&](size_t _begin, size_t _end) {
+      uint32_t counts[c_radix] = {};
+      for (size_t i = _begin; i < _end; ++i)
+      {
+        ++counts[(m_keys[i] >> shift) & (c_radix - 1)];
+      }
+      size_t chunk = _begin / m_grain;
+      for (size_t d = 0; d < c_radix; ++d)
+      {
+        m_histogram[d * numChunks + chunk] = counts[d];
+      }
+    });
+    // exclusive scan in digit then chunk order, so each chunk writes its digit d keys after those of every
+    // lower digit and of the earlier chunks. A pass where every key has the same digit would move nothing
+    uint32_t running = 0;
+    bool trivial = false;
+    for (size_t d = 0; d < c_radix; ++d)
+    {
+      uint32_t digitStart = running;
+      for (size_t c = 0; c < numChunks; ++c)
+      {
+        uint32_t count = m_histogram[d * numChunks + c];
+        m_histogram[d * numChunks + c] = running;
+        running += count;
+      }
+      trivial |= running - digitStart == _count;
+    }
+    if (trivial)
+    {
+      continue;
+    }
+    _pool.parallelFor(_count, m_grain, [&](size_t _begin, size_t _end) {
+      uint32_t offset[c_radix];
+      size_t chunk = _begin / m_grain;
+      for (size_t d = 0; d < c_radix; ++d)
+      {
+        offset[d] = m_histogram[d * numChunks + chunk];
+      }
+      for (size_t i = _begin; i < _end; ++i)
+      {
+        uint32_t dst = offset[(m_keys[i] >> shift) & (c_radix - 1)]++;
+        m_sortedKeys[dst] = m_keys[i];
+        m_sortedOrder[dst] = m_order[i];
+      }
+    });
+    m_keys.swap(m_sortedKeys);
+    m_order.swap(m_sortedOrder);
+  }
+}
+
+void MortonOrder::gather(const float *_src, float *o_dst, ThreadPool &_pool) const
+{
+  _pool.parallelFor(m_order.size(), m_grain, [&](size_t _begin, size_t _end) {
+    for (size_t k = _begin; k < _end; ++k)
+    {
+      o_dst[k] = _src[m_order[k]];
+    }
+  });
+}
+
+size_t MortonOrder::memoryFootprint() const
+{
+  return (m_keys.size() + m_order.size() + m_sortedKeys.size() + m_sortedOrder.size() + m_histogram.size()) *
+         sizeof(uint32_t);
+}
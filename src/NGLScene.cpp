@@ -1,17 +1,27 @@
 #include "NGLScene.h"
+#include "CheckpointReader.h"
+#include "CPUParticleSimulator.h"
+#include "GPUParticleSimulator.h"
+#include "ParticleFormat.h"
+#include "ParticleSystems.h"
+#include "Profiler.h"
+#include "ShaderVariantCache.h"
 #include <QGuiApplication>
 #include <QMouseEvent>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #include <ngl/NGLInit.h>
 #include <ngl/NGLStream.h>
 #include <ngl/Random.h>
-#include <ngl/Transformation.h>
+#include <ngl/VAOPrimitives.h>
 #include <ngl/ShaderLib.h>
+#include <ngl/Vec4.h>
 
-constexpr auto ComputeShader="ComputeShader";
-constexpr auto ParticleShader="ParticleShader";
 
-NGLScene::NGLScene()
+NGLScene::NGLScene(const SimulationConfig &_config) : m_config(_config)
 {
   setTitle( "Qt5 Simple NGL Demo" );
 }
@@ -20,6 +30,21 @@ NGLScene::NGLScene()
 NGLScene::~NGLScene()
 {
   std::cout << "Shutting down NGL, removing VAO's and Shaders\n";
+  // finishes its batch first, nothing else touches the simulator after this
+  m_simThread.reset();
+  // the GPU backend releases its buffers so needs the context
+  makeCurrent();
+  // writes out whatever is still queued
+  m_checkpoints.reset();
+  m_simulator.reset();
+  m_cpuPositions.reset();
+  m_cpuAttractors.reset();
+  m_culler.reset();
+  m_simulateTimer.release();
+  m_pointsTimer.release();
+  m_spheresTimer.release();
+  m_cullTimer.release();
+  doneCurrent();
 }
 
 
@@ -43,99 +68,306 @@ void NGLScene::initializeGL()
   glEnable( GL_DEPTH_TEST );
 
   glEnable( GL_MULTISAMPLE );
-  
-  // create the shader program
-  ngl::ShaderLib::createShaderProgram( ParticleShader );
-  // now we are going to create empty shaders for Frag and Vert
-  constexpr auto vertexShader  = "ComputeVertex";
-  constexpr auto fragShader    = "ComputeFragment";
-
-  ngl::ShaderLib::attachShader( vertexShader, ngl::ShaderType::VERTEX );
-  ngl::ShaderLib::attachShader( fragShader, ngl::ShaderType::FRAGMENT );
-  // attach the source
-  ngl::ShaderLib::loadShaderSource( vertexShader, "shaders/ParticlesVertex.glsl" );
-  ngl::ShaderLib::loadShaderSource( fragShader, "shaders/ParticlesFragment.glsl" );
-
-  // compile the shaders
-  ngl::ShaderLib::compileShader( vertexShader );
-  ngl::ShaderLib::compileShader( fragShader );
-  // add them to the program
-  ngl::ShaderLib::attachShaderToProgram( ParticleShader, vertexShader );
-  ngl::ShaderLib::attachShaderToProgram( ParticleShader, fragShader );
-  ngl::ShaderLib::linkProgramObject(ParticleShader);
-  ngl::ShaderLib::use(ParticleShader);
-
-
-  constexpr auto compute = "Compute";
-
-  ngl::ShaderLib::createShaderProgram( ComputeShader );
-  ngl::ShaderLib::attachShader( compute, ngl::ShaderType::COMPUTE );
-  ngl::ShaderLib::loadShaderSource( compute, "shaders/ParticlesCompute.glsl" );
-  ngl::ShaderLib::compileShader( compute );
-  ngl::ShaderLib::attachShaderToProgram( ComputeShader, compute );
-  ngl::ShaderLib::linkProgramObject(ComputeShader);
-  ngl::ShaderLib::use(ComputeShader);
-  createComputeBuffers();
+
+  // every program below (and the simulator's) is loaded from here when this driver has built it before
+  ShaderVariantCache::setBinaryCache(m_config.shaderCache);
+  // create the shader program, the vertex shader decodes the same buffer layout the simulation writes
+  if(!ShaderVariantCache::program({{ngl::ShaderType::VERTEX,"shaders/ParticlesVertex.glsl"},
+                                   {ngl::ShaderType::FRAGMENT,"shaders/ParticlesFragment.glsl"}},
+       GPUParticleSimulator::formatDefines(m_config.particleFormat,m_config.positionExtent),m_particleShader))
+  {
+    std::cerr<<"unable to build the particle shader, there is nothing to draw\n";
+    std::exit(EXIT_FAILURE);
+  }
+  ngl::ShaderLib::use(m_particleShader);
+  // the spheres are only a guide, without them the particles are still drawn
+  if(!ShaderVariantCache::program({{ngl::ShaderType::VERTEX,"shaders/AttractorVertex.glsl"},
+                                   {ngl::ShaderType::FRAGMENT,"shaders/AttractorFragment.glsl"}},{},m_attractorShader))
+  {
+    std::cerr<<"unable to build the attractor shader, the attractors won't be drawn\n";
+  }
+
+  createSimulator();
+  if(m_config.checkpointInterval!=0)
+  {
+    m_checkpoints=std::make_unique<CheckpointWriter>(m_config.checkpointDir,m_config.checkpointCompress);
+  }
   startTimer(10);
-  m_attractorUpdateTimer=startTimer(800);
+  // a deterministic run moves the attractors by step count instead, see simulate, and with paths the
+  // simulator moves them itself every step
+  if(!m_config.deterministic && !m_simulator->animatedAttractors())
+  {
+    m_attractorUpdateTimer=startTimer(800);
+  }
   m_elapsedTimer.start();
+  m_titleTimer.start();
+  m_reloadTimer.start();
   ngl::VAOPrimitives::createSphere("sphere",0.2f,10.0f);
-  ngl::ShaderLib::use("nglDiffuseShader");
-
-  ngl::ShaderLib::setUniform("Colour",1.0f,1.0f,1.0f,1.0f);
-  ngl::ShaderLib::setUniform("lightPos",0.0f,0.0f,1.0f);
-  ngl::ShaderLib::setUniform("lightDiffuse",1.0f,1.0f,1.0f,1.0f);
-  ngl::Mat3 normalMatrix;
-  ngl::ShaderLib::setUniform("normalMatrix",normalMatrix);
 
 
   m_view=ngl::lookAt(ngl::Vec3(25,25,25),ngl::Vec3::zero(),ngl::Vec3::up());
 
   m_projection=ngl::perspective(45.0f,float(width())/height(),0.5f,100.0f);
 
-
-
+  if(m_config.simThread)
+  {
+    m_cullMVP=m_projection*m_view;
+    m_simThread=std::make_unique<SimulationThread>(m_config,
+      [this](size_t _steps)
+      {
+        bool more=simulate(_steps);
+        collectSnapshot();
+        return more;
+      },
+      [this](SimulationThread::Frame &o_frame){ publishFrame(o_frame); });
+  }
 }
 
-void NGLScene::createComputeBuffers()
+void NGLScene::createSimulator()
 {
   glGenVertexArrays(1,&m_vao);
-  glBindVertexArray(m_vao);
-  std::vector<ngl::Vec4> pos(c_numParticles);
-  for(auto &p : pos)
+  // a systems table sets both counts, the backends load it again for the per system parameters
+  if(!m_config.particleSystems.empty())
   {
-    p.m_x=ngl::Random::randomNumber(40);
-    p.m_y=ngl::Random::randomNumber(40);
-    p.m_z=ngl::Random::randomNumber(40);
-    p.m_w=ngl::Random::randomPositiveNumber(1.0f)+0.1f;
+    ParticleSystems systems;
+    if(systems.load(m_config.particleSystems))
+    {
+      m_config.numParticles=systems.numParticles();
+      m_config.numAttractors=systems.numAttractors();
+    }
+  }
+  // a checkpoint brings its own particle count and seed, they have to be known before anything is allocated
+  CheckpointReader checkpoint;
+  bool restore=!m_config.loadCheckpoint.empty() && checkpoint.open(m_config.loadCheckpoint);
+  if(restore)
+  {
+    m_config.numParticles=static_cast<size_t>(checkpoint.header().numParticles);
+    m_config.seed=checkpoint.header().seed;
   }
 
-  glGenBuffers(1, &m_positionBufferID);
-  glBindBuffer(GL_ARRAY_BUFFER, m_positionBufferID);
-  glBufferData(GL_ARRAY_BUFFER, c_numParticles * sizeof(ngl::Vec4), &pos[0].m_x, GL_DYNAMIC_COPY);
-
-
-  std::vector<ngl::Vec3> vel(c_numParticles);
-  for(auto &v : vel)
+  if(m_config.backend==SimulatorBackend::CPU)
   {
-    v.m_x=0.001f+ngl::Random::randomNumber(0.5f);
-    v.m_y=0.001f+ngl::Random::randomNumber(0.5f);
-    v.m_z=0.001f+ngl::Random::randomNumber(0.5f);
+    m_simulator=std::make_unique<CPUParticleSimulator>(m_config);
+    m_cpuPositions=std::make_unique<StreamingBuffer>();
+    m_cpuPositions->allocate(m_config.numParticles * particleformat::positionStride(m_config.particleFormat));
+    m_cpuAttractors=std::make_unique<StreamingBuffer>();
+    m_cpuAttractors->allocate(std::max<size_t>(m_config.numAttractors,1) * sizeof(ngl::Vec4));
+    if(m_config.cull)
+    {
+      m_visible.resize(m_config.numParticles);
+    }
+  }
+  else
+  {
+    m_simulator=std::make_unique<GPUParticleSimulator>(m_config);
+    if(m_config.cull)
+    {
+      m_culler=std::make_unique<GPUParticleCuller>(m_config);
+    }
+  }
+  std::cout<<"Using "<<m_simulator->name()<<" simulation backend\n";
+  if(restore && m_simulator->restore(checkpoint))
+  {
+    m_stepCount=checkpoint.header().stepIndex;
+    std::cout<<"Restored "<<m_config.loadCheckpoint<<" at step "<<m_stepCount<<'\n';
+  }
+  else
+  {
+    if(restore)
+    {
+      std::cerr<<"unable to restore "<<m_config.loadCheckpoint<<", starting from the seed\n";
+      restore=false;
+    }
+    m_simulator->initialize(m_config.numParticles,m_config.seed);
   }
-  glGenBuffers(1, &m_velocityBufferID);
-  glBindBuffer(GL_ARRAY_BUFFER, m_velocityBufferID);
-  glBufferData(GL_ARRAY_BUFFER, vel.size() * sizeof(ngl::Vec3), &vel[0].m_x, GL_DYNAMIC_COPY);
 
-  m_attractors.resize(c_numAttractors);
+  // the attractors come from ngl::Random, seed it so a deterministic run starts from the same attractors
+  if(m_config.deterministic)
+  {
+    ngl::Random::setSeed(m_config.seed);
+  }
+  m_attractors.resize(m_config.numAttractors);
   for(auto &a : m_attractors)
   {
     a=ngl::Random::getRandomPoint(20,20,20);
   }
-  glGenBuffers(1, &m_attractorBufferID);
-  glBindBuffer(GL_ARRAY_BUFFER, m_attractorBufferID);
-  glBufferData(GL_ARRAY_BUFFER, m_attractors.size() * sizeof(ngl::Vec3), &m_attractors[0].m_x, GL_DYNAMIC_COPY);
+  uploadAttractors();
+  // emitters come from the same distribution with a spawn radius of 2, they never move
+  if(m_config.numEmitters!=0)
+  {
+    std::vector<ngl::Vec4> emitters(m_config.numEmitters);
+    for(auto &e : emitters)
+    {
+      ngl::Vec3 p=ngl::Random::getRandomPoint(20,20,20);
+      e.set(p.m_x,p.m_y,p.m_z,2.0f);
+    }
+    m_simulator->setEmitters(&emitters[0].m_x,emitters.size());
+  }
+  if(restore)
+  {
+    if(m_config.deterministic && !m_simulator->animatedAttractors())
+    {
+      // replay the moves so the attractors and the random stream are exactly where the saved run had them
+      for(size_t i=0; i<m_stepCount/c_attractorSteps; ++i)
+      {
+        updateAttractors();
+      }
+    }
+    else if(checkpoint.header().numAttractors==m_attractors.size())
+    {
+      std::vector<float> xyz=checkpoint.attractors();
+      for(size_t i=0; i<m_attractors.size(); ++i)
+      {
+        m_attractors[i].set(xyz[i*3],xyz[i*3+1],xyz[i*3+2]);
+      }
+      uploadAttractors();
+    }
+  }
+}
+
+void NGLScene::collectSnapshot()
+{
+  checkpoint::Frame frame;
+  if(!m_checkpoints || !m_simulator->pollSnapshot(frame))
+  {
+    return;
+  }
+  // animated attractors are recomputed from the step on load, the host copy only has to have the right count
+  frame.attractors.resize(m_attractors.size()*3);
+  for(size_t i=0; i<m_attractors.size(); ++i)
+  {
+    frame.attractors[i*3+0]=m_attractors[i].m_x;
+    frame.attractors[i*3+1]=m_attractors[i].m_y;
+    frame.attractors[i*3+2]=m_attractors[i].m_z;
+  }
+  uint32_t step=frame.stepIndex;
+  if(!m_checkpoints->submit(std::move(frame)))
+  {
+    std::cerr<<"checkpoint writer is behind, dropped step "<<step<<'\n';
+  }
+}
+
+void NGLScene::uploadAttractors()
+{
+  m_simulator->setAttractors(&m_attractors[0].m_x,m_attractors.size());
+  // on the simulation thread there is no context, the spheres are drawn from the published frame instead
+  if(m_cpuAttractors && !m_config.simThread)
+  {
+    // std430 pads vec3 array elements to 16 bytes
+    auto dst=static_cast<ngl::Vec4 *>(m_cpuAttractors->beginWrite());
+    for(size_t i=0; i<m_attractors.size(); ++i)
+    {
+      dst[i].set(m_attractors[i].m_x,m_attractors[i].m_y,m_attractors[i].m_z,0.0f);
+    }
+    m_cpuAttractors->endWrite(m_attractors.size()*sizeof(ngl::Vec4));
+  }
+}
+
+void NGLScene::drawAttractors(const ngl::Mat4 &_mvp)
+{
+  if(m_attractors.empty() || m_attractorShader.empty())
+  {
+    return;
+  }
+  ngl::ShaderLib::use(m_attractorShader);
+  ngl::ShaderLib::setUniform("MVP",_mvp);
+  bool gpu=m_config.backend==SimulatorBackend::GPU;
+  if(gpu)
+  {
+    static_cast<GPUParticleSimulator *>(m_simulator.get())->bindAttractors(2);
+  }
+  else
+  {
+    if(m_simThread)
+    {
+      // the spheres follow the frame the points came from
+      const std::vector<float> &xyzw=m_simThread->front().attractors;
+      std::memcpy(m_cpuAttractors->beginWrite(),xyzw.data(),xyzw.size()*sizeof(float));
+      m_cpuAttractors->endWrite(xyzw.size()*sizeof(float));
+    }
+    // animated attractors move every step, the spheres follow the simulator's copy
+    else if(m_simulator->animatedAttractors())
+    {
+      auto cpu=static_cast<CPUParticleSimulator *>(m_simulator.get());
+      cpu->writeAttractors(static_cast<float *>(m_cpuAttractors->beginWrite()));
+      m_cpuAttractors->endWrite(cpu->numAttractors()*sizeof(ngl::Vec4));
+    }
+    m_cpuAttractors->bindRange(GL_SHADER_STORAGE_BUFFER,2);
+  }
+  auto vao=ngl::VAOPrimitives::getVAOFromName("sphere");
+  vao->bind();
+  glDrawArraysInstanced(vao->getMode(),0,static_cast<GLsizei>(vao->numIndices()),
+                        static_cast<GLsizei>(m_attractors.size()));
+  vao->unbind();
+  // the ring slot must not be rewritten until the draw has read it
+  if(gpu)
+  {
+    static_cast<GPUParticleSimulator *>(m_simulator.get())->fenceAttractors();
+  }
+  else
+  {
+    m_cpuAttractors->fence();
+  }
+}
 
-  glBindVertexArray(0);
+size_t NGLScene::bindParticlePositions(const ngl::Mat4 &_mvp)
+{
+  // compact positions are two packed words, they must reach the shader as integers
+  bool compact=m_config.particleFormat==ParticleFormat::Compact;
+  auto attribPointer=[compact](size_t _offset)
+  {
+    if(compact)
+    {
+      glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, 0, reinterpret_cast<void *>(_offset));
+    }
+    else
+    {
+      glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(_offset));
+    }
+  };
+  if(m_config.backend==SimulatorBackend::GPU)
+  {
+    // a streaming simulator only keeps its first chunk in the position buffer
+    auto gpu=static_cast<GPUParticleSimulator *>(m_simulator.get());
+    glBindBuffer(GL_ARRAY_BUFFER, gpu->positionBuffer());
+    attribPointer(0);
+    return gpu->residentCount();
+  }
+  if(m_simThread)
+  {
+    // the newest frame the simulation thread has finished, already culled and in the draw format
+    const SimulationThread::Frame &frame=m_simThread->acquire();
+    size_t bytes=frame.count * particleformat::positionStride(m_config.particleFormat);
+    std::memcpy(m_cpuPositions->beginWrite(),frame.positions.data(),bytes);
+    m_cpuPositions->endWrite(bytes);
+    glBindBuffer(GL_ARRAY_BUFFER, m_cpuPositions->id());
+    attribPointer(m_cpuPositions->currentOffset());
+    return frame.count;
+  }
+  // with culling only the visible particles are uploaded, in index order
+  auto cpu=static_cast<CPUParticleSimulator *>(m_simulator.get());
+  const uint32_t *indices=nullptr;
+  size_t count=m_config.numParticles;
+  if(!m_visible.empty())
+  {
+    count=cpu->cullVisible(&_mvp.m_m[0][0],m_config.lodDistance,m_visible.data());
+    indices=m_visible.data();
+  }
+  // write straight into the next persistently mapped slot, no copy through the driver
+  size_t bytes=count * particleformat::positionStride(m_config.particleFormat);
+  if(compact)
+  {
+    cpu->writePackedPositions(static_cast<uint32_t *>(m_cpuPositions->beginWrite()),m_config.positionExtent,
+                              indices,count);
+  }
+  else
+  {
+    cpu->writeInterleavedPositions(static_cast<float *>(m_cpuPositions->beginWrite()),indices,count);
+  }
+  m_cpuPositions->endWrite(bytes);
+  glBindBuffer(GL_ARRAY_BUFFER, m_cpuPositions->id());
+  attribPointer(m_cpuPositions->currentOffset());
+  return count;
 }
 
 
@@ -147,6 +379,12 @@ void NGLScene::loadMatricesToShader()
 
 void NGLScene::paintGL()
 {
+  // before anything is drawn so a frame never mixes old and new programs
+  if(m_config.hotReload && m_reloadTimer.elapsed()>500)
+  {
+    ShaderVariantCache::reloadChanged();
+    m_reloadTimer.restart();
+  }
   glViewport( 0, 0, m_win.width, m_win.height );
   // clear the screen and depth buffer
   glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
@@ -171,37 +409,89 @@ void NGLScene::paintGL()
   glDisable(GL_CULL_FACE);
 
   glBindVertexArray(m_vao);
-  ngl::ShaderLib::use(ComputeShader);
-  m_dt=m_elapsedTimer.elapsed()/60.0f;
-  m_elapsedTimer.restart();
-  ngl::ShaderLib::setUniform("dt",m_dt);
-  std::cout<<m_dt<<'\n';
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_positionBufferID);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_velocityBufferID);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_attractorBufferID);
-
-  glDispatchCompute(c_numParticles / 128, 1, 1);
-  glMemoryBarrier(GL_ALL_BARRIER_BITS);
-
-
-  ngl::ShaderLib::use(ParticleShader);
   ngl::Mat4 MVP= m_projection * m_view * m_mouseGlobalTX;
+  if(m_simThread)
+  {
+    // the simulation thread keeps its own clock, this frame just draws the newest state it has published
+    if(m_simThread->finished())
+    {
+      QGuiApplication::exit(EXIT_SUCCESS);
+    }
+    std::lock_guard<std::mutex> lock(m_cullMutex);
+    m_cullMVP=MVP;
+  }
+  // fixed steps of stepMs, the wall clock time since the last frame is banked and spent a step at a time so the
+  // motion no longer depends on the frame rate. A deterministic run ignores the clock and does one step a frame.
+  size_t steps=m_simThread ? 0 : 1;
+  if(!m_config.deterministic && !m_simThread)
+  {
+    m_accumulator+=m_elapsedTimer.nsecsElapsed()*1e-6;
+    m_elapsedTimer.restart();
+    steps=std::min(static_cast<size_t>(m_accumulator/m_config.stepMs),m_config.maxSubsteps);
+    m_accumulator-=steps*m_config.stepMs;
+    // after a hitch drop whatever maxSubsteps couldn't cover rather than trying to catch up next frame
+    m_accumulator=std::fmod(m_accumulator,static_cast<double>(m_config.stepMs));
+  }
+  if(steps!=0)
+  {
+    PROFILE_SCOPE("simulate");
+    GPUScope gpu(m_simulateTimer);
+    if(!simulate(steps))
+    {
+      QGuiApplication::exit(EXIT_SUCCESS);
+    }
+  }
+  // picks up the snapshot of an earlier frame once its copy has finished
+  if(!m_simThread)
+  {
+    collectSnapshot();
+  }
+
+  if(m_culler)
+  {
+    PROFILE_SCOPE("cull");
+    GPUScope gpu(m_cullTimer);
+    auto sim=static_cast<GPUParticleSimulator *>(m_simulator.get());
+    m_culler->cull(sim->positionBuffer(),sim->residentCount(),MVP);
+  }
+  ngl::ShaderLib::use(m_particleShader);
   ngl::ShaderLib::setUniform("MVP",MVP);
 
-  glBindBuffer (GL_ARRAY_BUFFER, m_positionBufferID);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE,0, 0);
-  glDrawArrays(GL_POINTS, 0, c_numParticles);
+  {
+    PROFILE_SCOPE("draw points");
+    size_t count=bindParticlePositions(MVP);
+    GPUScope gpu(m_pointsTimer);
+    glEnableVertexAttribArray(0);
+    if(m_culler)
+    {
+      m_culler->draw();
+    }
+    else
+    {
+      glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    }
+  }
+  if(m_cpuPositions)
+  {
+    m_cpuPositions->fence();
+  }
 
   glEnable(GL_CULL_FACE);
-  ngl::ShaderLib::use("nglDiffuseShader");
-  ngl::Transformation tx;
-  for(auto p : m_attractors)
   {
-    tx.setPosition(p);
-    MVP= m_projection * m_view * m_mouseGlobalTX  * tx.getMatrix();
-    ngl::ShaderLib::setUniform("MVP",MVP);
-    ngl::VAOPrimitives::draw("sphere");
+    PROFILE_SCOPE("draw attractors");
+    GPUScope gpu(m_spheresTimer);
+    drawAttractors(MVP);
+  }
+  if(Profiler::enabled() && m_titleTimer.elapsed()>1000)
+  {
+    // the summary is built on the profiler thread, this is just a copy
+    std::string title=Profiler::summary();
+    if(m_simThread)
+    {
+      title="simulation "+std::to_string(static_cast<int>(m_simThread->stepsPerSecond()))+" steps/s "+title;
+    }
+    setTitle(QString::fromStdString(title));
+    m_titleTimer.restart();
   }
 
 
@@ -209,32 +499,126 @@ void NGLScene::paintGL()
 }
 
 
-void NGLScene::timerEvent(QTimerEvent *_event)
+bool NGLScene::simulate(size_t _steps)
 {
- if(_event->timerId()== m_attractorUpdateTimer)
+  const float dt=m_config.stepMs/60.0f;
+  // attractors on paths are moved inside every step, only host driven ones split the batches
+  const bool moveAttractors=m_config.deterministic && !m_simulator->animatedAttractors();
+  while(_steps!=0)
   {
+    // split the batch wherever the attractors move or the run has to stop
+    size_t batch=_steps;
+    if(moveAttractors)
+    {
+      batch=std::min(batch,c_attractorSteps-m_stepCount%c_attractorSteps);
+    }
+    if(m_config.stopAfter!=0)
+    {
+      batch=std::min(batch,m_config.stopAfter-m_stepCount);
+    }
+    const size_t checkpointEvery=m_config.checkpointInterval;
+    if(checkpointEvery!=0)
+    {
+      batch=std::min(batch,checkpointEvery-m_stepCount%checkpointEvery);
+    }
+    m_simulator->advance(dt,batch);
+    m_stepCount+=batch;
+    _steps-=batch;
+    // before the attractors move so the snapshot matches the attractors saved with it
+    if(checkpointEvery!=0 && m_stepCount%checkpointEvery==0 && !m_simulator->requestSnapshot())
+    {
+      std::cerr<<"previous snapshot still in flight, skipped step "<<m_stepCount<<'\n';
+    }
+    if(moveAttractors && m_stepCount%c_attractorSteps==0)
+    {
+      updateAttractors();
+    }
+    if(m_config.stopAfter!=0 && m_stepCount>=m_config.stopAfter)
+    {
+      // the last snapshot would otherwise be lost with the window
+      if(m_checkpoints)
+      {
+        m_simulator->finish();
+        collectSnapshot();
+      }
+      std::cout<<"position checksum after "<<m_stepCount<<" steps "<<std::hex<<m_simulator->positionChecksum()
+               <<std::dec<<'\n';
+      return false;
+    }
+  }
+  return true;
+}
 
-    static float d=0.0f;
-
-    for(auto &a : m_attractors)
+void NGLScene::publishFrame(SimulationThread::Frame &o_frame)
+{
+  auto cpu=static_cast<CPUParticleSimulator *>(m_simulator.get());
+  const uint32_t *indices=nullptr;
+  size_t count=cpu->numParticles();
+  if(!m_visible.empty())
+  {
+    ngl::Mat4 mvp;
     {
-      //a=ngl::Random::getRandomPoint(10,10,10);
+      std::lock_guard<std::mutex> lock(m_cullMutex);
+      mvp=m_cullMVP;
+    }
+    count=cpu->cullVisible(&mvp.m_m[0][0],m_config.lodDistance,m_visible.data());
+    indices=m_visible.data();
+  }
+  o_frame.positions.resize(cpu->numParticles() * particleformat::positionStride(m_config.particleFormat));
+  if(m_config.particleFormat==ParticleFormat::Compact)
+  {
+    cpu->writePackedPositions(reinterpret_cast<uint32_t *>(o_frame.positions.data()),m_config.positionExtent,
+                              indices,count);
+  }
+  else
+  {
+    cpu->writeInterleavedPositions(reinterpret_cast<float *>(o_frame.positions.data()),indices,count);
+  }
+  o_frame.count=count;
+  o_frame.attractors.resize(cpu->numAttractors()*4);
+  cpu->writeAttractors(o_frame.attractors.data());
+}
+
+void NGLScene::onSimulator(std::function<void()> _command)
+{
+  if(m_simThread)
+  {
+    m_simThread->post(std::move(_command));
+  }
+  else
+  {
+    makeCurrent();
+    _command();
+  }
+}
+
+void NGLScene::updateAttractors()
+{
+  for(auto &a : m_attractors)
+  {
+    //a=ngl::Random::getRandomPoint(10,10,10);
 //      float dt=m_elapsedTimer.elapsed()/60.0f;
 //      a.m_x=sinf(dt)*ngl::Random::randomPositiveNumber(60);
 //      a.m_y=cosf(dt)*ngl::Random::randomNumber(20);
 //      a.m_z=tanf(dt);
-      a.m_x = sinf(ngl::radians(d)) * ngl::Random::randomPositiveNumber(20);
-      a.m_y = cosf(ngl::radians(d)) * ngl::Random::randomPositiveNumber(20);
-      a.m_z = tanf(ngl::radians(d));
+    a.m_x = sinf(ngl::radians(m_attractorPhase)) * ngl::Random::randomPositiveNumber(20);
+    a.m_y = cosf(ngl::radians(m_attractorPhase)) * ngl::Random::randomPositiveNumber(20);
+    a.m_z = tanf(ngl::radians(m_attractorPhase));
 
 
-      //a.m_z=sinf(dt)*ngl::Random::randomPositiveNumber(10); //0.0f;//tanf(0.5f);
-      std::cout<<a<<'\n';
-    }
-    d+=1.0f;
-    glGenBuffers(1, &m_attractorBufferID);
-    glBindBuffer(GL_ARRAY_BUFFER, m_attractorBufferID);
-    glBufferData(GL_ARRAY_BUFFER, m_attractors.size() * sizeof(ngl::Vec3), &m_attractors[0].m_x, GL_DYNAMIC_COPY);
+    //a.m_z=sinf(dt)*ngl::Random::randomPositiveNumber(10); //0.0f;//tanf(0.5f);
+  }
+  m_attractorPhase+=1.0f;
+  PROFILE_SCOPE("set attractors");
+  uploadAttractors();
+}
+
+
+void NGLScene::timerEvent(QTimerEvent *_event)
+{
+ if(!m_config.deterministic && _event->timerId()== m_attractorUpdateTimer)
+  {
+    onSimulator([this]{ updateAttractors(); });
   }
   update();
 }
@@ -278,6 +662,23 @@ void NGLScene::keyPressEvent( QKeyEvent* _event )
      // m_dt=0.5f;
     break;
 
+    // a burst of a tenth of the pool from the emitters on the next step
+    case Qt::Key_E :
+      onSimulator([this]{ m_simulator->emitBurst(m_config.numParticles/10); });
+    break;
+
+    // save the state after the current step, collected by paintGL once the copy is done
+    case Qt::Key_C :
+      onSimulator([this]
+      {
+        if(!m_checkpoints)
+        {
+          m_checkpoints=std::make_unique<CheckpointWriter>(m_config.checkpointDir,m_config.checkpointCompress);
+        }
+        m_simulator->requestSnapshot();
+      });
+    break;
+
     case Qt::Key_Up :
       //m_dt+=0.01f;
     break;
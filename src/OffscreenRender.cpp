@@ -0,0 +1,422 @@
+//----------------------------------------------------------------------------------------------------------------------
+/// @file OffscreenRender.cpp
+/// @brief renders the scene into a framebuffer object with no window or display server and writes every frame out
+/// as a PNG / EXR sequence or a raw stream, e.g. for render nodes or software GL. The simulation runs a fixed number
+/// of steps per frame so a sequence is the same however long each frame takes to render and encode.
+//----------------------------------------------------------------------------------------------------------------------
+#include "CPUParticleSimulator.h"
+#include "FrameCapture.h"
+#include "FrameEncoder.h"
+#include "GPUParticleSimulator.h"
+#include "HeadlessContext.h"
+#include "OffscreenTarget.h"
+#include "ParticleFormat.h"
+#include "ParticleSystems.h"
+#include "Profiler.h"
+#include "ShaderVariantCache.h"
+#include "SimulationConfig.h"
+#include "StreamingBuffer.h"
+#include <ngl/NGLInit.h>
+#include <ngl/Random.h>
+#include <ngl/ShaderLib.h>
+#include <ngl/Util.h>
+#include <ngl/VAOPrimitives.h>
+#include <ngl/Vec4.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct RenderOptions
+  {
+    size_t frames = 300;
+    size_t width = 1280;
+    size_t height = 720;
+    size_t stepsPerFrame = 1;
+    // the window asks for 4 samples in main.cpp
+    size_t samples = 4;
+    size_t pboRing = 3;
+    // 0 = one per hardware thread
+    size_t encoders = 0;
+    CaptureFormat format = CaptureFormat::PNG;
+    std::string output;
+  };
+
+  // the GUI moves the attractors every 80 steps in a deterministic run
+  constexpr size_t c_attractorSteps = 80;
+
+  void printUsage(const char *_program)
+  {
+    SimulationConfig::printUsage(_program);
+    std::cout << "offscreen render options\n"
+              << "  --frames N          frames to render (default 300)\n"
+              << "  --size WxH          frame size in pixels (default 1280x720)\n"
+              << "  --steps-per-frame N fixed simulation steps between two frames (default 1)\n"
+              << "  --samples N         multisample the frame, 0 or 1 = off (default 4)\n"
+              << "  --pbo-ring N        pixel buffers the read back rotates through (default 3)\n"
+              << "  --encoders N        encoder threads, 0 = all cores, raw always uses one (default 0)\n"
+              << "  --capture-format F  png (8 bit, needs zlib), exr (half float) or raw RGBA8 (default png)\n"
+              << "  --capture-out PATH  png / exr : directory for the sequence (default frames)\n"
+              << "                      raw : a file, - for stdout or |command to pipe into (default -)\n";
+  }
+
+  bool parseOptions(int _argc, char **_argv, RenderOptions &o_options)
+  {
+    for (int i = 1; i < _argc; ++i)
+    {
+      const char *arg = _argv[i];
+      const char *next = i + 1 < _argc ? _argv[i + 1] : nullptr;
+      auto is = [&](const char *_name) { return std::strcmp(arg, _name) == 0; };
+      if (is("--help") || is("-h"))
+      {
+        printUsage(_argv[0]);
+        return false;
+      }
+      if (next == nullptr)
+      {
+        continue;
+      }
+      if (is("--frames"))
+      {
+        o_options.frames = std::max<size_t>(1, std::strtoul(next, nullptr, 10));
+      }
+      else if (is("--size"))
+      {
+        char *end = nullptr;
+        o_options.width = std::strtoul(next, &end, 10);
+        o_options.height = *end == 'x' ? std::strtoul(end + 1, nullptr, 10) : 0;
+        if (o_options.width == 0 || o_options.height == 0)
+        {
+          std::cerr << "--size expects WxH, e.g. 1920x1080\n";
+          return false;
+        }
+      }
+      else if (is("--steps-per-frame"))
+      {
+        o_options.stepsPerFrame = std::strtoul(next, nullptr, 10);
+      }
+      else if (is("--samples"))
+      {
+        o_options.samples = std::strtoul(next, nullptr, 10);
+      }
+      else if (is("--pbo-ring"))
+      {
+        o_options.pboRing = std::max<size_t>(1, std::strtoul(next, nullptr, 10));
+      }
+      else if (is("--encoders"))
+      {
+        o_options.encoders = std::strtoul(next, nullptr, 10);
+      }
+      else if (is("--capture-format"))
+      {
+        if (std::strcmp(next, "png") == 0)
+        {
+          o_options.format = CaptureFormat::PNG;
+        }
+        else if (std::strcmp(next, "exr") == 0)
+        {
+          o_options.format = CaptureFormat::EXR;
+        }
+        else if (std::strcmp(next, "raw") == 0)
+        {
+          o_options.format = CaptureFormat::Raw;
+        }
+        else
+        {
+          std::cerr << "unknown capture format " << next << " expected png, exr or raw\n";
+          return false;
+        }
+      }
+      else if (is("--capture-out"))
+      {
+        o_options.output = next;
+      }
+      else
+      {
+        continue;
+      }
+      ++i;
+    }
+    if (o_options.output.empty())
+    {
+      o_options.output = o_options.format == CaptureFormat::Raw ? "-" : "frames";
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the same move as NGLScene::updateAttractors so a deterministic sequence matches the window
+  //----------------------------------------------------------------------------------------------------------------------
+  void moveAttractors(std::vector<ngl::Vec3> &io_attractors, float &io_phase)
+  {
+    for (auto &a : io_attractors)
+    {
+      a.m_x = sinf(ngl::radians(io_phase)) * ngl::Random::randomPositiveNumber(20);
+      a.m_y = cosf(ngl::radians(io_phase)) * ngl::Random::randomPositiveNumber(20);
+      a.m_z = tanf(ngl::radians(io_phase));
+    }
+    io_phase += 1.0f;
+  }
+} // end anon namespace
+
+int main(int argc, char **argv)
+{
+  SimulationConfig config;
+  RenderOptions options;
+  if (!parseOptions(argc, argv, options) || !config.parse(argc, argv))
+  {
+    return EXIT_FAILURE;
+  }
+  // the whole pool is drawn every frame, culling only pays off when the camera moves
+  config.cull = false;
+  if (config.simThread || !config.loadCheckpoint.empty())
+  {
+    // the steps already run back to back with the draw, and a sequence always starts from the seed
+    std::cerr << "offscreen rendering ignores --sim-thread and --load\n";
+    config.simThread = false;
+    config.loadCheckpoint.clear();
+  }
+  if (!config.particleSystems.empty())
+  {
+    ParticleSystems systems;
+    if (!systems.load(config.particleSystems))
+    {
+      return EXIT_FAILURE;
+    }
+    config.numParticles = systems.numParticles();
+    config.numAttractors = systems.numAttractors();
+  }
+  // stdout may be the raw stream so the summary goes to stderr
+  if (!config.traceFile.empty())
+  {
+    Profiler::start(config.traceFile, false);
+  }
+
+  HeadlessContext context;
+  if (!context.create())
+  {
+    return EXIT_FAILURE;
+  }
+  ngl::NGLInit::initialize();
+  std::cerr << "rendering with " << glGetString(GL_RENDERER) << '\n';
+  OffscreenTarget target;
+  if (!target.allocate(options.width, options.height, options.samples, FrameCapture::colourFormat(options.format)))
+  {
+    return EXIT_FAILURE;
+  }
+  FrameEncoder encoder(options.format, options.width, options.height, options.output, options.encoders);
+  if (!encoder.valid())
+  {
+    return EXIT_FAILURE;
+  }
+
+  // the same programs and state as NGLScene::initializeGL
+  ShaderVariantCache::setBinaryCache(config.shaderCache);
+  std::string particleShader;
+  std::string attractorShader;
+  if (!ShaderVariantCache::program({{ngl::ShaderType::VERTEX, "shaders/ParticlesVertex.glsl"},
+                                    {ngl::ShaderType::FRAGMENT, "shaders/ParticlesFragment.glsl"}},
+                                   GPUParticleSimulator::formatDefines(config.particleFormat, config.positionExtent),
+                                   particleShader) ||
+      !ShaderVariantCache::program({{ngl::ShaderType::VERTEX, "shaders/AttractorVertex.glsl"},
+                                    {ngl::ShaderType::FRAGMENT, "shaders/AttractorFragment.glsl"}},
+                                   {}, attractorShader))
+  {
+    // a sequence missing the particles or the spheres is no use, unlike the window there is nobody to notice
+    std::cerr << "unable to build the draw shaders\n";
+    return EXIT_FAILURE;
+  }
+  ngl::VAOPrimitives::createSphere("sphere", 0.2f, 10.0f);
+  GLuint vao = 0;
+  glGenVertexArrays(1, &vao);
+
+  std::unique_ptr<ParticleSimulator> sim;
+  std::unique_ptr<StreamingBuffer> cpuPositions;
+  std::unique_ptr<StreamingBuffer> cpuAttractors;
+  const size_t stride = particleformat::positionStride(config.particleFormat);
+  if (config.backend == SimulatorBackend::CPU)
+  {
+    sim = std::make_unique<CPUParticleSimulator>(config);
+    cpuPositions = std::make_unique<StreamingBuffer>();
+    cpuPositions->allocate(config.numParticles * stride);
+    cpuAttractors = std::make_unique<StreamingBuffer>();
+    cpuAttractors->allocate(std::max<size_t>(config.numAttractors, 1) * sizeof(ngl::Vec4));
+  }
+  else
+  {
+    sim = std::make_unique<GPUParticleSimulator>(config);
+  }
+  std::cerr << "Using " << sim->name() << " simulation backend\n";
+  sim->initialize(config.numParticles, config.seed);
+  if (config.deterministic)
+  {
+    ngl::Random::setSeed(config.seed);
+  }
+  std::vector<ngl::Vec3> attractors(config.numAttractors);
+  for (auto &a : attractors)
+  {
+    a = ngl::Random::getRandomPoint(20, 20, 20);
+  }
+  if (!attractors.empty())
+  {
+    sim->setAttractors(&attractors[0].m_x, attractors.size());
+  }
+  if (config.numEmitters != 0)
+  {
+    std::vector<ngl::Vec4> emitters(config.numEmitters);
+    for (auto &e : emitters)
+    {
+      ngl::Vec3 p = ngl::Random::getRandomPoint(20, 20, 20);
+      e.set(p.m_x, p.m_y, p.m_z, 2.0f);
+    }
+    sim->setEmitters(&emitters[0].m_x, emitters.size());
+  }
+  ngl::Mat4 view = ngl::lookAt(ngl::Vec3(25, 25, 25), ngl::Vec3::zero(), ngl::Vec3::up());
+  ngl::Mat4 projection = ngl::perspective(45.0f, float(options.width) / options.height, 0.5f, 100.0f);
+  const ngl::Mat4 MVP = projection * view;
+  const bool compact = config.particleFormat == ParticleFormat::Compact;
+  const float dt = config.stepMs / 60.0f;
+  const bool animated = sim->animatedAttractors();
+  size_t stepCount = 0;
+  float attractorPhase = 0.0f;
+
+  FrameCapture capture(encoder, options.format, options.width, options.height, options.pboRing);
+  if (!capture.valid())
+  {
+    return EXIT_FAILURE;
+  }
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_MULTISAMPLE);
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  for (size_t frame = 0; frame < options.frames; ++frame)
+  {
+    {
+      PROFILE_SCOPE("simulate");
+      // split wherever the attractors move, as NGLScene::simulate does in a deterministic run
+      for (size_t steps = options.stepsPerFrame; steps != 0;)
+      {
+        size_t batch = animated ? steps : std::min(steps, c_attractorSteps - stepCount % c_attractorSteps);
+        sim->advance(dt, batch);
+        stepCount += batch;
+        steps -= batch;
+        if (!animated && stepCount % c_attractorSteps == 0 && !attractors.empty())
+        {
+          moveAttractors(attractors, attractorPhase);
+          sim->setAttractors(&attractors[0].m_x, attractors.size());
+        }
+      }
+    }
+    target.bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDisable(GL_CULL_FACE);
+    glBindVertexArray(vao);
+    ngl::ShaderLib::use(particleShader);
+    ngl::ShaderLib::setUniform("MVP", MVP);
+    {
+      PROFILE_SCOPE("draw points");
+      size_t count = 0;
+      size_t offset = 0;
+      if (cpuPositions)
+      {
+        auto cpu = static_cast<CPUParticleSimulator *>(sim.get());
+        count = cpu->numParticles();
+        if (compact)
+        {
+          cpu->writePackedPositions(static_cast<uint32_t *>(cpuPositions->beginWrite()), config.positionExtent,
+                                    nullptr, count);
+        }
+        else
+        {
+          cpu->writeInterleavedPositions(static_cast<float *>(cpuPositions->beginWrite()), nullptr, count);
+        }
+        cpuPositions->endWrite(count * stride);
+        glBindBuffer(GL_ARRAY_BUFFER, cpuPositions->id());
+        offset = cpuPositions->currentOffset();
+      }
+      else
+      {
+        auto gpu = static_cast<GPUParticleSimulator *>(sim.get());
+        glBindBuffer(GL_ARRAY_BUFFER, gpu->positionBuffer());
+        count = gpu->residentCount();
+      }
+      if (compact)
+      {
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, 0, reinterpret_cast<void *>(offset));
+      }
+      else
+      {
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(offset));
+      }
+      glEnableVertexAttribArray(0);
+      glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+      if (cpuPositions)
+      {
+        cpuPositions->fence();
+      }
+    }
+    if (!attractors.empty())
+    {
+      PROFILE_SCOPE("draw attractors");
+      glEnable(GL_CULL_FACE);
+      ngl::ShaderLib::use(attractorShader);
+      ngl::ShaderLib::setUniform("MVP", MVP);
+      if (cpuAttractors)
+      {
+        // the simulator's copy, animated attractors move every step
+        auto cpu = static_cast<CPUParticleSimulator *>(sim.get());
+        cpu->writeAttractors(static_cast<float *>(cpuAttractors->beginWrite()));
+        cpuAttractors->endWrite(cpu->numAttractors() * sizeof(ngl::Vec4));
+        cpuAttractors->bindRange(GL_SHADER_STORAGE_BUFFER, 2);
+      }
+      else
+      {
+        static_cast<GPUParticleSimulator *>(sim.get())->bindAttractors(2);
+      }
+      auto sphere = ngl::VAOPrimitives::getVAOFromName("sphere");
+      sphere->bind();
+      glDrawArraysInstanced(sphere->getMode(), 0, static_cast<GLsizei>(sphere->numIndices()),
+                            static_cast<GLsizei>(attractors.size()));
+      sphere->unbind();
+      if (cpuAttractors)
+      {
+        cpuAttractors->fence();
+      }
+      else
+      {
+        static_cast<GPUParticleSimulator *>(sim.get())->fenceAttractors();
+      }
+    }
+    // queue the read back and hand over whatever earlier frames have arrived, nothing here waits for the GPU
+    target.resolve();
+    capture.capture(frame);
+    capture.collect(false);
+  }
+  capture.finish();
+  encoder.flush();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  Profiler::stop();
+  std::cerr << options.frames << " " << toString(options.format) << " frames of " << options.width << "x"
+            << options.height << " in " << seconds << " s : " << options.frames / seconds << " frames/s, "
+            << encoder.bytesWritten() / (seconds * 1e6) << " MB/s written by " << encoder.numThreads()
+            << " encoders, " << capture.stalls() << " read back stalls\n";
+  if (config.deterministic)
+  {
+    sim->finish();
+    std::cerr << "position checksum after " << stepCount << " steps " << std::hex << sim->positionChecksum()
+              << std::dec << '\n';
+  }
+  glDeleteVertexArrays(1, &vao);
+  return encoder.framesWritten() == options.frames ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,86 @@
+#include "OffscreenTarget.h"
+#include <iostream>
+
+OffscreenTarget::~OffscreenTarget()
+{
+  release();
+}
+
+void OffscreenTarget::release()
+{
+  glDeleteFramebuffers(1,&m_framebuffer);
+  glDeleteFramebuffers(1,&m_resolveFramebuffer);
+  GLuint renderbuffers[]={m_colour,m_depth,m_resolveColour};
+  glDeleteRenderbuffers(3,renderbuffers);
+  m_framebuffer=m_resolveFramebuffer=0;
+  m_colour=m_depth=m_resolveColour=0;
+}
+
+bool OffscreenTarget::allocate(size_t _width, size_t _height, size_t _samples, GLenum _colourFormat)
+{
+  release();
+  m_width=_width;
+  m_height=_height;
+  const GLsizei w=static_cast<GLsizei>(_width);
+  const GLsizei h=static_cast<GLsizei>(_height);
+  const GLsizei samples=_samples>1 ? static_cast<GLsizei>(_samples) : 0;
+  auto renderbuffer=[&](GLenum _format, GLsizei _samples)
+  {
+    GLuint id=0;
+    glGenRenderbuffers(1,&id);
+    glBindRenderbuffer(GL_RENDERBUFFER,id);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER,_samples,_format,w,h);
+    return id;
+  };
+  // checks the bound framebuffer
+  auto complete=[]()
+  {
+    GLenum status=glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if(status!=GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cerr<<"offscreen framebuffer incomplete, status 0x"<<std::hex<<status<<std::dec<<'\n';
+      return false;
+    }
+    return true;
+  };
+  m_colour=renderbuffer(_colourFormat,samples);
+  m_depth=renderbuffer(GL_DEPTH_COMPONENT24,samples);
+  glGenFramebuffers(1,&m_framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER,m_framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,m_colour);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,m_depth);
+  bool ok=complete();
+  if(samples!=0)
+  {
+    m_resolveColour=renderbuffer(_colourFormat,0);
+    glGenFramebuffers(1,&m_resolveFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER,m_resolveFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,m_resolveColour);
+    ok=ok && complete();
+  }
+  glBindRenderbuffer(GL_RENDERBUFFER,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  return ok;
+}
+
+void OffscreenTarget::bind() const
+{
+  glBindFramebuffer(GL_FRAMEBUFFER,m_framebuffer);
+  glViewport(0,0,static_cast<GLsizei>(m_width),static_cast<GLsizei>(m_height));
+}
+
+void OffscreenTarget::resolve() const
+{
+  if(m_resolveFramebuffer==0)
+  {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER,m_framebuffer);
+    return;
+  }
+  const GLint w=static_cast<GLint>(m_width);
+  const GLint h=static_cast<GLint>(m_height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER,m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER,m_resolveFramebuffer);
+  glBlitFramebuffer(0,0,w,h,0,0,w,h,GL_COLOR_BUFFER_BIT,GL_NEAREST);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER,0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER,m_resolveFramebuffer);
+}
@@ -0,0 +1,52 @@
+#include "ParticleSimulator.h"
+#include "Philox.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+uint64_t ParticleSimulator::positionChecksum()
+{
+  // read back in chunks so huge particle counts don't need a full host copy
+  constexpr size_t c_chunk = 1 << 20;
+  std::vector<float> positions(std::min(c_chunk, numParticles()) * 4);
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t first = 0; first < numParticles(); first += c_chunk)
+  {
+    size_t count = std::min(c_chunk, numParticles() - first);
+    readPositions(positions.data(), first, count);
+    for (size_t i = 0; i < count * 4; ++i)
+    {
+      uint32_t bits;
+      std::memcpy(&bits, &positions[i], sizeof(bits));
+      hash = (hash ^ bits) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+void ParticleSimulator::initialState(uint32_t _index, uint32_t _seed, float o_position[4], float o_velocity[3])
+{
+  auto p = philox::generate(_index, 0, philox::c_initPosition, _seed);
+  auto v = philox::generate(_index, 0, philox::c_initVelocity, _seed);
+  // written so no multiply is followed by an add, a compiler fusing those into an fma would round differently
+  // to ParticlesInit.glsl. u - 0.5 is exact for the 24 bit uniforms.
+  for (size_t c = 0; c < 3; ++c)
+  {
+    o_position[c] = (philox::uniform(p[c]) - 0.5f) * 80.0f;
+    o_velocity[c] = 0.001f + philox::uniform(v[c]) - 0.5f;
+  }
+  o_position[3] = philox::uniform(p[3]) + 0.1f;
+}
+
+void ParticleSimulator::emittedState(uint32_t _index, uint32_t _step, uint32_t _seed, const float _emitter[4],
+                                     float o_position[4], float o_velocity[3])
+{
+  auto p = philox::generate(_index, _step, philox::c_emitPosition, _seed);
+  auto v = philox::generate(_index, _step, philox::c_emitVelocity, _seed);
+  for (size_t c = 0; c < 3; ++c)
+  {
+    o_position[c] = _emitter[c] + (philox::uniform(p[c]) * 2.0f - 1.0f) * _emitter[3];
+    o_velocity[c] = philox::uniform(v[c]) - 0.5f;
+  }
+  o_position[3] = 0.5f + philox::uniform(p[3]) * 0.49f;
+}
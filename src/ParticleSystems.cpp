@@ -0,0 +1,66 @@
+#include "ParticleSystems.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool ParticleSystems::load(const std::string &_path)
+{
+  m_systems.clear();
+  m_numParticles = 0;
+  m_numAttractors = 0;
+  std::ifstream in(_path);
+  if (!in)
+  {
+    std::cerr << "unable to open particle system file " << _path << "\n";
+    return false;
+  }
+  std::string line;
+  size_t lineNumber = 0;
+  while (std::getline(in, line))
+  {
+    ++lineNumber;
+    std::istringstream ss(line.substr(0, line.find('#')));
+    // read as doubles so counts can be written 1e6 as on the command line
+    std::vector<double> values;
+    for (double v; ss >> v;)
+    {
+      values.push_back(v);
+    }
+    if (values.empty() && ss.eof())
+    {
+      continue;
+    }
+    System system = {};
+    system.kV = values.size() > 2 ? static_cast<float>(values[2]) : c_defaultKV;
+    system.gauss = values.size() > 3 ? static_cast<float>(values[3]) : c_defaultGauss;
+    system.decay = values.size() > 4 ? static_cast<float>(values[4]) : c_defaultDecay;
+    const double particles = values.empty() ? 0.0 : values[0];
+    const double attractors = values.size() > 1 ? values[1] : -1.0;
+    const size_t count = (static_cast<size_t>(std::max(particles, 0.0)) + c_align - 1) / c_align * c_align;
+    bool valid = ss.eof() && values.size() <= 5 && particles >= 1.0 && attractors >= 0.0 && system.gauss > 0.0f &&
+                 m_numParticles + count <= 0xFFFFFFFFull;
+    if (!valid)
+    {
+      std::cerr << _path << ":" << lineNumber << " expected particles attractors [k_v gauss decay] with at least "
+                << "one particle and a positive gauss\n";
+      m_systems.clear();
+      m_numParticles = 0;
+      m_numAttractors = 0;
+      return false;
+    }
+    system.first = static_cast<uint32_t>(m_numParticles);
+    system.count = static_cast<uint32_t>(count);
+    system.firstAttractor = static_cast<uint32_t>(m_numAttractors);
+    system.numAttractors = static_cast<uint32_t>(attractors);
+    m_numParticles += count;
+    m_numAttractors += system.numAttractors;
+    m_systems.push_back(system);
+  }
+  if (m_systems.empty())
+  {
+    std::cerr << _path << " has no particle systems\n";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,202 @@
+#include "Profiler.h"
+#include "LockFreeRing.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  struct Sample
+  {
+    const char *name;
+    uint64_t startNs;
+    uint64_t durationNs;
+    uint32_t thread;
+    Profiler::Track track;
+  };
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief how often the rolling summary is rebuilt
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr auto c_summaryInterval = std::chrono::seconds(2);
+
+  struct State
+  {
+    LockFreeRing<Sample> ring{1 << 16};
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> running{false};
+    std::atomic<size_t> dropped{0};
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::thread writer;
+    std::mutex summaryMutex;
+    std::string summary;
+  };
+
+  State &state()
+  {
+    static State s_state;
+    return s_state;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief small stable id for the calling thread, the trace viewer shows one row per id (0 is the GPU row)
+  //----------------------------------------------------------------------------------------------------------------------
+  uint32_t threadIndex()
+  {
+    static std::atomic<uint32_t> s_next{1};
+    thread_local uint32_t t_index = s_next.fetch_add(1);
+    return t_index;
+  }
+
+  struct Stats
+  {
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+    size_t count = 0;
+  };
+
+  void writeEvent(std::ostream &_out, bool &io_first, const Sample &_s)
+  {
+    _out << (io_first ? "\n" : ",\n");
+    io_first = false;
+    // trace_event times are in microseconds
+    _out << "{\"name\":\"" << _s.name << "\",\"cat\":\"" << (_s.track == Profiler::Track::GPU ? "gpu" : "cpu")
+         << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << _s.thread << ",\"ts\":" << _s.startNs / 1000.0
+         << ",\"dur\":" << _s.durationNs / 1000.0 << "}";
+  }
+
+  void writerLoop(std::string _tracePath, bool _printSummary)
+  {
+    State &st = state();
+    std::ofstream trace;
+    bool first = true;
+    if (!_tracePath.empty())
+    {
+      trace.open(_tracePath);
+      if (!trace)
+      {
+        std::cerr << "Profiler unable to open " << _tracePath << '\n';
+      }
+      trace << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+      trace << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+      first = false;
+    }
+    std::map<std::string, Stats> stats;
+    auto lastSummary = std::chrono::steady_clock::now();
+    Sample s;
+    for (;;)
+    {
+      // read running before draining so nothing pushed before stop() is missed
+      bool running = st.running.load(std::memory_order_acquire);
+      bool any = false;
+      while (st.ring.pop(s))
+      {
+        any = true;
+        if (trace.is_open())
+        {
+          writeEvent(trace, first, s);
+        }
+        auto &entry = stats[std::string(s.track == Profiler::Track::GPU ? "[gpu] " : "") + s.name];
+        entry.totalNs += s.durationNs;
+        entry.maxNs = std::max(entry.maxNs, s.durationNs);
+        ++entry.count;
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (now - lastSummary >= c_summaryInterval && !stats.empty())
+      {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(2);
+        for (auto &e : stats)
+        {
+          ss << (ss.tellp() > 0 ? " | " : "") << e.first << " " << e.second.totalNs / 1e6 / e.second.count << "ms";
+        }
+        {
+          std::lock_guard<std::mutex> lock(st.summaryMutex);
+          st.summary = ss.str();
+        }
+        if (_printSummary)
+        {
+          std::cout << st.summary << '\n';
+        }
+        stats.clear();
+        lastSummary = now;
+      }
+      if (!running)
+      {
+        break;
+      }
+      if (!any)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+    }
+    if (trace.is_open())
+    {
+      trace << "\n]}\n";
+    }
+  }
+} // end anon namespace
+
+void Profiler::start(const std::string &_tracePath, bool _printSummary)
+{
+  State &st = state();
+  if (st.running)
+  {
+    return;
+  }
+  st.running = true;
+  st.writer = std::thread(writerLoop, _tracePath, _printSummary);
+  st.enabled.store(true, std::memory_order_release);
+}
+
+void Profiler::stop()
+{
+  State &st = state();
+  if (!st.running)
+  {
+    return;
+  }
+  st.enabled.store(false, std::memory_order_release);
+  st.running.store(false, std::memory_order_release);
+  st.writer.join();
+}
+
+bool Profiler::enabled()
+{
+  return state().enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t Profiler::now()
+{
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state().epoch).count());
+}
+
+void Profiler::record(const char *_name, uint64_t _startNs, uint64_t _durationNs, Track _track)
+{
+  Sample s{_name, _startNs, _durationNs, _track == Track::GPU ? 0u : threadIndex(), _track};
+  if (!state().ring.push(s))
+  {
+    state().dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+std::string Profiler::summary()
+{
+  State &st = state();
+  std::lock_guard<std::mutex> lock(st.summaryMutex);
+  return st.summary;
+}
+
+size_t Profiler::dropped()
+{
+  return state().dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,508 @@
+#include "ShaderVariantCache.h"
+#include "Profiler.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+namespace
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a built program and what is needed to rebuild it, files holds every file the stages read with the
+  /// write time it had when they were read
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Variant
+  {
+    std::string name;
+    std::vector<ShaderVariantCache::Stage> stages;
+    ShaderVariantCache::Defines defines;
+    std::vector<std::pair<std::string, std::filesystem::file_time_type>> files;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief program key -> variant, the name is empty if the variant failed to build so we don't retry every frame
+  //----------------------------------------------------------------------------------------------------------------------
+  std::unordered_map<std::string, Variant> &variants()
+  {
+    static std::unordered_map<std::string, Variant> s_variants;
+    return s_variants;
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the program binary directory, empty with the cache off
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string &binaryCache()
+  {
+    static std::string s_directory;
+    return s_directory;
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start of a cached program binary file, followed by length bytes of binary. The hash is checked as
+  /// well as the name so a truncated or foreign file is never handed to the driver
+  //----------------------------------------------------------------------------------------------------------------------
+  struct BinaryHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t format;
+    uint32_t length;
+  };
+  static_assert(sizeof(BinaryHeader)==24,"BinaryHeader is written as is");
+  constexpr uint32_t c_binaryMagic=0x4e494250; // PBIN
+  // 2 names the files by program key, 1 named them by the full hash and left a file behind for every edit
+  constexpr uint32_t c_binaryVersion=2;
+
+  std::filesystem::file_time_type writeTime(const std::string &_path)
+  {
+    std::error_code error;
+    auto time=std::filesystem::last_write_time(_path,error);
+    return error ? std::filesystem::file_time_type::min() : time;
+  }
+
+  GLenum glShaderType(ngl::ShaderType _type)
+  {
+    switch(_type)
+    {
+      case ngl::ShaderType::VERTEX : return GL_VERTEX_SHADER;
+      case ngl::ShaderType::FRAGMENT : return GL_FRAGMENT_SHADER;
+      case ngl::ShaderType::GEOMETRY : return GL_GEOMETRY_SHADER;
+      case ngl::ShaderType::TESSCONTROL : return GL_TESS_CONTROL_SHADER;
+      case ngl::ShaderType::TESSEVAL : return GL_TESS_EVALUATION_SHADER;
+      default : return GL_COMPUTE_SHADER;
+    }
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the final source of every stage, records the files read in o_variant.files
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<std::string> stageSources(Variant &o_variant)
+  {
+    std::vector<std::string> sources;
+    std::vector<std::string> files;
+    for(auto &stage : o_variant.stages)
+    {
+      size_t slash=stage.path.find_last_of('/');
+      std::string source=ShaderVariantCache::loadFile(stage.path);
+      files.push_back(stage.path);
+      if(!source.empty())
+      {
+        source=ShaderVariantCache::resolveIncludes(source,stage.path.substr(0,slash==std::string::npos ? 0 : slash+1),
+                                                   0,&files);
+        source=ShaderVariantCache::injectDefines(source,o_variant.defines);
+      }
+      sources.push_back(source);
+    }
+    o_variant.files.clear();
+    for(auto &f : files)
+    {
+      o_variant.files.push_back({f,writeTime(f)});
+    }
+    return sources;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief FNV-1a as ParticleSimulator::positionChecksum
+  //----------------------------------------------------------------------------------------------------------------------
+  void fnv(uint64_t &io_hash, const std::string &_bytes)
+  {
+    for(unsigned char c : _bytes)
+    {
+      io_hash^=c;
+      io_hash*=1099511628211ull;
+    }
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief hash of the driver strings, a binary is only good for the driver that made it, and the final stage
+  /// sources. Stored in the file to tell whether it is still current
+  //----------------------------------------------------------------------------------------------------------------------
+  uint64_t programHash(const std::vector<ShaderVariantCache::Stage> &_stages, const std::vector<std::string> &_sources)
+  {
+    uint64_t hash=14695981039346656037ull;
+    auto add=[&hash](const std::string &_bytes){ fnv(hash,_bytes); };
+    for(GLenum name : {GL_VENDOR,GL_RENDERER,GL_VERSION})
+    {
+      auto value=reinterpret_cast<const char *>(glGetString(name));
+      add(value!=nullptr ? value : "");
+      add("\n");
+    }
+    for(size_t i=0; i<_stages.size(); ++i)
+    {
+      add(std::to_string(static_cast<int>(_stages[i].type))+"\n");
+      add(_sources[i]);
+    }
+    return hash;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief one file per program key, so a program whose sources or driver changed finds its old binary, rejects
+  /// it and overwrites it rather than leaving it in the directory for good
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string binaryPath(const std::string &_key)
+  {
+    uint64_t hash=14695981039346656037ull;
+    fnv(hash,_key);
+    std::ostringstream path;
+    path<<binaryCache()<<'/'<<std::hex<<std::setw(16)<<std::setfill('0')<<hash<<".bin";
+    return path.str();
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief load the cached binary for _key into _program if it was built from sources and a driver matching _hash
+  /// @returns false if there is none, it is stale or the driver rejected it. The program is then unlinked and a
+  /// stale or rejected file is removed, the rebuild saves a current one in its place
+  //----------------------------------------------------------------------------------------------------------------------
+  bool loadBinary(GLuint _program, const std::string &_key, uint64_t _hash)
+  {
+    if(binaryCache().empty())
+    {
+      return false;
+    }
+    std::string path=binaryPath(_key);
+    std::ifstream in(path,std::ios::binary);
+    if(!in)
+    {
+      return false;
+    }
+    BinaryHeader header;
+    bool linked=false;
+    if(in.read(reinterpret_cast<char *>(&header),sizeof(header)) && header.magic==c_binaryMagic &&
+       header.version==c_binaryVersion && header.hash==_hash)
+    {
+      std::vector<char> binary(header.length);
+      if(in.read(binary.data(),static_cast<std::streamsize>(binary.size())))
+      {
+        glProgramBinary(_program,header.format,binary.data(),static_cast<GLsizei>(binary.size()));
+        GLint status=GL_FALSE;
+        glGetProgramiv(_program,GL_LINK_STATUS,&status);
+        linked=status==GL_TRUE;
+      }
+    }
+    if(!linked)
+    {
+      in.close();
+      std::error_code error;
+      std::filesystem::remove(path,error);
+    }
+    return linked;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief save the linked _program, written to a uniquely named file and renamed over the final name so a
+  /// crash or a second instance never leaves half a file
+  //----------------------------------------------------------------------------------------------------------------------
+  void saveBinary(GLuint _program, const std::string &_key, uint64_t _hash)
+  {
+    GLint formats=0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&formats);
+    GLint length=0;
+    glGetProgramiv(_program,GL_PROGRAM_BINARY_LENGTH,&length);
+    if(binaryCache().empty() || formats==0 || length<=0)
+    {
+      return;
+    }
+    BinaryHeader header{c_binaryMagic,c_binaryVersion,_hash,0,0};
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLsizei written=0;
+    GLenum format=0;
+    glGetProgramBinary(_program,length,&written,&format,binary.data());
+    header.format=format;
+    header.length=static_cast<uint32_t>(written);
+
+    std::error_code error;
+    std::filesystem::create_directories(binaryCache(),error);
+    std::string path=binaryPath(_key);
+    std::string temporary=path+"."+std::to_string(std::random_device()())+".tmp";
+    {
+      std::ofstream out(temporary,std::ios::binary|std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(&header),sizeof(header));
+      out.write(binary.data(),written);
+      if(!out)
+      {
+        std::cerr<<"ShaderVariantCache unable to write "<<temporary<<'\n';
+        out.close();
+        std::filesystem::remove(temporary,error);
+        return;
+      }
+    }
+    std::filesystem::rename(temporary,path,error);
+    if(error)
+    {
+      std::cerr<<"ShaderVariantCache unable to save "<<path<<" : "<<error.message()<<'\n';
+      std::filesystem::remove(temporary,error);
+    }
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief compile _sources and relink _program with them, the id stays the same. Everything is checked on a
+  /// scratch program first so a broken edit leaves _program as it was
+  //----------------------------------------------------------------------------------------------------------------------
+  bool relink(GLuint _program, const std::vector<ShaderVariantCache::Stage> &_stages,
+              const std::vector<std::string> &_sources)
+  {
+    char log[4096];
+    bool ok=true;
+    GLuint scratch=glCreateProgram();
+    std::vector<GLuint> shaders;
+    for(size_t i=0; i<_stages.size() && ok; ++i)
+    {
+      GLuint shader=glCreateShader(glShaderType(_stages[i].type));
+      const char *source=_sources[i].c_str();
+      glShaderSource(shader,1,&source,nullptr);
+      glCompileShader(shader);
+      GLint compiled=GL_FALSE;
+      glGetShaderiv(shader,GL_COMPILE_STATUS,&compiled);
+      if(compiled!=GL_TRUE)
+      {
+        glGetShaderInfoLog(shader,sizeof(log),nullptr,log);
+        std::cerr<<_stages[i].path<<" failed to compile\n"<<log<<'\n';
+        ok=false;
+      }
+      glAttachShader(scratch,shader);
+      shaders.push_back(shader);
+    }
+    if(ok)
+    {
+      glLinkProgram(scratch);
+      GLint linked=GL_FALSE;
+      glGetProgramiv(scratch,GL_LINK_STATUS,&linked);
+      if(linked!=GL_TRUE)
+      {
+        glGetProgramInfoLog(scratch,sizeof(log),nullptr,log);
+        std::cerr<<"link failed\n"<<log<<'\n';
+        ok=false;
+      }
+    }
+    glDeleteProgram(scratch);
+    if(ok)
+    {
+      GLint count=0;
+      glGetProgramiv(_program,GL_ATTACHED_SHADERS,&count);
+      std::vector<GLuint> attached(static_cast<size_t>(count));
+      if(count!=0)
+      {
+        glGetAttachedShaders(_program,count,nullptr,attached.data());
+      }
+      for(auto shader : attached)
+      {
+        glDetachShader(_program,shader);
+      }
+      for(auto shader : shaders)
+      {
+        glAttachShader(_program,shader);
+      }
+      glProgramParameteri(_program,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+      glLinkProgram(_program);
+    }
+    // only flagged while still attached to _program
+    for(auto shader : shaders)
+    {
+      glDeleteShader(shader);
+    }
+    return ok;
+  }
+} // end anon namespace
+
+void ShaderVariantCache::setBinaryCache(const std::string &_directory)
+{
+  binaryCache()=_directory;
+  GLint formats=0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&formats);
+  if(!_directory.empty() && formats==0)
+  {
+    std::cerr<<"ShaderVariantCache the driver has no program binary formats, always compiling from source\n";
+  }
+  if(_directory.empty())
+  {
+    return;
+  }
+  // files from an older layout are never looked up again, the current ones are checked as they are loaded
+  std::error_code error;
+  std::vector<std::filesystem::path> stale;
+  for(auto &entry : std::filesystem::directory_iterator(_directory,error))
+  {
+    if(entry.path().extension()!=".bin")
+    {
+      continue;
+    }
+    std::ifstream in(entry.path(),std::ios::binary);
+    BinaryHeader header;
+    if(!in.read(reinterpret_cast<char *>(&header),sizeof(header)) || header.magic!=c_binaryMagic ||
+       header.version!=c_binaryVersion)
+    {
+      stale.push_back(entry.path());
+    }
+  }
+  for(auto &path : stale)
+  {
+    std::filesystem::remove(path,error);
+  }
+}
+
+std::string ShaderVariantCache::loadFile(const std::string &_path)
+{
+  std::ifstream in(_path);
+  if(!in)
+  {
+    std::cerr<<"ShaderVariantCache unable to open "<<_path<<'\n';
+    return {};
+  }
+  std::stringstream ss;
+  ss<<in.rdbuf();
+  return ss.str();
+}
+
+std::string ShaderVariantCache::resolveIncludes(const std::string &_source, const std::string &_directory, int _depth,
+                                                std::vector<std::string> *o_files)
+{
+  if(_depth>8)
+  {
+    std::cerr<<"ShaderVariantCache #include nested too deeply\n";
+    return _source;
+  }
+  std::stringstream in(_source);
+  std::string result;
+  std::string line;
+  while(std::getline(in,line))
+  {
+    size_t first=line.find_first_not_of(" \t");
+    size_t open=line.find('"');
+    size_t close= open==std::string::npos ? open : line.find('"',open+1);
+    if(first!=std::string::npos && line.compare(first,8,"#include")==0 && close!=std::string::npos)
+    {
+      std::string path=_directory+line.substr(open+1,close-open-1);
+      size_t slash=path.find_last_of('/');
+      if(o_files!=nullptr)
+      {
+        o_files->push_back(path);
+      }
+      result+=resolveIncludes(loadFile(path),path.substr(0,slash==std::string::npos ? 0 : slash+1),_depth+1,o_files);
+      result+='\n';
+    }
+    else
+    {
+      result+=line+'\n';
+    }
+  }
+  return result;
+}
+
+std::string ShaderVariantCache::injectDefines(const std::string &_source, const Defines &_defines)
+{
+  std::string defines;
+  for(auto &d : _defines)
+  {
+    defines+="#define "+d.first+" "+d.second+"\n";
+  }
+  // #version must stay the first statement so insert after that line
+  size_t version=_source.find("#version");
+  if(version==std::string::npos)
+  {
+    return defines+_source;
+  }
+  size_t lineEnd=_source.find('\n',version);
+  if(lineEnd==std::string::npos)
+  {
+    return _source+"\n"+defines;
+  }
+  return _source.substr(0,lineEnd+1)+defines+_source.substr(lineEnd+1);
+}
+
+bool ShaderVariantCache::program(const std::vector<Stage> &_stages, const Defines &_defines, std::string &o_name)
+{
+  std::string key;
+  for(auto &s : _stages)
+  {
+    key+=s.path+";";
+  }
+  for(auto &d : _defines)
+  {
+    key+=d.first+"="+d.second+";";
+  }
+  auto found=variants().find(key);
+  if(found!=variants().end())
+  {
+    o_name=found->second.name;
+    return !o_name.empty();
+  }
+
+  PROFILE_SCOPE("build program");
+  Variant variant{std::string(),_stages,_defines,{}};
+  std::vector<std::string> sources=stageSources(variant);
+  uint64_t hash=programHash(_stages,sources);
+  ngl::ShaderLib::createShaderProgram(key);
+  GLuint id=ngl::ShaderLib::getProgramID(key);
+  // a cached binary skips compiling and linking, but ngl then still has to find the uniforms
+  bool ok=loadBinary(id,key,hash);
+  if(ok)
+  {
+    ngl::ShaderLib::autoRegisterUniforms(key);
+  }
+  else
+  {
+    ok=true;
+    for(size_t i=0; i<_stages.size(); ++i)
+    {
+      std::string shaderName=key+"#"+std::to_string(i);
+      ngl::ShaderLib::attachShader(shaderName,_stages[i].type);
+      ngl::ShaderLib::loadShaderSourceFromString(shaderName,sources[i]);
+      ok&=!sources[i].empty() && ngl::ShaderLib::compileShader(shaderName);
+      ngl::ShaderLib::attachShaderToProgram(key,shaderName);
+    }
+    glProgramParameteri(id,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+    ok=ok && ngl::ShaderLib::linkProgramObject(key);
+    if(ok)
+    {
+      saveBinary(id,key,hash);
+    }
+  }
+  if(!ok)
+  {
+    std::cerr<<"ShaderVariantCache failed to build "<<key<<'\n';
+  }
+  variant.name= ok ? key : std::string();
+  o_name=variant.name;
+  variants().emplace(key,std::move(variant));
+  return ok;
+}
+
+size_t ShaderVariantCache::reloadChanged()
+{
+  size_t reloaded=0;
+  for(auto &entry : variants())
+  {
+    Variant &variant=entry.second;
+    bool changed=false;
+    for(auto &file : variant.files)
+    {
+      changed|=writeTime(file.first)!=file.second;
+    }
+    if(variant.name.empty() || !changed)
+    {
+      continue;
+    }
+    // the new write times are taken now so a broken edit is only reported once, not every poll
+    std::vector<std::string> sources=stageSources(variant);
+    GLuint id=ngl::ShaderLib::getProgramID(variant.name);
+    if(relink(id,variant.stages,sources))
+    {
+      ngl::ShaderLib::autoRegisterUniforms(variant.name);
+      saveBinary(id,entry.first,programHash(variant.stages,sources));
+      std::cout<<"ShaderVariantCache reloaded "<<variant.name<<'\n';
+      ++reloaded;
+    }
+    else
+    {
+      std::cerr<<"ShaderVariantCache keeping the old "<<variant.name<<'\n';
+    }
+  }
+  return reloaded;
+}
+
+bool ShaderVariantCache::compute(const std::string &_path, const Defines &_defines, std::string &o_name)
+{
+  return program({{ngl::ShaderType::COMPUTE,_path}},_defines,o_name);
+}
@@ -0,0 +1,444 @@
+#include "SimulationConfig.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+const char *toString(SimulatorBackend _backend)
+{
+  switch (_backend)
+  {
+    case SimulatorBackend::GPU:
+      return "gpu";
+    case SimulatorBackend::CPU:
+      return "cpu";
+  }
+  return "unknown";
+}
+
+const char *toString(ForceMode _mode)
+{
+  switch (_mode)
+  {
+    case ForceMode::Summed:
+      return "summed";
+    case ForceMode::Tiled:
+      return "tiled";
+    case ForceMode::Grid:
+      return "grid";
+  }
+  return "unknown";
+}
+
+const char *toString(InitMode _mode)
+{
+  switch (_mode)
+  {
+    case InitMode::Compute:
+      return "compute";
+    case InitMode::Mapped:
+      return "mapped";
+  }
+  return "unknown";
+}
+
+const char *toString(ParticleFormat _format)
+{
+  switch (_format)
+  {
+    case ParticleFormat::Full:
+      return "full";
+    case ParticleFormat::Compact:
+      return "compact";
+  }
+  return "unknown";
+}
+
+void SimulationConfig::printUsage(const char *_program)
+{
+  std::cout << "usage : " << _program << " [options]\n"
+            << "  --backend gpu|cpu   simulation backend (default gpu)\n"
+            << "  --config FILE       read options from a file, later command line options override it\n"
+            << "  --particles N       number of particles, 1e6 style values are fine (default 1e6)\n"
+            << "  --attractors N      number of attractors (default 4)\n"
+            << "  --emitters N        spawn particles from N emitters into a pool of --particles slots, 0 keeps\n"
+            << "                      every particle alive and respawns them in place (default 0)\n"
+            << "  --emit-rate N       particles spawned per step over all the emitters (default 2000)\n"
+            << "  --force MODE        summed (all attractors as one point), tiled (per attractor) or grid\n"
+            << "                      (tiled field baked into a 3D grid) (default summed)\n"
+            << "  --grid-res N        cells per side of the grid force field (default 64)\n"
+            << "  --grid-extent F     the grid covers -F..F on each axis (default 60)\n"
+            << "  --neighbor-radius F particle / particle interaction radius, 0 = off (default 0)\n"
+            << "  --separation F      neighbour force strength, negative for cohesion (default 0.1)\n"
+            << "  --reorder N         sort the particles into Morton order every N steps, 0 = off (default 0)\n"
+            << "  --workgroup N       compute shader work group size (default 128)\n"
+            << "  --init MODE         gpu start state written by a compute pass or through a mapping\n"
+            << "                      filled on the CPU, compute|mapped (default compute)\n"
+            << "  --format FORMAT     particle buffers as full floats or compact (16 bit position, half float\n"
+            << "                      velocity), full|compact (default full)\n"
+            << "  --bounds F          compact positions cover -F..F on each axis (default 128)\n"
+            << "  --cull 0|1          draw only the particles in the view frustum (default 1)\n"
+            << "  --lod-distance F    thin out particles further than F from the camera, 0 = off (default 0)\n"
+            << "  --threads N         CPU backend threads, 0 = all cores (default 0)\n"
+            << "  --seed N            seed for the initial particles (default 1234)\n"
+            << "  --step-ms F         milliseconds per fixed simulation step (default 10)\n"
+            << "  --max-substeps N    most fixed steps per rendered frame (default 4)\n"
+            << "  --deterministic 0|1 one fixed step per frame, attractors moved by step count (default 0)\n"
+            << "  --paths FILE        move the attractors along the paths in FILE every step (default none)\n"
+            << "  --systems FILE      step the independent particle systems listed in FILE as one batch, each\n"
+            << "                      with its own attractors, k_v, gauss and decay (default none)\n"
+            << "  --stop-after N      print the position checksum and quit after N steps, 0 = never\n"
+            << "  --trace FILE        write a Chrome trace (chrome://tracing, ui.perfetto.dev) of the profiler\n"
+            << "  --shader-cache DIR  keep linked program binaries in DIR, none = off (default shadercache)\n"
+            << "  --hot-reload 0|1    rebuild the programs whose shader files change while running (default 0)\n"
+            << "  --sim-thread 0|1    step the simulation on its own thread instead of the gui thread, needs\n"
+            << "                      --backend cpu (default 0)\n"
+            << "  --checkpoint-every N  save the particle state every N steps, 0 = never (default 0)\n"
+            << "  --checkpoint-dir DIR  where the checkpoints go (default checkpoints)\n"
+            << "  --compress 0|1      deflate the checkpoint streams, needs zlib (default 0)\n"
+            << "  --load FILE         start from a checkpoint instead of the seed (default none)\n"
+            << "  --stream-chunk N    out of core, stream N particle chunks through the device (gpu) or pinned\n"
+            << "                      threads (cpu), 0 = everything resident (default 0)\n"
+            << "  --state-file FILE   map the streamed gpu state from FILE instead of memory (default none)\n";
+}
+
+bool SimulationConfig::parse(int _argc, char **_argv)
+{
+  for (int i = 1; i < _argc; ++i)
+  {
+    const char *arg = _argv[i];
+    // all our options take a value
+    auto value = [&]() -> const char * { return i + 1 < _argc ? _argv[++i] : nullptr; };
+    if (std::strcmp(arg, "--backend") == 0)
+    {
+      const char *v = value();
+      if (v != nullptr && std::strcmp(v, "cpu") == 0)
+      {
+        backend = SimulatorBackend::CPU;
+      }
+      else if (v != nullptr && std::strcmp(v, "gpu") == 0)
+      {
+        backend = SimulatorBackend::GPU;
+      }
+      else
+      {
+        std::cerr << "unknown backend " << (v ? v : "") << " expected cpu or gpu\n";
+        return false;
+      }
+    }
+    else if (std::strcmp(arg, "--particles") == 0 || std::strcmp(arg, "--attractors") == 0 ||
+             std::strcmp(arg, "--workgroup") == 0 || std::strcmp(arg, "--threads") == 0 ||
+             std::strcmp(arg, "--grid-res") == 0 || std::strcmp(arg, "--max-substeps") == 0 ||
+             std::strcmp(arg, "--deterministic") == 0 || std::strcmp(arg, "--stop-after") == 0 ||
+             std::strcmp(arg, "--cull") == 0 || std::strcmp(arg, "--emitters") == 0 ||
+             std::strcmp(arg, "--emit-rate") == 0 || std::strcmp(arg, "--reorder") == 0 ||
+             std::strcmp(arg, "--hot-reload") == 0 || std::strcmp(arg, "--checkpoint-every") == 0 ||
+             std::strcmp(arg, "--compress") == 0 || std::strcmp(arg, "--stream-chunk") == 0 ||
+             std::strcmp(arg, "--sim-thread") == 0 || std::strcmp(arg, "--seed") == 0)
+    {
+      const char *v = value();
+      if (v == nullptr)
+      {
+        std::cerr << arg << " needs a value\n";
+        return false;
+      }
+      // strtod so counts can be written as 1e6, anything that isn't a finite count in range of size_t is refused
+      // before the cast, which would be undefined for it
+      char *end = nullptr;
+      const double d = std::strtod(v, &end);
+      if (end == v || *end != '\0' || !std::isfinite(d) || d < 0.0 ||
+          d >= static_cast<double>(std::numeric_limits<size_t>::max()))
+      {
+        std::cerr << arg << " needs a count, got " << v << "\n";
+        return false;
+      }
+      size_t n = static_cast<size_t>(d);
+      if (std::strcmp(arg, "--particles") == 0)
+      {
+        numParticles = n;
+      }
+      else if (std::strcmp(arg, "--attractors") == 0)
+      {
+        numAttractors = n;
+      }
+      else if (std::strcmp(arg, "--workgroup") == 0)
+      {
+        workgroupSize = n;
+      }
+      else if (std::strcmp(arg, "--threads") == 0)
+      {
+        numThreads = n;
+      }
+      else if (std::strcmp(arg, "--grid-res") == 0)
+      {
+        gridResolution = n;
+      }
+      else if (std::strcmp(arg, "--max-substeps") == 0)
+      {
+        maxSubsteps = n;
+      }
+      else if (std::strcmp(arg, "--deterministic") == 0)
+      {
+        deterministic = n != 0;
+      }
+      else if (std::strcmp(arg, "--stop-after") == 0)
+      {
+        stopAfter = n;
+      }
+      else if (std::strcmp(arg, "--cull") == 0)
+      {
+        cull = n != 0;
+      }
+      else if (std::strcmp(arg, "--emitters") == 0)
+      {
+        numEmitters = n;
+      }
+      else if (std::strcmp(arg, "--emit-rate") == 0)
+      {
+        emitRate = n;
+      }
+      else if (std::strcmp(arg, "--reorder") == 0)
+      {
+        reorderInterval = n;
+      }
+      else if (std::strcmp(arg, "--hot-reload") == 0)
+      {
+        hotReload = n != 0;
+      }
+      else if (std::strcmp(arg, "--checkpoint-every") == 0)
+      {
+        checkpointInterval = n;
+      }
+      else if (std::strcmp(arg, "--compress") == 0)
+      {
+        checkpointCompress = n != 0;
+      }
+      else if (std::strcmp(arg, "--stream-chunk") == 0)
+      {
+        streamChunk = n;
+      }
+      else if (std::strcmp(arg, "--sim-thread") == 0)
+      {
+        simThread = n != 0;
+      }
+      else
+      {
+        seed = static_cast<uint32_t>(n);
+      }
+    }
+    else if (std::strcmp(arg, "--force") == 0)
+    {
+      const char *v = value();
+      if (v != nullptr && std::strcmp(v, "summed") == 0)
+      {
+        forceMode = ForceMode::Summed;
+      }
+      else if (v != nullptr && std::strcmp(v, "tiled") == 0)
+      {
+        forceMode = ForceMode::Tiled;
+      }
+      else if (v != nullptr && std::strcmp(v, "grid") == 0)
+      {
+        forceMode = ForceMode::Grid;
+      }
+      else
+      {
+        std::cerr << "unknown force mode " << (v ? v : "") << " expected summed, tiled or grid\n";
+        return false;
+      }
+    }
+    else if (std::strcmp(arg, "--init") == 0)
+    {
+      const char *v = value();
+      if (v != nullptr && std::strcmp(v, "compute") == 0)
+      {
+        initMode = InitMode::Compute;
+      }
+      else if (v != nullptr && std::strcmp(v, "mapped") == 0)
+      {
+        initMode = InitMode::Mapped;
+      }
+      else
+      {
+        std::cerr << "unknown init mode " << (v ? v : "") << " expected compute or mapped\n";
+        return false;
+      }
+    }
+    else if (std::strcmp(arg, "--format") == 0)
+    {
+      const char *v = value();
+      if (v != nullptr && std::strcmp(v, "full") == 0)
+      {
+        particleFormat = ParticleFormat::Full;
+      }
+      else if (v != nullptr && std::strcmp(v, "compact") == 0)
+      {
+        particleFormat = ParticleFormat::Compact;
+      }
+      else
+      {
+        std::cerr << "unknown particle format " << (v ? v : "") << " expected full or compact\n";
+        return false;
+      }
+    }
+    else if (std::strcmp(arg, "--grid-extent") == 0 || std::strcmp(arg, "--neighbor-radius") == 0 ||
+             std::strcmp(arg, "--separation") == 0 || std::strcmp(arg, "--step-ms") == 0 ||
+             std::strcmp(arg, "--bounds") == 0 || std::strcmp(arg, "--lod-distance") == 0)
+    {
+      const char *v = value();
+      if (v == nullptr)
+      {
+        std::cerr << arg << " needs a value\n";
+        return false;
+      }
+      float f = std::strtof(v, nullptr);
+      if (std::strcmp(arg, "--grid-extent") == 0)
+      {
+        gridExtent = f;
+      }
+      else if (std::strcmp(arg, "--neighbor-radius") == 0)
+      {
+        neighborRadius = f;
+      }
+      else if (std::strcmp(arg, "--step-ms") == 0)
+      {
+        stepMs = f;
+      }
+      else if (std::strcmp(arg, "--bounds") == 0)
+      {
+        positionExtent = f;
+      }
+      else if (std::strcmp(arg, "--lod-distance") == 0)
+      {
+        lodDistance = f;
+      }
+      else
+      {
+        separation = f;
+      }
+    }
+    else if (std::strcmp(arg, "--trace") == 0 || std::strcmp(arg, "--paths") == 0 ||
+             std::strcmp(arg, "--shader-cache") == 0 || std::strcmp(arg, "--checkpoint-dir") == 0 ||
+             std::strcmp(arg, "--load") == 0 || std::strcmp(arg, "--state-file") == 0 ||
+             std::strcmp(arg, "--systems") == 0)
+    {
+      const char *v = value();
+      if (v == nullptr)
+      {
+        std::cerr << arg << " needs a value\n";
+        return false;
+      }
+      if (std::strcmp(arg, "--trace") == 0)
+      {
+        traceFile = v;
+      }
+      else if (std::strcmp(arg, "--shader-cache") == 0)
+      {
+        // a config file can't give an empty value
+        shaderCache = std::strcmp(v, "none") == 0 ? "" : v;
+      }
+      else if (std::strcmp(arg, "--checkpoint-dir") == 0)
+      {
+        checkpointDir = v;
+      }
+      else if (std::strcmp(arg, "--load") == 0)
+      {
+        loadCheckpoint = v;
+      }
+      else if (std::strcmp(arg, "--state-file") == 0)
+      {
+        stateFile = v;
+      }
+      else if (std::strcmp(arg, "--systems") == 0)
+      {
+        particleSystems = v;
+      }
+      else
+      {
+        attractorPaths = v;
+      }
+    }
+    else if (std::strcmp(arg, "--config") == 0)
+    {
+      const char *v = value();
+      if (v == nullptr || !loadFile(v))
+      {
+        return false;
+      }
+    }
+    else if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0)
+    {
+      printUsage(_argv[0]);
+      return false;
+    }
+  }
+  if (numParticles == 0 || workgroupSize == 0 || gridResolution < 2 || gridExtent <= 0.0f || neighborRadius < 0.0f ||
+      stepMs <= 0.0f || maxSubsteps == 0 || positionExtent <= 0.0f || lodDistance < 0.0f)
+  {
+    std::cerr << "--particles, --workgroup, --grid-extent, --step-ms, --max-substeps, --bounds must be greater than "
+                 "zero, --grid-res at least 2 and --neighbor-radius, --lod-distance not negative\n";
+    return false;
+  }
+  if (numEmitters != 0 && neighborRadius > 0.0f)
+  {
+    // the spatial hash bins every slot, dead ones included
+    std::cerr << "--emitters can't be combined with --neighbor-radius\n";
+    return false;
+  }
+  if (streamChunk != 0 && (numEmitters != 0 || neighborRadius > 0.0f || reorderInterval != 0))
+  {
+    // these need every particle resident at once, a streamed chunk only sees itself
+    std::cerr << "--stream-chunk can't be combined with --emitters, --neighbor-radius or --reorder\n";
+    return false;
+  }
+  if (!particleSystems.empty() && (forceMode != ForceMode::Summed || numEmitters != 0 || neighborRadius > 0.0f ||
+                                   reorderInterval != 0 || streamChunk != 0))
+  {
+    // the tiles and the baked grid are shared by every particle, the other modes move particles between systems
+    std::cerr << "--systems needs --force summed and can't be combined with --emitters, --neighbor-radius, --reorder "
+                 "or --stream-chunk\n";
+    return false;
+  }
+  if (simThread && backend != SimulatorBackend::CPU)
+  {
+    // the compute passes go through ngl::ShaderLib, which is a single unsynchronised instance
+    std::cerr << "--sim-thread needs --backend cpu\n";
+    return false;
+  }
+  return true;
+}
+
+bool SimulationConfig::loadFile(const std::string &_path)
+{
+  std::ifstream in(_path);
+  if (!in)
+  {
+    std::cerr << "unable to open config file " << _path << "\n";
+    return false;
+  }
+  // turn the file into an argv so it goes through exactly the same parsing as the command line
+  std::vector<std::string> words = {_path};
+  std::string line;
+  while (std::getline(in, line))
+  {
+    line = line.substr(0, line.find('#'));
+    std::istringstream ss(line);
+    std::string name;
+    std::string v;
+    if (ss >> name >> v)
+    {
+      words.push_back("--" + name);
+      words.push_back(v);
+    }
+  }
+  std::vector<char *> argv;
+  for (auto &w : words)
+  {
+    argv.push_back(&w[0]);
+  }
+  return parse(static_cast<int>(argv.size()), argv.data());
+}
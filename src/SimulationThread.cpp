@@ -0,0 +1,123 @@
+#include "SimulationThread.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+SimulationThread::SimulationThread(const SimulationConfig &_config, StepFunction _step, PublishFunction _publish)
+    : m_stepMs(_config.stepMs), m_maxSubsteps(_config.maxSubsteps), m_deterministic(_config.deterministic),
+      m_step(std::move(_step)), m_publish(std::move(_publish))
+{
+  m_thread = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+}
+
+void SimulationThread::post(std::function<void()> _command)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_commands.push_back(std::move(_command));
+  }
+  m_wake.notify_one();
+}
+
+const SimulationThread::Frame &SimulationThread::acquire()
+{
+  if ((m_ready.load(std::memory_order_relaxed) & c_fresh) != 0)
+  {
+    // acquire pairs with the release in publish so the frame's contents are visible
+    m_front = m_ready.exchange(static_cast<uint32_t>(m_front), std::memory_order_acq_rel) & ~c_fresh;
+  }
+  return m_frames[m_front];
+}
+
+void SimulationThread::publish()
+{
+  PROFILE_SCOPE("publish frame");
+  m_publish(m_frames[m_back]);
+  m_back = m_ready.exchange(static_cast<uint32_t>(m_back) | c_fresh, std::memory_order_acq_rel) & ~c_fresh;
+}
+
+void SimulationThread::runCommands()
+{
+  std::vector<std::function<void()>> commands;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    commands.swap(m_commands);
+  }
+  for (auto &command : commands)
+  {
+    command();
+  }
+}
+
+void SimulationThread::run()
+{
+  using Clock = std::chrono::steady_clock;
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  publish();
+  auto last = Clock::now();
+  auto rateStart = last;
+  size_t rateSteps = 0;
+  double accumulator = 0.0;
+  for (;;)
+  {
+    runCommands();
+    size_t steps = 1;
+    if (!m_deterministic)
+    {
+      auto now = Clock::now();
+      accumulator += Milliseconds(now - last).count();
+      last = now;
+      steps = std::min(static_cast<size_t>(accumulator / m_stepMs), m_maxSubsteps);
+      accumulator -= steps * m_stepMs;
+      // after a hitch drop whatever maxSubsteps couldn't cover rather than trying to catch up next time
+      accumulator = std::fmod(accumulator, static_cast<double>(m_stepMs));
+    }
+    {
+      // sleep until the next step is due, a post or the destructor wakes it early
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (steps == 0)
+      {
+        m_wake.wait_for(lock, Milliseconds(m_stepMs - accumulator), [this] { return m_quit || !m_commands.empty(); });
+      }
+      if (m_quit)
+      {
+        return;
+      }
+    }
+    if (steps == 0)
+    {
+      continue;
+    }
+    bool more;
+    {
+      PROFILE_SCOPE("simulate");
+      more = m_step(steps);
+    }
+    publish();
+    if (!more)
+    {
+      m_finished = true;
+      return;
+    }
+    rateSteps += steps;
+    auto now = Clock::now();
+    if (now - rateStart >= std::chrono::seconds(1))
+    {
+      m_stepsPerSecond = static_cast<float>(rateSteps / std::chrono::duration<double>(now - rateStart).count());
+      rateStart = now;
+      rateSteps = 0;
+    }
+  }
+}
@@ -0,0 +1,126 @@
+#include "SpatialHash.h"
+#include <algorithm>
+
+namespace
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief table slots per chunk for the clear / scan / sort passes
+  //----------------------------------------------------------------------------------------------------------------------
+  constexpr size_t c_cellGrain = 16384;
+} // end anon namespace
+
+size_t SpatialHash::tableSizeFor(size_t _count)
+{
+  size_t size = 1024;
+  while (size < _count)
+  {
+    size <<= 1;
+  }
+  return size;
+}
+
+void SpatialHash::build(const float *_x, const float *_y, const float *_z, size_t _count, float _cellSize,
+                        ThreadPool &_pool)
+{
+  const size_t tableSize = tableSizeFor(_count);
+  m_invCellSize = 1.0f / _cellSize;
+  m_mask = static_cast<uint32_t>(tableSize - 1);
+  m_particleHash.resize(_count);
+  m_sorted.resize(_count);
+  m_sortedX.resize(_count + c_padding);
+  m_sortedY.resize(_count + c_padding);
+  m_sortedZ.resize(_count + c_padding);
+  m_cellStart.resize(tableSize + 1);
+  if (m_cellFillSize != tableSize)
+  {
+    m_cellFill.reset(new std::atomic<uint32_t>[tableSize]);
+    m_cellFillSize = tableSize;
+  }
+  size_t chunks = _pool.size() * 8;
+  size_t grain = std::max<size_t>(4096, (_count + chunks - 1) / chunks);
+
+  _pool.parallelFor(tableSize, c_cellGrain, [&](size_t _begin, size_t _end) {
+    for (size_t s = _begin; s < _end; ++s)
+    {
+      m_cellFill[s].store(0, std::memory_order_relaxed);
+    }
+  });
+
+  // hash pass, slot of each particle and the per slot counts
+  _pool.parallelFor(_count, grain, [&](size_t _begin, size_t _end) {
+    for (size_t i = _begin; i < _end; ++i)
+    {
+      uint32_t slot = hashCell(static_cast<int32_t>(std::floor(_x[i] * m_invCellSize)),
+                               static_cast<int32_t>(std::floor(_y[i] * m_invCellSize)),
+                               static_cast<int32_t>(std::floor(_z[i] * m_invCellSize)), m_mask);
+      m_particleHash[i] = slot;
+      m_cellFill[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+
+  // exclusive prefix sum of the counts, each chunk sums its slots, the chunk totals are scanned serially and
+  // then each chunk scans its own slots from its offset. The counts become the scatter write cursors.
+  std::vector<uint32_t> chunkOffset((tableSize + c_cellGrain - 1) / c_cellGrain);
+  _pool.parallelFor(tableSize, c_cellGrain, [&](size_t _begin, size_t _end) {
+    uint32_t sum = 0;
+    for (size_t s = _begin; s < _end; ++s)
+    {
+      sum += m_cellFill[s].load(std::memory_order_relaxed);
+    }
+    chunkOffset[_begin / c_cellGrain] = sum;
+  });
+  uint32_t running = 0;
+  for (auto &offset : chunkOffset)
+  {
+    uint32_t sum = offset;
+    offset = running;
+    running += sum;
+  }
+  _pool.parallelFor(tableSize, c_cellGrain, [&](size_t _begin, size_t _end) {
+    uint32_t start = chunkOffset[_begin / c_cellGrain];
+    for (size_t s = _begin; s < _end; ++s)
+    {
+      uint32_t count = m_cellFill[s].load(std::memory_order_relaxed);
+      m_cellStart[s] = start;
+      m_cellFill[s].store(start, std::memory_order_relaxed);
+      start += count;
+    }
+  });
+  m_cellStart[tableSize] = static_cast<uint32_t>(_count);
+
+  // scatter the indices into their slot ranges
+  _pool.parallelFor(_count, grain, [&](size_t _begin, size_t _end) {
+    for (size_t i = _begin; i < _end; ++i)
+    {
+      m_sorted[m_cellFill[m_particleHash[i]].fetch_add(1, std::memory_order_relaxed)] = static_cast<uint32_t>(i);
+    }
+  });
+
+  // the order within a slot depends on thread timing, sort each slot so the neighbour order (and so the order
+  // forces are summed in) is the same every run
+  _pool.parallelFor(tableSize, c_cellGrain, [&](size_t _begin, size_t _end) {
+    for (size_t s = _begin; s < _end; ++s)
+    {
+      if (m_cellStart[s + 1] - m_cellStart[s] > 1)
+      {
+        std::sort(m_sorted.begin() + m_cellStart[s], m_sorted.begin() + m_cellStart[s + 1]);
+      }
+    }
+  });
+
+  _pool.parallelFor(_count, grain, [&](size_t _begin, size_t _end) {
+    for (size_t k = _begin; k < _end; ++k)
+    {
+      uint32_t i = m_sorted[k];
+      m_sortedX[k] = _x[i];
+      m_sortedY[k] = _y[i];
+      m_sortedZ[k] = _z[i];
+    }
+  });
+}
+
+size_t SpatialHash::memoryFootprint() const
+{
+  return (m_particleHash.size() + m_sorted.size() + m_cellStart.size() + m_cellFillSize) * sizeof(uint32_t) +
+         (m_sortedX.size() + m_sortedY.size() + m_sortedZ.size()) * sizeof(float);
+}
@@ -0,0 +1,105 @@
+#include "StreamingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+StreamingBuffer::~StreamingBuffer()
+{
+  release();
+}
+
+void StreamingBuffer::release()
+{
+  for(auto &f : m_fences)
+  {
+    if(f != nullptr)
+    {
+      glDeleteSync(f);
+      f=nullptr;
+    }
+  }
+  if(m_id != 0)
+  {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_id);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1,&m_id);
+    m_id=0;
+  }
+  m_mapped=nullptr;
+}
+
+void StreamingBuffer::allocate(size_t _slotSize)
+{
+  release();
+  // slots are bound with glBindBufferRange so each offset must satisfy the larger of the two alignments
+  GLint ssboAlign=1;
+  GLint uboAlign=1;
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,&ssboAlign);
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,&uboAlign);
+  size_t align=static_cast<size_t>(std::max({ssboAlign,uboAlign,16}));
+  m_slotSize=(std::max<size_t>(_slotSize,1)+align-1)/align*align;
+  m_current=0;
+  m_currentSize=0;
+
+  constexpr GLbitfield flags=GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1,&m_id);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_id);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(m_slotSize*c_numSlots), nullptr, flags);
+  m_mapped=static_cast<unsigned char *>(
+    glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(m_slotSize*c_numSlots), flags));
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void *StreamingBuffer::beginWrite()
+{
+  size_t next=(m_current+1)%c_numSlots;
+  GLsync &f=m_fences[next];
+  if(f != nullptr)
+  {
+    // only blocks if the GPU is still more than two uploads behind
+    while(glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+    {
+    }
+    glDeleteSync(f);
+    f=nullptr;
+  }
+  return m_mapped+next*m_slotSize;
+}
+
+void StreamingBuffer::endWrite(size_t _bytes)
+{
+  m_current=(m_current+1)%c_numSlots;
+  m_currentSize=_bytes;
+}
+
+void StreamingBuffer::write(const void *_data, size_t _bytes)
+{
+  if(m_id == 0 || _bytes > m_slotSize)
+  {
+    allocate(_bytes);
+  }
+  std::memcpy(beginWrite(), _data, _bytes);
+  endWrite(_bytes);
+}
+
+void StreamingBuffer::bindRange(GLenum _target, GLuint _index) const
+{
+  glBindBufferRange(_target, _index, m_id, static_cast<GLintptr>(currentOffset()),
+                    static_cast<GLsizeiptr>(std::max<size_t>(m_currentSize,1)));
+}
+
+void StreamingBuffer::fence()
+{
+  // a ring that was never allocated (the attractors with paths live in the simulator's own buffer) has nothing
+  // in flight to guard
+  if(m_id == 0)
+  {
+    return;
+  }
+  GLsync &f=m_fences[m_current];
+  if(f != nullptr)
+  {
+    glDeleteSync(f);
+  }
+  f=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
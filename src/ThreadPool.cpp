@@ -0,0 +1,161 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(size_t _numThreads, bool _pinThreads)
+{
+  const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  if (_numThreads == 0)
+  {
+    _numThreads = cores;
+  }
+  m_workers.reserve(_numThreads - 1);
+  for (size_t i = 1; i < _numThreads; ++i)
+  {
+    m_workers.emplace_back(&ThreadPool::workerLoop, this, i - 1);
+#ifdef __linux__
+    if (_pinThreads)
+    {
+      // a failure (e.g. a restricted cpuset) just leaves the thread to the scheduler
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(static_cast<int>(i % cores), &set);
+      pthread_setaffinity_np(m_workers.back().native_handle(), sizeof(set), &set);
+    }
+#else
+    (void)_pinThreads;
+#endif
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_all();
+  for (auto &t : m_workers)
+  {
+    t.join();
+  }
+}
+
+void ThreadPool::runChunks()
+{
+  for (;;)
+  {
+    size_t chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+    if (chunk >= m_numChunks)
+    {
+      return;
+    }
+    size_t begin = chunk * m_grain;
+    size_t end = std::min(begin + m_grain, m_count);
+    (*m_job)(begin, end);
+  }
+}
+
+void ThreadPool::workerLoop(size_t _index)
+{
+  uint64_t seen = 0;
+  for (;;)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wake.wait(lock, [&] { return m_quit || m_generation != seen; });
+    if (m_quit)
+    {
+      return;
+    }
+    seen = m_generation;
+    lock.unlock();
+    if (m_static)
+    {
+      size_t begin = std::min(_index * m_grain, m_count);
+      size_t end = std::min(begin + m_grain, m_count);
+      if (begin < end)
+      {
+        (*m_job)(begin, end);
+      }
+    }
+    else
+    {
+      runChunks();
+    }
+    lock.lock();
+    if (--m_active == 0)
+    {
+      m_done.notify_one();
+    }
+  }
+}
+
+void ThreadPool::parallelFor(size_t _count, size_t _grain, const RangeFunction &_fn)
+{
+  if (_count == 0)
+  {
+    return;
+  }
+  _grain = std::max<size_t>(_grain, 1);
+  size_t numChunks = (_count + _grain - 1) / _grain;
+  // not worth waking anyone for a single chunk
+  if (m_workers.empty() || numChunks == 1)
+  {
+    for (size_t begin = 0; begin < _count; begin += _grain)
+    {
+      _fn(begin, std::min(begin + _grain, _count));
+    }
+    return;
+  }
+  std::lock_guard<std::mutex> submit(m_submitMutex);
+  m_job = &_fn;
+  m_count = _count;
+  m_grain = _grain;
+  m_numChunks = numChunks;
+  m_static = false;
+  runJob(true);
+}
+
+void ThreadPool::parallelForStatic(size_t _count, size_t _align, const RangeFunction &_fn)
+{
+  if (_count == 0)
+  {
+    return;
+  }
+  if (m_workers.empty())
+  {
+    _fn(0, _count);
+    return;
+  }
+  _align = std::max<size_t>(_align, 1);
+  size_t slice = (_count + m_workers.size() - 1) / m_workers.size();
+  slice = (slice + _align - 1) / _align * _align;
+  std::lock_guard<std::mutex> submit(m_submitMutex);
+  m_job = &_fn;
+  m_count = _count;
+  m_grain = slice;
+  m_numChunks = m_workers.size();
+  m_static = true;
+  runJob(false);
+}
+
+void ThreadPool::runJob(bool _help)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_nextChunk.store(0, std::memory_order_relaxed);
+    m_active = m_workers.size();
+    ++m_generation;
+  }
+  m_wake.notify_all();
+  if (_help)
+  {
+    runChunks();
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [&] { return m_active == 0; });
+  m_job = nullptr;
+}
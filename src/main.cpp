@@ -2,13 +2,22 @@
 basic OpenGL demo modified from http://qt-project.org/doc/qt-5.0/qtgui/openglwindow.html
 ****************************************************************************/
 #include "NGLScene.h"
+#include "Profiler.h"
+#include "SimulationConfig.h"
 #include <QtGui/QGuiApplication>
+#include <cstdlib>
 #include <iostream>
 
 
 int main(int argc, char** argv)
 {
   QGuiApplication app(argc, argv);
+  // Qt has removed its own arguments by now so anything left is ours
+  SimulationConfig config;
+  if(!config.parse(argc,argv))
+  {
+    return EXIT_FAILURE;
+  }
   // create an OpenGL format specifier
   QSurfaceFormat format;
   // set the number of samples for multisampling
@@ -31,8 +40,11 @@ int main(int argc, char** argv)
   // set that as the default format for all windows
   QSurfaceFormat::setDefaultFormat(format);
 
+  // the scopes and GPU timers cost almost nothing so always run the profiler, the rolling summary goes to the
+  // console and title bar and --trace also writes every sample out
+  Profiler::start(config.traceFile,true);
   // now we are going to create our scene window
-  NGLScene window;
+  NGLScene window(config);
 
   // we can now query the version to see if it worked
   std::cout << "Profile is " << format.majorVersion() << " " << format.minorVersion() << "\n";
@@ -40,5 +52,7 @@ int main(int argc, char** argv)
   window.resize(1024*2, 720*2);
   // and finally show
   window.show();
-  return app.exec();
+  int result=app.exec();
+  Profiler::stop();
+  return result;
 }